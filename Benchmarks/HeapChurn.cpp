@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  Benchmark of the overhead of the heap hook (HeapHook) on allocation-heavy workloads.
+  The workload keeps a window of 4096 live blocks and replaces a random one in each step (log-uniform sizes from 16 bytes to 64 KiB):
+   - churn: the blocks are not touched, i.e. nothing but malloc() and free() (the worst case for the hook)
+   - touch: each block is written completely, like a program which uses what it allocates
+   - grow: blocks of 16 to 256 bytes are allocated from 65536 distinct call stacks and only freed at the end (a quarter of the steps),
+     i.e. the live heap peaks at every sample (the worst case for keeping the peak profile)
+  Each workload runs in a child process without the hook, with the hook counting (like --heap), and with the hook sampling at several rates
+  (like --heap-profile). Reported is the time per step (best of 3 runs) and the overhead relative to the run without the hook.
+
+  Usage: HeapChurn [--steps N (default: 5000000)] [--hook PATH (default: the one built along)]
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "HeapChurn is only available on Linux.\n";
+  return 1;
+}
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "Heap.h"
+
+using namespace WinTime;
+
+namespace
+{
+  void* allocateRight(const uint64_t path, const int levels, const size_t size);
+
+  /// malloc() from one of 2^@p levels call stacks, chosen by the bits of @p path
+  __attribute__((noinline)) void* allocateLeft(const uint64_t path, const int levels, const size_t size)
+  {
+    void* ptr = levels == 0 ? malloc(size) : ((path & 1) ? allocateRight : allocateLeft)(path >> 1, levels - 1, size);
+    asm volatile("" ::: "memory"); // no tail call, which would merge the stacks
+    return ptr;
+  }
+
+  /// like allocateLeft(), but not the same code, which identical code folding would merge
+  __attribute__((noinline)) void* allocateRight(const uint64_t path, const int levels, const size_t size)
+  {
+    void* ptr = levels == 0 ? malloc(size) : ((path & 2) ? allocateLeft : allocateRight)(path >> 2, levels - 1, size);
+    asm volatile("" ::: "memory");
+    return ptr;
+  }
+
+  /// run the 'grow' workload (in the child); returns nanoseconds per step
+  double runGrowth(const size_t steps)
+  {
+    std::vector<void*> blocks(steps / 4);
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    const auto t_start = std::chrono::steady_clock::now();
+    for (auto& block : blocks)
+    {
+      random ^= random << 13;
+      random ^= random >> 7;
+      random ^= random << 17;
+      block = allocateLeft(random, 16, 16 + (random >> 56));
+      static_cast<char*>(block)[0] = char(random);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    for (void* ptr : blocks) free(ptr);
+    return seconds * 1e9 / double(blocks.size());
+  }
+
+  /// run a workload (in the child); returns nanoseconds per step
+  double runWorkload(const bool touch, const size_t steps)
+  {
+    std::vector<void*> window(4096, nullptr);
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    const auto next = [&random] {
+      random ^= random << 13;
+      random ^= random >> 7;
+      random ^= random << 17;
+      return random;
+    };
+    const auto t_start = std::chrono::steady_clock::now();
+    for (size_t step = 0; step < steps; ++step)
+    {
+      const uint64_t bits = next();
+      void*& slot = window[bits % window.size()];
+      free(slot);
+      const size_t size = size_t(16) << ((bits >> 12) % 13) | ((bits >> 16) & 15);   // 16 bytes ... 64 KiB
+      slot = malloc(size);
+      if (touch) std::memset(slot, int(step), size);
+      else static_cast<char*>(slot)[0] = char(step);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    for (void* ptr : window) free(ptr);
+    return seconds * 1e9 / double(steps);
+  }
+
+  /// run the workload in a child with @p environment (e.g. 'LD_PRELOAD=... '); returns the best time per step of 3 runs
+  double measure(const std::string& self, const std::string& environment, const char* workload, const size_t steps)
+  {
+    double best = 1e300;
+    for (int run = 0; run < 3; ++run)
+    {
+      const std::string command = "env " + environment + " '" + self + "' --child " + workload + ' ' + std::to_string(steps) + " 2>/dev/null";
+      FILE* child = popen(command.c_str(), "r");
+      double ns = 0;
+      if (child == nullptr || fscanf(child, "%lf", &ns) != 1 || pclose(child) != 0)
+      {
+        fprintf(stderr, "Running '%s' failed.\n", command.c_str());
+        exit(1);
+      }
+      best = std::min(best, ns);
+    }
+    return best;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc == 4 && std::string(argv[1]) == "--child")
+  {
+    const std::string workload = argv[2];
+    const size_t child_steps = std::stoull(argv[3]);
+    printf("%f\n", workload == "grow" ? runGrowth(child_steps) : runWorkload(workload == "touch", child_steps));
+    return 0;
+  }
+  size_t steps = 5000000;
+  std::string hook = HEAP_HOOK_PATH;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--steps") steps = std::stoull(argv[i + 1]);
+    else if (arg == "--hook") hook = argv[i + 1];
+    else
+    {
+      fprintf(stderr, "Usage: HeapChurn [--steps N] [--hook PATH]\n");
+      return 1;
+    }
+  }
+  char self[4096];
+  const ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length <= 0) return 1;
+  self[length] = '\0';
+  char profiles[] = "/tmp/heapchurn-XXXXXX";
+  if (mkdtemp(profiles) == nullptr) return 1;
+
+  struct Variant
+  {
+    std::string name;
+    std::string environment;
+  };
+  std::vector<Variant> variants{ { "no hook", "" }, { "--heap", "LD_PRELOAD='" + hook + "'" } };
+  for (const uint64_t rate : { HEAP_SAMPLE_RATE_DEFAULT, uint64_t(64 << 10), uint64_t(4 << 10) })
+  {
+    variants.push_back({ "--heap-profile, rate " + std::to_string(rate >> 10) + " KiB",
+                         "LD_PRELOAD='" + hook + "' " + s_env_heapprofile + "='" + profiles + "/churn' " + s_env_heapsamplerate + '=' + std::to_string(rate) });
+  }
+
+  const char* workloads[] = { "churn", "touch", "grow" };
+  printf("%-30s %14s %9s %14s %9s %14s %9s\n", "", "churn ns/step", "overhead", "touch ns/step", "overhead", "grow ns/step", "overhead");
+  double baseline[3] = { 0, 0, 0 };
+  for (const auto& variant : variants)
+  {
+    printf("%-30s", variant.name.c_str());
+    for (int w = 0; w < 3; ++w)
+    {
+      const double ns = measure(self, variant.environment, workloads[w], steps);
+      if (baseline[w] == 0) baseline[w] = ns;
+      printf(" %14.1f %8.1f%%", ns, (ns / baseline[w] - 1) * 100);
+    }
+    printf("\n");
+  }
+  const std::string cleanup = std::string("rm -rf '") + profiles + "'";
+  return system(cleanup.c_str()) == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+  Stress benchmark for concurrent log appends: N writer processes append M rows each to the same log via FileLog,
+  all starting at the same time. Afterwards, the log is checked for corruption (exactly one header, every row
+  present exactly once and intact), and the percentiles of the append latency are reported.
+
+  Usage: LogStress [writers (default: 64)] [rows per writer (default: 200)] [--poll]
+    --poll  emulate the former locking (tryLock() and sleeping 50ms until it succeeds) for comparison
+  Returns 0 if the log is intact.
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "LogStress forks its writers and is not available on Windows yet.\n";
+  return 1;
+}
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "FileLog.h"
+
+using namespace WinTime;
+
+namespace
+{
+  const std::string HEADER = "writer\tseq\tpayload\n";
+
+  /// a row which can be verified: the payload depends on writer and sequence number
+  std::string makeRow(size_t writer, size_t seq)
+  {
+    const char c = char('a' + (writer * 7 + seq) % 26);
+    return std::to_string(writer) + '\t' + std::to_string(seq) + '\t' + std::string(100 + (writer + seq) % 100, c) + '\n';
+  }
+
+  void appendPolling(const std::string& filename, const std::string& row)
+  {
+    LockedFile lockf(filename, OpenMode::APPEND);
+    while (!lockf.tryLock())
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (lockf.isFileEmpty()) lockf.write(HEADER.c_str());
+    lockf.write(row.c_str());
+  }
+
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    return sorted[size_t(p * (sorted.size() - 1))];
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t writers = 64, rows = 200;
+  bool poll = false;
+  std::vector<std::string> numbers;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::string(argv[i]) == "--poll") poll = true;
+    else numbers.push_back(argv[i]);
+  }
+  if (numbers.size() > 0) writers = std::stoul(numbers[0]);
+  if (numbers.size() > 1) rows = std::stoul(numbers[1]);
+
+  const std::string filename = (std::filesystem::temp_directory_path() / ("LogStress." + std::to_string(getpid()) + ".tsv")).string();
+  std::filesystem::remove(filename);
+
+  // latencies (seconds) of all appends, written by the children
+  const size_t total = writers * rows;
+  auto* latencies = static_cast<double*>(mmap(nullptr, total * sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (latencies == MAP_FAILED)
+  {
+    std::perror("mmap");
+    return 1;
+  }
+
+  // all writers start when the pipe is closed
+  int start_pipe[2];
+  if (pipe(start_pipe) != 0)
+  {
+    std::perror("pipe");
+    return 1;
+  }
+  std::cout << writers << " writers append " << rows << " rows each to " << filename << (poll ? " (polling)" : "") << '\n';
+  std::vector<pid_t> children;
+  for (size_t w = 0; w < writers; ++w)
+  {
+    const pid_t pid = fork();
+    if (pid == -1)
+    {
+      std::perror("fork");
+      return 1;
+    }
+    if (pid == 0)
+    {
+      close(start_pipe[1]);
+      char c;
+      [[maybe_unused]] auto ignored = read(start_pipe[0], &c, 1);
+      for (size_t seq = 0; seq < rows; ++seq)
+      {
+        const std::string row = makeRow(w, seq);
+        const auto t0 = std::chrono::steady_clock::now();
+        if (poll) appendPolling(filename, row);
+        else FileLog(filename, OpenMode::APPEND).append(HEADER, row);
+        latencies[w * rows + seq] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      }
+      _exit(0);
+    }
+    children.push_back(pid);
+  }
+  const auto t_start = std::chrono::steady_clock::now();
+  close(start_pipe[0]);
+  close(start_pipe[1]);
+  int failed_writers = 0;
+  for (pid_t pid : children)
+  {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failed_writers;
+  }
+  const double t_total = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+  // verify the log
+  size_t errors = 0;
+  std::ifstream in(filename);
+  std::string line;
+  std::getline(in, line);
+  if (line + '\n' != HEADER)
+  {
+    std::cerr << "Header is missing or corrupt: '" << line << "'\n";
+    ++errors;
+  }
+  std::set<std::pair<size_t, size_t>> seen;
+  size_t line_number = 1;
+  while (std::getline(in, line))
+  {
+    ++line_number;
+    std::istringstream cells(line);
+    size_t w, seq;
+    if (!(cells >> w >> seq) || w >= writers || seq >= rows || makeRow(w, seq) != line + '\n' || !seen.emplace(w, seq).second)
+    {
+      if (errors < 10) std::cerr << "Line " << line_number << " is corrupt or duplicated: '" << line.substr(0, 60) << "'\n";
+      ++errors;
+    }
+  }
+  if (seen.size() != total)
+  {
+    std::cerr << "Found " << seen.size() << " of " << total << " rows.\n";
+    ++errors;
+  }
+  std::filesystem::remove(filename);
+
+  std::vector<double> sorted(latencies, latencies + total);
+  std::sort(sorted.begin(), sorted.end());
+  std::printf("%zu appends in %.3f s (%.0f appends/s)\n", total, t_total, total / t_total);
+  std::printf("Append latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+    percentile(sorted, 0.5) * 1e3, percentile(sorted, 0.9) * 1e3, percentile(sorted, 0.99) * 1e3, percentile(sorted, 0.999) * 1e3, sorted.back() * 1e3);
+  const bool ok = errors == 0 && failed_writers == 0;
+  std::cout << (ok ? "OK: log is intact\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
+
+#endif
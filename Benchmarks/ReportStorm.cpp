@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  Local test harness for the ReportServer: a tree of short-lived processes (each one started with posix_spawn() by its parent)
+  which all report to the same server at once, like an injected library would in every process of a build.
+  Each process connects, sends its messages, starts its children, waits for them and exits. The tree is traced (see ProcessTree),
+  and the harness checks that every process was heard completely and in order, with the right parent, and matches a node of the tree.
+
+  Usage: ReportStorm [--processes N (default: 500)] [--fanout F (default: 8)] [--messages M per process (default: 20)]
+  Returns 0 if all checks passed.
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "ReportStorm is only available on Linux.\n";
+  return 1;
+}
+#else
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Process.h"
+#include "ProcessTree.h"
+#include "ReportServer.h"
+
+extern char** environ;
+
+using namespace WinTime;
+
+namespace
+{
+  std::string getSelfPath()
+  {
+    char path[PATH_MAX];
+    const ssize_t size = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    return size > 0 ? std::string(path, size_t(size)) : std::string();
+  }
+
+  std::vector<std::string> nodeArgs(const std::string& self, size_t node, size_t processes, size_t fanout, size_t messages)
+  {
+    return { self, "--node", std::to_string(node), std::to_string(processes), std::to_string(fanout), std::to_string(messages) };
+  }
+
+  std::string messageText(size_t node, size_t message)
+  {
+    return "node " + std::to_string(node) + " message " + std::to_string(message);
+  }
+
+  /// one process of the tree: report, start the children (node * fanout + 1, ...), wait for them
+  int runNode(const size_t node, const size_t processes, const size_t fanout, const size_t messages)
+  {
+    ReportClient client;
+    if (!client.isValid()) return 2;
+    for (size_t i = 0; i < messages; ++i)
+    {
+      const auto text = messageText(node, i);
+      if (!client.send(ReportType::TEXT, text.data(), text.size())) return 3;
+    }
+    const std::string self = getSelfPath();
+    std::vector<pid_t> children;
+    for (size_t child = node * fanout + 1; child <= node * fanout + fanout && child < processes; ++child)
+    {
+      const auto args = nodeArgs(self, child, processes, fanout, messages);
+      std::vector<char*> argv;
+      for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+      argv.push_back(nullptr);
+      pid_t pid;
+      if (posix_spawn(&pid, self.c_str(), nullptr, nullptr, argv.data(), environ) != 0) return 4;
+      children.push_back(pid);
+    }
+    int result = 0;
+    for (const pid_t pid : children)
+    {
+      int status;
+      if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) result = 5;
+    }
+    return result;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t processes = 500;
+  size_t fanout = 8;
+  size_t messages = 20;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--node" && i + 4 < argc)
+    {
+      return runNode(std::stoul(argv[i + 1]), std::stoul(argv[i + 2]), std::stoul(argv[i + 3]), std::stoul(argv[i + 4]));
+    }
+    if (arg == "--processes" && i + 1 < argc) processes = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--fanout" && i + 1 < argc) fanout = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--messages" && i + 1 < argc) messages = std::stoul(argv[++i]);
+    else
+    {
+      std::fprintf(stderr, "Usage: ReportStorm [--processes N] [--fanout F] [--messages M]\n");
+      return 1;
+    }
+  }
+
+  ReportServer server;
+  ProcessTree tree;
+  SpawnOptions options;
+  options.observers.push_back(&tree);
+  const std::string self = getSelfPath();
+  const auto t_start = std::chrono::steady_clock::now();
+  Process root(self, nodeArgs(self, 0, processes, fanout, messages), options);
+  if (!root.wasCreated())
+  {
+    std::fprintf(stderr, "Could not start the root process.\n");
+    return 1;
+  }
+  root.waitForFinish();
+  const auto t_exit = std::chrono::steady_clock::now();
+  const auto reports = server.finish();
+  const auto t_finish = std::chrono::steady_clock::now();
+  const auto& stats = server.getStats();
+  const auto nodes = tree.getNodes();
+
+  // every process must have sent all its messages in order, with its parent being the node it was started by
+  std::vector<const ProcessReport*> by_node(processes, nullptr);
+  size_t errors = 0;
+  for (const auto& report : reports)
+  {
+    size_t node = SIZE_MAX;
+    if (std::sscanf(report.cmdline.c_str(), "%*s --node %zu", &node) != 1 || node >= processes || by_node[node])
+    {
+      ++errors;
+      continue;
+    }
+    by_node[node] = &report;
+    bool complete = report.messages.size() == messages;
+    for (size_t i = 0; complete && i < messages; ++i) complete = report.messages[i].payload == messageText(node, i);
+    if (!complete) ++errors;
+  }
+  size_t missing = 0;
+  for (size_t node = 0; node < processes; ++node)
+  {
+    if (!by_node[node]) ++missing;
+    else if (node > 0 && by_node[(node - 1) / fanout] && by_node[node]->ppid != by_node[(node - 1) / fanout]->pid) ++errors;
+  }
+  size_t unmatched = 0;
+  for (const size_t index : matchTreeNodes(reports, nodes)) unmatched += index == SIZE_MAX;
+
+  const auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+  std::printf("%zu processes (fanout %zu) with %zu messages each: %.1f ms until the root exited, %.2f ms to finish the server\n",
+              processes, fanout, messages, ms(t_exit - t_start), ms(t_finish - t_exit));
+  std::printf("connections: %zu (at most %zu at once), messages: %zu, bytes: %llu, rejected: %zu\n",
+              stats.connections, stats.max_concurrent, stats.messages, (unsigned long long)stats.bytes, stats.rejected);
+  std::printf("processes heard: %zu of %zu, missing: %zu, incomplete or misattributed: %zu, not in the traced tree (%zu nodes): %zu\n",
+              reports.size(), processes, missing, errors, nodes.size(), unmatched);
+  const bool ok = missing == 0 && errors == 0 && unmatched == 0 && root.getExitCode() == 0;
+  std::printf("%s\n", ok ? "All checks passed." : "FAILED");
+  return ok ? 0 : 1;
+}
+
+#endif
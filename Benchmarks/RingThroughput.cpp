@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  Benchmark and consistency check of the shared memory rings (RingBuffer.h) for events reported from within a target.
+  A forked 'target' pushes records from several threads while this process drains the rings (every 100us when idle), like WinTime would:
+   - push:  nanoseconds per RingBufferClient::push() in the target
+   - pipe:  nanoseconds per record when each record is written to a pipe instead (one write() per record), for comparison
+   - drain: records received and dropped (because a ring was full); each ring must deliver its records in order
+  Finally, each thread's records are checked to arrive in order and complete up to the drops.
+
+  Usage: RingThroughput [--records N per thread (default: 10000000)] [--threads T (default: 1..4)] [--capacity C (default: 16384)]
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "RingThroughput is only available on Linux.\n";
+  return 1;
+}
+#else
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "RingBuffer.h"
+#include "RingBufferServer.h"
+
+using namespace WinTime;
+
+namespace
+{
+  double secondsSince(const std::chrono::steady_clock::time_point t_start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+  }
+
+  /// the target: push @p records records from each of @p threads threads, then report ns per push to @p report_fd
+  void runTarget(const size_t threads, const size_t records, const int report_fd)
+  {
+    RingBufferClient client;
+    if (!client.isValid()) _exit(2);
+    const auto t_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&client, t, records]() {
+        for (uint64_t i = 0; i < records; ++i) client.push(1, uint32_t(t), i, 0);
+      });
+    }
+    for (auto& w : workers) w.join();
+    const double ns_per_push = secondsSince(t_start) * 1e9 / double(threads * records);
+    if (write(report_fd, &ns_per_push, sizeof(ns_per_push)) != sizeof(ns_per_push)) _exit(3);
+    _exit(0);
+  }
+
+  /// the same records, written to a pipe one by one (and read by this process)
+  double measurePipe(const size_t records)
+  {
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+    const auto t_start = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(fds[0]);
+      for (uint64_t i = 0; i < records; ++i)
+      {
+        const RingRecord r{ RingBufferClient::now(), 1, 0, { i, 0 } };
+        if (write(fds[1], &r, sizeof(r)) != sizeof(r)) _exit(1);
+      }
+      _exit(0);
+    }
+    close(fds[1]);
+    RingRecord buffer[256];
+    while (read(fds[0], buffer, sizeof(buffer)) > 0) {}
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return secondsSince(t_start) * 1e9 / double(records);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  size_t records = 10000000;
+  std::vector<size_t> thread_counts{ 1, 2, 4 };
+  size_t capacity = size_t(1) << 14;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--records" && i + 1 < argc) records = std::max(1ul, std::stoul(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc) thread_counts = { std::max(1ul, std::stoul(argv[++i])) };
+    else if (arg == "--capacity" && i + 1 < argc) capacity = std::max(1ul, std::stoul(argv[++i]));
+    else
+    {
+      std::fprintf(stderr, "Usage: RingThroughput [--records N] [--threads T] [--capacity C]\n");
+      return 1;
+    }
+  }
+
+  std::printf("%zu records per thread, %zu records per ring; %.1f ns per record through a pipe\n", records, capacity, measurePipe(records));
+  std::printf("%7s | %10s | %12s %12s %14s | %s\n", "threads", "ns/push", "received", "dropped", "drain [rec/s]", "check");
+  bool all_ok = true;
+  for (const size_t threads : thread_counts)
+  {
+    RingBufferServer server(threads, capacity);
+    int report[2];
+    if (pipe(report) != 0) return 1;
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(report[0]);
+      runTarget(threads, records, report[1]);
+    }
+    close(report[1]);
+
+    // next expected sequence number per thread; a gap means dropped records, going backwards is an error
+    std::map<uint32_t, uint64_t> next;
+    size_t received = 0, out_of_order = 0;
+    const auto check = [&](const RingOwner&, const RingRecord& r) {
+      auto& expected = next[r.aux];
+      if (r.value[0] < expected) ++out_of_order;
+      expected = r.value[0] + 1;
+    };
+    const auto t_start = std::chrono::steady_clock::now();
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+      const size_t n = server.drain(check);
+      received += n;
+      if (n == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    received += server.drain(check);
+    const double t_drain = secondsSince(t_start);
+
+    double ns_per_push = 0;
+    const bool target_ok = WIFEXITED(status) && WEXITSTATUS(status) == 0 && read(report[0], &ns_per_push, sizeof(ns_per_push)) == sizeof(ns_per_push);
+    close(report[0]);
+    const uint64_t dropped = server.getDropped();
+    const bool ok = target_ok && out_of_order == 0 && received + dropped == threads * records && server.getClaimedRings() + server.getRecycledRings() == threads;
+    all_ok &= ok;
+    std::printf("%7zu | %10.1f | %12zu %12llu %14.0f | %s\n", threads, ns_per_push, received, (unsigned long long)dropped,
+                double(received) / t_drain, ok ? "ok" : "FAILED");
+    std::fflush(stdout);
+  }
+  return all_ok ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  Benchmark of the latency which WinTime adds to starting a short command, compared with running it directly
+  (posix_spawn() + waitpid()), for several sizes of the environment and of the argument list:
+   - fork:  Process with fork() (the default), i.e. the measurement itself
+   - spawn: Process with posix_spawn() (--fast-spawn)
+   - WinTime64: the whole wrapper, with and without --fast-spawn, if its path is given (its report goes to /dev/null)
+  Each value is the wall time from starting to reaping the command, median and p95 over all runs.
+  Finally, the peak RSS which each spawn method reports for COMMAND shows what --fast-spawn costs in accuracy.
+
+  Usage: SpawnOverhead [--wintime PATH/TO/WinTime64] [--runs N (default: 100)] [COMMAND (default: true)]
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "SpawnOverhead is only available on Linux.\n";
+  return 1;
+}
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <spawn.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Process.h"
+
+using namespace WinTime;
+
+namespace
+{
+  struct Latency
+  {
+    double median;  ///< microseconds
+    double p95;     ///< microseconds
+  };
+
+  /// run @p once @p runs times (after one warmup run) and return the latency of a run
+  Latency measure(const size_t runs, const std::function<bool()>& once)
+  {
+    once();
+    std::vector<double> times;
+    for (size_t i = 0; i < runs; ++i)
+    {
+      const auto t_start = std::chrono::steady_clock::now();
+      if (!once())
+      {
+        throw std::runtime_error("A run failed.");
+      }
+      times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t_start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return Latency{ times[times.size() / 2], times[size_t(0.95 * (times.size() - 1))] };
+  }
+
+  /// posix_spawn() @p exe with @p argv and @p env, optionally with STDERR to /dev/null, and reap it
+  bool spawnDirectly(const std::string& exe, const std::vector<std::string>& argv, const std::vector<std::string>& env, const bool quiet)
+  {
+    std::vector<char*> c_argv, c_env;
+    for (const auto& arg : argv) c_argv.push_back(const_cast<char*>(arg.c_str()));
+    c_argv.push_back(nullptr);
+    for (const auto& entry : env) c_env.push_back(const_cast<char*>(entry.c_str()));
+    c_env.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (quiet) posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    pid_t pid;
+    const int err = posix_spawn(&pid, exe.c_str(), &actions, nullptr, c_argv.data(), c_env.data());
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) return false;
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+    {
+      if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  /// start @p exe with Process and wait for it; returns its peak RSS in bytes (0 if it failed)
+  uint64_t spawnProcess(const std::string& exe, const std::vector<std::string>& argv, const std::vector<std::string>& env, const bool fast_spawn)
+  {
+    SpawnOptions options;
+    options.env = env;
+    options.inherit_env = false;
+    options.fast_spawn = fast_spawn;
+    Process process(exe, argv, options);
+    if (!process.wasCreated()) return 0;
+    process.waitForFinish();
+    if (process.getExitCode() != 0) return 0;
+    return uint64_t(process.getHandle()->usage.ru_maxrss) * 1024;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::string wintime;
+  size_t runs = 100;
+  std::string command = "true";
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--wintime" && i + 1 < argc) wintime = argv[++i];
+    else if (arg == "--runs" && i + 1 < argc) runs = std::max(1ul, std::stoul(argv[++i]));
+    else command = arg;
+  }
+  const std::string exe = Process::searchPATH(command);
+
+  std::printf("Latency of '%s' in microseconds (median / p95 of %zu runs)\n", exe.c_str(), runs);
+  std::printf("%8s %8s | %15s | %15s %9s | %15s %9s", "env vars", "args", "direct", "fork", "+median", "spawn", "+median");
+  if (!wintime.empty()) std::printf(" | %15s %9s | %15s %9s", "WinTime64", "+median", "--fast-spawn", "+median");
+  std::printf("\n");
+
+  for (const size_t env_count : { 10, 100, 1000 })
+  {
+    std::vector<std::string> env{ "PATH=/usr/bin:/bin" };
+    for (size_t i = 1; i < env_count; ++i) env.push_back("WINTIME_BENCH_" + std::to_string(i) + "=" + std::string(64, 'x'));
+    for (const size_t arg_count : { 0, 100, 1000 })
+    {
+      std::vector<std::string> args{ command };
+      for (size_t i = 0; i < arg_count; ++i) args.push_back("--argument-" + std::to_string(i) + "=" + std::string(24, 'y'));
+
+      const auto direct = measure(runs, [&]() { return spawnDirectly(exe, args, env, false); });
+      const auto fork = measure(runs, [&]() { return spawnProcess(exe, args, env, false) != 0; });
+      const auto spawn = measure(runs, [&]() { return spawnProcess(exe, args, env, true) != 0; });
+      std::printf("%8zu %8zu | %7.0f %7.0f | %7.0f %7.0f %+9.0f | %7.0f %7.0f %+9.0f", env_count, arg_count,
+                  direct.median, direct.p95, fork.median, fork.p95, fork.median - direct.median, spawn.median, spawn.p95, spawn.median - direct.median);
+      if (!wintime.empty())
+      {
+        for (const bool fast_spawn : { false, true })
+        {
+          std::vector<std::string> wrapped{ wintime, "--" };
+          if (fast_spawn) wrapped.insert(wrapped.begin() + 1, "--fast-spawn");
+          wrapped.push_back(exe);
+          wrapped.insert(wrapped.end(), args.begin() + 1, args.end());
+          const auto wrapper = measure(runs, [&]() { return spawnDirectly(wintime, wrapped, env, true); });
+          std::printf(" | %7.0f %7.0f %+9.0f", wrapper.median, wrapper.p95, wrapper.median - direct.median);
+        }
+      }
+      std::printf("\n");
+      std::fflush(stdout);
+    }
+  }
+
+  const std::vector<std::string> env{ "PATH=/usr/bin:/bin" };
+  std::printf("Peak RSS of '%s': %llu KiB with fork, %llu KiB with posix_spawn (which includes the memory of this benchmark)\n", exe.c_str(),
+              (unsigned long long)(spawnProcess(exe, { command }, env, false) / 1024), (unsigned long long)(spawnProcess(exe, { command }, env, true) / 1024));
+  return 0;
+}
+
+#endif
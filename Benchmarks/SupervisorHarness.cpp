@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+  Local test harness for the Supervisor: starts many short-lived children at once and checks that all of them
+  are collected from a single thread, with a wall time which is not inflated by the supervision.
+
+  Usage: SupervisorHarness [children (default: 2000)] [seconds each child sleeps (default: 0.5)]
+  Returns 0 if all checks passed.
+*/
+
+#ifdef _WIN32
+#include <iostream>
+
+int main()
+{
+  std::cerr << "The Supervisor is not available on Windows yet.\n";
+  return 1;
+}
+#else
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Process.h"
+#include "Supervisor.h"
+#include "Time.h"
+
+using namespace WinTime;
+
+namespace
+{
+  /// number of threads of this process
+  int countThreads()
+  {
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key)
+    {
+      if (key == "Threads:")
+      {
+        int threads;
+        status >> threads;
+        return threads;
+      }
+    }
+    return -1;
+  }
+
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    return sorted[size_t(p * (sorted.size() - 1))];
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const size_t children = argc > 1 ? std::stoul(argv[1]) : 2000;
+  const std::string sleep_time = argc > 2 ? argv[2] : "0.5";
+  const double sleep_seconds = std::stod(sleep_time);
+  const std::string sleep_exe = Process::searchPATH("sleep");
+
+  std::cout << "Supervising " << children << " children of 'sleep " << sleep_time << "'\n";
+  const auto t_start = std::chrono::steady_clock::now();
+  auto elapsed = [&t_start]() { return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count(); };
+
+  Supervisor supervisor;
+  std::vector<int> collected(children, 0);
+  size_t failures = 0;
+  auto collect = [&](const std::vector<size_t>& indices) {
+    for (size_t index : indices) ++collected[index];
+  };
+
+  for (size_t i = 0; i < children; ++i)
+  {
+    if (!supervisor.spawn(sleep_exe, { "sleep", sleep_time }))
+    {
+      std::perror("spawn");
+      return 1;
+    }
+    collect(supervisor.waitAny(std::chrono::milliseconds(0))); // children which already finished must not wait for the others to be spawned
+  }
+  const double t_spawned = elapsed();
+  const int threads = countThreads();
+
+  while (supervisor.running() > 0)
+  {
+    collect(supervisor.waitAny());
+  }
+  const double t_done = elapsed();
+
+  std::vector<double> overheads;
+  for (size_t i = 0; i < children; ++i)
+  {
+    const Process& process = supervisor.getProcess(i);
+    if (collected[i] != 1)
+    {
+      std::cerr << "Child " << i << " was collected " << collected[i] << " times.\n";
+      ++failures;
+      continue;
+    }
+    if (process.getExitCode() != 0)
+    {
+      std::cerr << "Child " << i << " has exit code " << process.getExitCode().value_or(-1) << ".\n";
+      ++failures;
+    }
+    overheads.push_back(getProcessTime(process.getHandle()).t_wall - sleep_seconds);
+  }
+  std::sort(overheads.begin(), overheads.end());
+
+  std::printf("Spawned all after %.3f s; all collected after %.3f s\n", t_spawned, t_done);
+  std::printf("Threads while supervising: %d\n", threads);
+  if (!overheads.empty())
+  {
+    std::printf("Measured wall time minus sleep time: min %.2f ms, median %.2f ms, p99 %.2f ms, max %.2f ms\n",
+      overheads.front() * 1e3, percentile(overheads, 0.5) * 1e3, percentile(overheads, 0.99) * 1e3, overheads.back() * 1e3);
+    if (overheads.front() < 0)
+    {
+      std::cerr << "A child was measured shorter than it slept.\n";
+      ++failures;
+    }
+  }
+  if (threads != 1)
+  {
+    std::cerr << "Expected a single thread.\n";
+    ++failures;
+  }
+  std::cout << (failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -5,6 +5,10 @@
 #include <iomanip>
 #include <sstream>
 
+#include <cstdlib>
+#include <string>
+
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 #define _CRT_SECURE_NO_WARNINGS 1
 #include <windows.h>
@@ -14,6 +18,10 @@
 #define PSAPI_VERSION 1
 #include <psapi.h>        // for PROCESS_MEMORY_COUNTERS
 #pragma comment (lib, "Psapi.lib")
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
 
 
 /// convert bytes to a human readable unit (TiB, GiB, MiB, KiB)
@@ -37,6 +45,7 @@ inline std::string toHumanReadable(uint64_t bytes)
   return std::string("Congrats. That's a lot of bytes: ") + std::to_string(bytes);
 }
 
+#ifdef _WIN32
 void getMemoryInfo(DWORD processID)
 {
   HANDLE hProcess;
@@ -65,6 +74,22 @@ void getMemoryInfo(DWORD processID)
 
   CloseHandle(hProcess);
 }
+#else
+void getMemoryInfo(pid_t processID)
+{
+  // the memory related lines of /proc/<pid>/status, e.g. 'VmHWM:  10240 kB' (peak resident set size)
+  std::ifstream status("/proc/" + std::to_string(processID) + "/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.rfind("Vm", 0) == 0 || line.rfind("Rss", 0) == 0)
+    {
+      std::cerr << line << '\n';
+    }
+  }
+  std::cerr.flush();
+}
+#endif
 
 int main(int argc, char** argv)
 {
@@ -88,7 +113,7 @@ int main(int argc, char** argv)
     std::cerr << "  -- Allocating " << mb << " Mb\n";
     size_t bytes_to_allocate = mb * 1024 * 1024;
     std::string large_data(bytes_to_allocate, 0);
-    volatile char* vd = large_data.data();
+    [[maybe_unused]] volatile char* vd = large_data.data();
   }
   if (argc >= 3)
   {
@@ -100,7 +125,11 @@ int main(int argc, char** argv)
   }
   if (argc >= 4) 
   {
+#ifdef _WIN32
     getMemoryInfo(GetCurrentProcessId());
+#else
+    getMemoryInfo(getpid());
+#endif
   }
   std::cerr << "-- end of ExampleTarget\n\n";
 }
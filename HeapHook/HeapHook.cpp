@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  The heap hook: a library which WinTime preloads into the target (LD_PRELOAD, see --heap) to count its allocations.
+
+  malloc() and friends are interposed and forwarded to glibc's __libc_malloc() etc., so no dlsym() bootstrapping is needed.
+  The hot path neither locks nor allocates: each thread counts into a slot of its own (claimed on its first allocation, found via
+  an initial-exec TLS pointer); only the live heap is published to a shared atomic, in steps of 16 KiB per thread, to track its peak.
+  When the process exits, the slots are summed up and sent to WinTime (ReportServer) as HeapCounters, or printed to STDERR
+  if the hook was preloaded without WinTime.
+  With --heap-profile, allocations are also sampled with their call stacks (see HeapProfile.h).
+  With --locks, the waits for contended pthread locks are timed (see LockProfile.h).
+  With --io, file I/O is timed and attributed to paths (see IoProfile.h).
+*/
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <pthread.h>
+
+#include "Heap.h"
+#include "HeapProfile.h"
+#include "Interpose.h"
+#include "IoProfile.h"
+#include "LockProfile.h"
+#include "ReportProtocol.h"
+#include "RingBuffer.h"
+
+extern "C"
+{
+  void* __libc_malloc(size_t size);
+  void __libc_free(void* ptr);
+  void* __libc_calloc(size_t count, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+  void* __libc_memalign(size_t alignment, size_t size);
+  void* __libc_valloc(size_t size);
+  void* __libc_pvalloc(size_t size);
+}
+
+namespace
+{
+  using namespace WinTime;
+
+  /// the counters of one thread; only written by that thread (relaxed atomics, i.e. plain loads and stores, so the final sum may read them)
+  struct alignas(64) Slot
+  {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> reallocations;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> bytes_allocated;
+    std::atomic<int64_t> live;        ///< net bytes allocated by this thread (negative if it frees blocks of other threads)
+    std::atomic<uint64_t> size_classes[HEAP_SIZE_CLASSES];
+  };
+
+  /// threads beyond this share an overflow slot (with atomic read-modify-writes)
+  constexpr size_t MAX_SLOTS = 1024;
+
+  /// the live heap is published to g_live when a thread's unpublished change reaches this
+  constexpr int64_t PUBLISH_BYTES = 16 << 10;
+
+  Slot g_slots[MAX_SLOTS];
+  Slot g_overflow;
+  std::atomic<size_t> g_claimed{ 0 };
+  std::atomic<int64_t> g_live{ 0 };    ///< published live heap of all threads
+  std::atomic<int64_t> g_peak{ 0 };
+
+  /// streams the live heap to WinTime (if it samples the target); created in onLoad() and never destroyed, since other threads may allocate during exit
+  RingBufferClient* g_ring = nullptr;
+  alignas(RingBufferClient) unsigned char g_ring_storage[sizeof(RingBufferClient)];
+
+  __thread Slot* t_slot __attribute__((tls_model("initial-exec"))) = nullptr;
+  __thread int64_t t_unpublished __attribute__((tls_model("initial-exec"))) = 0;
+
+  /// add @p value to a counter of the calling thread's slot
+  template<typename T>
+  inline void bump(std::atomic<T>& counter, T value)
+  {
+    if (t_slot == &g_overflow) counter.fetch_add(value, std::memory_order_relaxed);
+    else counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  inline Slot& getSlot()
+  {
+    if (t_slot == nullptr)
+    {
+      const size_t index = g_claimed.fetch_add(1, std::memory_order_relaxed);
+      t_slot = index < MAX_SLOTS ? &g_slots[index] : &g_overflow;
+    }
+    return *t_slot;
+  }
+
+  /// the live heap changed by @p delta bytes
+  inline void onLive(Slot& slot, const int64_t delta)
+  {
+    bump(slot.live, delta);
+    t_unpublished += delta;
+    if (t_unpublished < PUBLISH_BYTES && t_unpublished > -PUBLISH_BYTES) return;
+    const int64_t live = g_live.fetch_add(t_unpublished, std::memory_order_relaxed) + t_unpublished;
+    t_unpublished = 0;
+    int64_t peak = g_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    if (g_ring) g_ring->push(HEAP_RING_LIVE, 0, uint64_t(std::max(int64_t(0), live)), uint64_t(std::max(live, peak)));
+  }
+
+  inline void onAllocation(void* ptr, const size_t size)
+  {
+    if (ptr == nullptr) return;
+    Slot& slot = getSlot();
+    bump(slot.allocations, uint64_t(1));
+    bump(slot.bytes_allocated, uint64_t(size));
+    bump(slot.size_classes[heapSizeClass(size)], uint64_t(1));
+    onLive(slot, int64_t(malloc_usable_size(ptr)));
+    HeapProfile::onAllocation(ptr, size);
+  }
+
+  inline void onFree(void* ptr)
+  {
+    if (ptr == nullptr) return;
+    Slot& slot = getSlot();
+    bump(slot.frees, uint64_t(1));
+    onLive(slot, -int64_t(malloc_usable_size(ptr)));
+    HeapProfile::onFree(ptr);
+  }
+
+  /// in the child of fork(), only the forking thread survives: its slot takes over the live blocks of all threads, all other counters start at 0
+  void resetAfterFork()
+  {
+    int64_t live = 0;
+    for (Slot* slot = g_slots; slot != g_slots + MAX_SLOTS; ++slot) live += slot->live.load(std::memory_order_relaxed);
+    live += g_overflow.live.load(std::memory_order_relaxed);
+    std::memset(static_cast<void*>(g_slots), 0, sizeof(g_slots));
+    std::memset(static_cast<void*>(&g_overflow), 0, sizeof(g_overflow));
+    g_claimed.store(0, std::memory_order_relaxed);
+    t_slot = nullptr;
+    t_unpublished = 0;
+    getSlot().live.store(live, std::memory_order_relaxed);
+    g_live.store(live, std::memory_order_relaxed);
+    g_peak.store(live, std::memory_order_relaxed);
+  }
+
+  HeapCounters sumUp()
+  {
+    HeapCounters counters;
+    int64_t live = 0;
+    const auto add = [&](const Slot& slot) {
+      counters.allocations += slot.allocations.load(std::memory_order_relaxed);
+      counters.reallocations += slot.reallocations.load(std::memory_order_relaxed);
+      counters.frees += slot.frees.load(std::memory_order_relaxed);
+      counters.bytes_allocated += slot.bytes_allocated.load(std::memory_order_relaxed);
+      live += slot.live.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) counters.size_classes[i] += slot.size_classes[i].load(std::memory_order_relaxed);
+    };
+    const size_t claimed = std::min(g_claimed.load(std::memory_order_relaxed), MAX_SLOTS);
+    for (size_t i = 0; i < claimed; ++i) add(g_slots[i]);
+    add(g_overflow);
+    counters.live_at_exit = uint64_t(std::max(int64_t(0), live));
+    counters.peak_live = uint64_t(std::max(g_peak.load(std::memory_order_relaxed), live));
+    return counters;
+  }
+
+  __attribute__((constructor)) void onLoad()
+  {
+    pthread_atfork(nullptr, nullptr, resetAfterFork);
+    auto* ring = new (g_ring_storage) RingBufferClient;
+    if (ring->isValid()) g_ring = ring;
+    HeapProfile::init(&g_live);
+    LockProfile::init();
+    IoProfile::init();
+  }
+
+  __attribute__((destructor)) void onExit()
+  {
+    IoProfile::stop(); // before connecting (which reads /proc/self/cmdline) and writing heap profiles
+    ReportClient client;
+    IoProfile::write(client);
+    HeapProfile::write(client);
+    LockProfile::write(client);
+    const HeapCounters counters = sumUp();
+    if (client.send(ReportType::HEAP_COUNTERS, &counters, sizeof(counters))) return;
+    std::fprintf(stderr, "WinTime heap hook: %llu allocations, %llu reallocations, %llu frees, %llu bytes allocated, peak live heap %llu bytes, %llu bytes live at exit\n",
+                 (unsigned long long)counters.allocations, (unsigned long long)counters.reallocations, (unsigned long long)counters.frees,
+                 (unsigned long long)counters.bytes_allocated, (unsigned long long)counters.peak_live, (unsigned long long)counters.live_at_exit);
+  }
+}
+
+WINTIME_EXPORT void* malloc(size_t size)
+{
+  void* ptr = __libc_malloc(size);
+  onAllocation(ptr, size);
+  return ptr;
+}
+
+WINTIME_EXPORT void free(void* ptr)
+{
+  onFree(ptr);
+  __libc_free(ptr);
+}
+
+WINTIME_EXPORT void* calloc(size_t count, size_t size)
+{
+  void* ptr = __libc_calloc(count, size);
+  onAllocation(ptr, count * size); // no overflow: calloc() failed otherwise
+  return ptr;
+}
+
+WINTIME_EXPORT void* realloc(void* ptr, size_t size)
+{
+  if (ptr == nullptr) return malloc(size);
+  if (size == 0)
+  { // frees ptr (and returns nullptr)
+    onFree(ptr);
+    return __libc_realloc(ptr, size);
+  }
+  const size_t old_size = malloc_usable_size(ptr);
+  void* new_ptr = __libc_realloc(ptr, size);
+  if (new_ptr == nullptr) return nullptr; // ptr is untouched
+  Slot& slot = getSlot();
+  bump(slot.reallocations, uint64_t(1));
+  bump(slot.bytes_allocated, uint64_t(size));
+  bump(slot.size_classes[heapSizeClass(size)], uint64_t(1));
+  onLive(slot, int64_t(malloc_usable_size(new_ptr)) - int64_t(old_size));
+  // a moved (or resized) block counts as a new one for the profile; the old address is only a key here
+  HeapProfile::onFree(ptr);
+  HeapProfile::onAllocation(new_ptr, size);
+  return new_ptr;
+}
+
+WINTIME_EXPORT void* reallocarray(void* ptr, size_t count, size_t size)
+{
+  size_t bytes;
+  if (__builtin_mul_overflow(count, size, &bytes))
+  {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(ptr, bytes);
+}
+
+WINTIME_EXPORT void* memalign(size_t alignment, size_t size)
+{
+  void* ptr = __libc_memalign(alignment, size);
+  onAllocation(ptr, size);
+  return ptr;
+}
+
+WINTIME_EXPORT void* aligned_alloc(size_t alignment, size_t size)
+{
+  return memalign(alignment, size);
+}
+
+WINTIME_EXPORT int posix_memalign(void** result, size_t alignment, size_t size)
+{
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) return EINVAL;
+  void* ptr = memalign(alignment, size);
+  if (ptr == nullptr) return ENOMEM;
+  *result = ptr;
+  return 0;
+}
+
+WINTIME_EXPORT void* valloc(size_t size)
+{
+  void* ptr = __libc_valloc(size);
+  onAllocation(ptr, size);
+  return ptr;
+}
+
+WINTIME_EXPORT void* pvalloc(size_t size)
+{
+  void* ptr = __libc_pvalloc(size);
+  onAllocation(ptr, size);
+  return ptr;
+}
+
+#endif
@@ -0,0 +1,506 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "HeapProfile.h"
+
+#include "Heap.h"
+#include "LockProfile.h"
+#include "ReportProtocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace WinTime
+{
+  namespace HeapProfile
+  {
+    __thread int64_t t_until_sample __attribute__((tls_model("initial-exec"))) = 0;
+    std::atomic<uint16_t> g_filter[FILTER_SIZE];
+  }
+}
+
+namespace
+{
+  using namespace WinTime;
+
+  /// frames of a call stack which are kept (the innermost ones)
+  constexpr int MAX_DEPTH = 48;
+
+  /// distinct call stacks; samples of further stacks are dropped
+  constexpr size_t MAX_STACKS = 1 << 16;
+
+  /// sampled blocks and bytes of one call stack
+  struct Counts
+  {
+    uint64_t alloc_objects;
+    uint64_t alloc_bytes;
+    uint64_t live_objects;
+    uint64_t live_bytes;
+  };
+
+  struct Stack
+  {
+    uint64_t hash;
+    int depth;
+    void* frames[MAX_DEPTH];
+    Counts now;
+    Counts peak;   ///< a copy of 'now' at the peak of the live heap, if peak_generation is current (else 'now' still is)
+    uint64_t peak_generation;
+  };
+
+  /// a sampled live block; ptr == 0 marks an empty entry of the table
+  struct Object
+  {
+    uintptr_t ptr;
+    uint64_t size;
+    uint32_t stack;
+  };
+
+  std::atomic<bool> g_initialized{ false };
+  int64_t g_rate = 0;              ///< mean bytes between samples; 0: profiling is off
+  char g_prefix[PATH_MAX];
+  const std::atomic<int64_t>* g_live = nullptr;
+  uintptr_t g_hook_begin = 0;      ///< the code of the hook, whose frames are cut off the stacks
+  uintptr_t g_hook_end = 0;
+
+  pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;   ///< guards the tables below (locked untimed, see LockProfile::lockUntimed())
+  Stack* g_stacks = nullptr;       ///< MAX_STACKS reserved, g_stack_count used
+  size_t g_stack_count = 0;
+  uint32_t* g_stack_index = nullptr;   ///< by hash (open addressing, 2 * MAX_STACKS entries): index + 1 into g_stacks, 0 if empty
+  Object* g_objects = nullptr;     ///< by address (open addressing, linear probing)
+  size_t g_object_capacity = 0;
+  size_t g_object_count = 0;
+  int64_t g_peak_live = -1;        ///< the live heap at its last peak
+  uint64_t g_peak_generation = 1;  ///< incremented at each new peak, which marks the Stack::peak of all stacks as outdated
+
+  __thread uint64_t t_random __attribute__((tls_model("initial-exec"))) = 0;   ///< the thread's random generator (0: not seeded yet)
+  __thread bool t_busy __attribute__((tls_model("initial-exec"))) = false;     ///< in the profiler, whose own allocations are not sampled
+
+  /// pages for the tables (never via malloc(), which we are part of); only touched pages use memory
+  void* mapMemory(const size_t bytes)
+  {
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  /// the number of bytes until the next sample: exponentially distributed with mean g_rate
+  int64_t nextInterval()
+  {
+    if (t_random == 0)
+    {
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      t_random = (uint64_t(now.tv_nsec) * 0x9E3779B97F4A7C15ull ^ uint64_t(uintptr_t(&t_random))) | 1;
+    }
+    // xorshift64*
+    t_random ^= t_random >> 12;
+    t_random ^= t_random << 25;
+    t_random ^= t_random >> 27;
+    const double u = double(((t_random * 0x2545F4914F6CDD1Dull) >> 11) + 1) * 0x1.0p-53; // (0, 1]
+    return int64_t(std::min(-std::log(u) * double(g_rate), 1e15)) + 1;
+  }
+
+  /// find the loaded segments of the hook itself (see dl_iterate_phdr())
+  int findHook(dl_phdr_info* info, size_t, void*)
+  {
+    const uintptr_t self = uintptr_t(&HeapProfile::sample);
+    uintptr_t begin = UINTPTR_MAX, end = 0;
+    bool found = false;
+    for (int i = 0; i < info->dlpi_phnum; ++i)
+    {
+      const auto& header = info->dlpi_phdr[i];
+      if (header.p_type != PT_LOAD) continue;
+      const uintptr_t segment = info->dlpi_addr + header.p_vaddr;
+      begin = std::min(begin, segment);
+      end = std::max(end, segment + header.p_memsz);
+      found |= self >= segment && self < segment + header.p_memsz;
+    }
+    if (!found) return 0;
+    g_hook_begin = begin;
+    g_hook_end = end;
+    return 1;
+  }
+
+  /// the counters of @p stack, about to be changed: keep them as its peak first if a new peak was reached since they last changed
+  /// (copying 'now' of all stacks at every new peak would cost O(stacks) per sample while the heap grows)
+  Counts& changeCounts(Stack& stack)
+  {
+    if (stack.peak_generation != g_peak_generation)
+    {
+      stack.peak = stack.now;
+      stack.peak_generation = g_peak_generation;
+    }
+    return stack.now;
+  }
+
+  /// the index of the call stack @p frames in g_stacks, which is added if it is new; MAX_STACKS if the table is full
+  uint32_t findStack(void* const* frames, const int depth)
+  {
+    uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a over the addresses
+    for (int i = 0; i < depth; ++i) hash = (hash ^ uint64_t(uintptr_t(frames[i]))) * 0x100000001b3ull;
+    const size_t mask = 2 * MAX_STACKS - 1;
+    size_t slot = size_t(hash ^ (hash >> 32)) & mask;
+    for (; g_stack_index[slot] != 0; slot = (slot + 1) & mask)
+    {
+      const Stack& stack = g_stacks[g_stack_index[slot] - 1];
+      if (stack.hash == hash && stack.depth == depth && std::memcmp(stack.frames, frames, size_t(depth) * sizeof(void*)) == 0) return g_stack_index[slot] - 1;
+    }
+    if (g_stack_count == MAX_STACKS) return MAX_STACKS;
+    Stack& stack = g_stacks[g_stack_count]; // fresh pages are zeroed
+    stack.hash = hash;
+    stack.depth = depth;
+    std::memcpy(stack.frames, frames, size_t(depth) * sizeof(void*));
+    g_stack_index[slot] = uint32_t(++g_stack_count);
+    return uint32_t(g_stack_count - 1);
+  }
+
+  size_t objectSlot(const uintptr_t ptr, const size_t capacity)
+  {
+    return size_t(((ptr >> 4) * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+  }
+
+  /// the entry of @p ptr in g_objects, or nullptr
+  Object* findObject(const uintptr_t ptr)
+  {
+    if (g_object_capacity == 0) return nullptr;
+    for (size_t slot = objectSlot(ptr, g_object_capacity);; slot = (slot + 1) & (g_object_capacity - 1))
+    {
+      if (g_objects[slot].ptr == ptr) return &g_objects[slot];
+      if (g_objects[slot].ptr == 0) return nullptr;
+    }
+  }
+
+  void insertObject(Object* objects, const size_t capacity, const Object& object)
+  {
+    size_t slot = objectSlot(object.ptr, capacity);
+    while (objects[slot].ptr != 0) slot = (slot + 1) & (capacity - 1);
+    objects[slot] = object;
+  }
+
+  /// double the capacity of g_objects (keeping its load at most 1/2); returns false if out of memory
+  bool growObjects()
+  {
+    const size_t capacity = g_object_capacity == 0 ? 4096 : 2 * g_object_capacity;
+    auto* objects = static_cast<Object*>(mapMemory(capacity * sizeof(Object)));
+    if (objects == nullptr) return false;
+    for (size_t i = 0; i < g_object_capacity; ++i)
+    {
+      if (g_objects[i].ptr != 0) insertObject(objects, capacity, g_objects[i]);
+    }
+    if (g_objects != nullptr) munmap(g_objects, g_object_capacity * sizeof(Object));
+    g_objects = objects;
+    g_object_capacity = capacity;
+    return true;
+  }
+
+  /// remove @p entry from g_objects, and its block from the live counters
+  void eraseObject(Object* entry)
+  {
+    Counts& counts = changeCounts(g_stacks[entry->stack]);
+    --counts.live_objects;
+    counts.live_bytes -= entry->size;
+    HeapProfile::g_filter[HeapProfile::filterBucket(reinterpret_cast<void*>(entry->ptr))].fetch_sub(1, std::memory_order_relaxed);
+    --g_object_count;
+    // backward shift deletion: move later entries of the probe sequence into the hole, unless that would put them before their home slot
+    const size_t mask = g_object_capacity - 1;
+    size_t hole = size_t(entry - g_objects);
+    for (size_t slot = (hole + 1) & mask; g_objects[slot].ptr != 0; slot = (slot + 1) & mask)
+    {
+      const size_t home = objectSlot(g_objects[slot].ptr, g_object_capacity);
+      if (((slot - home) & mask) >= ((slot - hole) & mask))
+      {
+        g_objects[hole] = g_objects[slot];
+        hole = slot;
+      }
+    }
+    g_objects[hole].ptr = 0;
+  }
+
+  void lockForFork()
+  {
+    LockProfile::lockUntimed(&g_mutex);
+  }
+
+  void unlockForFork()
+  {
+    pthread_mutex_unlock(&g_mutex);
+  }
+
+  /// the child of fork() inherits the live blocks, but starts with no allocations (like the counters of the hook)
+  void resetAfterFork()
+  {
+    pthread_mutex_init(&g_mutex, nullptr);
+    for (size_t i = 0; i < g_stack_count; ++i)
+    {
+      g_stacks[i].now.alloc_objects = 0;
+      g_stacks[i].now.alloc_bytes = 0;
+    }
+    g_peak_live = g_live->load(std::memory_order_relaxed);
+    ++g_peak_generation;
+    t_random = (t_random ^ (uint64_t(getpid()) * 0x9E3779B97F4A7C15ull)) | 1; // do not sample in step with the parent
+  }
+
+  /// buffered output to a file, which needs no allocations
+  class Output
+  {
+  public:
+    explicit Output(const char* path)
+      : fd_(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+    {}
+
+    bool isOpen() const
+    {
+      return fd_ >= 0;
+    }
+
+    void print(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+      char line[256];
+      va_list args;
+      va_start(args, format);
+      const int length = std::vsnprintf(line, sizeof(line), format, args);
+      va_end(args);
+      if (length > 0) append(line, std::min(size_t(length), sizeof(line) - 1));
+    }
+
+    void append(const char* data, size_t size)
+    {
+      if (used_ + size > sizeof(buffer_)) flush_();
+      if (size > sizeof(buffer_))
+      {
+        writeAll_(data, size);
+        return;
+      }
+      std::memcpy(buffer_ + used_, data, size);
+      used_ += size;
+    }
+
+    /// returns false if any write failed
+    bool close()
+    {
+      flush_();
+      const bool ok = ok_ && ::close(fd_) == 0;
+      fd_ = -1;
+      return ok;
+    }
+
+  private:
+    void flush_()
+    {
+      writeAll_(buffer_, used_);
+      used_ = 0;
+    }
+
+    void writeAll_(const char* data, size_t size)
+    {
+      while (ok_ && size > 0)
+      {
+        const ssize_t written = ::write(fd_, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0)
+        {
+          ok_ = false;
+          return;
+        }
+        data += written;
+        size -= size_t(written);
+      }
+    }
+
+    int fd_;
+    bool ok_{ true };
+    size_t used_{ 0 };
+    char buffer_[16384];
+  };
+
+  /// write the counters @p which of all stacks as a heap profile to @p path (see HeapProfile); returns false on failure (with errno set)
+  bool writeProfile(const char* path, Counts Stack::* which)
+  {
+    Output out(path);
+    if (!out.isOpen()) return false;
+    Counts total{};
+    for (size_t i = 0; i < g_stack_count; ++i)
+    {
+      const Counts& counts = g_stacks[i].*which;
+      total.alloc_objects += counts.alloc_objects;
+      total.alloc_bytes += counts.alloc_bytes;
+      total.live_objects += counts.live_objects;
+      total.live_bytes += counts.live_bytes;
+    }
+    out.print("heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%lld\n", (unsigned long long)total.live_objects, (unsigned long long)total.live_bytes,
+              (unsigned long long)total.alloc_objects, (unsigned long long)total.alloc_bytes, (long long)g_rate);
+    for (size_t i = 0; i < g_stack_count; ++i)
+    {
+      const Stack& stack = g_stacks[i];
+      const Counts& counts = stack.*which;
+      if (counts.alloc_objects == 0 && counts.live_objects == 0) continue;
+      out.print("%llu: %llu [%llu: %llu] @", (unsigned long long)counts.live_objects, (unsigned long long)counts.live_bytes,
+                (unsigned long long)counts.alloc_objects, (unsigned long long)counts.alloc_bytes);
+      for (int f = 0; f < stack.depth; ++f) out.print(" %#llx", (unsigned long long)uintptr_t(stack.frames[f]));
+      out.append("\n", 1);
+    }
+    // the mappings let pprof find the binary (and offset) of each address
+    out.append("\nMAPPED_LIBRARIES:\n", 19);
+    const int maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps >= 0)
+    {
+      char chunk[4096];
+      ssize_t bytes;
+      while ((bytes = read(maps, chunk, sizeof(chunk))) > 0) out.append(chunk, size_t(bytes));
+      ::close(maps);
+    }
+    return out.close();
+  }
+}
+
+void WinTime::HeapProfile::init(const std::atomic<int64_t>* live)
+{
+  g_live = live;
+  const char* prefix = getenv(s_env_heapprofile);
+  if (prefix && *prefix && std::strlen(prefix) + 64 < sizeof(g_prefix))
+  {
+    g_stacks = static_cast<Stack*>(mapMemory(MAX_STACKS * sizeof(Stack)));
+    g_stack_index = static_cast<uint32_t*>(mapMemory(2 * MAX_STACKS * sizeof(uint32_t)));
+    if (g_stacks && g_stack_index)
+    {
+      std::strcpy(g_prefix, prefix);
+      dl_iterate_phdr(findHook, nullptr);
+      // backtrace() loads libgcc_s on its first call, which allocates; better now than within the first sample
+      t_busy = true;
+      void* frame;
+      backtrace(&frame, 1);
+      t_busy = false;
+      pthread_atfork(lockForFork, unlockForFork, resetAfterFork);
+      const char* rate = getenv(s_env_heapsamplerate);
+      const long long bytes = rate ? std::strtoll(rate, nullptr, 10) : 0;
+      g_rate = bytes > 0 ? bytes : int64_t(HEAP_SAMPLE_RATE_DEFAULT);
+    }
+  }
+  g_initialized.store(true, std::memory_order_release);
+}
+
+void WinTime::HeapProfile::sample(void* ptr, const size_t size)
+{
+  if (t_busy) return;
+  if (!g_initialized.load(std::memory_order_acquire))
+  { // allocations before init() (by the loader or other constructors) are not sampled; check again on the next one
+    t_until_sample = 0;
+    return;
+  }
+  if (g_rate == 0)
+  {
+    t_until_sample = INT64_MAX;
+    return;
+  }
+  const bool first = t_random == 0;
+  t_until_sample = nextInterval();
+  if (first || ptr == nullptr) return; // the first call of a thread only starts its countdown
+
+  t_busy = true;
+  void* frames[MAX_DEPTH + 8];
+  const int captured = backtrace(frames, MAX_DEPTH + 8);
+  int skip = 0;
+  while (skip < captured && uintptr_t(frames[skip]) >= g_hook_begin && uintptr_t(frames[skip]) < g_hook_end) ++skip;
+  const int depth = std::min(captured - skip, MAX_DEPTH);
+
+  LockProfile::lockUntimed(&g_mutex);
+  const uint32_t index = findStack(frames + skip, depth);
+  if (index != MAX_STACKS && (2 * (g_object_count + 1) <= g_object_capacity || growObjects()))
+  {
+    // a block which was freed behind our back (e.g. while t_busy) is replaced
+    if (Object* stale = findObject(uintptr_t(ptr))) eraseObject(stale);
+    insertObject(g_objects, g_object_capacity, Object{ uintptr_t(ptr), size, index });
+    ++g_object_count;
+    g_filter[filterBucket(ptr)].fetch_add(1, std::memory_order_relaxed);
+    Counts& counts = changeCounts(g_stacks[index]);
+    ++counts.alloc_objects;
+    counts.alloc_bytes += size;
+    ++counts.live_objects;
+    counts.live_bytes += size;
+    const int64_t live = g_live->load(std::memory_order_relaxed);
+    if (live > g_peak_live)
+    {
+      g_peak_live = live;
+      ++g_peak_generation;
+    }
+  }
+  pthread_mutex_unlock(&g_mutex);
+  t_busy = false;
+}
+
+void WinTime::HeapProfile::remove(void* ptr)
+{
+  if (t_busy) return;
+  LockProfile::lockUntimed(&g_mutex);
+  if (Object* entry = findObject(uintptr_t(ptr))) eraseObject(entry);
+  pthread_mutex_unlock(&g_mutex);
+}
+
+void WinTime::HeapProfile::write(ReportClient& client)
+{
+  if (g_rate == 0) return;
+  t_busy = true;
+  LockProfile::lockUntimed(&g_mutex);
+  for (size_t i = 0; i < g_stack_count; ++i) changeCounts(g_stacks[i]); // bring all peaks up to date
+  const struct
+  {
+    const char* name;
+    Counts Stack::* counts;
+  } profiles[] = { { "peak", &Stack::peak }, { "exit", &Stack::now } };
+  for (const auto& profile : profiles)
+  {
+    // the prefix, '.', the PID (at most 11 characters), '.', the name and '.heap'
+    char path[sizeof(g_prefix) + 32];
+    const int length = std::snprintf(path, sizeof(path), "%s.%d.%s.heap", g_prefix, int(getpid()), profile.name);
+    if (length < 0 || size_t(length) >= sizeof(path))
+    {
+      std::fprintf(stderr, "WinTime heap hook: the path of the heap profile is too long\n");
+      continue;
+    }
+    if (!writeProfile(path, profile.counts))
+    {
+      std::fprintf(stderr, "WinTime heap hook: cannot write the heap profile '%s': %s\n", path, std::strerror(errno));
+      continue;
+    }
+    if (!client.send(ReportType::HEAP_PROFILE, path, std::strlen(path))) std::fprintf(stderr, "WinTime heap hook: wrote the heap profile '%s'\n", path);
+  }
+  pthread_mutex_unlock(&g_mutex);
+  t_busy = false;
+}
+
+#endif
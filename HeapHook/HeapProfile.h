@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace WinTime
+{
+  class ReportClient;
+
+  /**
+    @brief The sampling heap profiler of the heap hook (see --heap-profile)
+
+    Allocations are sampled at byte intervals: each thread draws the number of bytes until its next sample from an
+    exponential distribution (mean: the sample rate), so every allocated byte is equally likely to be sampled and large
+    blocks are sampled more often than small ones. A sampled block is recorded with its call stack and tracked until it is freed.
+    The hot path only decrements a thread-local counter on allocation, and reads one entry of a counting filter on free; all
+    bookkeeping of samples happens under a mutex, in memory which is mapped directly (never via malloc()).
+
+    When the sampled live heap reaches a new high, the per-stack counters are copied; at exit, both this peak and the final state
+    are written as heap profiles in the (legacy) text format of gperftools, which pprof reads ('heap_v2' with the sample rate, so pprof
+    scales the samples up to estimates of the real numbers).
+  */
+  namespace HeapProfile
+  {
+    /// bytes the calling thread may allocate until its next sample (see onAllocation())
+    extern __thread int64_t t_until_sample __attribute__((tls_model("initial-exec")));
+
+    /// number of sampled live blocks per bucket of their address hash; an empty bucket means: not sampled
+    constexpr size_t FILTER_SIZE = 1 << 16;
+    extern std::atomic<uint16_t> g_filter[FILTER_SIZE];
+
+    inline size_t filterBucket(const void* ptr)
+    {
+      return size_t((uintptr_t(ptr) >> 4) * 0x9E3779B97F4A7C15ull >> 48) & (FILTER_SIZE - 1);
+    }
+
+    /// read the configuration from the environment (s_env_heapprofile, s_env_heapsamplerate); profiling is off unless a prefix is set
+    /// @param live The published live heap of the process (used to find its peak)
+    void init(const std::atomic<int64_t>* live);
+
+    /// the slow path of onAllocation(): the counter ran out (or is not set up yet for this thread)
+    void sample(void* ptr, size_t size);
+
+    /// the slow path of onFree(): @p ptr might be sampled
+    void remove(void* ptr);
+
+    /// a block @p ptr of @p size bytes was allocated
+    inline void onAllocation(void* ptr, const size_t size)
+    {
+      t_until_sample -= int64_t(size);
+      if (t_until_sample < 0) sample(ptr, size);
+    }
+
+    /// the block @p ptr is about to be freed
+    inline void onFree(void* ptr)
+    {
+      if (g_filter[filterBucket(ptr)].load(std::memory_order_relaxed) != 0) remove(ptr);
+    }
+
+    /// write the profiles at the peak and at exit (if profiling is on); their paths are sent via @p client (or printed to STDERR if it is not connected)
+    void write(ReportClient& client);
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+
+/// functions of the heap hook which replace those of libc (everything else is hidden)
+#define WINTIME_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace WinTime
+{
+  /// the definition of @p name which the interposed one hides (i.e. glibc's), looked up on first use
+  /// (other libraries may call it before the constructor of the hook runs); aborts if there is none
+  template<typename F>
+  F* next(std::atomic<F*>& cache, const char* name)
+  {
+    F* function = cache.load(std::memory_order_relaxed);
+    if (function == nullptr)
+    {
+      function = reinterpret_cast<F*>(dlsym(RTLD_NEXT, name));
+      if (function == nullptr)
+      {
+        std::fprintf(stderr, "WinTime heap hook: cannot find '%s'\n", name);
+        std::abort();
+      }
+      cache.store(function, std::memory_order_relaxed);
+    }
+    return function;
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+// this file defines open(), read() etc., which fortified headers would define as inline wrappers
+#undef _FORTIFY_SOURCE
+
+#ifndef _WIN32
+
+#include "IoProfile.h"
+
+#include "Interpose.h"
+#include "Io.h"
+#include "LockProfile.h"
+#include "ReportProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C"
+{
+  int __open(const char* path, int flags, ...);
+  int __open64(const char* path, int flags, ...);
+  int __close(int fd);
+  ssize_t __read(int fd, void* buffer, size_t count);
+  ssize_t __write(int fd, const void* buffer, size_t count);
+  ssize_t __pread64(int fd, void* buffer, size_t count, off64_t offset);
+  ssize_t __pwrite64(int fd, const void* buffer, size_t count, off64_t offset);
+}
+
+namespace
+{
+  using namespace WinTime;
+
+  /// descriptors beyond this are attributed to OTHER
+  constexpr int MAX_FDS = 1 << 16;
+
+  /// distinct paths; further paths are attributed to OTHER
+  constexpr uint32_t MAX_FILES = 1 << 14;
+
+  /// bytes for all paths
+  constexpr size_t PATH_BYTES = 8 << 20;
+
+  /// the file of all descriptors and paths which do not fit into the tables (or cannot be resolved)
+  constexpr uint32_t OTHER = 1;
+
+  struct File
+  {
+    std::atomic<uint64_t> opens;
+    std::atomic<uint64_t> failed_opens;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> read_bytes;
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> write_bytes;
+    std::atomic<uint64_t> time_ns;
+    std::atomic<uint64_t> mmaps;
+    std::atomic<uint64_t> mmap_bytes;
+    uint64_t hash;
+    uint32_t path;     ///< offset in g_paths
+    uint32_t length;
+  };
+
+  struct Totals
+  {
+    std::atomic<uint64_t> calls[IO_OPERATIONS];
+    std::atomic<uint64_t> bytes[IO_OPERATIONS];
+    std::atomic<uint64_t> time_ns[IO_OPERATIONS];
+    std::atomic<uint64_t> latency[IO_OPERATIONS][IO_LATENCY_BUCKETS];
+    std::atomic<uint64_t> failed_opens;
+    std::atomic<uint64_t> mmaps;
+    std::atomic<uint64_t> mmap_bytes;
+  };
+
+  std::atomic<bool> g_enabled{ false };
+  Totals g_totals;
+  IoCounters g_final;                       ///< the counters when profiling stopped (see IoProfile::stop())
+  std::atomic<uint32_t>* g_fds = nullptr;   ///< the file of each descriptor (0: not resolved yet)
+  File* g_files = nullptr;                  ///< MAX_FILES reserved; index 0 is unused
+  std::atomic<uint32_t> g_file_count{ 1 };
+  pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;   ///< guards adding paths (locked untimed, see LockProfile::lockUntimed())
+  uint32_t* g_file_index = nullptr;         ///< by hash (open addressing, 2 * MAX_FILES entries): index into g_files, 0 if empty
+  char* g_paths = nullptr;
+  size_t g_paths_used = 0;
+
+  std::atomic<int (*)(const char*, int, ...)> r_open_2{ nullptr };
+  std::atomic<int (*)(const char*, int, ...)> r_open64_2{ nullptr };
+  std::atomic<int (*)(int, const char*, int, ...)> r_openat{ nullptr };
+  std::atomic<int (*)(int, const char*, int, ...)> r_openat64{ nullptr };
+  std::atomic<int (*)(int, const char*, int, ...)> r_openat_2{ nullptr };
+  std::atomic<int (*)(int, const char*, int, ...)> r_openat64_2{ nullptr };
+  std::atomic<FILE* (*)(const char*, const char*)> r_fopen{ nullptr };
+  std::atomic<FILE* (*)(const char*, const char*)> r_fopen64{ nullptr };
+  std::atomic<int (*)(FILE*)> r_fclose{ nullptr };
+  std::atomic<int (*)(int, int)> r_dup2{ nullptr };
+  std::atomic<int (*)(int, int, int)> r_dup3{ nullptr };
+  std::atomic<ssize_t (*)(int, const iovec*, int)> r_readv{ nullptr };
+  std::atomic<ssize_t (*)(int, const iovec*, int)> r_writev{ nullptr };
+  std::atomic<ssize_t (*)(int, void*, size_t, size_t)> r_read_chk{ nullptr };
+  std::atomic<ssize_t (*)(int, void*, size_t, off_t, size_t)> r_pread_chk{ nullptr };
+  std::atomic<ssize_t (*)(int, void*, size_t, off64_t, size_t)> r_pread64_chk{ nullptr };
+  std::atomic<ssize_t (*)(int, off64_t*, int, off64_t*, size_t, unsigned)> r_copy_file_range{ nullptr };
+  std::atomic<ssize_t (*)(int, int, off_t*, size_t)> r_sendfile{ nullptr };
+  std::atomic<ssize_t (*)(int, int, off64_t*, size_t)> r_sendfile64{ nullptr };
+  std::atomic<void* (*)(void*, size_t, int, int, int, off_t)> r_mmap{ nullptr };
+  std::atomic<void* (*)(void*, size_t, int, int, int, off64_t)> r_mmap64{ nullptr };
+
+  inline bool isEnabled()
+  {
+    return g_enabled.load(std::memory_order_relaxed);
+  }
+
+  inline uint64_t now()
+  {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + uint64_t(t.tv_nsec);
+  }
+
+  inline void add(std::atomic<uint64_t>& counter, const uint64_t value)
+  {
+    counter.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  /// the index of @p path in g_files, which is added if it is new (OTHER if the tables are full)
+  uint32_t intern(const char* path)
+  {
+    const size_t length = std::strlen(path);
+    uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+    for (size_t i = 0; i < length; ++i) hash = (hash ^ uint8_t(path[i])) * 0x100000001b3ull;
+    const size_t mask = 2 * MAX_FILES - 1;
+    size_t slot = size_t(hash ^ (hash >> 32)) & mask;
+    LockProfile::lockUntimed(&g_mutex);
+    for (; g_file_index[slot] != 0; slot = (slot + 1) & mask)
+    {
+      const File& file = g_files[g_file_index[slot]];
+      if (file.hash == hash && file.length == length && std::memcmp(g_paths + file.path, path, length) == 0)
+      {
+        const uint32_t index = g_file_index[slot];
+        pthread_mutex_unlock(&g_mutex);
+        return index;
+      }
+    }
+    const uint32_t index = g_file_count.load(std::memory_order_relaxed);
+    if (index == MAX_FILES || g_paths_used + length + 1 > PATH_BYTES)
+    {
+      pthread_mutex_unlock(&g_mutex);
+      return OTHER;
+    }
+    File& file = g_files[index]; // fresh pages are zeroed
+    file.hash = hash;
+    file.path = uint32_t(g_paths_used);
+    file.length = uint32_t(length);
+    std::memcpy(g_paths + g_paths_used, path, length + 1);
+    g_paths_used += length + 1;
+    g_file_index[slot] = index;
+    g_file_count.store(index + 1, std::memory_order_release);
+    pthread_mutex_unlock(&g_mutex);
+    return index;
+  }
+
+  /// look up the path of @p fd (e.g. '/usr/include/stdio.h' or 'pipe:[1234]') and remember it until the descriptor is closed
+  uint32_t resolve(const int fd)
+  {
+    if (fd < 0 || fd >= MAX_FDS) return OTHER;
+    char link[32];
+    std::snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    char path[PATH_MAX];
+    const ssize_t length = readlink(link, path, sizeof(path) - 1);
+    if (length <= 0) return OTHER;
+    path[length] = '\0';
+    const uint32_t index = intern(path);
+    g_fds[fd].store(index, std::memory_order_relaxed);
+    return index;
+  }
+
+  /// the file of @p fd
+  inline File& fileOf(const int fd)
+  {
+    const uint32_t index = fd >= 0 && fd < MAX_FDS ? g_fds[fd].load(std::memory_order_relaxed) : OTHER;
+    return g_files[index != 0 ? index : resolve(fd)];
+  }
+
+  /// @p fd is closed (or replaced), so its number may refer to another file next
+  inline void forget(const int fd)
+  {
+    if (g_fds != nullptr && fd >= 0 && fd < MAX_FDS) g_fds[fd].store(0, std::memory_order_relaxed);
+  }
+
+  void count(const IoOperation operation, const uint64_t ns)
+  {
+    const size_t op = size_t(operation);
+    add(g_totals.calls[op], 1);
+    add(g_totals.time_ns[op], ns);
+    add(g_totals.latency[op][ioLatencyBucket(ns)], 1);
+  }
+
+  /// time the read or write @p call on @p fd (which returns bytes transferred, or -1)
+  template<typename Call>
+  ssize_t transfer(const int fd, const IoOperation operation, Call&& call)
+  {
+    const uint64_t t_start = now();
+    const ssize_t result = call();
+    const uint64_t ns = now() - t_start;
+    const int saved_errno = errno;
+    count(operation, ns);
+    File& file = fileOf(fd);
+    add(file.time_ns, ns);
+    const uint64_t bytes = result > 0 ? uint64_t(result) : 0;
+    add(g_totals.bytes[size_t(operation)], bytes);
+    if (operation == IoOperation::READ)
+    {
+      add(file.reads, 1);
+      add(file.read_bytes, bytes);
+    }
+    else
+    {
+      add(file.writes, 1);
+      add(file.write_bytes, bytes);
+    }
+    errno = saved_errno;
+    return result;
+  }
+
+  /// time the @p call which copies from @p in_fd to @p out_fd in the kernel (and returns the bytes copied, or -1);
+  /// it counts as a write of @p out_fd (with the time) and a read of @p in_fd (without)
+  template<typename Call>
+  ssize_t copying(const int in_fd, const int out_fd, Call&& call)
+  {
+    const ssize_t result = transfer(out_fd, IoOperation::WRITE, call);
+    const int saved_errno = errno;
+    const uint64_t bytes = result > 0 ? uint64_t(result) : 0;
+    add(g_totals.calls[size_t(IoOperation::READ)], 1);
+    add(g_totals.bytes[size_t(IoOperation::READ)], bytes);
+    File& file = fileOf(in_fd);
+    add(file.reads, 1);
+    add(file.read_bytes, bytes);
+    errno = saved_errno;
+    return result;
+  }
+
+  /// time the @p call which opens @p path (and returns a descriptor, or -1)
+  template<typename Call>
+  int opening(const char* path, Call&& call)
+  {
+    const uint64_t t_start = now();
+    const int fd = call();
+    const uint64_t ns = now() - t_start;
+    const int saved_errno = errno;
+    count(IoOperation::OPEN, ns);
+    if (fd >= 0)
+    {
+      File& file = g_files[resolve(fd)];
+      add(file.opens, 1);
+      add(file.time_ns, ns);
+    }
+    else
+    {
+      add(g_totals.failed_opens, 1);
+      File& file = g_files[intern(path ? path : "(null)")];
+      add(file.failed_opens, 1);
+      add(file.time_ns, ns);
+    }
+    errno = saved_errno;
+    return fd;
+  }
+
+  /// a successful mmap() of @p length bytes of @p fd
+  void onMap(const int fd, const size_t length)
+  {
+    const int saved_errno = errno;
+    add(g_totals.mmaps, 1);
+    add(g_totals.mmap_bytes, length);
+    File& file = fileOf(fd);
+    add(file.mmaps, 1);
+    add(file.mmap_bytes, length);
+    errno = saved_errno;
+  }
+
+  /// in the child of fork(), the I/O of the parent is gone (but its descriptors and their paths are inherited)
+  void resetAfterFork()
+  {
+    std::memset(static_cast<void*>(&g_totals), 0, sizeof(g_totals));
+    const uint32_t count = g_file_count.load(std::memory_order_relaxed);
+    for (uint32_t i = 1; i < count; ++i)
+    {
+      File& file = g_files[i];
+      for (auto* counter : { &file.opens, &file.failed_opens, &file.reads, &file.read_bytes, &file.writes, &file.write_bytes, &file.time_ns, &file.mmaps, &file.mmap_bytes })
+      {
+        counter->store(0, std::memory_order_relaxed);
+      }
+    }
+    pthread_mutex_init(&g_mutex, nullptr);
+  }
+
+  void* mapMemory(const size_t bytes)
+  {
+    void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  /// the value of @p key (e.g. 'rchar: ') in the contents of /proc/self/io
+  uint64_t parseProcIo(const char* text, const char* key)
+  {
+    const char* line = std::strstr(text, key);
+    return line ? std::strtoull(line + std::strlen(key), nullptr, 10) : 0;
+  }
+
+  IoFileStat toStat(const File& file)
+  {
+    IoFileStat stat;
+    stat.opens = file.opens.load(std::memory_order_relaxed);
+    stat.failed_opens = file.failed_opens.load(std::memory_order_relaxed);
+    stat.reads = file.reads.load(std::memory_order_relaxed);
+    stat.read_bytes = file.read_bytes.load(std::memory_order_relaxed);
+    stat.writes = file.writes.load(std::memory_order_relaxed);
+    stat.write_bytes = file.write_bytes.load(std::memory_order_relaxed);
+    stat.time_ns = file.time_ns.load(std::memory_order_relaxed);
+    stat.mmaps = file.mmaps.load(std::memory_order_relaxed);
+    stat.mmap_bytes = file.mmap_bytes.load(std::memory_order_relaxed);
+    const char* path = g_paths + file.path;
+    if (file.length < sizeof(stat.path))
+    {
+      std::memcpy(stat.path, path, file.length + 1);
+    }
+    else
+    { // keep the end, which tells more
+      std::memcpy(stat.path, "...", 3);
+      std::memcpy(stat.path + 3, path + file.length - (sizeof(stat.path) - 4), sizeof(stat.path) - 4);
+      stat.path[sizeof(stat.path) - 1] = '\0';
+    }
+    return stat;
+  }
+}
+
+void WinTime::IoProfile::init()
+{
+  const char* io = getenv(s_env_io);
+  if (io == nullptr || *io == '\0' || *io == '0') return;
+  g_fds = static_cast<std::atomic<uint32_t>*>(mapMemory(MAX_FDS * sizeof(std::atomic<uint32_t>)));
+  g_files = static_cast<File*>(mapMemory(MAX_FILES * sizeof(File)));
+  g_file_index = static_cast<uint32_t*>(mapMemory(2 * MAX_FILES * sizeof(uint32_t)));
+  g_paths = static_cast<char*>(mapMemory(PATH_BYTES));
+  if (!g_fds || !g_files || !g_file_index || !g_paths) return;
+  intern("(other)"); // == OTHER
+  pthread_atfork(nullptr, nullptr, resetAfterFork);
+  g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void WinTime::IoProfile::stop()
+{
+  if (!isEnabled()) return;
+  g_enabled.store(false, std::memory_order_relaxed);
+  for (size_t op = 0; op < IO_OPERATIONS; ++op)
+  {
+    g_final.calls[op] = g_totals.calls[op].load(std::memory_order_relaxed);
+    g_final.bytes[op] = g_totals.bytes[op].load(std::memory_order_relaxed);
+    g_final.time_ns[op] = g_totals.time_ns[op].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < IO_LATENCY_BUCKETS; ++i) g_final.latency[op][i] = g_totals.latency[op][i].load(std::memory_order_relaxed);
+  }
+  g_final.failed_opens = g_totals.failed_opens.load(std::memory_order_relaxed);
+  g_final.mmaps = g_totals.mmaps.load(std::memory_order_relaxed);
+  g_final.mmap_bytes = g_totals.mmap_bytes.load(std::memory_order_relaxed);
+  char text[1024];
+  const int fd = __open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+  const ssize_t length = __read(fd, text, sizeof(text) - 1);
+  __close(fd);
+  if (length <= 0) return;
+  text[length] = '\0';
+  g_final.proc_rchar = parseProcIo(text, "rchar: ");
+  g_final.proc_wchar = parseProcIo(text, "wchar: ");
+  g_final.proc_syscr = parseProcIo(text, "syscr: ");
+  g_final.proc_syscw = parseProcIo(text, "syscw: ");
+  g_final.proc_read_bytes = parseProcIo(text, "\nread_bytes: ");
+  g_final.proc_write_bytes = parseProcIo(text, "\nwrite_bytes: ");
+}
+
+void WinTime::IoProfile::write(ReportClient& client)
+{
+  if (g_files == nullptr) return;
+  const uint32_t count = g_file_count.load(std::memory_order_acquire);
+  // the top files by time and by bytes (a file may be in both)
+  const size_t bytes = count * sizeof(uint32_t) + 2 * IO_FILES_MAX * sizeof(IoFileStat);
+  void* memory = mapMemory(bytes);
+  if (memory == nullptr) return;
+  uint32_t* order = static_cast<uint32_t*>(memory);
+  IoFileStat* stats = reinterpret_cast<IoFileStat*>(order + count);
+  size_t used = 0;
+  for (uint32_t i = 1; i < count; ++i)
+  {
+    const File& file = g_files[i];
+    if (file.time_ns.load(std::memory_order_relaxed) != 0 || file.mmaps.load(std::memory_order_relaxed) != 0) order[used++] = i;
+  }
+  size_t top = 0;
+  const auto time = [](uint32_t a, uint32_t b) { return g_files[a].time_ns.load(std::memory_order_relaxed) > g_files[b].time_ns.load(std::memory_order_relaxed); };
+  const auto volume = [](uint32_t a, uint32_t b) {
+    const auto sum = [](const File& f) { return f.read_bytes.load(std::memory_order_relaxed) + f.write_bytes.load(std::memory_order_relaxed) + f.mmap_bytes.load(std::memory_order_relaxed); };
+    return sum(g_files[a]) > sum(g_files[b]);
+  };
+  const size_t n = std::min(used, IO_FILES_MAX);
+  std::partial_sort(order, order + n, order + used, time);
+  for (size_t i = 0; i < n; ++i)
+  {
+    stats[top++] = toStat(g_files[order[i]]);
+    order[i] |= 0x80000000u; // taken
+  }
+  std::partial_sort(order, order + n, order + used, [&volume](uint32_t a, uint32_t b) { return volume(a & 0x7FFFFFFFu, b & 0x7FFFFFFFu); });
+  for (size_t i = 0; i < n; ++i)
+  {
+    if ((order[i] & 0x80000000u) == 0) stats[top++] = toStat(g_files[order[i]]);
+  }
+
+  if (client.send(ReportType::IO_COUNTERS, &g_final, sizeof(g_final)))
+  {
+    client.send(ReportType::IO_FILES, stats, top * sizeof(IoFileStat));
+  }
+  else
+  {
+    const auto read = size_t(IoOperation::READ), write = size_t(IoOperation::WRITE);
+    std::fprintf(stderr, "WinTime heap hook: %llu opens (%llu failed), %llu reads of %llu bytes in %.6f s, %llu writes of %llu bytes in %.6f s (/proc/self/io: %llu bytes read, %llu written)\n",
+                 (unsigned long long)g_final.calls[size_t(IoOperation::OPEN)], (unsigned long long)g_final.failed_opens,
+                 (unsigned long long)g_final.calls[read], (unsigned long long)g_final.bytes[read], double(g_final.time_ns[read]) * 1e-9,
+                 (unsigned long long)g_final.calls[write], (unsigned long long)g_final.bytes[write], double(g_final.time_ns[write]) * 1e-9,
+                 (unsigned long long)g_final.proc_rchar, (unsigned long long)g_final.proc_wchar);
+    for (size_t i = 0; i < std::min(n, size_t(10)); ++i)
+    {
+      std::fprintf(stderr, "  %12.6f s %8llu reads %12llu bytes %8llu writes %12llu bytes  %s\n", double(stats[i].time_ns) * 1e-9, (unsigned long long)stats[i].reads,
+                   (unsigned long long)stats[i].read_bytes, (unsigned long long)stats[i].writes, (unsigned long long)stats[i].write_bytes, stats[i].path);
+    }
+  }
+  munmap(memory, bytes);
+}
+
+WINTIME_EXPORT int open(const char* path, int flags, ...)
+{
+  mode_t mode = 0;
+  if (__OPEN_NEEDS_MODE(flags))
+  {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (!isEnabled()) return __open(path, flags, mode);
+  return opening(path, [&] { return __open(path, flags, mode); });
+}
+
+WINTIME_EXPORT int open64(const char* path, int flags, ...)
+{
+  mode_t mode = 0;
+  if (__OPEN_NEEDS_MODE(flags))
+  {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (!isEnabled()) return __open64(path, flags, mode);
+  return opening(path, [&] { return __open64(path, flags, mode); });
+}
+
+WINTIME_EXPORT int __open_2(const char* path, int flags)
+{
+  if (!isEnabled()) return next(r_open_2, "__open_2")(path, flags);
+  return opening(path, [&] { return next(r_open_2, "__open_2")(path, flags); });
+}
+
+WINTIME_EXPORT int __open64_2(const char* path, int flags)
+{
+  if (!isEnabled()) return next(r_open64_2, "__open64_2")(path, flags);
+  return opening(path, [&] { return next(r_open64_2, "__open64_2")(path, flags); });
+}
+
+WINTIME_EXPORT int openat(int dirfd, const char* path, int flags, ...)
+{
+  mode_t mode = 0;
+  if (__OPEN_NEEDS_MODE(flags))
+  {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (!isEnabled()) return next(r_openat, "openat")(dirfd, path, flags, mode);
+  return opening(path, [&] { return next(r_openat, "openat")(dirfd, path, flags, mode); });
+}
+
+WINTIME_EXPORT int openat64(int dirfd, const char* path, int flags, ...)
+{
+  mode_t mode = 0;
+  if (__OPEN_NEEDS_MODE(flags))
+  {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  if (!isEnabled()) return next(r_openat64, "openat64")(dirfd, path, flags, mode);
+  return opening(path, [&] { return next(r_openat64, "openat64")(dirfd, path, flags, mode); });
+}
+
+WINTIME_EXPORT int __openat_2(int dirfd, const char* path, int flags)
+{
+  if (!isEnabled()) return next(r_openat_2, "__openat_2")(dirfd, path, flags);
+  return opening(path, [&] { return next(r_openat_2, "__openat_2")(dirfd, path, flags); });
+}
+
+WINTIME_EXPORT int __openat64_2(int dirfd, const char* path, int flags)
+{
+  if (!isEnabled()) return next(r_openat64_2, "__openat64_2")(dirfd, path, flags);
+  return opening(path, [&] { return next(r_openat64_2, "__openat64_2")(dirfd, path, flags); });
+}
+
+WINTIME_EXPORT int creat(const char* path, mode_t mode)
+{
+  return open(path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+}
+
+WINTIME_EXPORT int creat64(const char* path, mode_t mode)
+{
+  return open64(path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+}
+
+WINTIME_EXPORT FILE* fopen(const char* path, const char* mode)
+{
+  if (!isEnabled()) return next(r_fopen, "fopen")(path, mode);
+  FILE* stream = nullptr;
+  opening(path, [&] {
+    stream = next(r_fopen, "fopen")(path, mode);
+    return stream ? fileno(stream) : -1;
+  });
+  return stream;
+}
+
+WINTIME_EXPORT FILE* fopen64(const char* path, const char* mode)
+{
+  if (!isEnabled()) return next(r_fopen64, "fopen64")(path, mode);
+  FILE* stream = nullptr;
+  opening(path, [&] {
+    stream = next(r_fopen64, "fopen64")(path, mode);
+    return stream ? fileno(stream) : -1;
+  });
+  return stream;
+}
+
+WINTIME_EXPORT int fclose(FILE* stream)
+{
+  if (stream != nullptr) forget(fileno(stream));
+  return next(r_fclose, "fclose")(stream);
+}
+
+WINTIME_EXPORT int close(int fd)
+{
+  forget(fd);
+  return __close(fd);
+}
+
+WINTIME_EXPORT int dup2(int old_fd, int new_fd)
+{
+  const int result = next(r_dup2, "dup2")(old_fd, new_fd);
+  if (result >= 0 && new_fd != old_fd) forget(new_fd);
+  return result;
+}
+
+WINTIME_EXPORT int dup3(int old_fd, int new_fd, int flags)
+{
+  const int result = next(r_dup3, "dup3")(old_fd, new_fd, flags);
+  if (result >= 0) forget(new_fd);
+  return result;
+}
+
+WINTIME_EXPORT ssize_t read(int fd, void* buffer, size_t count)
+{
+  if (!isEnabled()) return __read(fd, buffer, count);
+  return transfer(fd, IoOperation::READ, [&] { return __read(fd, buffer, count); });
+}
+
+WINTIME_EXPORT ssize_t __read_chk(int fd, void* buffer, size_t count, size_t buffer_size)
+{
+  if (!isEnabled()) return next(r_read_chk, "__read_chk")(fd, buffer, count, buffer_size);
+  return transfer(fd, IoOperation::READ, [&] { return next(r_read_chk, "__read_chk")(fd, buffer, count, buffer_size); });
+}
+
+WINTIME_EXPORT ssize_t pread(int fd, void* buffer, size_t count, off_t offset)
+{
+  if (!isEnabled()) return __pread64(fd, buffer, count, offset);
+  return transfer(fd, IoOperation::READ, [&] { return __pread64(fd, buffer, count, offset); });
+}
+
+WINTIME_EXPORT ssize_t pread64(int fd, void* buffer, size_t count, off64_t offset)
+{
+  if (!isEnabled()) return __pread64(fd, buffer, count, offset);
+  return transfer(fd, IoOperation::READ, [&] { return __pread64(fd, buffer, count, offset); });
+}
+
+WINTIME_EXPORT ssize_t __pread_chk(int fd, void* buffer, size_t count, off_t offset, size_t buffer_size)
+{
+  if (!isEnabled()) return next(r_pread_chk, "__pread_chk")(fd, buffer, count, offset, buffer_size);
+  return transfer(fd, IoOperation::READ, [&] { return next(r_pread_chk, "__pread_chk")(fd, buffer, count, offset, buffer_size); });
+}
+
+WINTIME_EXPORT ssize_t __pread64_chk(int fd, void* buffer, size_t count, off64_t offset, size_t buffer_size)
+{
+  if (!isEnabled()) return next(r_pread64_chk, "__pread64_chk")(fd, buffer, count, offset, buffer_size);
+  return transfer(fd, IoOperation::READ, [&] { return next(r_pread64_chk, "__pread64_chk")(fd, buffer, count, offset, buffer_size); });
+}
+
+WINTIME_EXPORT ssize_t readv(int fd, const iovec* iov, int count)
+{
+  if (!isEnabled()) return next(r_readv, "readv")(fd, iov, count);
+  return transfer(fd, IoOperation::READ, [&] { return next(r_readv, "readv")(fd, iov, count); });
+}
+
+WINTIME_EXPORT ssize_t write(int fd, const void* buffer, size_t count)
+{
+  if (!isEnabled()) return __write(fd, buffer, count);
+  return transfer(fd, IoOperation::WRITE, [&] { return __write(fd, buffer, count); });
+}
+
+WINTIME_EXPORT ssize_t pwrite(int fd, const void* buffer, size_t count, off_t offset)
+{
+  if (!isEnabled()) return __pwrite64(fd, buffer, count, offset);
+  return transfer(fd, IoOperation::WRITE, [&] { return __pwrite64(fd, buffer, count, offset); });
+}
+
+WINTIME_EXPORT ssize_t pwrite64(int fd, const void* buffer, size_t count, off64_t offset)
+{
+  if (!isEnabled()) return __pwrite64(fd, buffer, count, offset);
+  return transfer(fd, IoOperation::WRITE, [&] { return __pwrite64(fd, buffer, count, offset); });
+}
+
+WINTIME_EXPORT ssize_t writev(int fd, const iovec* iov, int count)
+{
+  if (!isEnabled()) return next(r_writev, "writev")(fd, iov, count);
+  return transfer(fd, IoOperation::WRITE, [&] { return next(r_writev, "writev")(fd, iov, count); });
+}
+
+WINTIME_EXPORT ssize_t copy_file_range(int in_fd, off64_t* in_offset, int out_fd, off64_t* out_offset, size_t length, unsigned flags)
+{
+  if (!isEnabled()) return next(r_copy_file_range, "copy_file_range")(in_fd, in_offset, out_fd, out_offset, length, flags);
+  return copying(in_fd, out_fd, [&] { return next(r_copy_file_range, "copy_file_range")(in_fd, in_offset, out_fd, out_offset, length, flags); });
+}
+
+WINTIME_EXPORT ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count)
+{
+  if (!isEnabled()) return next(r_sendfile, "sendfile")(out_fd, in_fd, offset, count);
+  return copying(in_fd, out_fd, [&] { return next(r_sendfile, "sendfile")(out_fd, in_fd, offset, count); });
+}
+
+WINTIME_EXPORT ssize_t sendfile64(int out_fd, int in_fd, off64_t* offset, size_t count)
+{
+  if (!isEnabled()) return next(r_sendfile64, "sendfile64")(out_fd, in_fd, offset, count);
+  return copying(in_fd, out_fd, [&] { return next(r_sendfile64, "sendfile64")(out_fd, in_fd, offset, count); });
+}
+
+WINTIME_EXPORT void* mmap(void* address, size_t length, int protection, int flags, int fd, off_t offset)
+{
+  void* result = next(r_mmap, "mmap")(address, length, protection, flags, fd, offset);
+  if (isEnabled() && result != MAP_FAILED && fd >= 0 && (flags & MAP_ANONYMOUS) == 0) onMap(fd, length);
+  return result;
+}
+
+WINTIME_EXPORT void* mmap64(void* address, size_t length, int protection, int flags, int fd, off64_t offset)
+{
+  void* result = next(r_mmap64, "mmap64")(address, length, protection, flags, fd, offset);
+  if (isEnabled() && result != MAP_FAILED && fd >= 0 && (flags & MAP_ANONYMOUS) == 0) onMap(fd, length);
+  return result;
+}
+
+#endif
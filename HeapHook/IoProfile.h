@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+namespace WinTime
+{
+  class ReportClient;
+
+  /**
+    @brief The I/O profiler of the heap hook (see --io)
+
+    The POSIX I/O calls (open/openat/creat/fopen, read/pread/readv, write/pwrite/writev, copy_file_range/sendfile, mmap, and the _FORTIFY_SOURCE variants) are interposed,
+    timed and attributed to the file of their descriptor. A descriptor is resolved to its path via /proc/self/fd once (when it is opened, or on its
+    first use if it was inherited or opened behind our back) and cached until it is closed; failed opens are counted by the path given.
+    Counters are relaxed atomics, per file and in total; only interning a new path takes a lock.
+    At exit, the totals (with /proc/self/io as a cross-check) and the top files by time and by bytes are sent to WinTime.
+
+    I/O within glibc (e.g. fread(), fwrite() and printf() through the stdio buffers) and of static code is not seen; /proc/self/io still counts it.
+  */
+  namespace IoProfile
+  {
+    /// read the configuration from the environment (s_env_io); profiling is off unless it is set
+    void init();
+
+    /// stop profiling and take the final counters (incl. /proc/self/io); to be called before the hook does I/O of its own at exit
+    void stop();
+
+    /// send the counters taken by stop() (if profiling was on) via @p client (or print them to STDERR if it is not connected)
+    void write(ReportClient& client);
+  }
+
+} // namespace
+
+#endif
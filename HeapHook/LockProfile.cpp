@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "LockProfile.h"
+
+#include "Interpose.h"
+#include "Locks.h"
+#include "ReportProtocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+
+namespace
+{
+  using namespace WinTime;
+
+  /// entries of the table of each thread; waits at further (lock, site) pairs are only counted in total
+  constexpr size_t TABLE_SIZE = 512;
+
+  /// entries probed before a wait counts as overflow
+  constexpr size_t MAX_PROBES = 32;
+
+  struct Entry
+  {
+    std::atomic<uintptr_t> lock;   ///< 0: empty; stored last (release), so the merge at exit sees complete keys
+    uintptr_t site;
+    LockKind kind;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> wait_ns;
+    std::atomic<uint64_t> max_wait_ns;
+  };
+
+  /// the waits of one thread: only written by that thread (relaxed atomics, i.e. plain loads and stores), read when the process exits
+  struct Table
+  {
+    Table* next;   ///< all tables of the process; never freed, so the waits of finished threads are kept
+    std::atomic<uint64_t> overflow_count[2];     ///< [0]: contention, [1]: condition waits
+    std::atomic<uint64_t> overflow_wait_ns[2];
+    Entry entries[TABLE_SIZE];
+  };
+
+  /// a merged entry
+  struct Wait
+  {
+    uintptr_t lock;   ///< 0 for the overflows
+    uintptr_t site;
+    LockKind kind;
+    uint64_t count;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+  };
+
+  std::atomic<bool> g_enabled{ false };
+  std::atomic<Table*> g_tables{ nullptr };
+  __thread Table* t_table __attribute__((tls_model("initial-exec"))) = nullptr;
+
+  std::atomic<int (*)(pthread_mutex_t*)> r_mutex_lock{ nullptr };
+  std::atomic<int (*)(pthread_mutex_t*)> r_mutex_trylock{ nullptr };
+  std::atomic<int (*)(pthread_rwlock_t*)> r_rwlock_rdlock{ nullptr };
+  std::atomic<int (*)(pthread_rwlock_t*)> r_rwlock_tryrdlock{ nullptr };
+  std::atomic<int (*)(pthread_rwlock_t*)> r_rwlock_wrlock{ nullptr };
+  std::atomic<int (*)(pthread_rwlock_t*)> r_rwlock_trywrlock{ nullptr };
+  std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> r_cond_wait{ nullptr };
+  std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*, const timespec*)> r_cond_timedwait{ nullptr };
+  std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*, clockid_t, const timespec*)> r_cond_clockwait{ nullptr };
+
+  inline uint64_t now()
+  {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000000000 + uint64_t(t.tv_nsec);
+  }
+
+  template<typename T>
+  inline void bump(std::atomic<T>& counter, T value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  /// the table of the calling thread (nullptr if out of memory)
+  Table* getTable()
+  {
+    if (t_table != nullptr) return t_table;
+    void* memory = mmap(nullptr, sizeof(Table), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    Table* table = static_cast<Table*>(memory);
+    table->next = g_tables.load(std::memory_order_relaxed);
+    while (!g_tables.compare_exchange_weak(table->next, table, std::memory_order_release, std::memory_order_relaxed)) {}
+    t_table = table;
+    return table;
+  }
+
+  /// the calling thread waited @p wait_ns for @p lock, called from @p site
+  void record(const void* lock, const void* site, const LockKind kind, const uint64_t wait_ns)
+  {
+    Table* table = getTable();
+    if (table == nullptr) return;
+    const uintptr_t key = uintptr_t(lock);
+    size_t slot = size_t(((key >> 3) ^ uintptr_t(site) ^ uint64_t(kind)) * 0x9E3779B97F4A7C15ull >> 40) & (TABLE_SIZE - 1);
+    for (size_t probe = 0; probe < MAX_PROBES; ++probe, slot = (slot + 1) & (TABLE_SIZE - 1))
+    {
+      Entry& entry = table->entries[slot];
+      const uintptr_t current = entry.lock.load(std::memory_order_relaxed);
+      if (current == 0)
+      {
+        entry.site = uintptr_t(site);
+        entry.kind = kind;
+        entry.lock.store(key, std::memory_order_release);
+      }
+      else if (current != key || entry.site != uintptr_t(site) || entry.kind != kind)
+      {
+        continue;
+      }
+      bump(entry.count, uint64_t(1));
+      bump(entry.wait_ns, wait_ns);
+      if (wait_ns > entry.max_wait_ns.load(std::memory_order_relaxed)) entry.max_wait_ns.store(wait_ns, std::memory_order_relaxed);
+      return;
+    }
+    const size_t overflow = kind == LockKind::CONDITION;
+    bump(table->overflow_count[overflow], uint64_t(1));
+    bump(table->overflow_wait_ns[overflow], wait_ns);
+  }
+
+  /// in the child of fork(), the waits of the parent are gone
+  void resetAfterFork()
+  {
+    for (Table* table = g_tables.load(std::memory_order_relaxed); table != nullptr; table = table->next)
+    {
+      std::memset(static_cast<void*>(table->entries), 0, sizeof(table->entries));
+      for (size_t overflow = 0; overflow < 2; ++overflow)
+      {
+        table->overflow_count[overflow].store(0, std::memory_order_relaxed);
+        table->overflow_wait_ns[overflow].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// describe @p address for humans: 'symbol+0x12', or 'module+0x1234' (the address in the file, as addr2line takes it), or the plain address
+  void describe(const uintptr_t address, char* out, const size_t size)
+  {
+    if (address == 0)
+    {
+      std::snprintf(out, size, "(other)");
+      return;
+    }
+    Dl_info info;
+    link_map* map = nullptr;
+    if (dladdr1(reinterpret_cast<void*>(address), &info, reinterpret_cast<void**>(&map), RTLD_DL_LINKMAP) == 0 || info.dli_fname == nullptr)
+    {
+      std::snprintf(out, size, "%#llx", (unsigned long long)address);
+    }
+    else if (info.dli_sname != nullptr && info.dli_saddr != nullptr)
+    {
+      std::snprintf(out, size, "%s+%#llx", info.dli_sname, (unsigned long long)(address - uintptr_t(info.dli_saddr)));
+    }
+    else
+    {
+      const char* slash = std::strrchr(info.dli_fname, '/');
+      const char* module = slash ? slash + 1 : info.dli_fname;
+      if (*module == '\0') module = program_invocation_short_name; // the executable has an empty name
+      std::snprintf(out, size, "%s+%#llx", module, (unsigned long long)(address - (map ? map->l_addr : 0)));
+    }
+  }
+}
+
+void WinTime::LockProfile::init()
+{
+  const char* locks = getenv(s_env_locks);
+  if (locks == nullptr || *locks == '\0' || *locks == '0') return;
+  pthread_atfork(nullptr, nullptr, resetAfterFork);
+  g_enabled.store(true, std::memory_order_relaxed);
+}
+
+void WinTime::LockProfile::write(ReportClient& client)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return;
+  g_enabled.store(false, std::memory_order_relaxed); // no more waits from here on
+  size_t used = 2; // the overflows
+  for (Table* table = g_tables.load(std::memory_order_acquire); table != nullptr; table = table->next)
+  {
+    for (const Entry& entry : table->entries) used += entry.lock.load(std::memory_order_acquire) != 0;
+  }
+  void* memory = mmap(nullptr, used * sizeof(Wait), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return;
+  Wait* waits = static_cast<Wait*>(memory);
+  waits[1].kind = LockKind::CONDITION;
+  size_t count = 2;
+  for (Table* table = g_tables.load(std::memory_order_acquire); table != nullptr; table = table->next)
+  {
+    for (size_t overflow = 0; overflow < 2; ++overflow)
+    {
+      waits[overflow].count += table->overflow_count[overflow].load(std::memory_order_relaxed);
+      waits[overflow].wait_ns += table->overflow_wait_ns[overflow].load(std::memory_order_relaxed);
+    }
+    for (const Entry& entry : table->entries)
+    {
+      const uintptr_t lock = entry.lock.load(std::memory_order_acquire);
+      if (lock == 0 || count == used) continue; // (a thread may still add entries)
+      waits[count++] = Wait{ lock, entry.site, entry.kind, entry.count.load(std::memory_order_relaxed), entry.wait_ns.load(std::memory_order_relaxed),
+                             entry.max_wait_ns.load(std::memory_order_relaxed) };
+    }
+  }
+  // merge the entries of all threads
+  std::sort(waits + 2, waits + count, [](const Wait& a, const Wait& b) {
+    return a.lock != b.lock ? a.lock < b.lock : a.site != b.site ? a.site < b.site : a.kind < b.kind;
+  });
+  size_t merged = 2;
+  for (size_t i = 2; i < count; ++i)
+  {
+    Wait& last = waits[merged - 1];
+    if (merged > 2 && last.lock == waits[i].lock && last.site == waits[i].site && last.kind == waits[i].kind)
+    {
+      last.count += waits[i].count;
+      last.wait_ns += waits[i].wait_ns;
+      last.max_wait_ns = std::max(last.max_wait_ns, waits[i].max_wait_ns);
+    }
+    else
+    {
+      waits[merged++] = waits[i];
+    }
+  }
+  merged = size_t(std::remove_if(waits, waits + merged, [](const Wait& w) { return w.count == 0; }) - waits); // unused overflows
+  // contention first: condition waits are mostly idle threads, whose long waits would crowd out the contended locks
+  const size_t top = std::min(merged, LOCK_STATS_MAX);
+  std::partial_sort(waits, waits + top, waits + merged, [](const Wait& a, const Wait& b) {
+    const bool a_condition = a.kind == LockKind::CONDITION, b_condition = b.kind == LockKind::CONDITION;
+    return a_condition != b_condition ? b_condition : a.wait_ns > b.wait_ns;
+  });
+
+  LockStat stats[LOCK_STATS_MAX];
+  for (size_t i = 0; i < top; ++i)
+  {
+    stats[i].kind = waits[i].kind;
+    stats[i].count = waits[i].count;
+    stats[i].wait_ns = waits[i].wait_ns;
+    stats[i].max_wait_ns = waits[i].max_wait_ns;
+    describe(waits[i].lock, stats[i].lock, sizeof(stats[i].lock));
+    describe(waits[i].site, stats[i].site, sizeof(stats[i].site));
+  }
+  munmap(memory, used * sizeof(Wait));
+  if (client.send(ReportType::LOCK_CONTENTION, stats, top * sizeof(LockStat))) return;
+  std::fprintf(stderr, "WinTime heap hook: %zu locks waited for (longest total wait first, condition waits last)\n", top);
+  for (size_t i = 0; i < std::min(top, size_t(10)); ++i)
+  {
+    std::fprintf(stderr, "  %12.6f s %10llu x  %-5s %s at %s\n", double(stats[i].wait_ns) * 1e-9, (unsigned long long)stats[i].count, toString(stats[i].kind),
+                 stats[i].lock, stats[i].site);
+  }
+}
+
+int WinTime::LockProfile::lockUntimed(pthread_mutex_t* mutex)
+{
+  return next(r_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+WINTIME_EXPORT int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_mutex_lock, "pthread_mutex_lock")(mutex);
+  // EBUSY: someone else holds it (for other results, e.g. of robust mutexes, trylock is as good as lock)
+  const int result = next(r_mutex_trylock, "pthread_mutex_trylock")(mutex);
+  if (result != EBUSY) return result;
+  const uint64_t t_start = now();
+  const int locked = next(r_mutex_lock, "pthread_mutex_lock")(mutex);
+  record(mutex, __builtin_return_address(0), LockKind::MUTEX, now() - t_start);
+  return locked;
+}
+
+WINTIME_EXPORT int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_rwlock_rdlock, "pthread_rwlock_rdlock")(rwlock);
+  const int result = next(r_rwlock_tryrdlock, "pthread_rwlock_tryrdlock")(rwlock);
+  if (result != EBUSY) return result;
+  const uint64_t t_start = now();
+  const int locked = next(r_rwlock_rdlock, "pthread_rwlock_rdlock")(rwlock);
+  record(rwlock, __builtin_return_address(0), LockKind::READ, now() - t_start);
+  return locked;
+}
+
+WINTIME_EXPORT int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_rwlock_wrlock, "pthread_rwlock_wrlock")(rwlock);
+  const int result = next(r_rwlock_trywrlock, "pthread_rwlock_trywrlock")(rwlock);
+  if (result != EBUSY) return result;
+  const uint64_t t_start = now();
+  const int locked = next(r_rwlock_wrlock, "pthread_rwlock_wrlock")(rwlock);
+  record(rwlock, __builtin_return_address(0), LockKind::WRITE, now() - t_start);
+  return locked;
+}
+
+WINTIME_EXPORT int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_cond_wait, "pthread_cond_wait")(cond, mutex);
+  const uint64_t t_start = now();
+  const int result = next(r_cond_wait, "pthread_cond_wait")(cond, mutex);
+  record(cond, __builtin_return_address(0), LockKind::CONDITION, now() - t_start);
+  return result;
+}
+
+WINTIME_EXPORT int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const timespec* abstime)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_cond_timedwait, "pthread_cond_timedwait")(cond, mutex, abstime);
+  const uint64_t t_start = now();
+  const int result = next(r_cond_timedwait, "pthread_cond_timedwait")(cond, mutex, abstime);
+  record(cond, __builtin_return_address(0), LockKind::CONDITION, now() - t_start);
+  return result;
+}
+
+WINTIME_EXPORT int pthread_cond_clockwait(pthread_cond_t* cond, pthread_mutex_t* mutex, clockid_t clock, const timespec* abstime)
+{
+  if (!g_enabled.load(std::memory_order_relaxed)) return next(r_cond_clockwait, "pthread_cond_clockwait")(cond, mutex, clock, abstime);
+  const uint64_t t_start = now();
+  const int result = next(r_cond_clockwait, "pthread_cond_clockwait")(cond, mutex, clock, abstime);
+  record(cond, __builtin_return_address(0), LockKind::CONDITION, now() - t_start);
+  return result;
+}
+
+#endif
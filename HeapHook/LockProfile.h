@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+namespace WinTime
+{
+  class ReportClient;
+
+  /**
+    @brief The lock profiler of the heap hook (see --locks)
+
+    pthread_mutex_lock(), pthread_rwlock_rdlock()/wrlock() and the condition waits are interposed. A lock is first tried without
+    waiting; only if that fails, the wait for it is timed, so uncontended locking costs one more branch and nothing else.
+    Each thread aggregates its waits by lock address, call site (the return address) and kind in a table of its own, without locks;
+    all tables are merged when the process exits, and the call sites and locks are resolved to symbols or 'module+offset' (as addr2line takes it).
+  */
+  namespace LockProfile
+  {
+    /// read the configuration from the environment (s_env_locks); profiling is off unless it is set
+    void init();
+
+    /// send the waits with the longest total (if profiling is on) via @p client (or print them to STDERR if it is not connected)
+    void write(ReportClient& client);
+
+    /// lock @p mutex with the pthread_mutex_lock() of libc, i.e. untimed: for the hook's own locks, whose waits are not the target's
+    int lockUntimed(pthread_mutex_t* mutex);
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/*
+  The client of 'WinTime64 --daemon=SOCKET': runs COMMAND through the daemon, which measures (and logs) it.
+  COMMAND gets our argv, working directory, environment, STDIN, STDOUT and STDERR, so the client can be put
+  in front of each compiler call of a build system (e.g. as a compiler launcher), like WinTime itself, at the cost of one socket round trip.
+
+  Usage: wintime-client [--socket SOCKET] [-v] [--] COMMAND [ARG...]
+  SOCKET defaults to $WINTIME_SOCKET. With -v, a summary of the run is printed to STDERR.
+  The exit code is that of COMMAND (128 + signal number if it was killed), or 125 if the daemon could not run it.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "DaemonProtocol.h"
+
+extern char** environ;
+
+using namespace WinTime;
+
+namespace
+{
+  int usage()
+  {
+    std::cerr << "Usage: wintime-client [--socket SOCKET] [-v] [--] COMMAND [ARG...]\n"
+                 "       SOCKET defaults to $WINTIME_SOCKET\n";
+    return 125;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const char* env_socket = getenv("WINTIME_SOCKET");
+  std::string socket_path = env_socket ? env_socket : "";
+  bool verbose = false;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i)
+  {
+    const std::string arg = argv[i];
+    if (arg == "--")
+    {
+      ++i;
+      break;
+    }
+    if (arg == "--socket" && i + 1 < argc) socket_path = argv[++i];
+    else if (arg == "-v") verbose = true;
+    else return usage();
+  }
+  if (i == argc || socket_path.empty()) return usage();
+
+  DaemonRequest request;
+  request.argv.assign(argv + i, argv + argc);
+  for (char** e = environ; *e != nullptr; ++e) request.env.emplace_back(*e);
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) == nullptr)
+  {
+    std::cerr << "wintime-client: could not get the working directory: " << std::strerror(errno) << '\n';
+    return 125;
+  }
+  request.cwd = cwd;
+
+  try
+  {
+    const DaemonReply reply = runViaDaemon(socket_path, request);
+    if (reply.error != 0)
+    {
+      std::cerr << "wintime-client: could not run '" << request.argv.front() << "': " << std::strerror(reply.error) << '\n';
+      return 125;
+    }
+    if (verbose)
+    {
+      std::fprintf(stderr, "wall %.3fs, user %.3fs, kernel %.3fs, peak RSS %llu KiB, exit code %d\n",
+                   reply.times.t_wall_ns / 1e9, reply.times.t_user_ns / 1e9, reply.times.t_kernel_ns / 1e9,
+                   (unsigned long long)(reply.memory.peak_rss / 1024), reply.exit_code);
+    }
+    return reply.exit_code;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "wintime-client: " << e.what() << '\n';
+    return 125;
+  }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WINTIME_SCAN_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace WinTime
+{
+  /// index of the lowest set bit of @p mask (which must not be 0)
+  inline int lowestBit(const uint32_t mask)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+  /// The first tab or newline in [pos, end), or @p end if there is none.
+  /// Compares 16 bytes at a time (SSE2, which every x86-64 CPU has), with a scalar loop for the tail and other CPUs.
+  inline const char* findDelimiter(const char* pos, const char* end)
+  {
+#ifdef WINTIME_SCAN_SSE2
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - pos >= 16; pos += 16)
+    {
+      const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+      const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, tab), _mm_cmpeq_epi8(chunk, newline)));
+      if (mask) return pos + lowestBit(uint32_t(mask));
+    }
+#endif
+    for (; pos < end; ++pos)
+    {
+      if (*pos == '\t' || *pos == '\n') return pos;
+    }
+    return end;
+  }
+
+  /// The first newline in [pos, end), or @p end if there is none (memchr() is vectorized by the C library)
+  inline const char* findNewline(const char* pos, const char* end)
+  {
+    const void* nl = std::memchr(pos, '\n', size_t(end - pos));
+    return nl ? static_cast<const char*>(nl) : end;
+  }
+
+} // namespace
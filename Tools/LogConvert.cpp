@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+  Converts WinTime logs between the TSV and the binary format (see BinaryLog.h), describes binary logs,
+  and compacts TSV logs in place (replaces command lines by their hashes; see CommandIndex.h).
+
+  Usage: wintime-logconv to-binary IN.tsv OUT [--block-rows N (default: 65536)]
+         wintime-logconv to-tsv IN OUT.tsv      (OUT.tsv may be '-' for STDOUT)
+         wintime-logconv info IN
+         wintime-logconv compact LOG.tsv        (writes LOG.tsv.cmds.tsv and LOG.tsv.idx)
+  Rows of a TSV log whose number of cells differs from the header (e.g. logs written with different options)
+  are kept; their columns are named after the header as far as possible and 'column<N>' beyond.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinaryLog.h"
+#include "CommandIndex.h"
+#include "MappedFile.h"
+
+using namespace WinTime;
+
+namespace
+{
+  int usage()
+  {
+    std::cerr << "Usage: wintime-logconv to-binary IN.tsv OUT [--block-rows N]\n"
+                 "       wintime-logconv to-tsv IN OUT.tsv   (OUT.tsv may be '-')\n"
+                 "       wintime-logconv info IN\n"
+                 "       wintime-logconv compact LOG.tsv\n";
+    return 1;
+  }
+
+  /// column names for a row with @p cells cells
+  std::vector<std::string> namesFor(const std::vector<std::string>& header, const size_t cells)
+  {
+    std::vector<std::string> names(header.begin(), header.begin() + std::min(cells, header.size()));
+    while (names.size() < cells) names.push_back("column" + std::to_string(names.size() + 1));
+    return names;
+  }
+
+  int toBinary(const std::string& in_file, const std::string& out_file, const size_t block_rows)
+  {
+    const MappedFile in(in_file);
+    std::ofstream out(out_file, std::ios::binary);
+    if (!out)
+    {
+      std::cerr << "Could not create '" << out_file << "'.\n";
+      return 1;
+    }
+
+    std::vector<std::string> header;
+    std::vector<std::string> names;     // of the current block
+    std::vector<uint64_t> written;      // IDs of the schemas written so far
+    std::vector<std::vector<std::string>> rows;
+    size_t n_rows = 0;
+    const auto flush = [&]()
+    {
+      if (rows.empty()) return;
+      if (std::find(written.begin(), written.end(), schemaID(names)) == written.end())
+      {
+        out << encodeSchemaBlock(names);
+        written.push_back(schemaID(names));
+      }
+      out << encodeDataBlock(names, rows);
+      n_rows += rows.size();
+      rows.clear();
+    };
+
+    const std::string_view text(in.data(), in.size());
+    for (size_t start = 0; start < text.size();)
+    {
+      size_t end = text.find('\n', start);
+      if (end == std::string_view::npos) end = text.size();
+      std::string_view line = text.substr(start, end - start);
+      start = end + 1;
+      if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+      if (line.empty()) continue;
+
+      auto cells = splitCells(line, '\t');
+      if (header.empty())
+      {
+        header = std::move(cells);
+        continue;
+      }
+      if (cells.size() != names.size() || rows.size() == block_rows)
+      {
+        flush();
+        names = namesFor(header, cells.size());
+      }
+      rows.push_back(std::move(cells));
+    }
+    flush();
+    if (header.empty())
+    {
+      std::cerr << "'" << in_file << "' has no header.\n";
+      return 1;
+    }
+    if (n_rows == 0)
+    { // keep the header at least
+      out << encodeSchemaBlock(header) << encodeDataBlock(header, {});
+    }
+    std::cerr << "Converted " << n_rows << " rows.\n";
+    return out ? 0 : 1;
+  }
+
+  int toTSV(const std::string& in_file, const std::string& out_file)
+  {
+    const BinaryLogReader reader(in_file);
+    if (reader.isDamaged())
+    {
+      std::cerr << "Warning: '" << in_file << "' contains incomplete or damaged blocks; " << reader.getSkippedBytes() << " bytes were skipped.\n";
+    }
+    if (out_file == "-")
+    {
+      reader.writeTSV(std::cout);
+      return std::cout ? 0 : 1;
+    }
+    std::ofstream out(out_file, std::ios::binary);
+    if (!out)
+    {
+      std::cerr << "Could not create '" << out_file << "'.\n";
+      return 1;
+    }
+    reader.writeTSV(out);
+    return out ? 0 : 1;
+  }
+
+  int info(const std::string& in_file)
+  {
+    const BinaryLogReader reader(in_file);
+    std::cout << "blocks: " << reader.getBlocks().size() << '\n'
+              << "rows: " << reader.getRowCount() << '\n'
+              << "skipped bytes (damaged): " << reader.getSkippedBytes() << '\n';
+    // bytes and types per column name, over all blocks
+    std::vector<std::string> names;
+    std::vector<size_t> bytes;
+    std::vector<std::string> types;
+    for (const auto& block : reader.getBlocks())
+    {
+      for (size_t c = 0; c < block.columns.size(); ++c)
+      {
+        const std::string& name = (*block.names)[c];
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end())
+        {
+          names.push_back(name);
+          bytes.push_back(0);
+          types.push_back("");
+          it = names.end() - 1;
+        }
+        const size_t i = it - names.begin();
+        bytes[i] += block.columns[c].size;
+        const std::string type = toString(block.columns[c].type);
+        if (types[i].find(type) == std::string::npos) types[i] += (types[i].empty() ? "" : ",") + type;
+      }
+    }
+    std::cout << "column\ttypes\tbytes\n";
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+      std::cout << names[i] << '\t' << types[i] << '\t' << bytes[i] << '\n';
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const std::vector<std::string> args(argv + 1, argv + argc);
+  try
+  {
+    if (args.size() >= 3 && args[0] == "to-binary")
+    {
+      size_t block_rows = 65536;
+      if (args.size() == 5 && args[3] == "--block-rows") block_rows = std::max(1ul, std::stoul(args[4]));
+      else if (args.size() != 3) return usage();
+      return toBinary(args[1], args[2], block_rows);
+    }
+    if (args.size() == 3 && args[0] == "to-tsv") return toTSV(args[1], args[2]);
+    if (args.size() == 2 && args[0] == "info") return info(args[1]);
+    if (args.size() == 2 && args[0] == "compact")
+    {
+      compactLog(args[1]).print();
+      return 0;
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << '\n';
+    return 1;
+  }
+  return usage();
+}
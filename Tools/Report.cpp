@@ -0,0 +1,500 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+  Summarizes a WinTime log (TSV or binary): groups the rows by a key and reports count, mean, percentiles and maximum of a numeric column.
+
+  Usage: wintime-report LOG [--value COLUMN] [--group-by cmd|exe|COLUMN] [--sort count|sum|mean|p50|p95|p99|max] [--top N] [--threads N] [--tsv]
+         wintime-report LOG --history COMMAND [ARG...]
+    --value     the column to aggregate (default: wall_time); for human readable sizes (e.g. PeakWorkingSetSize), its '(bytes)' column is used
+    --group-by  'cmd' (default), 'exe' (the executable of the command line, without its directory), or any other column
+    --sort      order of the groups, largest first (default: p95)
+    --top       number of groups to report (default: 50; 0 for all)
+    --threads   number of threads (default: number of CPUs)
+    --tsv       print a table with plain numbers instead of the aligned, human readable one
+    --history   print all rows of COMMAND (looked up in the index of logs with hashed command lines, see CommandIndex.h)
+  e.g. "p95 wall time per executable":       wintime-report log.tsv --group-by exe --value wall_time
+       "top 50 commands by peak memory":     wintime-report log.tsv --value PeakWorkingSetSize --sort max
+
+  A TSV log is memory-mapped and split into one chunk per thread (and a few more for balance) at line boundaries.
+  Each thread finds the cells of its lines with a vectorized scan for tabs and newlines, skips the rest of a line
+  once it has the cells it needs, parses numbers with from_chars() and groups them in its own hash map. The maps are merged
+  and the percentiles computed in parallel at the end. Durations are in seconds; since the log has millisecond resolution,
+  each one is taken as the middle of its millisecond (like in binary logs).
+  If the log has hashed command lines ('cmd_hash'), they are restored from its dictionary for grouping by 'cmd' or 'exe'.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "BinaryLog.h"
+#include "CommandIndex.h"
+#include "FieldScanner.h"
+#include "MappedFile.h"
+#include "Memory.h"
+#include "Process.h"
+#include "Statistics.h"
+
+using namespace WinTime;
+
+namespace
+{
+  struct ReportOptions
+  {
+    std::string value{ "wall_time" };
+    std::string group_by{ "cmd" };
+    std::string sort{ "p95" };
+    size_t top{ 50 };
+    size_t threads{ std::max(1u, std::thread::hardware_concurrency()) };
+    bool tsv{ false };
+  };
+
+  using Groups = std::unordered_map<std::string_view, std::vector<double>>;
+
+  /// what one thread found
+  struct Partial
+  {
+    Groups groups;
+    std::deque<std::string> keys;  ///< storage for keys which are not part of the mapping (binary logs)
+    size_t rows{ 0 };
+    size_t skipped{ 0 };           ///< rows without a (numeric) value
+  };
+
+  /// aggregate of one group
+  struct GroupStats
+  {
+    std::string_view key;
+    size_t count{ 0 };
+    double sum{ 0 };
+    double mean{ 0 };
+    double p50{ 0 };
+    double p95{ 0 };
+    double p99{ 0 };
+    double max{ 0 };
+
+    double get(const std::string& what) const
+    {
+      if (what == "count") return double(count);
+      if (what == "sum") return sum;
+      if (what == "mean") return mean;
+      if (what == "p50") return p50;
+      if (what == "p95") return p95;
+      if (what == "p99") return p99;
+      return max;
+    }
+  };
+
+  /// the executable of a command line as printed to the log, without its directory, e.g. 'g++' for '"/usr/bin/g++" -c a.cpp'
+  std::string_view executableOf(std::string_view cmd)
+  {
+    if (!cmd.empty() && cmd.front() == '"')
+    {
+      cmd.remove_prefix(1);
+      cmd = cmd.substr(0, cmd.find('"'));
+    }
+    else
+    {
+      cmd = cmd.substr(0, cmd.find(' '));
+    }
+    const size_t slash = cmd.find_last_of("/\\");
+    return slash == std::string_view::npos ? cmd : cmd.substr(slash + 1);
+  }
+
+  /// the command line of a 'cmd_hash' cell (or the cell itself if @p dictionary is null or does not know it)
+  std::string_view restoreCommand(const std::string_view cell, const CommandDictionary* dictionary)
+  {
+    if (!dictionary) return cell;
+    const auto hash = parseHash(cell);
+    const std::string* cmd = hash ? dictionary->find(*hash) : nullptr;
+    return cmd ? std::string_view(*cmd) : cell;
+  }
+
+  /// the column to group by: 'cmd_hash' stands in for 'cmd' in logs with hashed command lines
+  std::string resolveKeyColumn(const std::vector<std::string>& names, const ReportOptions& options)
+  {
+    const std::string key = options.group_by == "exe" ? "cmd" : options.group_by;
+    if (key == Command::printHeader('\t') && std::find(names.begin(), names.end(), key) == names.end()) return CommandHash::printHeader('\t');
+    return key;
+  }
+
+  /// a duration as printed by toTimeDiffString(), e.g. ' 0 days, 00:00:01.250 (1.25 seconds)', in seconds
+  std::optional<double> parseDuration(std::string_view cell)
+  {
+    const char* pos = cell.data();
+    const char* end = pos + cell.size();
+    while (pos < end && *pos == ' ') ++pos;
+    // a number, followed by @p separator
+    const auto next = [&](int64_t& value, const std::string_view separator)
+    {
+      const auto [ptr, ec] = std::from_chars(pos, end, value);
+      if (ec != std::errc() || size_t(end - ptr) < separator.size() || std::string_view(ptr, separator.size()) != separator) return false;
+      pos = ptr + separator.size();
+      return true;
+    };
+    int64_t days, hours, minutes, seconds, msec;
+    if (!next(days, " days, ") || !next(hours, ":") || !next(minutes, ":") || !next(seconds, ".") || !next(msec, " ")) return std::nullopt;
+    return double(((days * 24 + hours) * 60 + minutes) * 60 + seconds) + (double(msec) + 0.5) / 1000;
+  }
+
+  std::optional<double> parseValue(std::string_view cell)
+  {
+    if (!cell.empty() && cell.back() == '\r') cell.remove_suffix(1);
+    double value;
+    const auto [ptr, ec] = std::from_chars(cell.data(), cell.data() + cell.size(), value);
+    if (ec == std::errc() && ptr == cell.data() + cell.size()) return value;
+    return parseDuration(cell);
+  }
+
+  /// the column to aggregate: prefer the exact byte count over its human readable sibling
+  std::string resolveValueColumn(const std::vector<std::string>& names, const std::string& value)
+  {
+    if (std::find(names.begin(), names.end(), value + " (bytes)") != names.end()) return value + " (bytes)";
+    return value;
+  }
+
+  /// index of @p name in @p names
+  /// @throw std::runtime_error if there is no such column
+  size_t columnIndex(const std::vector<std::string>& names, const std::string& name)
+  {
+    const auto it = std::find(names.begin(), names.end(), name);
+    if (it == names.end()) throw std::runtime_error("The log has no column '" + name + "'.");
+    return size_t(it - names.begin());
+  }
+
+  /// group the lines in [begin, end) (which start at a line boundary) into @p out
+  void scanChunk(const char* begin, const char* end, const size_t key_column, const size_t value_column, const bool by_exe,
+                 const CommandDictionary* dictionary, Partial& out)
+  {
+    const size_t last = std::max(key_column, value_column);
+    for (const char* pos = begin; pos < end;)
+    {
+      std::string_view key, value;
+      size_t column = 0;
+      const char* cell = pos;
+      const char* line_end;
+      while (true)
+      {
+        const char* delimiter = findDelimiter(cell, end);
+        if (column == key_column) key = std::string_view(cell, size_t(delimiter - cell));
+        if (column == value_column) value = std::string_view(cell, size_t(delimiter - cell));
+        if (delimiter == end || *delimiter == '\n')
+        {
+          line_end = delimiter;
+          break;
+        }
+        if (column == last)
+        { // we have all we need: skip the rest of the line
+          line_end = findNewline(delimiter, end);
+          break;
+        }
+        ++column;
+        cell = delimiter + 1;
+      }
+      pos = line_end + 1;
+
+      const auto v = column < last ? std::nullopt : parseValue(value);
+      if (!v)
+      {
+        ++out.skipped;
+        continue;
+      }
+      if (!key.empty() && key.back() == '\r') key.remove_suffix(1);
+      key = restoreCommand(key, dictionary);
+      out.groups[by_exe ? executableOf(key) : key].push_back(*v);
+      ++out.rows;
+    }
+  }
+
+  /// split a TSV log into chunks at line boundaries and group them on @p threads threads; @p value_column is set to the aggregated column
+  std::vector<Partial> scanTSV(const MappedFile& log, const ReportOptions& options, const CommandDictionary* dictionary, std::string& value_column)
+  {
+    const char* data = log.data();
+    const char* end = data + log.size();
+    const char* header_end = findNewline(data, end);
+    auto header = splitCells(std::string_view(data, size_t(header_end - data)), '\t');
+    if (!header.empty() && !header.back().empty() && header.back().back() == '\r') header.back().pop_back();
+    const bool by_exe = options.group_by == "exe";
+    const std::string key_name = resolveKeyColumn(header, options);
+    const size_t key_column = columnIndex(header, key_name);
+    if (key_name != CommandHash::printHeader('\t')) dictionary = nullptr;
+    value_column = resolveValueColumn(header, options.value);
+    const size_t value_index = columnIndex(header, value_column);
+
+    // more chunks than threads, so a thread which got short lines does not idle at the end
+    const char* body = std::min(header_end + 1, end);
+    const size_t n_chunks = options.threads * 4;
+    std::vector<const char*> bounds{ body };
+    for (size_t i = 1; i < n_chunks; ++i)
+    {
+      const char* bound = std::max(bounds.back(), body + size_t(end - body) * i / n_chunks);
+      bound = findNewline(bound, end);
+      bounds.push_back(bound == end ? end : bound + 1);
+    }
+    bounds.push_back(end);
+
+    std::vector<Partial> partials(options.threads);
+    std::atomic<size_t> next_chunk{ 0 };
+    std::vector<std::thread> threads;
+    for (auto& partial : partials)
+    {
+      threads.emplace_back([&, p = &partial]()
+      {
+        for (size_t chunk; (chunk = next_chunk++) < n_chunks;)
+        {
+          scanChunk(bounds[chunk], bounds[chunk + 1], key_column, value_index, by_exe, dictionary, *p);
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    return partials;
+  }
+
+  /// group the blocks of a binary log on @p threads threads
+  std::vector<Partial> scanBinary(const BinaryLogReader& log, const ReportOptions& options, const CommandDictionary* dictionary)
+  {
+    const bool by_exe = options.group_by == "exe";
+    const auto& blocks = log.getBlocks();
+    std::vector<Partial> partials(options.threads);
+    std::atomic<size_t> next_block{ 0 };
+    std::vector<std::thread> threads;
+    for (auto& partial : partials)
+    {
+      threads.emplace_back([&, p = &partial]()
+      {
+        for (size_t b; (b = next_block++) < blocks.size();)
+        {
+          const DataBlock& block = blocks[b];
+          const std::string key_name = resolveKeyColumn(*block.names, options);
+          const int kc = block.findColumn(key_name);
+          const int vc = block.findColumn(resolveValueColumn(*block.names, options.value));
+          if (kc < 0 || vc < 0)
+          {
+            p->skipped += block.rows;
+            continue;
+          }
+          std::vector<std::string_view> keys;
+          if (block.columns[kc].type == ColumnType::STRING)
+          {
+            keys = BinaryLogReader::decodeStrings(block, kc);
+          }
+          else
+          {
+            for (auto& cell : BinaryLogReader::decodeCells(block, kc)) keys.push_back(p->keys.emplace_back(std::move(cell)));
+          }
+          std::vector<std::optional<double>> values;
+          if (block.columns[vc].type == ColumnType::STRING)
+          { // e.g. empty cells; parse what is there
+            for (const auto cell : BinaryLogReader::decodeStrings(block, vc)) values.push_back(parseValue(cell));
+          }
+          else
+          {
+            for (const double v : BinaryLogReader::decodeReals(block, vc)) values.push_back(v);
+          }
+          for (size_t r = 0; r < block.rows; ++r)
+          {
+            if (!values[r])
+            {
+              ++p->skipped;
+              continue;
+            }
+            const std::string_view key = key_name == CommandHash::printHeader('\t') ? restoreCommand(keys[r], dictionary) : keys[r];
+            p->groups[by_exe ? executableOf(key) : key].push_back(*values[r]);
+            ++p->rows;
+          }
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    return partials;
+  }
+
+  /// merge the groups of all @p partials and compute their statistics on @p threads threads
+  std::vector<GroupStats> aggregate(std::vector<Partial>& partials, const size_t n_threads)
+  {
+    Groups groups = std::move(partials.front().groups);
+    for (size_t i = 1; i < partials.size(); ++i)
+    {
+      for (auto& [key, values] : partials[i].groups)
+      {
+        auto& target = groups[key];
+        target.insert(target.end(), values.begin(), values.end());
+      }
+    }
+
+    std::vector<std::vector<double>*> group_values;
+    std::vector<GroupStats> stats;
+    for (auto& [key, values] : groups)
+    {
+      stats.push_back(GroupStats{ key });
+      group_values.push_back(&values);
+    }
+    std::atomic<size_t> next_group{ 0 };
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; ++t)
+    {
+      threads.emplace_back([&]()
+      {
+        for (size_t g; (g = next_group++) < stats.size();)
+        {
+          auto& values = *group_values[g];
+          std::sort(values.begin(), values.end());
+          GroupStats& s = stats[g];
+          s.count = values.size();
+          for (const double v : values) s.sum += v;
+          s.mean = s.sum / double(s.count);
+          s.p50 = percentile(values, 50);
+          s.p95 = percentile(values, 95);
+          s.p99 = percentile(values, 99);
+          s.max = values.back();
+        }
+      });
+    }
+    for (auto& t : threads) t.join();
+    return stats;
+  }
+
+  void printReport(const std::vector<GroupStats>& stats, const ReportOptions& options, const std::string& value_column)
+  {
+    if (options.tsv)
+    {
+      std::cout << options.group_by << "\tcount\tsum\tmean\tp50\tp95\tp99\tmax\n";
+      for (const auto& s : stats)
+      {
+        std::cout << s.key << '\t' << s.count << '\t' << s.sum << '\t' << s.mean << '\t' << s.p50 << '\t' << s.p95 << '\t' << s.p99 << '\t' << s.max << '\n';
+      }
+      return;
+    }
+    const bool is_bytes = value_column.size() >= 5 && (value_column.ends_with("(bytes)") || value_column.ends_with("Bytes"));
+    const auto format = [&](const double v)
+    {
+      if (is_bytes) return toHumanReadable(uint64_t(v));
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.4g", v);
+      return std::string(buffer);
+    };
+    std::printf("%10s %12s %12s %12s %12s %12s  %s\n", "count", "mean", "p50", "p95", "p99", "max", options.group_by.c_str());
+    for (const auto& s : stats)
+    {
+      std::printf("%10zu %12s %12s %12s %12s %12s  %.*s\n", s.count, format(s.mean).c_str(), format(s.p50).c_str(), format(s.p95).c_str(),
+                  format(s.p99).c_str(), format(s.max).c_str(), int(s.key.size()), s.key.data());
+    }
+  }
+
+  int usage()
+  {
+    std::cerr << "Usage: wintime-report LOG [--value COLUMN] [--group-by cmd|exe|COLUMN] [--sort count|sum|mean|p50|p95|p99|max] [--top N] [--threads N] [--tsv]\n"
+                 "       wintime-report LOG --history COMMAND [ARG...]\n";
+    return 1;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const std::vector<std::string> args(argv + 1, argv + argc);
+  if (args.empty()) return usage();
+  ReportOptions options;
+  for (size_t i = 1; i < args.size(); ++i)
+  {
+    const bool has_value = i + 1 < args.size();
+    if (args[i] == "--history" && has_value)
+    {
+      try
+      {
+        const std::vector<std::string> command_args(args.begin() + i + 2, args.end());
+        std::cout << commandHistory(args[0], Process::concatArguments(args[i + 1], command_args));
+        return 0;
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+      }
+    }
+    else if (args[i] == "--tsv") options.tsv = true;
+    else if (args[i] == "--value" && has_value) options.value = args[++i];
+    else if (args[i] == "--group-by" && has_value) options.group_by = args[++i];
+    else if (args[i] == "--sort" && has_value) options.sort = args[++i];
+    else if (args[i] == "--top" && has_value) options.top = std::stoul(args[++i]);
+    else if (args[i] == "--threads" && has_value) options.threads = std::max(1ul, std::stoul(args[++i]));
+    else return usage();
+  }
+  const std::vector<std::string> sorts{ "count", "sum", "mean", "p50", "p95", "p99", "max" };
+  if (std::find(sorts.begin(), sorts.end(), options.sort) == sorts.end()) return usage();
+
+  try
+  {
+    const auto t_start = std::chrono::steady_clock::now();
+    std::vector<Partial> partials;
+    std::string value_column;
+    size_t bytes;
+    // keep the mapping alive until the report is printed: the group keys point into it
+    std::optional<BinaryLogReader> binary_log;
+    std::optional<MappedFile> tsv_log;
+    const CommandDictionary dictionary(args[0]);
+    if (isBinaryLog(args[0]))
+    {
+      binary_log.emplace(args[0]);
+      if (binary_log->getBlocks().empty()) throw std::runtime_error("The log is empty.");
+      value_column = resolveValueColumn(*binary_log->getBlocks().front().names, options.value);
+      partials = scanBinary(*binary_log, options, &dictionary);
+      bytes = std::filesystem::file_size(args[0]);
+    }
+    else
+    {
+      tsv_log.emplace(args[0]);
+      partials = scanTSV(*tsv_log, options, &dictionary, value_column);
+      bytes = tsv_log->size();
+    }
+    size_t rows = 0, skipped = 0;
+    for (const auto& p : partials)
+    {
+      rows += p.rows;
+      skipped += p.skipped;
+    }
+    auto stats = aggregate(partials, options.threads);
+    std::sort(stats.begin(), stats.end(), [&](const GroupStats& a, const GroupStats& b) { return a.get(options.sort) > b.get(options.sort); });
+    if (options.top > 0 && stats.size() > options.top) stats.resize(options.top);
+    printReport(stats, options, value_column);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    std::cerr << rows << " rows (" << skipped << " without a value) in " << seconds << " s, "
+              << toHumanReadable(uint64_t(double(bytes) / std::max(seconds, 1e-9))) << "/s\n";
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "Error: " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
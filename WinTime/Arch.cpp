@@ -21,10 +21,16 @@
  */
 #define _CRT_SECURE_NO_WARNINGS 1
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 #include <windows.h> // for HANDLE; <windef.h> alone is not sufficient
 #undef max
 #undef min
+#else
+#include <elf.h>
+#include <unistd.h>
+#include <fstream>
+#endif
 
 #include <stdexcept>
 
@@ -36,6 +42,7 @@ using namespace std;
 
 namespace WinTime
 {
+#ifdef _WIN32
   Arch getArch(const std::string& path_to_exe)
   {
     DWORD result;
@@ -56,7 +63,34 @@ namespace WinTime
     }
   }
 
-  std::string getArchMatchedExplanation(const ArchMatched what, LPCSTR path_to_target_exe)
+#else
+  Arch getArch(const std::string& path_to_exe)
+  {
+    if (access(path_to_exe.c_str(), X_OK) != 0)
+    { // not an executable
+      return Arch::NOT_EXECUTABLE;
+    }
+    char ident[EI_NIDENT]{};
+    std::ifstream exe(path_to_exe, std::ios::binary);
+    if (!exe.read(ident, sizeof(ident)) || ident[EI_MAG0] != ELFMAG0 || ident[EI_MAG1] != ELFMAG1 || ident[EI_MAG2] != ELFMAG2 || ident[EI_MAG3] != ELFMAG3)
+    { // e.g. a script with '#!' interpreter line
+      return Arch::OTHER;
+    }
+    switch (ident[EI_CLASS])
+    {
+    break; case ELFCLASS32:
+      return Arch::x86;
+    break; case ELFCLASS64:
+      return Arch::x64;
+    break; default:
+      return Arch::OTHER;
+    }
+    return Arch::OTHER;
+  }
+
+#endif
+
+  std::string getArchMatchedExplanation(const ArchMatched what, const std::string& path_to_target_exe)
   {
     switch (what)
     {
@@ -68,7 +102,7 @@ namespace WinTime
       else
         return std::string("WinTime is 32 bit, but target (") + path_to_target_exe + ") is 64 bit. Please use 64 bit version of WinTime.";
     break; case ArchMatched::TARGET_UNKNOWN:
-      return std::string("Target Architecture (of ") + path_to_target_exe + ") is neither 32bit nor 64bit Windows, but something else.";
+      return std::string("Target Architecture (of ") + path_to_target_exe + ") is neither a 32bit nor a 64bit executable, but something else.";
     default:
       throw std::logic_error("Missed a case? Please report a bug!");
     };
@@ -80,6 +114,10 @@ namespace WinTime
     const auto target_arch = getArch(target_exe);
     constexpr const Arch this_arch = hostIs64Bit() ? Arch::x64 : Arch::x86;
     if (target_arch == this_arch) return ArchMatched::SAME;
+#ifndef _WIN32
+    // wait4() and /proc report the same data for children of any bitness (and for scripts), so there is no need to switch
+    if (target_arch != Arch::NOT_EXECUTABLE) return ArchMatched::SAME;
+#endif
     if (target_arch == Arch::OTHER || target_arch == Arch::NOT_EXECUTABLE) return ArchMatched::TARGET_UNKNOWN;
     return ArchMatched::MIXED;
   };
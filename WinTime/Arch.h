@@ -36,7 +36,7 @@ namespace WinTime
     NOT_EXECUTABLE
   };
 
-  /// Get architecture (32 or 64 bit) of executable
+  /// Get architecture (32 or 64 bit) of executable (a PE file on Windows, an ELF file on POSIX)
   /// Return Arch::NOT_EXECUTABLE on error
   Arch getArch(const std::string& path_to_exe);
 
@@ -52,7 +52,7 @@ namespace WinTime
     TARGET_UNKNOWN  ///< we surely know the host target (that's us; but target might be Arch::OTHER etc)
   };
 
-  std::string getArchMatchedExplanation(const ArchMatched what, LPCSTR path_to_target_exe);;
+  std::string getArchMatchedExplanation(const ArchMatched what, const std::string& path_to_target_exe);
 
   /// Does the architecture of @p target_exe match the architecture of the current process?
   ArchMatched checkMatchingArch(const std::string& target_exe);
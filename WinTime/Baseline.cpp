@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Baseline.h"
+
+#include "FileLog.h"
+#include "Memory.h"
+#include "Statistics.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    const char SEPARATOR = '\t';
+
+    /// the metrics checked for regressions, in output order
+    const std::vector<std::pair<std::string, double (*)(const RunMeasurement&)>> METRICS{
+      { "wall", [](const RunMeasurement& r) { return r.t_wall; } },
+      { "user", [](const RunMeasurement& r) { return r.t_user; } },
+      { "peak_ws", [](const RunMeasurement& r) { return double(r.peak_rss); } },
+      { "page_faults", [](const RunMeasurement& r) { return double(r.page_faults); } },
+    };
+
+    std::vector<std::string> split(const std::string& line, const char separator)
+    {
+      std::vector<std::string> cells;
+      std::stringstream ss(line);
+      std::string cell;
+      while (std::getline(ss, cell, separator)) cells.push_back(cell);
+      return cells;
+    }
+
+    std::string formatValue(const std::string& metric, double value)
+    {
+      if (metric == "peak_ws") return toHumanReadable(uint64_t(value));
+      char buffer[32];
+      if (metric == "page_faults") std::snprintf(buffer, sizeof(buffer), "%.0f", value);
+      else std::snprintf(buffer, sizeof(buffer), "%.4f s", value);
+      return buffer;
+    }
+  }
+
+  RegressionTest RegressionOptions::parseTest(const std::string& name)
+  {
+    if (name == "threshold") return RegressionTest::THRESHOLD;
+    if (name == "mann-whitney") return RegressionTest::MANN_WHITNEY;
+    throw std::runtime_error("Unknown regression test '" + name + "'. Use 'threshold' or 'mann-whitney'.");
+  }
+
+  void RegressionOptions::parseThresholds(const std::string& list)
+  {
+    for (const auto& item : split(list, ','))
+    {
+      const auto pos = item.find('=');
+      const auto metric = item.substr(0, pos);
+      if (pos == std::string::npos || thresholds.count(metric) == 0)
+      {
+        throw std::runtime_error("Invalid threshold '" + item + "'. Expected e.g. 'wall=5' for one of the metrics wall, user, peak_ws, page_faults.");
+      }
+      try
+      {
+        thresholds[metric] = std::stod(item.substr(pos + 1));
+      }
+      catch (const std::exception&)
+      {
+        throw std::runtime_error("Invalid threshold '" + item + "'. Expected a percentage.");
+      }
+    }
+  }
+
+  bool RegressionReport::hasRegression() const
+  {
+    for (const auto& c : checks)
+    {
+      if (c.regression) return true;
+    }
+    return false;
+  }
+
+  void RegressionReport::print() const
+  {
+    char buffer[200];
+    std::snprintf(buffer, sizeof(buffer), "  %-12s %12s %12s %9s %8s\n", "metric", "baseline", "current", "change", "p-value");
+    std::cerr << buffer;
+    for (const auto& c : checks)
+    {
+      const std::string p = c.p_value ? std::to_string(*c.p_value).substr(0, 6) : "-";
+      std::snprintf(buffer, sizeof(buffer), "%c %-12s %12s %12s %+8.1f%% %8s%s\n", c.regression ? '!' : ' ', c.metric.c_str(),
+        formatValue(c.metric, c.baseline).c_str(), formatValue(c.metric, c.current).c_str(), c.change * 100, p.c_str(),
+        c.regression ? "  REGRESSION" : "");
+      std::cerr << buffer;
+    }
+  }
+
+  RegressionReport checkRegression(const std::vector<RunMeasurement>& baseline, const std::vector<RunMeasurement>& current, const RegressionOptions& options)
+  {
+    const bool use_test = options.test == RegressionTest::MANN_WHITNEY && baseline.size() >= 3 && current.size() >= 3;
+
+    RegressionReport report;
+    for (const auto& [name, get] : METRICS)
+    {
+      std::vector<double> b, c;
+      for (const auto& r : baseline) b.push_back(get(r));
+      for (const auto& r : current) c.push_back(get(r));
+
+      MetricCheck check;
+      check.metric = name;
+      check.baseline = median(b);
+      check.current = median(c);
+      check.change = check.baseline > 0 ? check.current / check.baseline - 1 : 0;
+      check.regression = check.change * 100 > options.thresholds.at(name);
+      if (use_test)
+      {
+        check.p_value = mannWhitneyGreater(c, b);
+        check.regression = check.regression && *check.p_value < options.alpha;
+      }
+      report.checks.push_back(check);
+    }
+    return report;
+  }
+
+  BaselineStore::BaselineStore(const std::string& filename)
+    : filename_(filename)
+  {
+    std::ifstream in{ std::filesystem::path(filename) };
+    if (!in) return;
+    parse_(in, filename, entries_);
+  }
+
+  void BaselineStore::parse_(std::istream& in, const std::string& filename, Entries& entries)
+  {
+    std::string line;
+    std::getline(in, line); // header
+    size_t line_number = 1;
+    while (std::getline(in, line))
+    {
+      ++line_number;
+      if (line.empty()) continue;
+      const auto cells = split(line, SEPARATOR);
+      if (cells.size() != 8)
+      {
+        throw std::runtime_error("Baseline file '" + filename + "' is malformed in line " + std::to_string(line_number) + ".");
+      }
+      RunMeasurement r;
+      r.t_create = cells[2];
+      r.t_wall = std::stod(cells[3]);
+      r.t_user = std::stod(cells[4]);
+      r.t_kernel = std::stod(cells[5]);
+      r.peak_rss = std::stoull(cells[6]);
+      r.page_faults = std::stoull(cells[7]);
+      entries[cells[0]].push_back(r);
+    }
+  }
+
+  std::optional<std::vector<RunMeasurement>> BaselineStore::get(const std::string& cmd) const
+  {
+    auto it = entries_.find(cmd);
+    if (it == entries_.end()) return std::nullopt;
+    return it->second;
+  }
+
+  void BaselineStore::set(const std::string& cmd, const std::vector<RunMeasurement>& runs)
+  {
+    entries_[cmd] = runs;
+    changed_.insert(cmd);
+  }
+
+  void BaselineStore::save() const
+  {
+    // another process may have saved other commands since we loaded the file: merge under the lock, or their runs would be lost
+    LockedFile file(filename_, OpenMode::OVERWRITE);
+    if (!file.lock())
+    {
+      throw std::runtime_error("Could not lock baseline file '" + filename_ + "'.");
+    }
+    std::string content;
+    char buffer[4096];
+    for (size_t n; (n = file.readAt(buffer, sizeof(buffer), int64_t(content.size()))) > 0;)
+    {
+      content.append(buffer, n);
+    }
+    Entries merged;
+    std::istringstream in(content);
+    parse_(in, filename_, merged);
+    for (const auto& cmd : changed_)
+    {
+      merged[cmd] = entries_.at(cmd);
+    }
+
+    const char sep = SEPARATOR;
+    std::stringstream header, rows;
+    header << "cmd" << sep << "run" << sep << "creation_time" << sep << "wall_time" << sep << "user_time" << sep
+      << "kernel_time" << sep << "PeakWorkingSetSize (bytes)" << sep << "PageFaultCount" << '\n';
+    rows.precision(9);
+    for (const auto& [cmd, runs] : merged)
+    {
+      for (size_t i = 0; i < runs.size(); ++i)
+      {
+        const auto& r = runs[i];
+        rows << cmd << sep << i + 1 << sep << r.t_create << sep << r.t_wall << sep << r.t_user << sep
+          << r.t_kernel << sep << r.peak_rss << sep << r.page_faults << '\n';
+      }
+    }
+    file.write(header.str().c_str());
+    file.write(rows.str().c_str());
+  }
+
+} // namespace
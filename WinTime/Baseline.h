@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <map>
+#include <iosfwd>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+namespace WinTime
+{
+  /// exit code of WinTime if a regression against a baseline was detected
+  constexpr int EXIT_CODE_REGRESSION = 99;
+
+  /// How to decide whether a metric regressed
+  enum class RegressionTest
+  {
+    THRESHOLD,    ///< the median increased by more than the threshold
+    MANN_WHITNEY  ///< ... and a one-sided Mann-Whitney U test is significant (falls back to THRESHOLD with less than 3 runs on either side)
+  };
+
+  /// Parameters of checkRegression()
+  struct RegressionOptions
+  {
+    RegressionTest test{ RegressionTest::MANN_WHITNEY };
+    double alpha{ 0.05 };  ///< significance level of the test
+    /// allowed increase of the median in percent, per metric ('wall', 'user', 'peak_ws', 'page_faults')
+    std::map<std::string, double> thresholds{ { "wall", 5 }, { "user", 5 }, { "peak_ws", 10 }, { "page_faults", 20 } };
+
+    /// parse 'threshold', 'mann-whitney'
+    /// @throw std::runtime_error for unknown names
+    static RegressionTest parseTest(const std::string& name);
+
+    /// override thresholds from a list like 'wall=3,peak_ws=5'
+    /// @throw std::runtime_error for unknown metrics or malformed values
+    void parseThresholds(const std::string& list);
+  };
+
+  /// Result of checking a single metric
+  struct MetricCheck
+  {
+    std::string metric;
+    double baseline{ 0 };             ///< median of the baseline
+    double current{ 0 };              ///< median of the current runs
+    double change{ 0 };               ///< relative change of the median (0.1 = +10%)
+    std::optional<double> p_value;    ///< only with RegressionTest::MANN_WHITNEY and enough runs
+    bool regression{ false };
+  };
+
+  /// All metrics of a regression check
+  struct RegressionReport
+  {
+    std::vector<MetricCheck> checks;
+
+    bool hasRegression() const;
+
+    /// print a compact diff to std::cerr
+    void print() const;
+  };
+
+  /// compare the @p current runs against the @p baseline runs (both must not be empty)
+  RegressionReport checkRegression(const std::vector<RunMeasurement>& baseline, const std::vector<RunMeasurement>& current, const RegressionOptions& options);
+
+  /**
+    @brief A file of baseline runs, indexed by command line
+
+    The file is a table with one row per run (like --raw-runs), whose first column is the command line.
+    Saving the runs of a command replaces all earlier runs of the same command and keeps all other commands,
+    including those which other processes saved since the file was loaded.
+  */
+  class BaselineStore
+  {
+  public:
+    /// load @p filename if it exists
+    /// @throw std::runtime_error if the file is malformed
+    explicit BaselineStore(const std::string& filename);
+
+    /// the runs stored for @p cmd, if any
+    std::optional<std::vector<RunMeasurement>> get(const std::string& cmd) const;
+
+    /// replace the runs of @p cmd
+    void set(const std::string& cmd, const std::vector<RunMeasurement>& runs);
+
+    /// re-read the file and write it back with the commands passed to set(), all while holding the file lock
+    /// @throw std::runtime_error if the file cannot be locked or is malformed
+    void save() const;
+
+  private:
+    using Entries = std::map<std::string, std::vector<RunMeasurement>>;
+
+    /// add the rows of the table in @p in to @p entries
+    /// @throw std::runtime_error if a row is malformed
+    static void parse_(std::istream& in, const std::string& filename, Entries& entries);
+
+    std::string filename_;
+    Entries entries_;
+    std::set<std::string> changed_; ///< commands passed to set()
+  };
+
+} // namespace
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Batch.h"
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+#include <sstream>
+
+namespace WinTime
+{
+  std::string BatchRunInfo::print(const char separator) const
+  {
+    std::stringstream where;
+    where << line << separator
+      << slot << separator
+      << cpus << separator
+      << exit_code;
+    return where.str();
+  }
+
+  std::string BatchRunInfo::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "manifest_line" << separator
+      << "slot" << separator
+      << "cpus" << separator
+      << "exit_code";
+    return where.str();
+  }
+
+  JobQueue::JobQueue(size_t jobs)
+    : jobs_(jobs)
+  {
+  }
+
+  std::optional<size_t> JobQueue::next()
+  {
+    if (next_ == jobs_) return std::nullopt;
+    return next_++;
+  }
+
+  std::vector<std::vector<int>> assignCPUs(size_t slots)
+  {
+    std::vector<std::vector<int>> result(slots);
+#ifndef _WIN32
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return result;
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+    if (cpus.empty()) return result;
+    if (slots >= cpus.size())
+    {
+      for (size_t slot = 0; slot < slots; ++slot) result[slot].push_back(cpus[slot % cpus.size()]);
+      return result;
+    }
+    // contiguous groups; the first (cpus % slots) groups get one CPU more
+    size_t next = 0;
+    for (size_t slot = 0; slot < slots; ++slot)
+    {
+      const size_t count = cpus.size() / slots + (slot < cpus.size() % slots ? 1 : 0);
+      result[slot].assign(cpus.begin() + next, cpus.begin() + next + count);
+      next += count;
+    }
+#endif
+    return result;
+  }
+
+  std::string toCPUList(const std::vector<int>& cpus)
+  {
+    std::stringstream ss;
+    for (size_t i = 0; i < cpus.size();)
+    {
+      size_t j = i;
+      while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+      if (i > 0) ss << ',';
+      ss << cpus[i];
+      if (j > i) ss << '-' << cpus[j];
+      i = j + 1;
+    }
+    return ss.str();
+  }
+
+} // namespace
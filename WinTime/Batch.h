@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace WinTime
+{
+  /// Printable attribution of a batch run: where it came from and where it ran
+  struct BatchRunInfo
+  {
+    size_t line{ 0 };        ///< line in the manifest
+    size_t slot{ 0 };
+    std::string cpus;        ///< CPUs of the slot, e.g. '0-3' (empty if not pinned)
+    int exit_code{ 0 };
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+  /**
+    @brief Hands out job indices in manifest order to whichever slot becomes free first
+
+    A single FIFO: slots which got long-running jobs do not hold back the rest, since every other slot takes
+    the next job as soon as its own one finishes. All slots are served from one thread (see Supervisor), so it needs no locking.
+  */
+  class JobQueue
+  {
+  public:
+    explicit JobQueue(size_t jobs);
+
+    /// the next job, or nothing if all jobs are taken
+    std::optional<size_t> next();
+
+  private:
+    size_t jobs_;
+    size_t next_{ 0 };
+  };
+
+  /// Split the CPUs WinTime may run on into @p slots disjoint groups of (about) equal size.
+  /// With more slots than CPUs, slots share CPUs round-robin. Returns nothing per slot if the CPUs cannot be determined (e.g. on Windows).
+  std::vector<std::vector<int>> assignCPUs(size_t slots);
+
+  /// format CPU numbers as ranges, e.g. '0-3,8'
+  std::string toCPUList(const std::vector<int>& cpus);
+
+} // namespace
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Benchmark.h"
+
+#include "Memory.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+namespace WinTime
+{
+  namespace
+  {
+    std::vector<double> extract(const std::vector<RunMeasurement>& runs, double RunMeasurement::* member)
+    {
+      std::vector<double> values;
+      values.reserve(runs.size());
+      for (const auto& r : runs) values.push_back(r.*member);
+      return values;
+    }
+
+    std::vector<double> extractRSS(const std::vector<RunMeasurement>& runs)
+    {
+      std::vector<double> values;
+      values.reserve(runs.size());
+      for (const auto& r : runs) values.push_back(double(r.peak_rss));
+      return values;
+    }
+
+    void printStatisticsRow(const char* name, const Statistics& s, bool bytes)
+    {
+      char buffer[200];
+      if (bytes)
+      {
+        auto h = [](double v) { return toHumanReadable(uint64_t(v)); };
+        std::snprintf(buffer, sizeof(buffer), "%-12s %11s %11s %11s %11s %11s %11s %8zu\n", name, h(s.mean).c_str(), h(s.median).c_str(),
+          h(s.stddev).c_str(), h(s.min).c_str(), h(s.max).c_str(), h(s.mad).c_str(), s.outliers);
+      }
+      else
+      {
+        std::snprintf(buffer, sizeof(buffer), "%-12s %11.4f %11.4f %11.4f %11.4f %11.4f %11.4f %8zu\n", name, s.mean, s.median, s.stddev, s.min, s.max, s.mad, s.outliers);
+      }
+      std::cerr << buffer;
+    }
+
+    std::string printStatistics(const Statistics& s, const char separator)
+    {
+      std::stringstream where;
+      where << s.mean << separator
+        << s.median << separator
+        << s.stddev << separator
+        << s.min << separator
+        << s.max << separator
+        << s.mad << separator
+        << s.outliers;
+      return where.str();
+    }
+
+    /// same as printStatistics(), but rounded to whole bytes
+    std::string printStatisticsBytes(const Statistics& s, const char separator)
+    {
+      std::stringstream where;
+      where << uint64_t(s.mean) << separator
+        << uint64_t(s.median) << separator
+        << uint64_t(s.stddev) << separator
+        << uint64_t(s.min) << separator
+        << uint64_t(s.max) << separator
+        << uint64_t(s.mad) << separator
+        << s.outliers;
+      return where.str();
+    }
+
+    std::string printStatisticsHeader(const std::string& prefix, const char separator)
+    {
+      std::stringstream where;
+      for (const char* stat : { "mean", "median", "stddev", "min", "max", "mad" })
+      {
+        where << prefix << '_' << stat << separator;
+      }
+      where << prefix << "_outliers";
+      return where.str();
+    }
+  }
+
+  std::string printRuns(const std::vector<RunMeasurement>& runs, const std::string& run_id, const char separator)
+  {
+    const auto wall = Statistics::compute(extract(runs, &RunMeasurement::t_wall));
+    const auto user = Statistics::compute(extract(runs, &RunMeasurement::t_user));
+    const auto kernel = Statistics::compute(extract(runs, &RunMeasurement::t_kernel));
+    const auto rss = Statistics::compute(extractRSS(runs));
+
+    std::stringstream where;
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+      const auto& r = runs[i];
+      std::string outlier;
+      auto flag = [&outlier](bool is_outlier, const char* name) { if (is_outlier) outlier += (outlier.empty() ? "" : ",") + std::string(name); };
+      flag(wall.isOutlier(r.t_wall), "wall");
+      flag(user.isOutlier(r.t_user), "user");
+      flag(kernel.isOutlier(r.t_kernel), "kernel");
+      flag(rss.isOutlier(double(r.peak_rss)), "rss");
+
+      where << run_id << separator
+        << i + 1 << separator
+        << r.t_create << separator
+        << r.t_wall << separator
+        << r.t_user << separator
+        << r.t_kernel << separator
+        << r.peak_rss << separator
+        << outlier << '\n';
+    }
+    return where.str();
+  }
+
+  std::string printRunsHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "run_id" << separator
+      << "run" << separator
+      << "creation_time" << separator
+      << "wall_time" << separator
+      << "user_time" << separator
+      << "kernel_time" << separator
+      << "PeakWorkingSetSize (bytes)" << separator
+      << "outlier" << '\n';
+    return where.str();
+  }
+
+  bool BenchmarkOptions::isAdaptive() const
+  {
+    return target_ci.has_value() || time_budget.has_value();
+  }
+
+  bool BenchmarkOptions::isRepeated() const
+  {
+    return runs > 1 || warmup > 0 || isAdaptive();
+  }
+
+  void BenchmarkSummary::print() const
+  {
+    std::cerr << "Runs: " << runs << " (+" << warmup << " warmup)";
+    if (median_ci)
+    {
+      char buffer[64];
+      std::snprintf(buffer, sizeof(buffer), "%.2f", *median_ci * 100);
+      std::cerr << "; 95% CI of the median wall time: +-" << buffer << '%';
+    }
+    std::cerr << '\n';
+    char buffer[200];
+    std::snprintf(buffer, sizeof(buffer), "%-12s %11s %11s %11s %11s %11s %11s %8s\n", "", "mean", "median", "stddev", "min", "max", "MAD", "outliers");
+    std::cerr << buffer;
+    printStatisticsRow("Wall [s]", wall, false);
+    printStatisticsRow("User [s]", user, false);
+    printStatisticsRow("Kernel [s]", kernel, false);
+    printStatisticsRow("PeakRSS", peak_rss, true);
+  }
+
+  std::string BenchmarkSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << t_create << separator
+      << runs << separator
+      << warmup << separator
+      << (median_ci ? std::to_string(*median_ci) : "") << separator
+      << printStatistics(wall, separator) << separator
+      << printStatistics(user, separator) << separator
+      << printStatistics(kernel, separator) << separator
+      << printStatisticsBytes(peak_rss, separator);
+    return where.str();
+  }
+
+  std::string BenchmarkSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "creation_time" << separator
+      << "runs" << separator
+      << "warmup_runs" << separator
+      << "wall_median_ci" << separator
+      << printStatisticsHeader("wall", separator) << separator
+      << printStatisticsHeader("user", separator) << separator
+      << printStatisticsHeader("kernel", separator) << separator
+      << printStatisticsHeader("PeakWorkingSetSize", separator);
+    return where.str();
+  }
+
+  Benchmark::Benchmark(const BenchmarkOptions& options)
+    : options_(options)
+  {
+  }
+
+  bool Benchmark::run(const RunFunction& run_once)
+  {
+    const auto t_start = std::chrono::steady_clock::now();
+    auto budget_used = [&]() {
+      return options_.time_budget && std::chrono::steady_clock::now() - t_start >= *options_.time_budget;
+    };
+
+    for (size_t i = 0; i < options_.warmup; ++i)
+    {
+      if (!run_once()) return false;
+    }
+
+    while (true)
+    {
+      auto measurement = run_once();
+      if (!measurement) return false;
+      runs_.push_back(*measurement);
+
+      if (runs_.size() < options_.runs) continue;
+      if (!options_.isAdaptive()) break;
+      if (options_.target_ci)
+      {
+        auto ci = medianCI_();
+        if (ci && *ci * 100 <= *options_.target_ci)
+        {
+          target_reached_ = true;
+          break;
+        }
+      }
+      else if (!options_.time_budget)
+      {
+        break;
+      }
+      if (budget_used() || runs_.size() >= options_.max_runs) break;
+    }
+    return true;
+  }
+
+  const std::vector<RunMeasurement>& Benchmark::getRuns() const
+  {
+    return runs_;
+  }
+
+  BenchmarkSummary Benchmark::getSummary() const
+  {
+    BenchmarkSummary s;
+    s.t_create = runs_.empty() ? "" : runs_.front().t_create;
+    s.runs = runs_.size();
+    s.warmup = options_.warmup;
+    s.median_ci = medianCI_();
+    s.target_reached = target_reached_;
+    s.wall = Statistics::compute(extract(runs_, &RunMeasurement::t_wall));
+    s.user = Statistics::compute(extract(runs_, &RunMeasurement::t_user));
+    s.kernel = Statistics::compute(extract(runs_, &RunMeasurement::t_kernel));
+    s.peak_rss = Statistics::compute(extractRSS(runs_));
+    return s;
+  }
+
+  std::optional<double> Benchmark::medianCI_() const
+  {
+    auto wall = extract(runs_, &RunMeasurement::t_wall);
+    auto ci = medianConfidenceInterval(wall);
+    const double m = wall.empty() ? 0 : median(wall);
+    if (!ci || m <= 0) return std::nullopt;
+    return (ci->second - ci->first) / 2 / m;
+  }
+
+} // namespace
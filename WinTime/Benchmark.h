@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Statistics.h"
+
+namespace WinTime
+{
+  /// The numbers of a single run which are aggregated over repeated runs
+  struct RunMeasurement
+  {
+    std::string t_create;   ///< creation time of the process (see PTime)
+    double t_wall{ 0 };
+    double t_user{ 0 };
+    double t_kernel{ 0 };
+    uint64_t peak_rss{ 0 }; ///< peak working set in bytes
+    uint64_t page_faults{ 0 };
+  };
+
+  /// Write @p runs as rows of a table, each starting with @p run_id (e.g. the creation time of the first run)
+  /// The last column lists the metrics for which a run is an outlier (see Statistics::isOutlier()).
+  std::string printRuns(const std::vector<RunMeasurement>& runs, const std::string& run_id, const char separator);
+
+  /// Header matching printRuns()
+  std::string printRunsHeader(const char separator);
+
+  /// When to stop repeating the target
+  struct BenchmarkOptions
+  {
+    size_t runs{ 1 };                                       ///< number of measured runs (the minimum in adaptive mode)
+    size_t warmup{ 0 };                                     ///< unmeasured runs before the first measured one
+    std::optional<double> target_ci;                        ///< stop once the 95% CI of the median wall time is within +-target_ci percent
+    std::optional<std::chrono::microseconds> time_budget;   ///< stop once this much wall time was spent (including warmup)
+    size_t max_runs{ 1000 };                                ///< upper limit in adaptive mode
+
+    /// true if a target CI or a time budget is given
+    bool isAdaptive() const;
+
+    /// true if the target should run more than once
+    bool isRepeated() const;
+  };
+
+  /// Aggregate over all measured runs of a benchmark
+  struct BenchmarkSummary
+  {
+    std::string t_create;                    ///< creation time of the first measured run (links the row to the raw runs)
+    size_t runs{ 0 };
+    size_t warmup{ 0 };
+    std::optional<double> median_ci;         ///< half width of the 95% CI of the median wall time, relative to the median (0.01 = +-1%)
+    bool target_reached{ false };            ///< only meaningful with a target CI
+    Statistics wall;
+    Statistics user;
+    Statistics kernel;
+    Statistics peak_rss;
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+  /**
+    @brief Runs a target repeatedly (after some warmup runs) until the stopping criterion of BenchmarkOptions is met
+
+    Without a target CI or time budget, exactly BenchmarkOptions::runs runs are measured. Otherwise, at least that many runs
+    are measured, and more until the CI of the median wall time is narrow enough, the budget is used up, or max_runs is reached.
+  */
+  class Benchmark
+  {
+  public:
+    /// runs the target once; returns nothing if the run failed (which aborts the benchmark)
+    using RunFunction = std::function<std::optional<RunMeasurement>()>;
+
+    explicit Benchmark(const BenchmarkOptions& options);
+
+    /// run the benchmark; returns false if a run failed
+    bool run(const RunFunction& run_once);
+
+    /// all measured runs (not the warmup runs)
+    const std::vector<RunMeasurement>& getRuns() const;
+
+    BenchmarkSummary getSummary() const;
+
+  private:
+    /// relative half width of the CI of the median wall time of all runs so far
+    std::optional<double> medianCI_() const;
+
+    BenchmarkOptions options_;
+    std::vector<RunMeasurement> runs_;
+    bool target_reached_{ false };
+  };
+
+} // namespace
@@ -0,0 +1,656 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "BinaryLog.h"
+
+#include "Memory.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// every block starts with these 3 bytes, followed by its kind and the 32 bit payload length
+    const char MAGIC[3] = { 'W', 'T', 'L' };
+    constexpr size_t FRAME_SIZE = 8;
+    constexpr char KIND_SCHEMA = 'S';
+    constexpr char KIND_DATA = 'D';
+
+    void putVarint(std::string& out, uint64_t value)
+    {
+      while (value >= 0x80)
+      {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+      }
+      out.push_back(char(value));
+    }
+
+    void putU64(std::string& out, const uint64_t value)
+    {
+      for (int i = 0; i < 8; ++i) out.push_back(char(value >> (8 * i)));
+    }
+
+    uint64_t getU64(const uint8_t* p)
+    {
+      uint64_t value = 0;
+      for (int i = 0; i < 8; ++i) value |= uint64_t(p[i]) << (8 * i);
+      return value;
+    }
+
+    uint32_t getU32(const uint8_t* p)
+    {
+      return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    uint64_t zigzag(const int64_t value)
+    {
+      return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+    }
+
+    int64_t unzigzag(const uint64_t value)
+    {
+      return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+
+    /// bounds checked reading of a payload
+    class Cursor
+    {
+    public:
+      Cursor(const uint8_t* data, const size_t size)
+        : pos_(data), end_(data + size)
+      {
+      }
+
+      bool atEnd() const
+      {
+        return pos_ == end_;
+      }
+
+      uint64_t varint()
+      {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+          if (pos_ == end_) break;
+          const uint8_t byte = *pos_++;
+          value |= uint64_t(byte & 0x7f) << shift;
+          if (!(byte & 0x80)) return value;
+        }
+        throw std::runtime_error("Damaged block in binary log.");
+      }
+
+      const uint8_t* bytes(const uint64_t n)
+      {
+        if (n > uint64_t(end_ - pos_)) throw std::runtime_error("Damaged block in binary log.");
+        const uint8_t* start = pos_;
+        pos_ += n;
+        return start;
+      }
+
+    private:
+      const uint8_t* pos_;
+      const uint8_t* end_;
+    };
+
+    /// true if a block header (of a known kind) starts at @p data
+    bool isBlockStart(const uint8_t* data, const size_t size)
+    {
+      return size >= FRAME_SIZE && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0 && (data[3] == KIND_SCHEMA || data[3] == KIND_DATA);
+    }
+
+    std::string frame(const char kind, const std::string& payload)
+    {
+      if (payload.size() > UINT32_MAX) throw std::runtime_error("Block too large for binary log.");
+      std::string block(MAGIC, sizeof(MAGIC));
+      block.push_back(kind);
+      for (int i = 0; i < 4; ++i) block.push_back(char(payload.size() >> (8 * i)));
+      return block + payload;
+    }
+
+    std::tm toLocalTime(const time_t t)
+    {
+      std::tm local{};
+#ifdef _WIN32
+      localtime_s(&local, &t);
+#else
+      localtime_r(&t, &local);
+#endif
+      return local;
+    }
+
+    std::optional<int64_t> parseInt(const std::string& cell)
+    {
+      int64_t value;
+      const auto [ptr, ec] = std::from_chars(cell.data(), cell.data() + cell.size(), value);
+      if (ec != std::errc() || ptr != cell.data() + cell.size()) return std::nullopt;
+      return value;
+    }
+
+    std::string printInt(const int64_t value)
+    {
+      return std::to_string(value);
+    }
+
+    /// a date as printed by toDateString(), e.g. '2023/02/13 10:19:04.200' (local time), in ns since the epoch
+    std::optional<int64_t> parseTimestamp(const std::string& cell)
+    {
+      std::tm local{};
+      int msec = 0, consumed = 0;
+      if (std::sscanf(cell.c_str(), "%d/%d/%d %d:%d:%d.%d%n", &local.tm_year, &local.tm_mon, &local.tm_mday,
+                      &local.tm_hour, &local.tm_min, &local.tm_sec, &msec, &consumed) != 7 || size_t(consumed) != cell.size())
+      {
+        return std::nullopt;
+      }
+      local.tm_year -= 1900;
+      local.tm_mon -= 1;
+      local.tm_isdst = -1; // let mktime() figure out daylight saving time
+      const time_t t = std::mktime(&local);
+      if (t == time_t(-1)) return std::nullopt;
+      return int64_t(t) * 1000000000 + int64_t(msec) * 1000000;
+    }
+
+    std::string printTimestamp(const int64_t ns)
+    {
+      const int64_t sec = (ns >= 0 ? ns : ns - 999999999) / 1000000000; // round towards -inf
+      const std::tm local = toLocalTime(time_t(sec));
+      char buffer[100];
+      std::snprintf(buffer, sizeof(buffer), "%i/%.2i/%.2i %.2i:%.2i:%.2i.%.3i", local.tm_year + 1900, local.tm_mon + 1, local.tm_mday,
+                    local.tm_hour, local.tm_min, local.tm_sec, int((ns - sec * 1000000000) / 1000000));
+      return buffer;
+    }
+
+    /// a duration as printed by toTimeDiffString(), e.g. ' 0 days, 00:00:01.250 (1.25 seconds)', in ns
+    /// The text has millisecond resolution; the result is the middle of that millisecond.
+    std::optional<int64_t> parseDuration(const std::string& cell)
+    {
+      long long days, hours, minutes, seconds;
+      int msec, consumed = 0;
+      if (std::sscanf(cell.c_str(), " %lld days, %lld:%lld:%lld.%d (%*f seconds)%n", &days, &hours, &minutes, &seconds, &msec, &consumed) != 5
+          || size_t(consumed) != cell.size())
+      {
+        return std::nullopt;
+      }
+      return (((days * 24 + hours) * 60 + minutes) * 60 + seconds) * 1000000000 + int64_t(msec) * 1000000 + 500000;
+    }
+
+    std::string printDuration(const int64_t ns)
+    {
+      return toTimeDiffString(ns / 1e9);
+    }
+
+    std::optional<double> parseReal(const std::string& cell)
+    {
+      double value;
+      const auto [ptr, ec] = std::from_chars(cell.data(), cell.data() + cell.size(), value);
+      if (ec != std::errc() || ptr != cell.data() + cell.size()) return std::nullopt;
+      return value;
+    }
+
+    /// the way doubles are streamed into the TSV log
+    std::string printReal(const double value)
+    {
+      std::ostringstream out;
+      out << value;
+      return out.str();
+    }
+
+    /// Encode column @p c of @p rows as delta coded integers, if @p parse and @p print reproduce every cell
+    template<typename Parse, typename Print>
+    bool encodeIntegers(const std::vector<std::vector<std::string>>& rows, const size_t c, Parse parse, Print print, std::string& data)
+    {
+      std::string out;
+      int64_t previous = 0;
+      for (const auto& row : rows)
+      {
+        const auto value = parse(row[c]);
+        if (!value || print(*value) != row[c]) return false;
+        putVarint(out, zigzag(int64_t(uint64_t(*value) - uint64_t(previous))));
+        previous = *value;
+      }
+      data = std::move(out);
+      return true;
+    }
+
+    /// Encode the @p exact values of column @p c of @p rows as delta coded integers, if @p print reproduces every cell
+    template<typename Print>
+    bool encodeExact(const std::vector<std::vector<std::string>>& rows, const size_t c, const std::vector<int64_t>& exact, Print print, std::string& data)
+    {
+      if (exact.size() != rows.size()) return false;
+      std::string out;
+      int64_t previous = 0;
+      for (size_t r = 0; r < rows.size(); ++r)
+      {
+        if (print(exact[r]) != rows[r][c]) return false;
+        putVarint(out, zigzag(int64_t(uint64_t(exact[r]) - uint64_t(previous))));
+        previous = exact[r];
+      }
+      data = std::move(out);
+      return true;
+    }
+
+    bool encodeReals(const std::vector<std::vector<std::string>>& rows, const size_t c, std::string& data)
+    {
+      std::string out;
+      for (const auto& row : rows)
+      {
+        const auto value = parseReal(row[c]);
+        if (!value || printReal(*value) != row[c]) return false;
+        uint64_t bits;
+        std::memcpy(&bits, &*value, sizeof(bits));
+        putU64(out, bits);
+      }
+      data = std::move(out);
+      return true;
+    }
+
+    /// human readable sizes can be recomputed from the sibling column '<name> (bytes)', if it holds plain byte counts
+    bool isHumanBytes(const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows, const size_t c)
+    {
+      size_t sibling = 0;
+      while (sibling < names.size() && names[sibling] != names[c] + " (bytes)") ++sibling;
+      if (sibling == names.size()) return false;
+      for (const auto& row : rows)
+      {
+        const auto bytes = parseInt(row[sibling]);
+        if (!bytes || *bytes < 0 || printInt(*bytes) != row[sibling] || toHumanReadable(uint64_t(*bytes)) != row[c]) return false;
+      }
+      return true;
+    }
+
+    /// pick the most compact type which reproduces all cells of column @p c (preferring the values in @p exact)
+    ColumnType encodeColumn(const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows, const size_t c, const ExactColumns& exact, std::string& data)
+    {
+      if (isHumanBytes(names, rows, c)) return ColumnType::HUMAN_BYTES;
+      if (const auto it = exact.find(names[c]); it != exact.end())
+      {
+        if (encodeExact(rows, c, it->second, printTimestamp, data)) return ColumnType::TIMESTAMP;
+        if (encodeExact(rows, c, it->second, printDuration, data)) return ColumnType::DURATION;
+      }
+      if (encodeIntegers(rows, c, parseInt, printInt, data)) return ColumnType::INT;
+      if (encodeIntegers(rows, c, parseTimestamp, printTimestamp, data)) return ColumnType::TIMESTAMP;
+      if (encodeIntegers(rows, c, parseDuration, printDuration, data)) return ColumnType::DURATION;
+      if (encodeReals(rows, c, data)) return ColumnType::REAL;
+      for (const auto& row : rows)
+      {
+        putVarint(data, row[c].size());
+        data += row[c];
+      }
+      return ColumnType::STRING;
+    }
+  } // anonymous namespace
+
+  const char* toString(const ColumnType type)
+  {
+    switch (type)
+    {
+      case ColumnType::STRING: return "string";
+      case ColumnType::INT: return "int";
+      case ColumnType::REAL: return "real";
+      case ColumnType::TIMESTAMP: return "timestamp";
+      case ColumnType::DURATION: return "duration";
+      case ColumnType::HUMAN_BYTES: return "human_bytes";
+    }
+    return "unknown";
+  }
+
+  uint64_t schemaID(const std::vector<std::string>& names)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto& name : names)
+    {
+      for (const char c : name + '\t')
+      {
+        hash ^= uint8_t(c);
+        hash *= 1099511628211ull;
+      }
+    }
+    return hash;
+  }
+
+  std::vector<std::string> splitCells(const std::string_view line, const char separator)
+  {
+    std::vector<std::string> cells;
+    size_t start = 0;
+    for (size_t end; (end = line.find(separator, start)) != std::string_view::npos; start = end + 1)
+    {
+      cells.emplace_back(line.substr(start, end - start));
+    }
+    cells.emplace_back(line.substr(start));
+    return cells;
+  }
+
+  std::string encodeSchemaBlock(const std::vector<std::string>& names)
+  {
+    std::string payload;
+    putU64(payload, schemaID(names));
+    putVarint(payload, names.size());
+    for (const auto& name : names)
+    {
+      putVarint(payload, name.size());
+      payload += name;
+    }
+    return frame(KIND_SCHEMA, payload);
+  }
+
+  std::string encodeDataBlock(const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows, const ExactColumns& exact)
+  {
+    for (const auto& row : rows)
+    {
+      if (row.size() != names.size())
+      {
+        throw std::runtime_error("Row with " + std::to_string(row.size()) + " cells does not match the " + std::to_string(names.size()) + " columns of the binary log.");
+      }
+    }
+    std::string payload;
+    putU64(payload, schemaID(names));
+    putVarint(payload, rows.size());
+    putVarint(payload, names.size());
+    for (size_t c = 0; c < names.size(); ++c)
+    {
+      std::string data;
+      const ColumnType type = encodeColumn(names, rows, c, exact, data);
+      payload.push_back(char(type));
+      putVarint(payload, data.size());
+      payload += data;
+    }
+    return frame(KIND_DATA, payload);
+  }
+
+  void appendBinaryLog(const std::string& filename, const OpenMode mode, const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows,
+                       const ExactColumns& exact)
+  {
+    // encode before taking the lock, to keep it short
+    const std::string data = encodeDataBlock(names, rows, exact);
+
+    LockedFile lockf(filename, mode, true);
+    if (!lockf.lock())
+    {
+      throw std::runtime_error("Could not lock file '" + filename + "'.");
+    }
+
+    std::string blocks;
+    if (lockf.isFileEmpty())
+    {
+      blocks = encodeSchemaBlock(names);
+    }
+    else
+    { // the first block is never modified once written, so it is safe to check whether it already declares our schema
+      uint8_t head[FRAME_SIZE + 8];
+      const size_t n = lockf.readAt(reinterpret_cast<char*>(head), sizeof(head), 0);
+      if (n < 4 || std::memcmp(head, MAGIC, sizeof(MAGIC)) != 0)
+      {
+        throw std::runtime_error("'" + filename + "' is not a binary log. Convert it first or use another file.");
+      }
+      if (n < sizeof(head) || head[3] != KIND_SCHEMA || getU64(head + FRAME_SIZE) != schemaID(names))
+      {
+        blocks = encodeSchemaBlock(names);
+      }
+    }
+    blocks += data;
+    lockf.write(blocks.data(), blocks.size());
+  }
+
+  bool isBinaryLog(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::binary);
+    char head[4]{};
+    return in.read(head, sizeof(head)) && std::memcmp(head, MAGIC, sizeof(MAGIC)) == 0 && (head[3] == KIND_SCHEMA || head[3] == KIND_DATA);
+  }
+
+  int DataBlock::findColumn(const std::string_view name) const
+  {
+    for (size_t c = 0; c < names->size(); ++c)
+    {
+      if ((*names)[c] == name) return int(c);
+    }
+    return -1;
+  }
+
+  BinaryLogReader::BinaryLogReader(const std::string& filename)
+    : file_(filename)
+  {
+    const auto* data = reinterpret_cast<const uint8_t*>(file_.data());
+    const size_t size = file_.size();
+    if (size < FRAME_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+    {
+      throw std::runtime_error("'" + filename + "' is not a binary log.");
+    }
+    size_t pos = 0;
+    while (pos < size)
+    {
+      const size_t length = parseBlock_(data + pos, size - pos);
+      if (length > 0)
+      {
+        pos += length;
+        continue;
+      }
+      // cut short or damaged: resume at the next block header (a false match inside a payload fails to parse and is skipped likewise)
+      size_t next = pos + 1;
+      while (next < size && !isBlockStart(data + next, size - next))
+      {
+        const void* candidate = std::memchr(data + next + 1, MAGIC[0], size - next - 1);
+        next = candidate ? size_t(static_cast<const uint8_t*>(candidate) - data) : size;
+      }
+      skipped_bytes_ += next - pos;
+      pos = next;
+    }
+  }
+
+  size_t BinaryLogReader::parseBlock_(const uint8_t* data, const size_t size)
+  {
+    if (!isBlockStart(data, size)) return 0;
+    const size_t length = getU32(data + 4);
+    if (length > size - FRAME_SIZE) return 0;
+    try
+    {
+      Cursor cursor(data + FRAME_SIZE, length);
+      const uint64_t id = getU64(cursor.bytes(8));
+      if (data[3] == KIND_SCHEMA)
+      {
+        std::vector<std::string> names(cursor.varint());
+        for (auto& name : names)
+        {
+          const uint64_t n = cursor.varint();
+          name.assign(reinterpret_cast<const char*>(cursor.bytes(n)), n);
+        }
+        if (!cursor.atEnd()) return 0;
+        schemas_[id] = std::move(names);
+      }
+      else
+      {
+        const auto schema = schemas_.find(id);
+        if (schema == schemas_.end()) return 0; // its schema block was damaged
+        DataBlock block;
+        block.names = &schema->second;
+        block.rows = cursor.varint();
+        if (cursor.varint() != block.names->size()) return 0;
+        for (size_t c = 0; c < block.names->size(); ++c)
+        {
+          ColumnData column;
+          column.type = ColumnType(*cursor.bytes(1));
+          if (column.type > ColumnType::HUMAN_BYTES) return 0;
+          column.size = cursor.varint();
+          column.data = cursor.bytes(column.size);
+          block.columns.push_back(column);
+        }
+        if (!cursor.atEnd()) return 0;
+        blocks_.push_back(std::move(block));
+      }
+    }
+    catch (const std::runtime_error&)
+    {
+      return 0;
+    }
+    return FRAME_SIZE + length;
+  }
+
+  const std::vector<DataBlock>& BinaryLogReader::getBlocks() const
+  {
+    return blocks_;
+  }
+
+  size_t BinaryLogReader::getRowCount() const
+  {
+    size_t rows = 0;
+    for (const auto& block : blocks_) rows += block.rows;
+    return rows;
+  }
+
+  bool BinaryLogReader::isDamaged() const
+  {
+    return skipped_bytes_ > 0;
+  }
+
+  size_t BinaryLogReader::getSkippedBytes() const
+  {
+    return skipped_bytes_;
+  }
+
+  std::vector<int64_t> BinaryLogReader::decodeInts(const DataBlock& block, const size_t column)
+  {
+    const ColumnData& col = block.columns.at(column);
+    if (col.type != ColumnType::INT && col.type != ColumnType::TIMESTAMP && col.type != ColumnType::DURATION)
+    {
+      throw std::runtime_error("Column '" + (*block.names)[column] + "' is not an integer column.");
+    }
+    std::vector<int64_t> values(block.rows);
+    Cursor cursor(col.data, col.size);
+    int64_t previous = 0;
+    for (auto& value : values)
+    {
+      value = previous = int64_t(uint64_t(previous) + uint64_t(unzigzag(cursor.varint())));
+    }
+    return values;
+  }
+
+  std::vector<double> BinaryLogReader::decodeReals(const DataBlock& block, const size_t column)
+  {
+    const ColumnData& col = block.columns.at(column);
+    std::vector<double> values(block.rows);
+    switch (col.type)
+    {
+      case ColumnType::REAL:
+      {
+        Cursor cursor(col.data, col.size);
+        for (auto& value : values)
+        {
+          const uint64_t bits = getU64(cursor.bytes(8));
+          std::memcpy(&value, &bits, sizeof(value));
+        }
+      }
+      break; case ColumnType::INT:
+      {
+        const auto ints = decodeInts(block, column);
+        std::copy(ints.begin(), ints.end(), values.begin());
+      }
+      break; case ColumnType::TIMESTAMP:
+             case ColumnType::DURATION:
+      {
+        const auto ints = decodeInts(block, column);
+        for (size_t i = 0; i < ints.size(); ++i) values[i] = ints[i] / 1e9;
+      }
+      break; default:
+        throw std::runtime_error("Column '" + (*block.names)[column] + "' is not numeric.");
+    }
+    return values;
+  }
+
+  std::vector<std::string_view> BinaryLogReader::decodeStrings(const DataBlock& block, const size_t column)
+  {
+    const ColumnData& col = block.columns.at(column);
+    if (col.type != ColumnType::STRING)
+    {
+      throw std::runtime_error("Column '" + (*block.names)[column] + "' is not a string column.");
+    }
+    std::vector<std::string_view> values(block.rows);
+    Cursor cursor(col.data, col.size);
+    for (auto& value : values)
+    {
+      const uint64_t n = cursor.varint();
+      value = std::string_view(reinterpret_cast<const char*>(cursor.bytes(n)), n);
+    }
+    return values;
+  }
+
+  std::vector<std::string> BinaryLogReader::decodeCells(const DataBlock& block, const size_t column)
+  {
+    std::vector<std::string> cells;
+    cells.reserve(block.rows);
+    switch (block.columns.at(column).type)
+    {
+      case ColumnType::STRING:
+        for (const auto& s : decodeStrings(block, column)) cells.emplace_back(s);
+      break; case ColumnType::INT:
+        for (const auto v : decodeInts(block, column)) cells.push_back(printInt(v));
+      break; case ColumnType::TIMESTAMP:
+        for (const auto v : decodeInts(block, column)) cells.push_back(printTimestamp(v));
+      break; case ColumnType::DURATION:
+        for (const auto v : decodeInts(block, column)) cells.push_back(printDuration(v));
+      break; case ColumnType::REAL:
+        for (const auto v : decodeReals(block, column)) cells.push_back(printReal(v));
+      break; case ColumnType::HUMAN_BYTES:
+      {
+        const int sibling = block.findColumn((*block.names)[column] + " (bytes)");
+        if (sibling < 0) throw std::runtime_error("Column '" + (*block.names)[column] + "' lacks its byte count.");
+        for (const auto v : decodeInts(block, sibling)) cells.push_back(toHumanReadable(uint64_t(v)));
+      }
+    }
+    return cells;
+  }
+
+  void BinaryLogReader::writeTSV(std::ostream& out, const char separator) const
+  {
+    if (blocks_.empty()) return;
+    const auto& header = *blocks_.front().names;
+    for (size_t c = 0; c < header.size(); ++c)
+    {
+      if (c) out << separator;
+      out << header[c];
+    }
+    out << '\n';
+    for (const auto& block : blocks_)
+    {
+      std::vector<std::vector<std::string>> columns;
+      for (size_t c = 0; c < block.columns.size(); ++c) columns.push_back(decodeCells(block, c));
+      for (size_t r = 0; r < block.rows; ++r)
+      {
+        for (size_t c = 0; c < columns.size(); ++c)
+        {
+          if (c) out << separator;
+          out << columns[c][r];
+        }
+        out << '\n';
+      }
+    }
+  }
+
+} // namespace
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FileLog.h"
+#include "MappedFile.h"
+
+namespace WinTime
+{
+  /**
+    @brief A compact, typed, column-oriented alternative to the TSV log
+
+    The file is a sequence of self-contained blocks, each framed by a 4 byte tag ('WTL' + kind) and a 32 bit payload length:
+      - a schema block ('S') holds a 64 bit schema ID and the column names
+      - a data block ('D') refers to a schema by its ID and holds one or more rows, stored column by column;
+        each column has its own type and byte size, so a reader can skip columns it does not need.
+
+    Integer-like columns (INT, TIMESTAMP in ns since the epoch, DURATION in ns) are stored as zigzag varints of the
+    difference to the previous row. A column of human readable sizes (e.g. 'PeakWorkingSetSize') takes no space at all,
+    but is recomputed from its sibling column '<name> (bytes)'.
+
+    Blocks are created from the TSV cells which WinTime prints anyway. A type is only used for a column if printing
+    the decoded values reproduces the cells exactly (otherwise the column is stored as STRING), i.e. converting a TSV log
+    to binary and back is lossless. Where the writer passes the exact values of a column (see ExactColumns, e.g. the
+    nanoseconds of PTime), those are stored; durations only known as text with millisecond resolution are stored as the
+    middle of their millisecond.
+
+    Each append writes whole blocks under the same exclusive lock as the TSV log (see LockedFile), so several processes
+    can write to the same file. A block which is cut short (e.g. the writer was killed) or damaged is skipped: the reader
+    scans forward for the next block header.
+  */
+
+  enum class ColumnType : uint8_t
+  {
+    STRING = 0,
+    INT = 1,
+    REAL = 2,
+    TIMESTAMP = 3,
+    DURATION = 4,
+    HUMAN_BYTES = 5
+  };
+
+  const char* toString(const ColumnType type);
+
+  /// stable 64 bit ID of a list of column names (FNV-1a; does not change between runs or platforms)
+  uint64_t schemaID(const std::vector<std::string>& names);
+
+  /// split a line of a table (without the trailing newline) into its cells
+  std::vector<std::string> splitCells(const std::string_view line, const char separator);
+
+  /// A schema block for @p names
+  std::string encodeSchemaBlock(const std::vector<std::string>& names);
+
+  /// A data block for @p rows (each with one cell per entry of @p names) which refers to the schema of @p names.
+  /// Columns in @p exact are stored as TIMESTAMP or DURATION with those values, if they print as the cells.
+  /// @throw std::runtime_error if a row has the wrong number of cells
+  std::string encodeDataBlock(const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows, const ExactColumns& exact = {});
+
+  /// Lock @p filename and append @p rows as one data block, preceded by a schema block unless the file starts with the same schema
+  void appendBinaryLog(const std::string& filename, const OpenMode mode, const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows,
+                       const ExactColumns& exact = {});
+
+  /// true if @p filename exists and starts with a block of the binary log
+  bool isBinaryLog(const std::string& filename);
+
+  /// One column of a data block as stored in the file (not decoded yet)
+  struct ColumnData
+  {
+    ColumnType type{ ColumnType::STRING };
+    const uint8_t* data{ nullptr };
+    size_t size{ 0 };
+  };
+
+  /// A data block as found in the file
+  struct DataBlock
+  {
+    const std::vector<std::string>* names{ nullptr }; ///< column names of the schema
+    size_t rows{ 0 };
+    std::vector<ColumnData> columns;
+
+    /// index of column @p name, or -1 if the block has no such column
+    int findColumn(const std::string_view name) const;
+  };
+
+  /**
+    @brief Reads a binary log through a memory mapping
+
+    Opening the file only walks the block headers; columns are decoded on demand and without any text parsing.
+  */
+  class BinaryLogReader
+  {
+  public:
+    /// @throw std::runtime_error if the file cannot be mapped or does not start with a block
+    explicit BinaryLogReader(const std::string& filename);
+
+    /// the number of bytes which were skipped since they are not part of a valid block (0 for an intact file)
+    size_t getSkippedBytes() const;
+
+    const std::vector<DataBlock>& getBlocks() const;
+
+    /// total number of rows in all blocks
+    size_t getRowCount() const;
+
+    /// true if the file contains incomplete or damaged blocks (which were skipped)
+    bool isDamaged() const;
+
+    /// values of an INT, TIMESTAMP or DURATION column (durations/timestamps in ns)
+    /// @throw std::runtime_error for any other column type
+    static std::vector<int64_t> decodeInts(const DataBlock& block, const size_t column);
+
+    /// values of a REAL column, or of an integer-like column converted to double
+    /// @throw std::runtime_error for STRING and HUMAN_BYTES columns
+    static std::vector<double> decodeReals(const DataBlock& block, const size_t column);
+
+    /// values of a STRING column (pointing into the mapping)
+    /// @throw std::runtime_error for any other column type
+    static std::vector<std::string_view> decodeStrings(const DataBlock& block, const size_t column);
+
+    /// cells of any column, printed exactly as in the TSV log
+    static std::vector<std::string> decodeCells(const DataBlock& block, const size_t column);
+
+    /// Scan the numeric column @p name of all blocks, calling @p func for each value (durations/timestamps in seconds).
+    /// Blocks without this column, or where it is stored as text (e.g. because a cell was empty), are skipped.
+    template<typename Func>
+    void scanNumeric(const std::string_view name, Func func) const
+    {
+      for (const auto& block : blocks_)
+      {
+        const int c = block.findColumn(name);
+        if (c < 0 || block.columns[c].type == ColumnType::STRING || block.columns[c].type == ColumnType::HUMAN_BYTES) continue;
+        for (const double v : decodeReals(block, c)) func(v);
+      }
+    }
+
+    /// Write all rows as TSV: the header of the first schema, followed by all rows (like a TSV log with mixed rows)
+    void writeTSV(std::ostream& out, const char separator = '\t') const;
+
+  private:
+    /// Parse the block at @p data (with @p size bytes up to the end of the file) and add it to schemas_ or blocks_.
+    /// Returns its size, or 0 if it is incomplete or damaged.
+    size_t parseBlock_(const uint8_t* data, const size_t size);
+
+    MappedFile file_;
+    std::map<uint64_t, std::vector<std::string>> schemas_;
+    std::vector<DataBlock> blocks_;
+    size_t skipped_bytes_{ 0 };
+  };
+
+} // namespace
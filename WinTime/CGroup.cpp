@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "CGroup.h"
+
+#include "Memory.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace WinTime
+{
+  namespace
+  {
+    template<typename T>
+    std::string toCell(const std::optional<T>& value)
+    {
+      if (!value) return "";
+      std::stringstream ss;
+      ss << *value;
+      return ss.str();
+    }
+
+    std::string toBytes(const std::optional<uint64_t>& value)
+    {
+      return value ? toHumanReadable(*value) : "n/a";
+    }
+
+    std::string toTime(const std::optional<double>& value)
+    {
+      if (!value) return "n/a";
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.3f s", *value);
+      return buffer;
+    }
+
+    std::string toCount(const std::optional<uint64_t>& value)
+    {
+      return value ? std::to_string(*value) : "n/a";
+    }
+  }
+
+  void CGroupSummary::print() const
+  {
+    std::cerr << "CGroupMemoryPeak: " << toBytes(memory_peak) << '\n';
+    std::cerr << "CGroupMemory: anon " << toBytes(memory_anon) << ", file " << toBytes(memory_file)
+      << ", kernel " << toBytes(memory_kernel) << ", slab " << toBytes(memory_slab) << '\n';
+    std::cerr << "CGroupCPU: usage " << toTime(cpu_usage) << " (user " << toTime(cpu_user) << ", system " << toTime(cpu_system)
+      << "), throttled " << toCount(cpu_nr_throttled) << " times for " << toTime(cpu_throttled) << '\n';
+    std::cerr << "CGroupIO: read " << toBytes(io_rbytes) << " (" << toCount(io_rios) << " ops), written "
+      << toBytes(io_wbytes) << " (" << toCount(io_wios) << " ops)\n";
+    std::cerr << "CGroupPressure (some/full): cpu " << toTime(psi_cpu_some) << " / " << toTime(psi_cpu_full)
+      << ", memory " << toTime(psi_memory_some) << " / " << toTime(psi_memory_full)
+      << ", io " << toTime(psi_io_some) << " / " << toTime(psi_io_full) << '\n';
+  }
+
+  std::string CGroupSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << toCell(memory_peak) << separator
+      << toCell(memory_anon) << separator
+      << toCell(memory_file) << separator
+      << toCell(memory_kernel) << separator
+      << toCell(memory_slab) << separator
+      << toCell(cpu_usage) << separator
+      << toCell(cpu_user) << separator
+      << toCell(cpu_system) << separator
+      << toCell(cpu_nr_throttled) << separator
+      << toCell(cpu_throttled) << separator
+      << toCell(io_rbytes) << separator
+      << toCell(io_wbytes) << separator
+      << toCell(io_rios) << separator
+      << toCell(io_wios) << separator
+      << toCell(psi_cpu_some) << separator
+      << toCell(psi_cpu_full) << separator
+      << toCell(psi_memory_some) << separator
+      << toCell(psi_memory_full) << separator
+      << toCell(psi_io_some) << separator
+      << toCell(psi_io_full);
+    return where.str();
+  }
+
+  std::string CGroupSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "cg_memory_peak (bytes)" << separator
+      << "cg_memory_anon (bytes)" << separator
+      << "cg_memory_file (bytes)" << separator
+      << "cg_memory_kernel (bytes)" << separator
+      << "cg_memory_slab (bytes)" << separator
+      << "cg_cpu_usage" << separator
+      << "cg_cpu_user" << separator
+      << "cg_cpu_system" << separator
+      << "cg_cpu_nr_throttled" << separator
+      << "cg_cpu_throttled" << separator
+      << "cg_io_read (bytes)" << separator
+      << "cg_io_write (bytes)" << separator
+      << "cg_io_read_ops" << separator
+      << "cg_io_write_ops" << separator
+      << "psi_cpu_some" << separator
+      << "psi_cpu_full" << separator
+      << "psi_memory_some" << separator
+      << "psi_memory_full" << separator
+      << "psi_io_some" << separator
+      << "psi_io_full";
+    return where.str();
+  }
+
+#ifndef _WIN32
+  namespace
+  {
+    /// the whole content of a (small) file, or nothing if it cannot be read
+    std::optional<std::string> readFile(const std::string& path)
+    {
+      std::ifstream in(path);
+      if (!in) return std::nullopt;
+      std::stringstream ss;
+      ss << in.rdbuf();
+      return ss.str();
+    }
+
+    /// write @p data in a single write() call, as required by cgroupfs; returns false with errno set on failure
+    bool writeFile(const std::string& path, const std::string& data)
+    {
+      int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+      if (fd == -1) return false;
+      bool ok = write(fd, data.data(), data.size()) == ssize_t(data.size());
+      int err = errno;
+      close(fd);
+      errno = err;
+      return ok;
+    }
+
+    /// value of a 'key value' line in a flat keyed file (like cpu.stat or memory.stat)
+    std::optional<uint64_t> getKeyed(const std::string& content, const std::string& key)
+    {
+      std::istringstream in(content);
+      std::string k;
+      uint64_t v;
+      while (in >> k >> v)
+      {
+        if (k == key) return v;
+      }
+      return std::nullopt;
+    }
+
+    /// 'total=' of the 'some' or 'full' line of a pressure file, in seconds
+    std::optional<double> getPressure(const std::optional<std::string>& content, const std::string& line_type)
+    {
+      if (!content) return std::nullopt;
+      std::istringstream in(*content);
+      std::string line;
+      while (std::getline(in, line))
+      {
+        if (line.compare(0, line_type.size(), line_type) != 0) continue;
+        auto pos = line.find("total=");
+        if (pos == std::string::npos) return std::nullopt;
+        return std::stoull(line.substr(pos + 6)) / 1e6;
+      }
+      return std::nullopt;
+    }
+
+    /// whitespace separated words of @p content
+    bool containsWord(const std::string& content, const std::string& word)
+    {
+      std::istringstream in(content);
+      std::string w;
+      while (in >> w)
+      {
+        if (w == word) return true;
+      }
+      return false;
+    }
+
+    /// the leaf cgroup WinTime moved itself into, to be able to enable controllers for its parent
+    struct SelfLeaf
+    {
+      std::mutex mutex;
+      std::string parent;      ///< where WinTime was before
+      std::string path;        ///< empty: WinTime was not moved
+      std::string controllers; ///< what was enabled for the parent, e.g. '+memory +cpu'
+      unsigned users{ 0 };     ///< runs which still rely on it
+    };
+
+    SelfLeaf& getSelfLeaf()
+    {
+      static SelfLeaf leaf;
+      return leaf;
+    }
+  }
+
+  CGroupRun::CGroupRun()
+  {
+    std::string parent;
+    {
+      // resolved once for all concurrent runs (--batch): once WinTime moved itself into its leaf, /proc/self/cgroup names the leaf, not the parent
+      SelfLeaf& leaf = getSelfLeaf();
+      std::lock_guard lock(leaf.mutex);
+      if (!leaf.path.empty())
+      { // an earlier run did it all already
+        parent = leaf.parent;
+        ++leaf.users;
+        uses_self_ = true;
+      }
+      else
+      {
+        if (!findOwnCGroup_(parent)) return;
+        enableControllers_(parent); // not fatal: we just get fewer counters
+      }
+    }
+
+    static std::atomic<unsigned> counter{ 0 }; // concurrent runs (--batch) need distinct cgroups
+    const std::string path = parent + "/wintime-" + std::to_string(getpid()) + "-run" + std::to_string(counter++);
+    if (mkdir(path.c_str(), 0755) == -1)
+    {
+      fail_("cannot create cgroup '" + path + "'");
+      return;
+    }
+    fd_procs_ = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd_procs_ == -1)
+    {
+      fail_("cannot open '" + path + "/cgroup.procs'");
+      rmdir(path.c_str());
+      return;
+    }
+    path_ = path;
+  }
+
+  CGroupRun::~CGroupRun()
+  {
+    if (fd_procs_ != -1) close(fd_procs_);
+    if (!path_.empty() && rmdir(path_.c_str()) == -1)
+    {
+      std::cerr << "Warning: could not remove cgroup '" << path_ << "' (" << strerror(errno) << "). Descendants of the target might still be running in it.\n";
+    }
+    restoreControllers_();
+  }
+
+  bool CGroupRun::isValid() const
+  {
+    return fd_procs_ != -1;
+  }
+
+  const std::string& CGroupRun::getError() const
+  {
+    return error_;
+  }
+
+  const std::string& CGroupRun::getPath() const
+  {
+    return path_;
+  }
+
+  int CGroupRun::getProcsFD() const
+  {
+    return fd_procs_;
+  }
+
+  CGroupSummary CGroupRun::getSummary() const
+  {
+    CGroupSummary s;
+    auto us = [](std::optional<uint64_t> v) { return v ? std::optional<double>(*v / 1e6) : std::nullopt; };
+
+    if (auto peak = readFile(path_ + "/memory.peak"); peak && !peak->empty())
+    {
+      s.memory_peak = std::stoull(*peak);
+    }
+    if (auto mem = readFile(path_ + "/memory.stat"))
+    {
+      s.memory_anon = getKeyed(*mem, "anon");
+      s.memory_file = getKeyed(*mem, "file");
+      s.memory_kernel = getKeyed(*mem, "kernel");
+      s.memory_slab = getKeyed(*mem, "slab");
+    }
+    if (auto cpu = readFile(path_ + "/cpu.stat"))
+    {
+      s.cpu_usage = us(getKeyed(*cpu, "usage_usec"));
+      s.cpu_user = us(getKeyed(*cpu, "user_usec"));
+      s.cpu_system = us(getKeyed(*cpu, "system_usec"));
+      s.cpu_nr_throttled = getKeyed(*cpu, "nr_throttled");
+      s.cpu_throttled = us(getKeyed(*cpu, "throttled_usec"));
+    }
+    if (auto io = readFile(path_ + "/io.stat"))
+    { // one line per device: 'MAJ:MIN rbytes=1 wbytes=2 rios=3 wios=4 dbytes=5 dios=6'
+      s.io_rbytes = s.io_wbytes = s.io_rios = s.io_wios = 0;
+      std::istringstream in(*io);
+      std::string field;
+      while (in >> field)
+      {
+        auto pos = field.find('=');
+        if (pos == std::string::npos) continue;
+        auto key = field.substr(0, pos);
+        auto value = std::stoull(field.substr(pos + 1));
+        if (key == "rbytes") *s.io_rbytes += value;
+        else if (key == "wbytes") *s.io_wbytes += value;
+        else if (key == "rios") *s.io_rios += value;
+        else if (key == "wios") *s.io_wios += value;
+      }
+    }
+    auto cpu_pressure = readFile(path_ + "/cpu.pressure");
+    s.psi_cpu_some = getPressure(cpu_pressure, "some");
+    s.psi_cpu_full = getPressure(cpu_pressure, "full");
+    auto memory_pressure = readFile(path_ + "/memory.pressure");
+    s.psi_memory_some = getPressure(memory_pressure, "some");
+    s.psi_memory_full = getPressure(memory_pressure, "full");
+    auto io_pressure = readFile(path_ + "/io.pressure");
+    s.psi_io_some = getPressure(io_pressure, "some");
+    s.psi_io_full = getPressure(io_pressure, "full");
+    return s;
+  }
+
+  bool CGroupRun::fail_(const std::string& what)
+  {
+    error_ = what + ": " + strerror(errno);
+    return false;
+  }
+
+  bool CGroupRun::findOwnCGroup_(std::string& dir)
+  {
+    // the cgroup2 mount point: '36 35 0:30 / /sys/fs/cgroup rw,nosuid - cgroup2 cgroup2 rw'
+    std::ifstream mountinfo("/proc/self/mountinfo");
+    std::string line, mount_point;
+    while (std::getline(mountinfo, line))
+    {
+      auto dash = line.find(" - cgroup2 ");
+      if (dash == std::string::npos) continue;
+      std::istringstream fields(line.substr(0, dash));
+      std::string id, parent_id, dev, root;
+      fields >> id >> parent_id >> dev >> root >> mount_point;
+      break;
+    }
+    if (mount_point.empty())
+    {
+      errno = ENOENT;
+      return fail_("no cgroup2 file system is mounted");
+    }
+
+    // our own cgroup in the unified hierarchy: '0::/user.slice/...'
+    std::ifstream cgroup("/proc/self/cgroup");
+    std::string own;
+    while (std::getline(cgroup, line))
+    {
+      if (line.compare(0, 3, "0::") == 0) own = line.substr(3);
+    }
+    if (own.empty())
+    {
+      errno = ENOENT;
+      return fail_("not a member of a cgroup2 hierarchy");
+    }
+    dir = mount_point + (own == "/" ? "" : own);
+    return true;
+  }
+
+  bool CGroupRun::enableControllers_(const std::string& parent)
+  {
+    SelfLeaf& leaf = getSelfLeaf();
+    auto available = readFile(parent + "/cgroup.controllers");
+    auto enabled = readFile(parent + "/cgroup.subtree_control");
+    if (!available || !enabled) return false;
+
+    std::string request;
+    for (const char* controller : { "memory", "cpu", "io" })
+    {
+      if (containsWord(*available, controller) && !containsWord(*enabled, controller)) request += std::string(request.empty() ? "+" : " +") + controller;
+    }
+    if (request.empty()) return true;
+
+    const std::string subtree_control = parent + "/cgroup.subtree_control";
+    if (writeFile(subtree_control, request)) return true;
+    if (errno != EBUSY) return fail_("cannot enable '" + request + "' for '" + parent + "'");
+
+    // our cgroup has processes (at least us): move ourselves into a leaf first
+    const std::string self = parent + "/wintime-" + std::to_string(getpid()) + "-self";
+    if (mkdir(self.c_str(), 0755) == -1 && errno != EEXIST) return fail_("cannot create cgroup '" + self + "'");
+    if (!writeFile(self + "/cgroup.procs", "0"))
+    {
+      fail_("cannot move WinTime into '" + self + "'");
+      rmdir(self.c_str());
+      return false;
+    }
+    leaf.parent = parent;
+    leaf.path = self;
+    leaf.users = 1;
+    uses_self_ = true;
+    if (!writeFile(subtree_control, request)) return fail_("cannot enable '" + request + "' for '" + parent + "'");
+    leaf.controllers = request;
+    return true;
+  }
+
+  void CGroupRun::restoreControllers_()
+  {
+    if (!uses_self_) return;
+    SelfLeaf& leaf = getSelfLeaf();
+    std::lock_guard lock(leaf.mutex);
+    if (--leaf.users > 0) return;
+
+    // the parent may only contain processes again without controllers enabled for its children
+    std::string disable = leaf.controllers;
+    for (auto pos = disable.find('+'); pos != std::string::npos; pos = disable.find('+', pos)) disable[pos] = '-';
+    if (!disable.empty() && !writeFile(leaf.parent + "/cgroup.subtree_control", disable))
+    {
+      std::cerr << "Warning: could not disable '" << leaf.controllers << "' for cgroup '" << leaf.parent << "' (" << strerror(errno) << ").\n";
+    }
+    if (!writeFile(leaf.parent + "/cgroup.procs", "0") || rmdir(leaf.path.c_str()) == -1)
+    {
+      std::cerr << "Warning: could not leave and remove cgroup '" << leaf.path << "' (" << strerror(errno) << ").\n";
+    }
+    leaf.path.clear();
+    leaf.controllers.clear();
+  }
+#endif
+
+} // namespace
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+
+namespace WinTime
+{
+  /**
+    @brief Counters of a cgroup (v2), i.e. of all processes which ever ran inside it
+
+    Each counter is only present if the kernel provides it for the cgroup, which depends on the controllers
+    enabled for it (e.g. 'memory.peak' needs the memory controller and Linux 5.19+, pressure needs CONFIG_PSI).
+    Times are in seconds, sizes in bytes.
+  */
+  struct CGroupSummary
+  {
+    std::optional<uint64_t> memory_peak;     ///< memory.peak
+    std::optional<uint64_t> memory_anon;     ///< memory.stat: anon (at the end of the run)
+    std::optional<uint64_t> memory_file;     ///< memory.stat: file (page cache)
+    std::optional<uint64_t> memory_kernel;   ///< memory.stat: kernel
+    std::optional<uint64_t> memory_slab;     ///< memory.stat: slab
+    std::optional<double> cpu_usage;         ///< cpu.stat: usage_usec
+    std::optional<double> cpu_user;          ///< cpu.stat: user_usec
+    std::optional<double> cpu_system;        ///< cpu.stat: system_usec
+    std::optional<uint64_t> cpu_nr_throttled;///< cpu.stat: nr_throttled
+    std::optional<double> cpu_throttled;     ///< cpu.stat: throttled_usec
+    std::optional<uint64_t> io_rbytes;       ///< io.stat: sum of rbytes over all devices
+    std::optional<uint64_t> io_wbytes;       ///< io.stat: sum of wbytes over all devices
+    std::optional<uint64_t> io_rios;         ///< io.stat: sum of rios over all devices
+    std::optional<uint64_t> io_wios;         ///< io.stat: sum of wios over all devices
+    std::optional<double> psi_cpu_some;      ///< cpu.pressure: total stall time (some)
+    std::optional<double> psi_cpu_full;      ///< cpu.pressure: total stall time (full)
+    std::optional<double> psi_memory_some;   ///< memory.pressure: total stall time (some)
+    std::optional<double> psi_memory_full;   ///< memory.pressure: total stall time (full)
+    std::optional<double> psi_io_some;       ///< io.pressure: total stall time (some)
+    std::optional<double> psi_io_full;       ///< io.pressure: total stall time (full)
+
+    void print() const;
+
+    /// missing counters are written as empty cells
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+#ifndef _WIN32
+  /**
+    @brief A transient cgroup (v2) to run a target in, so that it and all its descendants are accounted for by the kernel
+
+    The cgroup is created as a child of the cgroup WinTime runs in (which must be writable, e.g. delegated
+    via 'systemd-run --user --scope -p Delegate=yes'). The memory, cpu and io controllers are enabled for it
+    if the parent offers them. If the parent contains processes (i.e. WinTime itself), controllers cannot be
+    enabled ('no internal processes' rule); WinTime then moves itself into a leaf cgroup 'wintime-<pid>-self' first.
+    That leaf is shared by concurrent runs; the last one to finish disables the controllers again, moves WinTime back and removes it.
+
+    The cgroup is removed in the destructor.
+  */
+  class CGroupRun
+  {
+  public:
+    /// Create the cgroup. Use isValid() to check for success, and getError() for the reason of a failure.
+    CGroupRun();
+
+    CGroupRun(const CGroupRun&) = delete;
+    void operator=(const CGroupRun&) = delete;
+
+    /// removes the cgroup (which must be empty by then)
+    ~CGroupRun();
+
+    bool isValid() const;
+
+    /// why the cgroup could not be created
+    const std::string& getError() const;
+
+    /// path of the cgroup directory
+    const std::string& getPath() const;
+
+    /// open 'cgroup.procs' of the cgroup (valid while this object lives); a process joins by writing "0" to it
+    int getProcsFD() const;
+
+    /// read all available counters
+    CGroupSummary getSummary() const;
+
+  private:
+    /// set error_ from errno and return false
+    bool fail_(const std::string& what);
+
+    /// find the cgroup2 mount point and our own cgroup; returns the directory of our cgroup
+    bool findOwnCGroup_(std::string& dir);
+
+    /// enable as many of the memory, cpu and io controllers as @p parent offers for its children (with the mutex of the self leaf held)
+    bool enableControllers_(const std::string& parent);
+
+    /// undo what enableControllers_() did, if this is the last run which relies on it
+    void restoreControllers_();
+
+    std::string path_;
+    std::string error_;
+    int fd_procs_{ -1 };
+    bool uses_self_{ false }; ///< WinTime was moved into its leaf cgroup for this run (or an earlier, concurrent one)
+  };
+#endif
+
+} // namespace
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "Calibration.h"
+
+#include "FileLog.h"
+#include "Process.h"
+#include "Statistics.h"
+#include "Time.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    const char SEPARATOR = '\t';
+
+    std::vector<std::string> split(const std::string& line, const char separator)
+    {
+      std::vector<std::string> cells;
+      std::stringstream ss(line);
+      std::string cell;
+      while (std::getline(ss, cell, separator)) cells.push_back(cell);
+      return cells;
+    }
+
+    /// the overhead is in the order of milliseconds, which toTimeDiffString() would round away
+    std::string toMilliseconds(const double seconds)
+    {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.3f ms", seconds * 1000);
+      return buffer;
+    }
+
+    /// raw seconds with ns resolution, for the log columns
+    std::string toExactSeconds(const double seconds)
+    {
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%.9f", seconds);
+      return buffer;
+    }
+  }
+
+  Calibration Calibration::fromRuns(const std::string& host, const std::vector<RunMeasurement>& runs)
+  {
+    std::vector<double> wall, user, kernel;
+    for (const auto& r : runs)
+    {
+      wall.push_back(r.t_wall);
+      user.push_back(r.t_user);
+      kernel.push_back(r.t_kernel);
+    }
+    std::sort(wall.begin(), wall.end());
+
+    Calibration c;
+    c.host = host;
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+    c.date = toISO8601(now.count());
+    c.runs = runs.size();
+    c.wall_median = median(wall);
+    c.wall_p95 = percentile(wall, 95);
+    c.user_median = median(user);
+    c.kernel_median = median(kernel);
+    return c;
+  }
+
+  void Calibration::print() const
+  {
+    std::cerr << "Calibration of '" << host << "' (" << runs << " runs of a no-op target, " << date << "):\n"
+              << "  wall time median: " << toMilliseconds(wall_median) << " (p95: " << toMilliseconds(wall_p95) << ")\n"
+              << "  user time median: " << toMilliseconds(user_median) << "\n"
+              << "kernel time median: " << toMilliseconds(kernel_median) << "\n";
+  }
+
+  std::string getHostName()
+  {
+#ifdef _WIN32
+    wchar_t name[256];
+    DWORD size = sizeof(name) / sizeof(name[0]);
+    if (!GetComputerNameExW(ComputerNameDnsHostname, name, &size)) return "localhost";
+    return narrow(std::wstring(name, size));
+#else
+    char name[256]{};
+    if (gethostname(name, sizeof(name) - 1) != 0) return "localhost";
+    return name;
+#endif
+  }
+
+  std::string getDefaultCalibrationFile()
+  {
+    std::filesystem::path dir;
+#ifdef _WIN32
+    const wchar_t* app_data = _wgetenv(L"LOCALAPPDATA");
+    if (!app_data || !*app_data) throw std::runtime_error("LOCALAPPDATA is not set. Use --calibration=FILE.");
+    dir = std::filesystem::path(app_data) / "WinTime";
+#else
+    const char* config = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    if (config && *config) dir = std::filesystem::path(config) / "wintime";
+    else if (home && *home) dir = std::filesystem::path(home) / ".config" / "wintime";
+    else throw std::runtime_error("Neither XDG_CONFIG_HOME nor HOME is set. Use --calibration=FILE.");
+#endif
+    return (dir / "calibration.tsv").string();
+  }
+
+  CalibrationStore::CalibrationStore(const std::string& filename)
+    : filename_(filename)
+  {
+    std::ifstream in{ std::filesystem::path(filename) };
+    if (!in) return;
+    parse_(in, filename, entries_);
+  }
+
+  void CalibrationStore::parse_(std::istream& in, const std::string& filename, Entries& entries)
+  {
+    std::string line;
+    std::getline(in, line); // header
+    size_t line_number = 1;
+    while (std::getline(in, line))
+    {
+      ++line_number;
+      if (line.empty()) continue;
+      const auto cells = split(line, SEPARATOR);
+      if (cells.size() != 7)
+      {
+        throw std::runtime_error("Calibration file '" + filename + "' is malformed in line " + std::to_string(line_number) + ".");
+      }
+      Calibration c;
+      c.host = cells[0];
+      c.date = cells[1];
+      c.runs = std::stoull(cells[2]);
+      c.wall_median = std::stod(cells[3]);
+      c.wall_p95 = std::stod(cells[4]);
+      c.user_median = std::stod(cells[5]);
+      c.kernel_median = std::stod(cells[6]);
+      entries[c.host] = c;
+    }
+  }
+
+  std::optional<Calibration> CalibrationStore::get(const std::string& host) const
+  {
+    auto it = entries_.find(host);
+    if (it == entries_.end()) return std::nullopt;
+    return it->second;
+  }
+
+  void CalibrationStore::set(const Calibration& calibration)
+  {
+    entries_[calibration.host] = calibration;
+    changed_.insert(calibration.host);
+  }
+
+  void CalibrationStore::save() const
+  {
+    const auto dir = std::filesystem::path(filename_).parent_path();
+    if (!dir.empty()) std::filesystem::create_directories(dir);
+
+    // another host may have saved its calibration since we loaded the shared file: merge under the lock, or it would be lost
+    LockedFile file(filename_, OpenMode::OVERWRITE);
+    if (!file.lock())
+    {
+      throw std::runtime_error("Could not lock calibration file '" + filename_ + "'.");
+    }
+    std::string content;
+    char buffer[4096];
+    for (size_t n; (n = file.readAt(buffer, sizeof(buffer), int64_t(content.size()))) > 0;)
+    {
+      content.append(buffer, n);
+    }
+    Entries merged;
+    std::istringstream in(content);
+    parse_(in, filename_, merged);
+    for (const auto& host : changed_)
+    {
+      merged[host] = entries_.at(host);
+    }
+
+    const char sep = SEPARATOR;
+    std::stringstream header, rows;
+    header << "host" << sep << "date" << sep << "runs" << sep << "wall_median" << sep << "wall_p95" << sep
+      << "user_median" << sep << "kernel_median" << '\n';
+    rows.precision(9);
+    for (const auto& [host, c] : merged)
+    {
+      rows << host << sep << c.date << sep << c.runs << sep << c.wall_median << sep << c.wall_p95 << sep
+        << c.user_median << sep << c.kernel_median << '\n';
+    }
+    file.write(header.str().c_str());
+    file.write(rows.str().c_str());
+  }
+
+  double OverheadEstimate::getCorrectedWall() const
+  {
+    return std::max(0.0, t_wall - overhead);
+  }
+
+  void OverheadEstimate::print() const
+  {
+    std::cerr << "     Overhead: " << toMilliseconds(overhead) << " (calibrated wall time of a no-op target)\n";
+    std::cerr << "Wall-Overhead: " << toTimeDiffString(getCorrectedWall()) << "\n";
+  }
+
+  std::string OverheadEstimate::print(const char separator) const
+  {
+    std::stringstream where;
+    where << toExactSeconds(overhead) << separator
+      << toExactSeconds(getCorrectedWall());
+    return where.str();
+  }
+
+  std::string OverheadEstimate::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "wrapper_overhead" << separator
+      << "wall_time_corrected";
+    return where.str();
+  }
+
+} // namespace
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+namespace WinTime
+{
+  /**
+    @brief The times WinTime reports for a target which does nothing, i.e. the floor of every measurement on a host
+
+    The wall time of a no-op target is the cost of spawning, loading and reaping a process plus the cost of
+    WinTime's own bookkeeping in between, i.e. the part of each reported wall time which is the wrapper's fault.
+  */
+  struct Calibration
+  {
+    std::string host;
+    std::string date;          ///< when the calibration was done (ISO-8601, UTC)
+    size_t runs{ 0 };
+    double wall_median{ 0 };   ///< seconds
+    double wall_p95{ 0 };      ///< seconds
+    double user_median{ 0 };   ///< seconds
+    double kernel_median{ 0 }; ///< seconds
+
+    /// summarize the runs of a no-op target on @p host (@p runs must not be empty)
+    static Calibration fromRuns(const std::string& host, const std::vector<RunMeasurement>& runs);
+
+    void print() const;
+  };
+
+  /// name of this host, as used to key the calibration store
+  std::string getHostName();
+
+  /// the default calibration store of the current user:
+  /// '%LOCALAPPDATA%\\WinTime\\calibration.tsv' on Windows, '$XDG_CONFIG_HOME/wintime/calibration.tsv' (or '~/.config/...') elsewhere
+  /// @throw std::runtime_error if there is no home directory
+  std::string getDefaultCalibrationFile();
+
+  /**
+    @brief A file of calibrations, one row per host
+
+    Saving the calibration of a host replaces its earlier one and keeps all other hosts,
+    so a single file can be shared between machines (e.g. in a home directory on a network drive).
+  */
+  class CalibrationStore
+  {
+  public:
+    /// load @p filename if it exists
+    /// @throw std::runtime_error if the file is malformed
+    explicit CalibrationStore(const std::string& filename);
+
+    /// the calibration of @p host, if any
+    std::optional<Calibration> get(const std::string& host) const;
+
+    /// replace the calibration of its host
+    void set(const Calibration& calibration);
+
+    /// write all hosts to the file (creating its directory if needed);
+    /// hosts saved by another process since loading are kept, hosts passed to set() replace theirs
+    /// @throw std::runtime_error if the file cannot be locked or has become malformed
+    void save() const;
+
+  private:
+    using Entries = std::map<std::string, Calibration>;
+
+    /// add the rows of the table in @p in to @p entries
+    /// @throw std::runtime_error if a row is malformed
+    static void parse_(std::istream& in, const std::string& filename, Entries& entries);
+
+    std::string filename_;
+    Entries entries_;
+    std::set<std::string> changed_; ///< hosts passed to set()
+  };
+
+  /// The calibrated wrapper overhead next to a measured wall time, which is reported unchanged (see --overhead)
+  struct OverheadEstimate
+  {
+    double overhead{ 0 };     ///< median wall time of a no-op target on this host (seconds)
+    double t_wall{ 0 };       ///< the measured (raw) wall time
+
+    /// wall time minus overhead, but at least 0
+    double getCorrectedWall() const;
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+} // namespace
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "CommandIndex.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace WinTime
+{
+  namespace
+  {
+    const char INDEX_MAGIC[8] = { 'W', 'T', 'I', 'D', 'X', '0', '0', '1' };
+    constexpr size_t INDEX_HEADER_SIZE = 16;
+    constexpr size_t RECORD_SIZE = 16;
+
+    void putU64(std::string& out, const uint64_t value)
+    {
+      for (int i = 0; i < 8; ++i) out.push_back(char(value >> (8 * i)));
+    }
+
+    uint64_t getU64(const char* p)
+    {
+      uint64_t value = 0;
+      for (int i = 0; i < 8; ++i) value |= uint64_t(uint8_t(p[i])) << (8 * i);
+      return value;
+    }
+
+    std::string indexHeader(const uint64_t sorted)
+    {
+      std::string header(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+      putU64(header, sorted);
+      return header;
+    }
+
+    std::string indexRecord(const uint64_t hash, const int64_t offset)
+    {
+      std::string record;
+      putU64(record, hash);
+      putU64(record, uint64_t(offset));
+      return record;
+    }
+
+    std::string dictionaryHeader()
+    {
+      return CommandHash::printHeader('\t') + '\t' + Command::printHeader('\t') + '\n';
+    }
+
+    bool isMissingOrEmpty(const std::string& filename)
+    {
+      return !std::filesystem::exists(filename) || std::filesystem::file_size(filename) == 0;
+    }
+
+    /// does @p header (the first line of a log) start with the column @p name?
+    bool startsWithColumn(const std::string_view header, const std::string_view name)
+    {
+      return header.substr(0, name.size()) == name && (header.size() == name.size() || header[name.size()] == '\t' || header[name.size()] == '\r' || header[name.size()] == '\n');
+    }
+
+    /// does the dictionary of @p log_file have an entry for @p hash?
+    /// Reads one line per distinct command (unlike the index, which has one record per row), without keeping the command lines.
+    bool isInDictionary(const std::string& log_file, const uint64_t hash)
+    {
+      std::ifstream in(dictionaryFile(log_file), std::ios::binary);
+      std::string line;
+      std::getline(in, line); // header
+      while (std::getline(in, line))
+      {
+        const size_t tab = line.find('\t');
+        if (tab != std::string::npos && parseHash(std::string_view(line).substr(0, tab)) == hash) return true;
+      }
+      return false;
+    }
+  }
+
+  std::string dictionaryFile(const std::string& log_file)
+  {
+    return log_file + ".cmds.tsv";
+  }
+
+  std::string indexFile(const std::string& log_file)
+  {
+    return log_file + ".idx";
+  }
+
+  std::optional<uint64_t> parseHash(const std::string_view hex)
+  {
+    uint64_t hash;
+    if (hex.size() != 16) return std::nullopt;
+    const auto [ptr, ec] = std::from_chars(hex.data(), hex.data() + hex.size(), hash, 16);
+    if (ec != std::errc() || ptr != hex.data() + hex.size()) return std::nullopt;
+    return hash;
+  }
+
+  CommandDictionary::CommandDictionary(const std::string& log_file)
+  {
+    std::ifstream in(dictionaryFile(log_file), std::ios::binary);
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line))
+    {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      const size_t tab = line.find('\t');
+      const auto hash = parseHash(std::string_view(line).substr(0, tab));
+      if (hash && tab != std::string::npos) commands_.emplace(*hash, line.substr(tab + 1));
+    }
+  }
+
+  const std::string* CommandDictionary::find(const uint64_t hash) const
+  {
+    const auto it = commands_.find(hash);
+    return it == commands_.end() ? nullptr : &it->second;
+  }
+
+  size_t CommandDictionary::size() const
+  {
+    return commands_.size();
+  }
+
+  CommandIndex::CommandIndex(const std::string& log_file)
+  {
+    const std::string filename = indexFile(log_file);
+    if (isMissingOrEmpty(filename)) return;
+    file_.emplace(filename);
+    if (file_->size() < INDEX_HEADER_SIZE || std::memcmp(file_->data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+    {
+      throw std::runtime_error("'" + filename + "' is not an index of a WinTime log.");
+    }
+    records_ = (file_->size() - INDEX_HEADER_SIZE) / RECORD_SIZE; // ignore a record which is cut short
+    sorted_ = std::min(size_t(getU64(file_->data() + 8)), records_);
+  }
+
+  bool CommandIndex::contains(const uint64_t hash) const
+  {
+    return !find(hash).empty();
+  }
+
+  std::vector<int64_t> CommandIndex::find(const uint64_t hash) const
+  {
+    std::vector<int64_t> offsets;
+    if (!file_) return offsets;
+    const char* records = file_->data() + INDEX_HEADER_SIZE;
+    const auto hashAt = [&](const size_t i) { return getU64(records + i * RECORD_SIZE); };
+    const auto offsetAt = [&](const size_t i) { return int64_t(getU64(records + i * RECORD_SIZE + 8)); };
+
+    // binary search for the first sorted record of hash
+    size_t lower = 0, upper = sorted_;
+    while (lower < upper)
+    {
+      const size_t mid = lower + (upper - lower) / 2;
+      if (hashAt(mid) < hash) lower = mid + 1;
+      else upper = mid;
+    }
+    for (size_t i = lower; i < sorted_ && hashAt(i) == hash; ++i) offsets.push_back(offsetAt(i));
+    // the unsorted tail (appended in order, i.e. with ascending offsets)
+    for (size_t i = sorted_; i < records_; ++i)
+    {
+      if (hashAt(i) == hash) offsets.push_back(offsetAt(i));
+    }
+    return offsets;
+  }
+
+  void appendInternedRow(const std::string& log_file, const OpenMode mode, const std::string& cmd, const std::string& header, const std::string& line)
+  {
+    const uint64_t hash = commandHash(cmd);
+    LockedFile lockf(log_file, mode);
+    if (!lockf.lock())
+    {
+      throw std::runtime_error("Could not lock file '" + log_file + "'.");
+    }
+
+    // the dictionary and index are only written while holding the lock of the log
+    const bool is_new = lockf.isFileEmpty();
+    if (is_new)
+    {
+      lockf.write(header.c_str());
+    }
+    else
+    {
+      char head[16]{};
+      const size_t n = lockf.readAt(head, sizeof(head), 0);
+      if (!startsWithColumn(std::string_view(head, n), CommandHash::printHeader('\t')))
+      {
+        throw std::runtime_error("'" + log_file + "' contains full command lines. Compact it first (wintime-logconv compact) or use another file.");
+      }
+    }
+
+    if (is_new || !isInDictionary(log_file, hash))
+    {
+      const bool needs_header = is_new || isMissingOrEmpty(dictionaryFile(log_file));
+      std::ofstream dictionary(dictionaryFile(log_file), std::ios::binary | (is_new ? std::ios::trunc : std::ios::app));
+      if (needs_header) dictionary << dictionaryHeader();
+      dictionary << toHex(hash) << '\t' << cmd << '\n';
+    }
+
+    const int64_t offset = lockf.position();
+    lockf.write(line.c_str());
+
+    const bool needs_header = is_new || isMissingOrEmpty(indexFile(log_file));
+    std::ofstream index(indexFile(log_file), std::ios::binary | (is_new ? std::ios::trunc : std::ios::app));
+    if (needs_header) index << indexHeader(0);
+    index << indexRecord(hash, offset);
+    if (!index)
+    {
+      std::cerr << "Could not update the index '" << indexFile(log_file) << "'. Rebuild it with 'wintime-logconv compact'.\n";
+    }
+  }
+
+  void CompactionSummary::print() const
+  {
+    std::cerr << "Compacted " << rows << " rows with " << commands << " distinct commands: "
+              << toHumanReadable(bytes_before) << " -> " << toHumanReadable(bytes_after) << '\n';
+    if (unknown_hashes > 0)
+    {
+      std::cerr << "Warning: " << unknown_hashes << " command hashes have no entry in the dictionary. They were kept, but their command lines are unknown.\n";
+    }
+  }
+
+  CompactionSummary compactLog(const std::string& log_file)
+  {
+    CompactionSummary summary;
+    if (!std::filesystem::exists(log_file))
+    {
+      throw std::runtime_error("'" + log_file + "' does not exist.");
+    }
+    // APPEND, so nothing is lost if anything fails before the log is rewritten below
+    LockedFile lockf(log_file, OpenMode::APPEND, true);
+    if (!lockf.lock())
+    {
+      throw std::runtime_error("Could not lock file '" + log_file + "'.");
+    }
+    summary.bytes_before = uint64_t(lockf.position());
+
+    const CommandDictionary known(log_file);
+    std::vector<std::pair<uint64_t, std::string>> dictionary; // in order of first appearance
+    std::unordered_set<uint64_t> seen;
+    std::vector<std::pair<uint64_t, int64_t>> index;
+
+    const std::string tmp_file = log_file + ".compact.tmp";
+    {
+      std::ofstream tmp(tmp_file, std::ios::binary | std::ios::trunc);
+      if (!tmp)
+      {
+        throw std::runtime_error("Could not create '" + tmp_file + "'.");
+      }
+      int64_t offset = 0;
+      bool is_header = true;
+      bool hashed = false; // the log has a 'cmd_hash' column already
+      // rewrite one line (including its line break, if any)
+      const auto compactLine = [&](const std::string_view line)
+      {
+        if (is_header)
+        {
+          is_header = false;
+          std::string_view rest;
+          hashed = startsWithColumn(line, CommandHash::printHeader('\t'));
+          if (hashed) rest = line.substr(CommandHash::printHeader('\t').size());
+          else if (startsWithColumn(line, Command::printHeader('\t'))) rest = line.substr(Command::printHeader('\t').size());
+          else throw std::runtime_error("'" + log_file + "' does not start with a 'cmd' column.");
+          tmp << CommandHash::printHeader('\t') << rest;
+          offset += int64_t(CommandHash::printHeader('\t').size() + rest.size());
+          return;
+        }
+        const size_t end = std::min(line.find('\t'), line.find_first_of("\r\n"));
+        const std::string_view cell = line.substr(0, end);
+        const std::string_view rest = line.substr(std::min(end, line.size()));
+        // in a hashed log, a cell is a hash (hashing it again would lose the command for good), otherwise a command line
+        const auto hash = hashed ? parseHash(cell) : std::nullopt;
+        const std::string* cmd = hash ? known.find(*hash) : nullptr;
+        const uint64_t h = hash ? *hash : commandHash(cell);
+        if (seen.insert(h).second)
+        {
+          if (hash && !cmd) ++summary.unknown_hashes;
+          else dictionary.emplace_back(h, cmd ? *cmd : std::string(cell));
+        }
+        index.emplace_back(h, offset);
+        tmp << toHex(h) << rest;
+        offset += int64_t(16 + rest.size());
+        ++summary.rows;
+      };
+
+      std::vector<char> buffer(1 << 20);
+      std::string pending;
+      for (int64_t pos = 0; pos < int64_t(summary.bytes_before);)
+      {
+        const size_t n = lockf.readAt(buffer.data(), buffer.size(), pos);
+        if (n == 0) break;
+        pos += int64_t(n);
+        pending.append(buffer.data(), n);
+        size_t start = 0;
+        for (size_t nl; (nl = pending.find('\n', start)) != std::string::npos; start = nl + 1)
+        {
+          compactLine(std::string_view(pending).substr(start, nl + 1 - start));
+        }
+        pending.erase(0, start);
+      }
+      if (!pending.empty()) compactLine(pending);
+      if (!tmp.flush())
+      {
+        throw std::runtime_error("Could not write '" + tmp_file + "'.");
+      }
+    }
+
+    // replace the content of the log (which is still locked); the rest is cut off when the lock is released
+    {
+      std::ifstream tmp(tmp_file, std::ios::binary);
+      std::vector<char> buffer(1 << 20);
+      lockf.rewind();
+      while (tmp.read(buffer.data(), std::streamsize(buffer.size())) || tmp.gcount() > 0)
+      {
+        lockf.write(buffer.data(), size_t(tmp.gcount()));
+      }
+      summary.bytes_after = uint64_t(lockf.position());
+    }
+    std::filesystem::remove(tmp_file);
+
+    std::ofstream dict(dictionaryFile(log_file), std::ios::binary | std::ios::trunc);
+    dict << dictionaryHeader();
+    for (const auto& [hash, cmd] : dictionary) dict << toHex(hash) << '\t' << cmd << '\n';
+
+    std::sort(index.begin(), index.end());
+    std::string records = indexHeader(index.size());
+    for (const auto& [hash, offset] : index) records += indexRecord(hash, offset);
+    std::ofstream(indexFile(log_file), std::ios::binary | std::ios::trunc) << records;
+
+    summary.commands = dictionary.size();
+    return summary;
+  }
+
+  std::string commandHistory(const std::string& log_file, const std::string& cmd)
+  {
+    std::ifstream in(log_file, std::ios::binary);
+    if (!in)
+    {
+      throw std::runtime_error("Could not open '" + log_file + "'.");
+    }
+    std::string header, line;
+    std::getline(in, header);
+    std::ostringstream out;
+    const std::string hashed = CommandHash::printHeader('\t');
+    if (startsWithColumn(header, hashed))
+    {
+      out << Command::printHeader('\t') << header.substr(hashed.size()) << '\n';
+      const uint64_t hash = commandHash(cmd);
+      const std::string hex = toHex(hash);
+      for (const int64_t offset : CommandIndex(log_file).find(hash))
+      {
+        in.clear();
+        in.seekg(offset);
+        if (std::getline(in, line) && line.compare(0, hex.size(), hex) == 0)
+        {
+          out << cmd << line.substr(hex.size()) << '\n';
+        }
+      }
+    }
+    else
+    { // not compacted: scan
+      out << header << '\n';
+      while (std::getline(in, line))
+      {
+        if (line.compare(0, line.find('\t'), cmd) == 0) out << line << '\n';
+      }
+    }
+    return out.str();
+  }
+
+} // namespace
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "FileLog.h"
+#include "MappedFile.h"
+
+namespace WinTime
+{
+  /**
+    @brief Companion files of a TSV log whose rows carry only the hash of the command line (the 'cmd_hash' column)
+
+    - '<log>.cmds.tsv', the dictionary, holds each distinct command line once: 'cmd_hash <tab> cmd'.
+    - '<log>.idx', the index, maps each hash to the byte offsets of its rows in the log. It is a 16 byte header
+      ('WTIDX001' and the number of sorted records), followed by 16 byte records (hash, offset; little endian).
+      compactLog() sorts all records by hash and offset; records appended later follow unsorted, so a lookup
+      is a binary search plus a scan of the (short) tail.
+
+    Both are only modified while holding the lock of the log itself.
+  */
+
+  /// name of the dictionary of @p log_file
+  std::string dictionaryFile(const std::string& log_file);
+
+  /// name of the index of @p log_file
+  std::string indexFile(const std::string& log_file);
+
+  /// parse 16 hex digits as printed by toHex()
+  std::optional<uint64_t> parseHash(const std::string_view hex);
+
+  /// The dictionary of a log, in memory
+  class CommandDictionary
+  {
+  public:
+    /// read the dictionary of @p log_file (empty if there is none)
+    explicit CommandDictionary(const std::string& log_file);
+
+    /// the command line of @p hash, or nullptr if it is unknown
+    const std::string* find(const uint64_t hash) const;
+
+    size_t size() const;
+
+  private:
+    std::unordered_map<uint64_t, std::string> commands_;
+  };
+
+  /// The index of a log, memory-mapped
+  class CommandIndex
+  {
+  public:
+    /// map the index of @p log_file (empty if there is none)
+    /// @throw std::runtime_error if it is damaged
+    explicit CommandIndex(const std::string& log_file);
+
+    /// true if any row of @p hash was indexed
+    bool contains(const uint64_t hash) const;
+
+    /// offsets of all rows of @p hash in the log, in ascending order
+    std::vector<int64_t> find(const uint64_t hash) const;
+
+  private:
+    std::optional<MappedFile> file_;
+    size_t sorted_{ 0 };   ///< number of sorted records at the start
+    size_t records_{ 0 };
+  };
+
+  /// Lock @p log_file and append @p line (the row of @p cmd), preceded by @p header if the log is empty, and record @p cmd in the dictionary and index
+  /// @throw std::runtime_error if the log holds full command lines (see compactLog())
+  void appendInternedRow(const std::string& log_file, const OpenMode mode, const std::string& cmd, const std::string& header, const std::string& line);
+
+  /// Result of compactLog()
+  struct CompactionSummary
+  {
+    size_t rows{ 0 };
+    size_t commands{ 0 };        ///< distinct command lines
+    size_t unknown_hashes{ 0 };  ///< distinct hashes without a dictionary entry (kept as they are)
+    uint64_t bytes_before{ 0 };  ///< size of the log
+    uint64_t bytes_after{ 0 };   ///< size of the log, without dictionary and index
+
+    void print() const;
+  };
+
+  /**
+    @brief One-shot, in place upgrade of a TSV log to hashed command lines
+
+    Replaces the 'cmd' column by 'cmd_hash' and writes the dictionary and a fully sorted index.
+    A log which has hashes already just gets its dictionary and index rebuilt (e.g. to sort records appended since).
+    Hashes which the dictionary does not know (e.g. it was lost) are kept unchanged and indexed, but their command lines stay unknown.
+    The log stays locked meanwhile, so concurrent WinTime instances wait. A copy is built in '<log>.compact.tmp' first,
+    which is kept if copying it back fails.
+  */
+  CompactionSummary compactLog(const std::string& log_file);
+
+  /// All rows of @p cmd in @p log_file (hashed or not), with the command line restored and preceded by the header.
+  /// Hashed logs are looked up in the index; rows appended to them after the index was lost are only found again after compactLog().
+  std::string commandHistory(const std::string& log_file, const std::string& cmd);
+
+} // namespace
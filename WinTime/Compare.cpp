@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Compare.h"
+
+#include "Memory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+namespace WinTime
+{
+  std::string toString(Verdict verdict)
+  {
+    switch (verdict)
+    {
+      case Verdict::FASTER:
+        return "faster";
+      case Verdict::SLOWER:
+        return "slower";
+      case Verdict::INDISTINGUISHABLE:
+        return "indistinguishable";
+      case Verdict::INCONCLUSIVE:
+        return "inconclusive";
+    }
+    return "";
+  }
+
+  Comparison Comparison::compute(const std::string& baseline_cmd, const std::vector<RunMeasurement>& baseline,
+                                 const std::vector<RunMeasurement>& candidate)
+  {
+    auto wall = [](const std::vector<RunMeasurement>& runs) {
+      std::vector<double> values;
+      for (const auto& r : runs) values.push_back(r.t_wall);
+      return values;
+    };
+    auto rss = [](const std::vector<RunMeasurement>& runs) {
+      std::vector<double> values;
+      for (const auto& r : runs) values.push_back(double(r.peak_rss));
+      return values;
+    };
+
+    Comparison c;
+    c.baseline = baseline_cmd;
+    c.runs_baseline = baseline.size();
+    c.runs_candidate = candidate.size();
+    c.speedup = bootstrapRatioOfMedians(wall(baseline), wall(candidate));
+    c.memory_ratio = bootstrapRatioOfMedians(rss(candidate), rss(baseline));
+    if (std::min(c.runs_baseline, c.runs_candidate) < COMPARE_MIN_RUNS) c.verdict = Verdict::INCONCLUSIVE;
+    else if (c.speedup.lower > 1) c.verdict = Verdict::FASTER;
+    else if (c.speedup.upper < 1) c.verdict = Verdict::SLOWER;
+    else c.verdict = Verdict::INDISTINGUISHABLE;
+    return c;
+  }
+
+  void Comparison::print(const std::string& candidate_cmd) const
+  {
+    char buffer[200];
+    std::cerr << "'" << candidate_cmd << "' vs. '" << baseline << "' (" << runs_candidate << " vs. " << runs_baseline << " runs):\n";
+    std::snprintf(buffer, sizeof(buffer), "  Speedup:      %.3fx [%.3f, %.3f] (95%% CI)\n", speedup.estimate, speedup.lower, speedup.upper);
+    std::cerr << buffer;
+    std::snprintf(buffer, sizeof(buffer), "  Memory ratio: %.3fx [%.3f, %.3f] (95%% CI)\n", memory_ratio.estimate, memory_ratio.lower, memory_ratio.upper);
+    std::cerr << buffer;
+    std::cerr << "  Verdict: " << toString(verdict);
+    if (verdict == Verdict::INCONCLUSIVE) std::cerr << " (at least " << COMPARE_MIN_RUNS << " runs per command are needed; see -r)";
+    std::cerr << '\n';
+  }
+
+  std::string Comparison::print(const char separator) const
+  {
+    std::stringstream where;
+    where << baseline << separator
+      << runs_baseline << separator
+      << runs_candidate << separator
+      << speedup.estimate << separator
+      << speedup.lower << separator
+      << speedup.upper << separator
+      << memory_ratio.estimate << separator
+      << memory_ratio.lower << separator
+      << memory_ratio.upper << separator
+      << toString(verdict);
+    return where.str();
+  }
+
+  std::string Comparison::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "baseline_cmd" << separator
+      << "baseline_runs" << separator
+      << "runs" << separator
+      << "speedup" << separator
+      << "speedup_ci_lower" << separator
+      << "speedup_ci_upper" << separator
+      << "memory_ratio" << separator
+      << "memory_ratio_ci_lower" << separator
+      << "memory_ratio_ci_upper" << separator
+      << "verdict";
+    return where.str();
+  }
+
+  std::optional<std::vector<std::vector<RunMeasurement>>> runInterleaved(size_t commands, const InterleaveOptions& options, const IndexedRunFunction& run_once)
+  {
+    std::vector<std::vector<RunMeasurement>> runs(commands);
+    std::vector<size_t> order(commands);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 rng(std::random_device{}());
+
+    for (size_t round = 0; round < options.warmup + options.rounds; ++round)
+    {
+      if (options.shuffle) std::shuffle(order.begin(), order.end(), rng);
+      for (size_t index : order)
+      {
+        auto measurement = run_once(index);
+        if (!measurement) return std::nullopt;
+        if (round >= options.warmup) runs[index].push_back(*measurement);
+      }
+    }
+    return runs;
+  }
+
+} // namespace
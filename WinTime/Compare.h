@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+#include "Statistics.h"
+
+namespace WinTime
+{
+  /// fewer runs per command than this give no verdict: a bootstrap CI of a handful of samples is meaningless
+  constexpr size_t COMPARE_MIN_RUNS = 5;
+
+  /// Verdict of a comparison, based on the confidence interval of the speedup
+  enum class Verdict
+  {
+    FASTER,            ///< the CI of the speedup lies above 1
+    SLOWER,            ///< the CI of the speedup lies below 1
+    INDISTINGUISHABLE, ///< the CI of the speedup contains 1
+    INCONCLUSIVE       ///< too few runs (see COMPARE_MIN_RUNS)
+  };
+
+  /// "faster", "slower", "indistinguishable" or "inconclusive"
+  std::string toString(Verdict verdict);
+
+  /// Comparison of a candidate command against a baseline command, based on their median wall time and peak working set
+  struct Comparison
+  {
+    std::string baseline;             ///< command line of the baseline
+    size_t runs_baseline{ 0 };
+    size_t runs_candidate{ 0 };
+    ConfidenceInterval speedup;       ///< median wall time of the baseline / median wall time of the candidate (> 1: candidate is faster)
+    ConfidenceInterval memory_ratio;  ///< median peak working set of the candidate / median peak working set of the baseline
+    Verdict verdict{ Verdict::INDISTINGUISHABLE };
+
+    /// compare @p candidate against @p baseline (both must contain at least one run) using 95% bootstrap CIs;
+    /// the verdict is INCONCLUSIVE if either has fewer than COMPARE_MIN_RUNS runs
+    static Comparison compute(const std::string& baseline_cmd, const std::vector<RunMeasurement>& baseline,
+                              const std::vector<RunMeasurement>& candidate);
+
+    /// @p candidate_cmd is the command line of the candidate
+    void print(const std::string& candidate_cmd) const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+  /// How to interleave the runs of several commands
+  struct InterleaveOptions
+  {
+    size_t rounds{ 10 };   ///< each round runs every command once
+    size_t warmup{ 0 };    ///< unmeasured rounds before the first measured one
+    bool shuffle{ false }; ///< randomize the order of the commands within each round (instead of ABAB...)
+  };
+
+  /// runs command number @p index once; returns nothing if the run failed (which aborts all runs)
+  using IndexedRunFunction = std::function<std::optional<RunMeasurement>(size_t index)>;
+
+  /// Run @p commands commands in interleaved rounds, so that drift (thermal, caches, background load) affects all of them alike.
+  /// Returns the measured runs per command, or nothing if a run failed.
+  std::optional<std::vector<std::vector<RunMeasurement>>> runInterleaved(size_t commands, const InterleaveOptions& options, const IndexedRunFunction& run_once);
+
+} // namespace
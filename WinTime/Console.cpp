@@ -23,10 +23,16 @@
  
 #include "Console.h"
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 #include <windows.h> // for HANDLE; <windef.h> alone is not sufficient
 #undef max
 #undef min
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+#include <cstdlib>
 #include <iostream>
 
 
@@ -59,11 +65,19 @@ namespace WinTime
       {
         std::cerr << "output shaping: COLUMNS env does not exist!" << std::endl;
 
+#ifdef _WIN32
         HANDLE hOut;
         CONSOLE_SCREEN_BUFFER_INFO SBInfo;
         hOut = GetStdHandle(STD_OUTPUT_HANDLE);
         GetConsoleScreenBufferInfo(hOut, &SBInfo);
         console_width_ = SBInfo.dwSize.X;
+#else
+        winsize ws{};
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+        {
+          console_width_ = ws.ws_col;
+        }
+#endif
       }
       --console_width_; // to add the \n at the end of each line without forcing another line break on windows
     }
@@ -0,0 +1,728 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "CpuProfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <elf.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <set>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "MappedFile.h"
+#endif
+
+namespace WinTime
+{
+  namespace
+  {
+    /// rows of the table printed to the console
+    constexpr size_t TOP_ROWS = 15;
+
+    /// '_ZN3foo3barEv' -> 'foo::bar()'
+    std::string demangle(const std::string& symbol)
+    {
+#ifdef __GNUG__
+      if (symbol.rfind("_Z", 0) != 0) return symbol;
+      int status = 0;
+      char* readable = abi::__cxa_demangle(symbol.c_str(), nullptr, nullptr, &status);
+      std::string name = status == 0 && readable ? readable : symbol;
+      std::free(readable);
+      return name;
+#else
+      return symbol;
+#endif
+    }
+
+    /// @p part of @p whole in percent
+    double percent(const uint64_t part, const uint64_t whole)
+    {
+      return whole == 0 ? 0 : 100.0 * double(part) / double(whole);
+    }
+  }
+
+  void CpuProfileSummary::print() const
+  {
+    if (samples == 0)
+    {
+      std::cerr << "CPU profile: no samples (did the target run for less than " << interval * 1e3 << " ms of CPU time?)\n";
+      return;
+    }
+    std::cerr << "CPU profile (" << samples << " samples every " << interval * 1e3 << " ms of CPU time in " << processes
+              << (processes == 1 ? " process" : " processes") << "; " << lost << " lost)";
+    if (!folded_file.empty()) std::cerr << ": folded stacks written to '" << folded_file << "'";
+    std::cerr << "\n   self [%]       self  total [%]      total  function (module)\n";
+    for (size_t i = 0; i < std::min(TOP_ROWS, functions.size()); ++i)
+    {
+      const auto& function = functions[i];
+      char buffer[64];
+      std::snprintf(buffer, sizeof(buffer), "%10.1f %10llu %10.1f %10llu  ", percent(function.self, samples), (unsigned long long)function.self,
+                    percent(function.total, samples), (unsigned long long)function.total);
+      std::cerr << buffer << function.name << " (" << function.module << ")\n";
+    }
+  }
+
+  std::string CpuProfileSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << samples << separator
+      << lost << separator
+      << processes << separator
+      << folded_file << separator
+      << (functions.empty() ? "" : functions.front().name);
+    return where.str();
+  }
+
+  std::string CpuProfileSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "cpu_samples" << separator
+      << "cpu_lost" << separator
+      << "cpu_processes" << separator
+      << "cpu_folded_file" << separator
+      << "cpu_top_function";
+    return where.str();
+  }
+
+#ifndef _WIN32
+
+  namespace
+  {
+    /// data pages of each ring buffer (a power of two); 512 KiB with 4 KiB pages, which is what perf_event_mlock_kb allows per CPU without privileges
+    constexpr size_t BUFFER_PAGES = 128;
+
+    int perfEventOpen(perf_event_attr& attr, pid_t pid, int cpu)
+    {
+      return int(syscall(SYS_perf_event_open, &attr, pid, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    /// the attributes of the sampling events
+    perf_event_attr makeAttributes(const uint64_t clock, const unsigned frequency)
+    {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = clock;
+      attr.sample_period = std::max(uint64_t(1), uint64_t(1000000000) / frequency); // the clocks count nanoseconds
+      attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+      attr.disabled = 1;
+      attr.enable_on_exec = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;   // allowed with perf_event_paranoid <= 2
+      attr.exclude_hv = 1;
+      attr.exclude_callchain_kernel = 1;
+      attr.mmap = 1;             // executable mappings, for symbolizing
+      attr.mmap2 = 1;
+      attr.comm = 1;
+      attr.comm_exec = 1;
+      attr.task = 1;             // fork(), to copy the mappings of the parent
+      attr.sample_id_all = 1;    // all records carry PID, TID and time
+      return attr;
+    }
+
+    /// the value of kernel.perf_event_paranoid (or -1000 if unknown)
+    int getParanoid()
+    {
+      std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+      int level = -1000;
+      file >> level;
+      return level;
+    }
+
+    /// the file name of @p path
+    std::string baseName(const std::string& path)
+    {
+      const size_t slash = path.rfind('/');
+      return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    /// The function symbols of an ELF file, by virtual address
+    class ElfSymbols
+    {
+    public:
+      /// load the symbols of @p filename (and of its debug file, if it has no .symtab); missing or broken files yield no symbols
+      explicit ElfSymbols(const std::string& filename)
+      {
+        try
+        {
+          const MappedFile file(filename);
+          std::string build_id;
+          const bool has_symtab = load_(file.data(), file.size(), true, build_id);
+          if (!has_symtab && build_id.size() > 2)
+          {
+            const MappedFile debug("/usr/lib/debug/.build-id/" + build_id.substr(0, 2) + '/' + build_id.substr(2) + ".debug");
+            load_(debug.data(), debug.size(), false, build_id);
+          }
+        }
+        catch (const std::exception&)
+        { // e.g. a deleted file, or no debug file
+        }
+        std::sort(symbols_.begin(), symbols_.end(), [](const Symbol& a, const Symbol& b) { return a.address < b.address; });
+      }
+
+      /// the symbol of the function at @p offset of the file (nullptr if none)
+      const std::string* find(const uint64_t offset) const
+      {
+        const auto segment = std::find_if(segments_.begin(), segments_.end(),
+                                          [offset](const Segment& s) { return offset >= s.offset && offset < s.offset + s.size; });
+        if (segment == segments_.end()) return nullptr;
+        const uint64_t address = offset - segment->offset + segment->address;
+        auto symbol = std::upper_bound(symbols_.begin(), symbols_.end(), address, [](uint64_t a, const Symbol& s) { return a < s.address; });
+        if (symbol == symbols_.begin()) return nullptr;
+        --symbol;
+        // labels without a size (e.g. '_init' before the PLT) would swallow all code up to the next symbol
+        if (address >= symbol->address + symbol->size) return nullptr;
+        return &symbol->name;
+      }
+
+    private:
+      struct Segment
+      {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t address;
+      };
+
+      struct Symbol
+      {
+        uint64_t address;
+        uint64_t size;
+        std::string name;
+      };
+
+      /// read the function symbols of the ELF image @p data (and its segments, if @p segments is set);
+      /// returns true if it has a .symtab; sets @p build_id (hex) if found
+      bool load_(const char* data, const size_t size, const bool segments, std::string& build_id)
+      {
+        if (size < sizeof(Elf64_Ehdr) || std::memcmp(data, ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS64) return false;
+        const auto& header = *reinterpret_cast<const Elf64_Ehdr*>(data);
+        const auto inside = [size](uint64_t offset, uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+        if (segments && inside(header.e_phoff, uint64_t(header.e_phnum) * sizeof(Elf64_Phdr)))
+        {
+          const auto* programs = reinterpret_cast<const Elf64_Phdr*>(data + header.e_phoff);
+          for (size_t i = 0; i < header.e_phnum; ++i)
+          {
+            if (programs[i].p_type == PT_LOAD) segments_.push_back({ programs[i].p_offset, programs[i].p_filesz, programs[i].p_vaddr });
+          }
+        }
+        if (header.e_shentsize != sizeof(Elf64_Shdr) || !inside(header.e_shoff, uint64_t(header.e_shnum) * sizeof(Elf64_Shdr))) return false;
+        const auto* sections = reinterpret_cast<const Elf64_Shdr*>(data + header.e_shoff);
+        bool has_symtab = false;
+        for (size_t i = 0; i < header.e_shnum; ++i)
+        {
+          const Elf64_Shdr& section = sections[i];
+          if (section.sh_type == SHT_NOTE && inside(section.sh_offset, section.sh_size))
+          {
+            readBuildId_(data + section.sh_offset, section.sh_size, build_id);
+          }
+          if (section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM) continue;
+          if (section.sh_link >= header.e_shnum || !inside(section.sh_offset, section.sh_size)) continue;
+          const Elf64_Shdr& strings = sections[section.sh_link];
+          if (!inside(strings.sh_offset, strings.sh_size)) continue;
+          has_symtab |= section.sh_type == SHT_SYMTAB;
+          const auto* symbols = reinterpret_cast<const Elf64_Sym*>(data + section.sh_offset);
+          for (size_t s = 0; s < section.sh_size / sizeof(Elf64_Sym); ++s)
+          {
+            const Elf64_Sym& symbol = symbols[s];
+            const int type = ELF64_ST_TYPE(symbol.st_info);
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || symbol.st_shndx == SHN_UNDEF || symbol.st_value == 0 || symbol.st_name >= strings.sh_size) continue;
+            const char* name = data + strings.sh_offset + symbol.st_name;
+            symbols_.push_back({ symbol.st_value, symbol.st_size, std::string(name, strnlen(name, strings.sh_size - symbol.st_name)) });
+          }
+        }
+        return has_symtab;
+      }
+
+      /// find the NT_GNU_BUILD_ID in the notes at @p notes
+      static void readBuildId_(const char* notes, const size_t size, std::string& build_id)
+      {
+        for (size_t offset = 0; offset + sizeof(Elf64_Nhdr) <= size;)
+        {
+          const auto& note = *reinterpret_cast<const Elf64_Nhdr*>(notes + offset);
+          const size_t name_offset = offset + sizeof(Elf64_Nhdr);
+          const size_t desc_offset = name_offset + ((note.n_namesz + 3) & ~size_t(3));
+          const size_t next = desc_offset + ((note.n_descsz + 3) & ~size_t(3));
+          if (next > size) return;
+          if (note.n_type == NT_GNU_BUILD_ID && note.n_namesz == 4 && std::memcmp(notes + name_offset, "GNU", 4) == 0)
+          {
+            build_id.clear();
+            char hex[3];
+            for (size_t i = 0; i < note.n_descsz; ++i)
+            {
+              std::snprintf(hex, sizeof(hex), "%02x", (unsigned)(unsigned char)notes[desc_offset + i]);
+              build_id += hex;
+            }
+            return;
+          }
+          offset = next;
+        }
+      }
+
+      std::vector<Segment> segments_;
+      std::vector<Symbol> symbols_;
+    };
+  }
+
+  CpuProfiler::CpuProfiler(unsigned frequency)
+    : frequency_(std::max(1u, frequency)),
+      page_size_(size_t(sysconf(_SC_PAGESIZE)))
+  {
+    summary_.interval = 1.0 / frequency_;
+    // try the events on ourselves (they are never enabled, since we do not exec())
+    for (const uint64_t clock : { PERF_COUNT_SW_TASK_CLOCK, PERF_COUNT_SW_CPU_CLOCK })
+    {
+      perf_event_attr attr = makeAttributes(clock, frequency_);
+      const int fd = perfEventOpen(attr, 0, -1);
+      if (fd != -1)
+      {
+        close(fd);
+        clock_ = clock;
+        break;
+      }
+      if (errno == EACCES || errno == EPERM)
+      {
+        error_ = std::string("perf_event_open() is not permitted: ") + strerror(errno) + "; kernel.perf_event_paranoid is " + std::to_string(getParanoid())
+                 + ", but must be 2 or lower (or run with CAP_PERFMON)";
+        return;
+      }
+      if (errno == ENOSYS)
+      {
+        error_ = "perf_event_open() is not available (kernel without CONFIG_PERF_EVENTS, or blocked by seccomp)";
+        return;
+      }
+      error_ = std::string("perf_event_open() failed: ") + strerror(errno);
+    }
+    if (clock_ == 0) return;
+    error_.clear();
+    if (pipe2(go_pipe_, O_CLOEXEC) != 0 || (wake_fd_ = eventfd(0, EFD_CLOEXEC)) == -1)
+    {
+      error_ = std::string("cannot create a pipe: ") + strerror(errno);
+      clock_ = 0;
+    }
+  }
+
+  CpuProfiler::~CpuProfiler()
+  {
+    stop();
+    for (size_t i = 0; i < fds_.size(); ++i)
+    {
+      munmap(buffers_[i], page_size_ + buffer_bytes_);
+      close(fds_[i]);
+    }
+    for (int fd : { go_pipe_[0], go_pipe_[1], wake_fd_ })
+    {
+      if (fd != -1) close(fd);
+    }
+  }
+
+  bool CpuProfiler::isValid() const
+  {
+    return clock_ != 0;
+  }
+
+  const std::string& CpuProfiler::getError() const
+  {
+    return error_;
+  }
+
+  void CpuProfiler::prepareChild() const
+  {
+    close(go_pipe_[1]);
+    char go;
+    while (read(go_pipe_[0], &go, 1) == -1 && errno == EINTR)
+    {
+    }
+    close(go_pipe_[0]);
+  }
+
+  bool CpuProfiler::attach(pid_t child)
+  {
+    close(go_pipe_[0]);
+    go_pipe_[0] = -1;
+    if (!open_(child))
+    { // the child still waits for us
+      const int err = errno;
+      kill(child, SIGKILL);
+      waitpid(child, nullptr, 0);
+      errno = err;
+      return false;
+    }
+    thread_ = std::thread(&CpuProfiler::run_, this);
+    // the events are enabled when the child calls exec()
+    const char go = 1;
+    [[maybe_unused]] auto written = write(go_pipe_[1], &go, 1);
+    close(go_pipe_[1]);
+    go_pipe_[1] = -1;
+    return true;
+  }
+
+  bool CpuProfiler::open_(pid_t pid)
+  {
+    const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    size_t pages = BUFFER_PAGES;
+    for (int cpu = 0; cpu < cpus; ++cpu)
+    {
+      perf_event_attr attr = makeAttributes(clock_, frequency_);
+      attr.watermark = 1;
+      attr.wakeup_watermark = uint32_t(pages * page_size_ / 2);
+      const int fd = perfEventOpen(attr, pid, cpu);
+      if (fd == -1)
+      {
+        if (errno == ENODEV) continue; // offline
+        return false;
+      }
+      void* buffer = MAP_FAILED;
+      while (true)
+      { // a smaller buffer, if we are over the limit of locked memory (perf_event_mlock_kb)
+        buffer = mmap(nullptr, (pages + 1) * page_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (buffer != MAP_FAILED || errno != EPERM || fds_.size() > 0 || pages <= 8) break;
+        pages /= 2;
+      }
+      if (buffer == MAP_FAILED)
+      {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return false;
+      }
+      buffer_bytes_ = pages * page_size_;
+      fds_.push_back(fd);
+      buffers_.push_back(buffer);
+    }
+    return !fds_.empty();
+  }
+
+  void CpuProfiler::run_()
+  {
+    std::vector<pollfd> polls{ { wake_fd_, POLLIN, 0 } };
+    for (int fd : fds_) polls.push_back({ fd, POLLIN, 0 });
+    while (true)
+    {
+      // the timeout covers descendants which run on after the events of the child hung up
+      const int ready = poll(polls.data(), polls.size(), 100);
+      if (ready > 0 && (polls[0].revents & POLLIN)) return;
+      for (auto& p : polls)
+      { // the child (whose events these are) exited; its descendants still write into the buffers
+        if (p.revents & POLLHUP) p.fd = -1;
+      }
+      drain_();
+    }
+  }
+
+  void CpuProfiler::drain_()
+  {
+    for (void* buffer : buffers_)
+    {
+      auto* meta = static_cast<perf_event_mmap_page*>(buffer);
+      const char* data = static_cast<const char*>(buffer) + page_size_;
+      const uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+      uint64_t tail = meta->data_tail;
+      while (tail + sizeof(perf_event_header) <= head)
+      {
+        const size_t start = size_t(tail % buffer_bytes_);
+        perf_event_header header;
+        if (start + sizeof(header) <= buffer_bytes_)
+        {
+          std::memcpy(&header, data + start, sizeof(header));
+        }
+        else
+        {
+          const size_t first = buffer_bytes_ - start;
+          std::memcpy(&header, data + start, first);
+          std::memcpy(reinterpret_cast<char*>(&header) + first, data, sizeof(header) - first);
+        }
+        if (header.size < sizeof(header) || tail + header.size > head) break;
+        if (start + header.size <= buffer_bytes_)
+        {
+          addRecord_(data + start, header.size);
+        }
+        else
+        { // wraps around
+          scratch_.resize(header.size);
+          const size_t first = buffer_bytes_ - start;
+          std::memcpy(scratch_.data(), data + start, first);
+          std::memcpy(scratch_.data() + first, data, header.size - first);
+          addRecord_(scratch_.data(), header.size);
+        }
+        tail += header.size;
+      }
+      __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+    }
+  }
+
+  void CpuProfiler::addRecord_(const char* record, const size_t size)
+  {
+    perf_event_header header;
+    std::memcpy(&header, record, sizeof(header));
+    const char* body = record + sizeof(header);
+    const size_t body_size = size - sizeof(header);
+    const auto u32 = [body](size_t offset) { uint32_t v; std::memcpy(&v, body + offset, sizeof(v)); return v; };
+    const auto u64 = [body](size_t offset) { uint64_t v; std::memcpy(&v, body + offset, sizeof(v)); return v; };
+    // sample_id_all: other records end with the PID, TID and time (PERF_SAMPLE_TID | PERF_SAMPLE_TIME)
+    const auto time = [&]() { return u64(body_size - 8); };
+    switch (header.type)
+    {
+      case PERF_RECORD_SAMPLE:
+      { // ip, pid, tid, time, nr, ips[nr]
+        if (body_size < 32) return;
+        const uint64_t count = u64(24);
+        if (count > (body_size - 32) / 8) return;
+        std::string chain;
+        chain.reserve(count * 8);
+        for (size_t i = 0; i < count; ++i)
+        {
+          const uint64_t address = u64(32 + i * 8);
+          if (address >= uint64_t(PERF_CONTEXT_MAX)) continue; // PERF_CONTEXT_USER etc.
+          chain.append(reinterpret_cast<const char*>(&address), sizeof(address));
+        }
+        if (chain.empty())
+        {
+          const uint64_t ip = u64(0);
+          chain.append(reinterpret_cast<const char*>(&ip), sizeof(ip));
+        }
+        const auto [it, inserted] = stack_index_.try_emplace(std::move(chain), uint32_t(stacks_.size()));
+        if (inserted) stacks_.push_back(&it->first);
+        events_.push_back({ u64(16), PERF_RECORD_SAMPLE, u32(8), u32(12), it->second });
+        return;
+      }
+      case PERF_RECORD_MMAP2:
+      { // pid, tid, addr, len, pgoff, maj, min, ino, ino_generation, prot, flags, filename, sample_id
+        constexpr size_t FILENAME = 64;
+        if (body_size < FILENAME + 16) return;
+        const char* filename = body + FILENAME;
+        mappings_.push_back({ u64(8), u64(8) + u64(16), u64(24), std::string(filename, strnlen(filename, body_size - FILENAME - 16)) });
+        events_.push_back({ time(), PERF_RECORD_MMAP2, u32(0), 0, uint32_t(mappings_.size() - 1) });
+        return;
+      }
+      case PERF_RECORD_COMM:
+      { // pid, tid, comm, sample_id
+        if (body_size < 8 + 16) return;
+        const bool exec = (header.misc & PERF_RECORD_MISC_COMM_EXEC) != 0;
+        if (!exec && u32(0) != u32(4)) return; // a thread was named
+        names_.emplace_back(body + 8, strnlen(body + 8, body_size - 8 - 16));
+        events_.push_back({ time(), PERF_RECORD_COMM, u32(0), exec ? 1u : 0u, uint32_t(names_.size() - 1) });
+        return;
+      }
+      case PERF_RECORD_FORK:
+      { // pid, ppid, tid, ptid, time, sample_id
+        if (body_size < 24) return;
+        if (u32(0) == u32(4)) return; // a new thread
+        events_.push_back({ u64(16), PERF_RECORD_FORK, u32(0), u32(4), 0 });
+        return;
+      }
+      case PERF_RECORD_LOST:
+      { // id, lost, sample_id
+        if (body_size < 16) return;
+        summary_.lost += u64(8);
+        return;
+      }
+      default:
+        return;
+    }
+  }
+
+  void CpuProfiler::stop()
+  {
+    if (stopped_) return;
+    stopped_ = true;
+    if (thread_.joinable())
+    {
+      const uint64_t wake = 1;
+      [[maybe_unused]] auto written = write(wake_fd_, &wake, sizeof(wake));
+      thread_.join();
+    }
+    for (int fd : fds_) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    drain_();
+    symbolize_();
+  }
+
+  void CpuProfiler::symbolize_()
+  {
+    // the buffers of different CPUs interleave
+    std::stable_sort(events_.begin(), events_.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+
+    /// the executable mappings of a process (from its last exec() on)
+    struct AddressSpace
+    {
+      uint32_t id{ 0 };
+      std::map<uint64_t, uint32_t> mappings;   ///< start -> index into mappings_
+      std::string name;
+    };
+    std::map<uint32_t, AddressSpace> spaces;   ///< by PID
+    uint32_t space_count = 0;
+    const auto getSpace = [&](uint32_t pid) -> AddressSpace& {
+      auto [it, inserted] = spaces.try_emplace(pid);
+      if (inserted) it->second.id = space_count++;
+      return it->second;
+    };
+    std::map<std::string, ElfSymbols> symbols;   ///< by file name
+    std::unordered_map<std::string, uint32_t> function_index;   ///< module '\0' name -> index into summary_.functions
+    std::unordered_map<uint64_t, std::vector<uint32_t>> frames;  ///< (space, stack) -> functions, leaf first
+    std::set<uint32_t> pids;
+
+    // the function at @p address
+    const auto resolve = [&](const AddressSpace& space, const uint64_t address) {
+      std::string module = "[unknown]", name = "[unknown]";
+      auto it = space.mappings.upper_bound(address);
+      if (it != space.mappings.begin() && address < mappings_[(--it)->second].end)
+      {
+        const Mapping& mapping = mappings_[it->second];
+        if (!mapping.filename.empty() && mapping.filename[0] == '/')
+        {
+          module = baseName(mapping.filename);
+          const uint64_t offset = address - mapping.start + mapping.offset;
+          const auto file = symbols.try_emplace(mapping.filename, mapping.filename).first;
+          const std::string* symbol = file->second.find(offset);
+          // without a symbol (e.g. local functions of a stripped library), all of its addresses are one frame, so the flame graph does not fall apart
+          name = symbol ? demangle(*symbol) : '[' + module + ']';
+        }
+        else
+        { // '[vdso]', '//anon' (e.g. JIT code)
+          module = mapping.filename;
+        }
+      }
+      const auto [index, inserted] = function_index.try_emplace(module + '\0' + name, uint32_t(summary_.functions.size()));
+      if (inserted) summary_.functions.push_back({ name, module });
+      return index->second;
+    };
+
+    std::vector<uint32_t> seen;
+    for (const Event& event : events_)
+    {
+      switch (event.type)
+      {
+        case PERF_RECORD_MMAP2:
+        {
+          const Mapping& mapping = mappings_[event.index];
+          auto& space = getSpace(event.pid);
+          // a new mapping replaces those it overlaps
+          auto it = space.mappings.lower_bound(mapping.start);
+          while (it != space.mappings.end() && it->first < mapping.end) it = space.mappings.erase(it);
+          space.mappings[mapping.start] = event.index;
+          break;
+        }
+        case PERF_RECORD_COMM:
+        {
+          auto& space = getSpace(event.pid);
+          if (event.other)
+          { // exec()
+            space.mappings.clear();
+            space.id = space_count++;
+          }
+          space.name = names_[event.index];
+          break;
+        }
+        case PERF_RECORD_FORK:
+        {
+          AddressSpace copy = getSpace(event.other);
+          copy.id = space_count++;
+          spaces[event.pid] = std::move(copy);
+          break;
+        }
+        case PERF_RECORD_SAMPLE:
+        {
+          const AddressSpace& space = getSpace(event.pid);
+          auto [it, inserted] = frames.try_emplace((uint64_t(space.id) << 32) | event.index);
+          if (inserted)
+          {
+            const std::string& chain = *stacks_[event.index];
+            for (size_t i = 0; i < chain.size() / 8; ++i)
+            {
+              uint64_t address;
+              std::memcpy(&address, chain.data() + i * 8, sizeof(address));
+              // callers are given by return address, which may be the first instruction after the function (e.g. after a call to a noreturn function)
+              it->second.push_back(resolve(space, i == 0 ? address : address - 1));
+            }
+          }
+          const auto& stack = it->second;
+          ++summary_.samples;
+          pids.insert(event.pid);
+          ++summary_.functions[stack.front()].self;
+          seen.assign(stack.begin(), stack.end());
+          std::sort(seen.begin(), seen.end());
+          seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+          for (uint32_t function : seen) ++summary_.functions[function].total;
+          std::string folded = space.name.empty() ? std::to_string(event.pid) : space.name;
+          for (auto frame = stack.rbegin(); frame != stack.rend(); ++frame)
+          {
+            folded += ';';
+            folded += summary_.functions[*frame].name;
+          }
+          ++folded_[folded];
+          break;
+        }
+      }
+    }
+    summary_.processes = pids.size();
+    std::stable_sort(summary_.functions.begin(), summary_.functions.end(),
+                     [](const CpuFunction& a, const CpuFunction& b) { return a.self > b.self || (a.self == b.self && a.total > b.total); });
+    // no longer needed
+    events_ = {};
+    stack_index_ = {};
+    stacks_ = {};
+  }
+
+  void CpuProfiler::writeFolded(const std::string& filename)
+  {
+    std::ofstream file(filename);
+    for (const auto& [stack, samples] : folded_)
+    {
+      file << stack << ' ' << samples << '\n';
+    }
+    if (!file)
+    {
+      throw std::runtime_error("Cannot write the CPU profile to '" + filename + "'.");
+    }
+    summary_.folded_file = filename;
+  }
+
+  const CpuProfileSummary& CpuProfiler::getSummary() const
+  {
+    return summary_;
+  }
+
+#endif
+
+} // namespace
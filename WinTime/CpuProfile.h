@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Platform.h"
+#include "Process.h"
+
+namespace WinTime
+{
+  /// default of --cpu-sample-rate: samples per second of CPU time (not a round number, so it does not run in lockstep with periodic work of the target)
+  constexpr unsigned CPU_SAMPLE_RATE_DEFAULT = 999;
+
+  /// The samples of one function (or unresolved address) of a CPU profile
+  struct CpuFunction
+  {
+    std::string name;     ///< demangled symbol, or '[module]' if the module has no symbol for it
+    std::string module;   ///< file name of the module (e.g. 'libc.so.6'), or '[unknown]'
+    uint64_t self{ 0 };   ///< samples with this function on top of the stack
+    uint64_t total{ 0 };  ///< samples with this function anywhere on the stack (counted once per sample)
+  };
+
+  /// The result of a CPU profile of all processes of a target
+  struct CpuProfileSummary
+  {
+    uint64_t samples{ 0 };
+    uint64_t lost{ 0 };                   ///< samples the kernel dropped since our ring buffers were full
+    size_t processes{ 0 };                ///< processes with at least one sample
+    double interval{ 0 };                 ///< seconds of CPU time between samples (per thread)
+    std::string folded_file;              ///< where the folded stacks were written
+    std::vector<CpuFunction> functions;   ///< by self samples (descending)
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+#ifndef _WIN32
+  /**
+    @brief Samples the call stacks of a process and all its descendants via perf_event_open(), in user space only
+
+    A software clock (task-clock, or cpu-clock if that is not available) interrupts each thread of the target every 1/frequency seconds
+    of CPU time and records its user-space call chain; no hardware PMU is needed. The events are opened for the child before its exec()
+    (see prepareChild() and attach()), are enabled by the exec() and inherited by all threads and processes it creates.
+    This needs no privileges if kernel.perf_event_paranoid is 2 or lower (the default of Linux), since we only profile user space of our own children.
+
+    Since the kernel cannot map the buffer of an inherited per-process event, there is one event (and ring buffer) per CPU;
+    a background thread drains them while the target runs. Along with the samples, the kernel records the executable mappings,
+    fork() and exec() of the target's processes, so the samples are symbolized after the run using the ELF symbol tables of the
+    mapped files (or their debug files in /usr/lib/debug/.build-id).
+
+    Call chains are unwound by the kernel via frame pointers: the sampled function is always right, but its callers are only
+    complete for code compiled with frame pointers (-fno-omit-frame-pointer).
+  */
+  class CpuProfiler : public SpawnObserver
+  {
+  public:
+    /// Check that perf events can be used. Use isValid() to check for success, and getError() for the reason of a failure.
+    /// @param frequency samples per second of CPU time of each thread
+    explicit CpuProfiler(unsigned frequency = CPU_SAMPLE_RATE_DEFAULT);
+
+    CpuProfiler(const CpuProfiler&) = delete;
+    void operator=(const CpuProfiler&) = delete;
+
+    /// calls stop()
+    ~CpuProfiler();
+
+    bool isValid() const;
+
+    /// why perf events cannot be used
+    const std::string& getError() const;
+
+    /// To be called in the forked child before exec(). Waits until the parent called attach(). Only async-signal-safe functions are used.
+    void prepareChild() const override;
+
+    /// To be called in the parent right after fork(). Opens the events for @p child, starts draining them and lets the child continue.
+    /// Returns false (with errno set) if the events cannot be opened; the child is killed and reaped then.
+    bool attach(pid_t child) override;
+
+    /// Stop sampling, drain the buffers and symbolize the samples
+    void stop();
+
+    /// Write the folded stacks (one line per distinct stack: 'process;caller;...;function count', for flamegraph.pl and the like)
+    /// @throw std::runtime_error if @p filename cannot be written
+    void writeFolded(const std::string& filename);
+
+    /// only valid after stop(); folded_file is set by writeFolded()
+    const CpuProfileSummary& getSummary() const;
+
+  private:
+    /// a record of the target, in the order of time (samples refer to an interned call chain)
+    struct Event
+    {
+      uint64_t time;
+      uint32_t type;    ///< PERF_RECORD_SAMPLE, _MMAP2, _COMM or _FORK
+      uint32_t pid;
+      uint32_t other;   ///< SAMPLE: tid; FORK: parent PID; COMM: 1 if it was an exec(); else 0
+      uint32_t index;   ///< SAMPLE: into stacks_; MMAP2: into mappings_; COMM: into names_
+    };
+
+    /// an executable file mapping of a process
+    struct Mapping
+    {
+      uint64_t start;
+      uint64_t end;
+      uint64_t offset;       ///< in the file
+      std::string filename;  ///< '//anon', '[vdso]' etc. for non-file mappings
+    };
+
+    /// open the events on all CPUs for @p pid; returns false with errno set on failure
+    bool open_(pid_t pid);
+
+    /// wait for data in the ring buffers and drain them until stop() (runs on thread_)
+    void run_();
+
+    /// move all records of each ring buffer to events_
+    void drain_();
+
+    /// parse one record of the ring buffer
+    void addRecord_(const char* record, size_t size);
+
+    /// replay events_ in the order of time and aggregate the symbolized stacks
+    void symbolize_();
+
+    unsigned frequency_;
+    std::string error_;
+    int go_pipe_[2]{ -1, -1 };       ///< the child waits for a byte (or EOF) on go_pipe_[0]
+    std::vector<int> fds_;           ///< one event per CPU
+    std::vector<void*> buffers_;     ///< the ring buffers of fds_ (1 metadata page + 2^n data pages each)
+    size_t buffer_bytes_{ 0 };
+    size_t page_size_;
+    uint64_t clock_{ 0 };            ///< PERF_COUNT_SW_TASK_CLOCK, or PERF_COUNT_SW_CPU_CLOCK
+    std::thread thread_;
+    int wake_fd_{ -1 };              ///< eventfd which ends run_()
+    bool stopped_{ false };
+    std::vector<char> scratch_;      ///< for records which wrap around the end of a ring buffer
+    std::vector<Event> events_;
+    std::unordered_map<std::string, uint32_t> stack_index_;   ///< packed call chain (uint64 addresses) -> index into stacks_
+    std::vector<const std::string*> stacks_;
+    std::vector<Mapping> mappings_;
+    std::vector<std::string> names_;
+    std::map<std::string, uint64_t> folded_;   ///< folded stack -> samples
+    CpuProfileSummary summary_;
+  };
+#endif
+
+} // namespace
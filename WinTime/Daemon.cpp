@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "Daemon.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace WinTime
+{
+  namespace
+  {
+    // epoll tags besides client ids
+    constexpr uint64_t TAG_LISTEN = UINT64_MAX;
+    constexpr uint64_t TAG_SUPERVISOR = UINT64_MAX - 1;
+    constexpr uint64_t TAG_STOP = UINT64_MAX - 2;
+
+    /// written to by the signal handler (self-pipe), so the event loop wakes up on SIGINT/SIGTERM
+    int stop_pipe[2]{ -1, -1 };
+
+    void onStopSignal(int)
+    {
+      const char byte = 1;
+      [[maybe_unused]] auto written = write(stop_pipe[1], &byte, 1);
+    }
+
+    void watch(const int epoll_fd, const int fd, const uint32_t events, const uint64_t tag)
+    {
+      epoll_event event{};
+      event.events = events;
+      event.data.u64 = tag;
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+      {
+        throw std::runtime_error(std::string("Daemon: could not watch a descriptor: ") + std::strerror(errno));
+      }
+    }
+
+    sockaddr_un toAddress(const std::string& socket_path)
+    {
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      if (socket_path.size() >= sizeof(address.sun_path))
+      {
+        throw std::runtime_error("Socket path '" + socket_path + "' is too long.");
+      }
+      std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+      return address;
+    }
+
+    /// value of @p name in @p env ('NAME=VALUE' entries)
+    std::string getEnv(const std::vector<std::string>& env, const std::string& name)
+    {
+      for (const auto& entry : env)
+      {
+        if (entry.size() > name.size() && entry.compare(0, name.size(), name) == 0 && entry[name.size()] == '=') return entry.substr(name.size() + 1);
+      }
+      return {};
+    }
+  }
+
+  Daemon::Daemon(const std::string& socket_path, const DaemonOptions& options)
+    : socket_path_(socket_path),
+      options_(options)
+  {
+    if (options_.log_file && isRecordFormat(options_.log_format))
+    {
+      record_writer_.emplace(options_.log_format, options_.log_file, options_.open_mode);
+      log_header_ = record_writer_->header();
+    }
+
+    const sockaddr_un address = toAddress(socket_path_);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ == -1)
+    {
+      throw std::runtime_error(std::string("Daemon: could not create a socket: ") + std::strerror(errno));
+    }
+    // a socket file nobody listens on is left over from a daemon which was killed
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool alive = probe != -1 && connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    if (probe != -1) close(probe);
+    if (alive)
+    {
+      close(listen_fd_);
+      throw std::runtime_error("Daemon: another daemon is listening on '" + socket_path_ + "'.");
+    }
+    unlink(socket_path_.c_str());
+    // only our user may connect, since requests run commands as us
+    const mode_t old_mask = umask(0077);
+    const bool bound = bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    umask(old_mask);
+    if (!bound || listen(listen_fd_, SOMAXCONN) != 0)
+    {
+      const std::string reason = std::strerror(errno);
+      close(listen_fd_);
+      throw std::runtime_error("Daemon: could not listen on '" + socket_path_ + "': " + reason);
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1 || pipe2(stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+      close(listen_fd_);
+      unlink(socket_path_.c_str());
+      throw std::runtime_error("Daemon: could not create an epoll instance.");
+    }
+    watch(epoll_fd_, listen_fd_, EPOLLIN, TAG_LISTEN);
+    watch(epoll_fd_, supervisor_.getEventFD(), EPOLLIN, TAG_SUPERVISOR);
+    watch(epoll_fd_, stop_pipe[0], EPOLLIN, TAG_STOP);
+  }
+
+  Daemon::~Daemon()
+  {
+    try
+    {
+      flush_(true);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "Daemon: could not write the log: " << e.what() << '\n';
+    }
+    for (auto& [id, client] : clients_)
+    {
+      closeStdio_(client);
+      if (client.fd != -1) close(client.fd);
+    }
+    if (listen_fd_ != -1)
+    {
+      close(listen_fd_);
+      unlink(socket_path_.c_str());
+    }
+    close(epoll_fd_);
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+  }
+
+  void Daemon::run()
+  {
+    struct sigaction action{};
+    action.sa_handler = onStopSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!stopping_ || supervisor_.running() > 0)
+    {
+      int timeout_ms = -1;
+      if (log_row_count_ > 0)
+      {
+        const auto age = std::chrono::steady_clock::now() - t_first_row_;
+        timeout_ms = int(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(options_.flush_interval - age).count()));
+      }
+      epoll_event events[64];
+      const int count = epoll_wait(epoll_fd_, events, int(std::size(events)), timeout_ms);
+      if (count == -1 && errno != EINTR)
+      {
+        throw std::runtime_error(std::string("Daemon: epoll_wait failed: ") + std::strerror(errno));
+      }
+      for (int i = 0; i < count; ++i)
+      {
+        const uint64_t tag = events[i].data.u64;
+        if (tag == TAG_LISTEN)
+        {
+          accept_();
+        }
+        else if (tag == TAG_SUPERVISOR)
+        {
+          for (const size_t index : supervisor_.waitAny(std::chrono::milliseconds(0)))
+          {
+            finish_(index);
+          }
+        }
+        else if (tag == TAG_STOP)
+        {
+          char buffer[16];
+          while (read(stop_pipe[0], buffer, sizeof(buffer)) > 0) {}
+          if (stopping_) continue;
+          stopping_ = true;
+          epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+          close(listen_fd_);
+          listen_fd_ = -1;
+          unlink(socket_path_.c_str());
+          // idle clients are done; the others get their reply when their command finished
+          for (auto it = clients_.begin(); it != clients_.end();)
+          {
+            const size_t id = (it++)->first;
+            if (!clients_[id].process) close_(id);
+          }
+        }
+        else if (clients_.count(size_t(tag)) && !read_(size_t(tag)))
+        {
+          close_(size_t(tag));
+        }
+      }
+      flush_(false);
+    }
+  }
+
+  void Daemon::accept_()
+  {
+    while (true)
+    {
+      const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1) return; // EAGAIN: all pending connections were accepted
+      // the socket file is private already; this also covers sockets in a directory others can write to
+      ucred peer{};
+      socklen_t length = sizeof(peer);
+      if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || peer.uid != getuid())
+      {
+        close(fd);
+        continue;
+      }
+      const size_t id = next_client_id_++;
+      watch(epoll_fd_, fd, EPOLLIN | EPOLLRDHUP, id);
+      clients_[id].fd = fd;
+    }
+  }
+
+  bool Daemon::read_(size_t id)
+  {
+    Client& client = clients_.at(id);
+    char buffer[64 * 1024];
+    while (true)
+    {
+      iovec data{ buffer, sizeof(buffer) };
+      alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+      msghdr header{};
+      header.msg_iov = &data;
+      header.msg_iovlen = 1;
+      header.msg_control = control;
+      header.msg_controllen = sizeof(control);
+      const ssize_t count = recvmsg(client.fd, &header, MSG_CMSG_CLOEXEC);
+      if (count == -1 && errno == EINTR) continue;
+      if (count == -1 && errno == EAGAIN) break;
+      if (count <= 0)
+      { // hung up (or broken); a command which still runs for it is of no use anymore
+        if (client.process)
+        {
+          kill(supervisor_.getProcess(*client.process).getPID(), SIGTERM);
+        }
+        return false;
+      }
+      for (cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg))
+      {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        const size_t fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int received[3]{ -1, -1, -1 };
+        std::memcpy(received, CMSG_DATA(cmsg), std::min<size_t>(fds, 3) * sizeof(int));
+        closeStdio_(client);
+        for (size_t fd = 0; fd < 3; ++fd) client.stdio[fd] = received[fd];
+      }
+      client.input.append(buffer, size_t(count));
+    }
+
+    if (!client.process)
+    {
+      try
+      {
+        if (auto request = decodeRequest(client.input))
+        {
+          start_(id, *request);
+        }
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << "Daemon: dropping a client: " << e.what() << '\n';
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Daemon::start_(size_t id, const DaemonRequest& request)
+  {
+    Client& client = clients_.at(id);
+    client.command_line = Process::concatArguments(request.argv.front(), std::vector<std::string>(request.argv.begin() + 1, request.argv.end()));
+
+    SpawnOptions spawn_options;
+    spawn_options.working_dir = request.cwd;
+    spawn_options.env = request.env;
+    spawn_options.inherit_env = false;
+    spawn_options.fast_spawn = options_.fast_spawn;
+    for (int fd = 0; fd < 3; ++fd) spawn_options.stdio[fd] = client.stdio[fd];
+    const std::string path = getEnv(request.env, "PATH");
+    const std::string exe = resolve_(request.argv.front(), path, request.cwd);
+    const auto index = supervisor_.spawn(exe, request.argv, spawn_options);
+    const int error = errno;
+    closeStdio_(client); // the command has its own copies
+
+    if (!index)
+    {
+      resolved_.erase(path + '\0' + request.argv.front()); // in case the executable was removed
+      DaemonReply reply;
+      reply.error = error == 0 ? ENOENT : error;
+      const std::string message = encodeReply(reply);
+      [[maybe_unused]] auto sent = send(client.fd, message.data(), message.size(), MSG_NOSIGNAL);
+      return;
+    }
+    client.process = index;
+    client_of_process_[*index] = id;
+  }
+
+  void Daemon::finish_(size_t index)
+  {
+    const size_t id = client_of_process_.at(index);
+    client_of_process_.erase(index);
+    Client& client = clients_.at(id);
+    client.process.reset();
+    const std::string command_line = std::move(client.command_line);
+
+    const Process& process = supervisor_.getProcess(index);
+    const auto ptime = getProcessTime(process.getHandle());
+    const ClientProcessMemoryCounter pmc(process.getHandle());
+    const int status = process.getHandle()->wait_status;
+    DaemonReply reply;
+    reply.exit_code = process.getExitCode().value_or(1);
+    reply.term_signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    reply.times = ptime.raw;
+    reply.memory = pmc.getRaw();
+
+    // answer first; the log can wait
+    if (client.fd != -1)
+    {
+      const std::string message = encodeReply(reply);
+      if (send(client.fd, message.data(), message.size(), MSG_NOSIGNAL) != ssize_t(message.size()))
+      {
+        close_(id);
+      }
+    }
+
+    if (options_.log_file)
+    {
+      if (log_row_count_ == 0) t_first_row_ = std::chrono::steady_clock::now();
+      if (record_writer_)
+      {
+        std::string_view command(command_line);
+        if (!command.empty() && command.back() == ' ') command.remove_suffix(1); // see Process::concatArguments()
+        const FormatValues values{ command, reply.times, reply.memory, reply.exit_code, reply.term_signal };
+        record_writer_->render(values, log_rows_);
+      }
+      else
+      {
+        std::stringstream row;
+        printLineToStream(row, '\t', [](const auto& type, const char sep) { return type.print(sep); }, Command{ command_line }, ptime, pmc);
+        log_rows_ += row.str();
+        addExactColumns(log_exact_, ptime);
+        if (log_header_.empty())
+        {
+          std::stringstream header;
+          printLineToStream(header, '\t', [](const auto& type, const char sep) { return type.printHeader(sep); }, Command(), ptime, pmc);
+          log_header_ = header.str();
+        }
+      }
+      ++log_row_count_;
+    }
+    supervisor_.release(index);
+
+    if (clients_.count(id))
+    { // the client may have sent its next request already
+      Client& next = clients_.at(id);
+      if (next.fd == -1 || stopping_)
+      {
+        close_(id);
+      }
+      else if (!read_(id))
+      {
+        close_(id);
+      }
+    }
+  }
+
+  void Daemon::close_(size_t id)
+  {
+    Client& client = clients_.at(id);
+    if (client.fd != -1)
+    {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client.fd, nullptr);
+      close(client.fd);
+      client.fd = -1;
+    }
+    closeStdio_(client);
+    // keep it until its command finished (see finish_())
+    if (!client.process) clients_.erase(id);
+  }
+
+  void Daemon::closeStdio_(Client& client)
+  {
+    for (int& fd : client.stdio)
+    {
+      if (fd != -1) close(fd);
+      fd = -1;
+    }
+  }
+
+  std::string Daemon::resolve_(const std::string& name, const std::string& path, const std::string& cwd)
+  {
+    // like execvp(): names containing a slash are taken as they are (relative ones from the working directory of the command)
+    if (name.find('/') != std::string::npos) return name;
+    const std::string key = path + '\0' + name;
+    if (const auto it = resolved_.find(key); it != resolved_.end()) return it->second;
+
+    // relative entries (an empty one is the working directory) depend on the working directory of the command, so a lookup which passed one is not cached
+    bool cacheable = true;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+      size_t end = path.find(':', start);
+      if (end == std::string::npos) end = path.size();
+      std::string dir = path.substr(start, end - start);
+      start = end + 1;
+      if (dir.empty() || dir.front() != '/')
+      {
+        cacheable = false;
+        const std::string base = cwd.empty() ? "." : cwd;
+        dir = dir.empty() ? base : base + '/' + dir;
+      }
+      const std::string candidate = dir + '/' + name;
+      struct stat info;
+      if (access(candidate.c_str(), X_OK) == 0 && stat(candidate.c_str(), &info) == 0 && S_ISREG(info.st_mode))
+      {
+        if (cacheable) resolved_[key] = candidate;
+        return candidate;
+      }
+    }
+    return name; // fails in spawn with ENOENT
+  }
+
+  void Daemon::flush_(bool force)
+  {
+    if (log_row_count_ == 0) return;
+    if (!force && log_row_count_ < options_.flush_rows && std::chrono::steady_clock::now() - t_first_row_ < options_.flush_interval) return;
+    std::string rows;
+    rows.swap(log_rows_);
+    ExactColumns exact;
+    exact.swap(log_exact_);
+    log_row_count_ = 0;
+    FileLog(*options_.log_file, options_.open_mode, '\t', record_writer_ ? LogFormat::TSV : options_.log_format).append(log_header_, rows, exact);
+    options_.open_mode = OpenMode::APPEND;
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "DaemonProtocol.h"
+#include "FileLog.h"
+#include "RecordWriter.h"
+#include "Supervisor.h"
+
+namespace WinTime
+{
+  struct DaemonOptions
+  {
+    std::optional<std::string> log_file;   ///< log each command here (like -o)
+    OpenMode open_mode{ OpenMode::OVERWRITE };  ///< for the first write to @p log_file
+    LogFormat log_format{ LogFormat::TSV };
+    std::chrono::milliseconds flush_interval{ 1000 };  ///< write buffered log rows at least this often
+    size_t flush_rows{ 1000 };                         ///< ... or when this many rows are buffered
+    bool fast_spawn{ false };                          ///< see SpawnOptions
+  };
+
+  /**
+    @brief Measures commands on behalf of clients (see wintime-client), so each call costs a socket round trip instead of starting WinTime
+
+    Listens on a Unix domain socket. Each request (see DaemonProtocol.h) carries argv, cwd, the environment and the client's
+    STDIN/STDOUT/STDERR; the command runs with exactly these and is supervised like in --batch (one epoll loop, pidfds).
+    Once it terminates, the client gets exit code, times and memory counters back, and a row is added to the log buffer.
+    Rows are written in one locked append per flush (see DaemonOptions), never while a client waits for its reply.
+
+    Executables are looked up in the PATH of the request, and the result is cached per (PATH, name).
+    If a client hangs up before its command finished (e.g. Ctrl-C), the command gets SIGTERM.
+    SIGINT/SIGTERM stop accepting connections; the daemon returns once all running commands were answered and the log was written.
+  */
+  class Daemon
+  {
+  public:
+    /// Bind to @p socket_path (a stale socket file is replaced; a live daemon there is an error)
+    /// @throw std::runtime_error if the socket cannot be created
+    Daemon(const std::string& socket_path, const DaemonOptions& options);
+
+    Daemon(const Daemon&) = delete;
+    void operator=(const Daemon&) = delete;
+
+    /// writes pending log rows and removes the socket file
+    ~Daemon();
+
+    /// serve requests until SIGINT or SIGTERM
+    void run();
+
+  private:
+    struct Client
+    {
+      int fd{ -1 };
+      std::string input;              ///< received, but not yet decoded bytes
+      int stdio[3]{ -1, -1, -1 };     ///< received with the request
+      std::optional<size_t> process;  ///< index of its command in supervisor_
+      std::string command_line;
+    };
+
+    void accept_();
+
+    /// read from @p id and start its command once the request is complete; returns false if the client is gone
+    bool read_(size_t id);
+
+    void start_(size_t id, const DaemonRequest& request);
+
+    /// reply to the client of the terminated process @p index and log it
+    void finish_(size_t index);
+
+    void close_(size_t id);
+
+    void closeStdio_(Client& client);
+
+    /// the executable for @p name, looked up in @p path (cached, unless a relative entry of @p path was searched; those are relative to @p cwd)
+    std::string resolve_(const std::string& name, const std::string& path, const std::string& cwd);
+
+    /// write buffered rows, if there are any (and @p force, or the buffer is old or large enough)
+    void flush_(bool force);
+
+    std::string socket_path_;
+    DaemonOptions options_;
+    int listen_fd_{ -1 };
+    int epoll_fd_{ -1 };
+    Supervisor supervisor_;
+    std::map<size_t, Client> clients_;                    ///< by id
+    std::map<size_t, size_t> client_of_process_;          ///< process index -> client id
+    size_t next_client_id_{ 0 };
+    bool stopping_{ false };                              ///< after SIGINT/SIGTERM
+    std::unordered_map<std::string, std::string> resolved_;  ///< PATH + '\0' + name -> executable
+    std::optional<RecordWriter> record_writer_;           ///< for the record formats
+    std::string log_header_;
+    std::string log_rows_;
+    ExactColumns log_exact_;                              ///< unrounded times of log_rows_, for binary logs
+    size_t log_row_count_{ 0 };
+    std::chrono::steady_clock::time_point t_first_row_;
+  };
+
+} // namespace
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "DaemonProtocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace WinTime
+{
+  namespace
+  {
+    constexpr std::string_view MAGIC = "WTD1";
+
+    /// limit for a single message, so a broken client cannot make the daemon allocate without bounds
+    constexpr uint32_t MAX_MESSAGE_SIZE = 64 << 20;
+
+    void putU32(std::string& out, const uint32_t value)
+    {
+      for (int i = 0; i < 4; ++i) out.push_back(char(value >> (8 * i)));
+    }
+
+    void putU64(std::string& out, const uint64_t value)
+    {
+      for (int i = 0; i < 8; ++i) out.push_back(char(value >> (8 * i)));
+    }
+
+    void putString(std::string& out, const std::string_view text)
+    {
+      putU32(out, uint32_t(text.size()));
+      out.append(text);
+    }
+
+    /// reads the fields of a message, checking the bounds
+    class Reader
+    {
+    public:
+      explicit Reader(const std::string_view data) : data_(data) {}
+
+      uint64_t get(const int bytes)
+      {
+        need_(size_t(bytes));
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) value |= uint64_t(uint8_t(data_[pos_ + i])) << (8 * i);
+        pos_ += size_t(bytes);
+        return value;
+      }
+
+      std::string getString()
+      {
+        const size_t size = get(4);
+        need_(size);
+        std::string result(data_.substr(pos_, size));
+        pos_ += size;
+        return result;
+      }
+
+      std::vector<std::string> getStrings()
+      {
+        const size_t count = get(4);
+        need_(count * 4); // every string needs at least its length
+        std::vector<std::string> result;
+        result.reserve(count);
+        for (size_t i = 0; i < count; ++i) result.push_back(getString());
+        return result;
+      }
+
+      void expectMagic()
+      {
+        need_(MAGIC.size());
+        if (data_.substr(pos_, MAGIC.size()) != MAGIC) throw std::runtime_error("Not a WinTime daemon message.");
+        pos_ += MAGIC.size();
+      }
+
+    private:
+      void need_(const size_t bytes) const
+      {
+        if (data_.size() - pos_ < bytes) throw std::runtime_error("Truncated WinTime daemon message.");
+      }
+
+      std::string_view data_;
+      size_t pos_{ 0 };
+    };
+
+    /// prefix @p body (which starts after the length) with its length
+    std::string frame(const std::string& body)
+    {
+      std::string message;
+      message.reserve(4 + body.size());
+      putU32(message, uint32_t(body.size()));
+      message += body;
+      return message;
+    }
+
+    /// the length of the message at the start of @p buffer, if it is complete
+    std::optional<uint32_t> completeMessage(const std::string_view buffer)
+    {
+      if (buffer.size() < 4) return std::nullopt;
+      const auto size = uint32_t(Reader(buffer).get(4));
+      if (size > MAX_MESSAGE_SIZE) throw std::runtime_error("WinTime daemon message too large.");
+      if (buffer.size() - 4 < size) return std::nullopt;
+      return size;
+    }
+  }
+
+  std::string encodeRequest(const DaemonRequest& request)
+  {
+    std::string body(MAGIC);
+    putU32(body, uint32_t(request.argv.size()));
+    for (const auto& arg : request.argv) putString(body, arg);
+    putString(body, request.cwd);
+    putU32(body, uint32_t(request.env.size()));
+    for (const auto& entry : request.env) putString(body, entry);
+    return frame(body);
+  }
+
+  std::optional<DaemonRequest> decodeRequest(std::string& buffer)
+  {
+    const auto size = completeMessage(buffer);
+    if (!size) return std::nullopt;
+    Reader reader(std::string_view(buffer).substr(4, *size));
+    reader.expectMagic();
+    DaemonRequest request;
+    request.argv = reader.getStrings();
+    request.cwd = reader.getString();
+    request.env = reader.getStrings();
+    if (request.argv.empty()) throw std::runtime_error("WinTime daemon request without a command.");
+    buffer.erase(0, 4 + size_t(*size));
+    return request;
+  }
+
+  std::string encodeReply(const DaemonReply& reply)
+  {
+    std::string body(MAGIC);
+    putU32(body, uint32_t(reply.error));
+    putU32(body, uint32_t(reply.exit_code));
+    putU32(body, uint32_t(reply.term_signal));
+    for (const int64_t t : { reply.times.t_create_ns, reply.times.t_exit_ns, reply.times.t_kernel_ns, reply.times.t_user_ns, reply.times.t_wall_ns })
+    {
+      putU64(body, uint64_t(t));
+    }
+    const auto& m = reply.memory;
+    for (const uint64_t c : { m.peak_rss, m.page_faults, m.minor_faults, m.major_faults, m.voluntary_cs, m.involuntary_cs, m.io_read_bytes, m.io_write_bytes })
+    {
+      putU64(body, c);
+    }
+    return frame(body);
+  }
+
+  DaemonReply decodeReply(const std::string_view message)
+  {
+    const auto size = completeMessage(message);
+    if (!size) throw std::runtime_error("Truncated WinTime daemon message.");
+    Reader reader(message.substr(4, *size));
+    reader.expectMagic();
+    DaemonReply reply;
+    reply.error = int32_t(reader.get(4));
+    reply.exit_code = int32_t(reader.get(4));
+    reply.term_signal = int32_t(reader.get(4));
+    for (int64_t* t : { &reply.times.t_create_ns, &reply.times.t_exit_ns, &reply.times.t_kernel_ns, &reply.times.t_user_ns, &reply.times.t_wall_ns })
+    {
+      *t = int64_t(reader.get(8));
+    }
+    auto& m = reply.memory;
+    for (uint64_t* c : { &m.peak_rss, &m.page_faults, &m.minor_faults, &m.major_faults, &m.voluntary_cs, &m.involuntary_cs, &m.io_read_bytes, &m.io_write_bytes })
+    {
+      *c = reader.get(8);
+    }
+    return reply;
+  }
+
+  DaemonReply runViaDaemon(const std::string& socket_path, const DaemonRequest& request)
+  {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+      throw std::runtime_error("Socket path '" + socket_path + "' is too long.");
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      const std::string reason = std::strerror(errno);
+      if (fd != -1) close(fd);
+      throw std::runtime_error("Could not connect to the WinTime daemon at '" + socket_path + "': " + reason);
+    }
+
+    // the whole request in one go; our STDIN, STDOUT and STDERR travel with its first byte
+    const std::string message = encodeRequest(request);
+    size_t sent = 0;
+    while (sent < message.size())
+    {
+      iovec data{ const_cast<char*>(message.data() + sent), message.size() - sent };
+      msghdr header{};
+      header.msg_iov = &data;
+      header.msg_iovlen = 1;
+      alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))];
+      if (sent == 0)
+      {
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+        const int stdio[3]{ 0, 1, 2 };
+        std::memcpy(CMSG_DATA(cmsg), stdio, sizeof(stdio));
+      }
+      const ssize_t count = sendmsg(fd, &header, MSG_NOSIGNAL);
+      if (count == -1 && errno == EINTR) continue;
+      if (count <= 0)
+      {
+        const std::string reason = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("Could not send the request to the WinTime daemon: " + reason);
+      }
+      sent += size_t(count);
+    }
+
+    // the reply comes once the command terminated
+    std::string reply;
+    char buffer[512];
+    while (true)
+    {
+      const ssize_t count = read(fd, buffer, sizeof(buffer));
+      if (count == -1 && errno == EINTR) continue;
+      if (count <= 0) break;
+      reply.append(buffer, size_t(count));
+      if (completeMessage(reply)) break;
+    }
+    close(fd);
+    if (!completeMessage(reply))
+    {
+      throw std::runtime_error("The WinTime daemon hung up without a reply.");
+    }
+    return decodeReply(reply);
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Memory.h"
+#include "Time.h"
+
+namespace WinTime
+{
+  /// What a client asks the daemon (see Daemon) to run
+  struct DaemonRequest
+  {
+    std::vector<std::string> argv;  ///< including argv[0] (looked up in the PATH of @p env, like execvp())
+    std::string cwd;                ///< working directory of the command
+    std::vector<std::string> env;   ///< the complete environment of the command ('NAME=VALUE')
+  };
+
+  /// What the daemon answers once the command terminated
+  struct DaemonReply
+  {
+    int32_t error{ 0 };        ///< errno if the command could not be started (then all other fields are 0)
+    int32_t exit_code{ 0 };    ///< 128 + signal number, if it was killed by a signal
+    int32_t term_signal{ 0 };
+    RawTimes times;
+    RawMemoryCounters memory;
+  };
+
+  /**
+    @name Wire format of the daemon protocol
+
+    Each message is a little endian uint32 length followed by that many bytes, which start with the magic 'WTD1'.
+    Strings are a uint32 length followed by the bytes; a request is argc, the argv strings, cwd, envc and the env strings.
+    A reply is error, exit_code and term_signal (int32), the times (5 x int64) and the memory counters (8 x uint64).
+    The client sends its STDIN, STDOUT and STDERR along with the request (SCM_RIGHTS), so the command writes to its terminal or pipes.
+  */
+  ///@{
+  std::string encodeRequest(const DaemonRequest& request);
+
+  /// Decode the first message of @p buffer and remove it from there; nothing if @p buffer does not hold a complete message yet
+  /// @throw std::runtime_error if the message is malformed
+  std::optional<DaemonRequest> decodeRequest(std::string& buffer);
+
+  std::string encodeReply(const DaemonReply& reply);
+
+  /// @throw std::runtime_error if @p message is not a complete reply
+  DaemonReply decodeReply(const std::string_view message);
+  ///@}
+
+  /// Send @p request to the daemon listening on @p socket_path, along with our STDIN, STDOUT and STDERR, and wait for its reply
+  /// @throw std::runtime_error if the daemon cannot be reached or hangs up
+  DaemonReply runViaDaemon(const std::string& socket_path, const DaemonRequest& request);
+
+} // namespace
+
+#endif
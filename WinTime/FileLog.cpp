@@ -22,33 +22,38 @@
 
 #include "FileLog.h"
 
+#include "BinaryLog.h"
+#include "CommandIndex.h"
 #include "Memory.h"
 #include "Process.h"
 
+#ifdef _WIN32
 #include <io.h> // for _chsize_s()
-#include <chrono>
+#else
+#include <cerrno>
+#include <sys/file.h> // for flock()
+#include <sys/stat.h> // for fstat()
+#include <unistd.h>   // for ftruncate()
+#endif
 #include <iostream>
 #include <filesystem>
-#include <thread>
 
 using namespace std;
 
 namespace WinTime
 {
-  /// Try to open (overwrite or append) and lock the file. Returns true on success.
+  /// Pass filename and mode; No operation on the file is attempted at this point. Use lock() or tryLock() to open and lock the file.
 
-
-  /// Pass filename and mode; No operation on the file is attempted at this point. Use tryLock() to open and lock the file.
-
-  LockedFile::LockedFile(const std::string& filename, const OpenMode mode)
+  LockedFile::LockedFile(const std::string& filename, const OpenMode mode, const bool binary)
     : filename_(filename),
-      openmode_(mode)
+      openmode_(mode),
+      binary_(binary)
   {
     // First, make sure the file exists:
     auto wfile = widen(filename_);
     if (!std::filesystem::exists(wfile))
     {
-      std::wofstream of(wfile);
+      std::wofstream of{ std::filesystem::path(wfile) };
       if (!of.is_open())
       { // this may print bogus characters if non-ascii letters are printed, but
         // printing to wcerr << wfile will not show non-ascii either, unless fiddling with 
@@ -59,7 +64,17 @@ namespace WinTime
     }
   }
 
+  bool LockedFile::lock()
+  {
+    return open_(true);
+  }
+
   bool LockedFile::tryLock()
+  {
+    return open_(false);
+  }
+
+  bool LockedFile::open_(const bool wait)
   {
     // at this point, the file exists!  -- see C'tor
 
@@ -67,9 +82,28 @@ namespace WinTime
     // We cannot query for filesize before, because another process might write stuff to the file
     // immediately afterwards (before we _fsopen for just writing in case we found the file being empty; this 
     // would overwrite the other process' data)
-    is_locked_ = ((stream_ = _wfsopen(&widen(filename_)[0], L"r+", _SH_DENYWR)) != NULL);
-
-    if (!is_locked_) return false;
+#ifdef _WIN32
+    if ((stream_ = _wfsopen(&widen(filename_)[0], binary_ ? L"r+b" : L"r+", _SH_DENYNO)) == NULL) return false;
+    // lock the whole file; without LOCKFILE_FAIL_IMMEDIATELY, the call is queued until the lock is granted
+    OVERLAPPED overlapped{};
+    const HANDLE handle = (HANDLE)_get_osfhandle(_fileno(stream_));
+    is_locked_ = LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY), 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+    if ((stream_ = fopen(filename_.c_str(), "r+")) == NULL) return false;
+    // advisory lock; all WinTime instances honor it. A blocking flock() sleeps in the kernel until the lock is released,
+    // i.e. waiters are woken right away instead of polling. (It belongs to the open file, so threads of one process exclude each other as well.)
+    int result;
+    while ((result = flock(fileno(stream_), LOCK_EX | (wait ? 0 : LOCK_NB))) == -1 && errno == EINTR)
+    {
+    }
+    is_locked_ = (result == 0);
+#endif
+    if (!is_locked_)
+    {
+      fclose(stream_);
+      stream_ = nullptr;
+      return false;
+    }
 
     // depending on mode_, seek to the end, before writing (i.e. append)
     if (openmode_ == OpenMode::OVERWRITE)
@@ -89,7 +123,11 @@ namespace WinTime
     {
       throw std::runtime_error("Trying to write to closed file");
     }
+#ifdef _WIN32
     return (_ftelli64(stream_) == 0);
+#else
+    return (ftello(stream_) == 0);
+#endif
   }
 
   /// Write some data to file. @p tryLock() must have been successful before!
@@ -100,48 +138,178 @@ namespace WinTime
     {
       throw std::runtime_error("Trying to write to closed file");
     }
-    fprintf(stream_, data);
+    fputs(data, stream_);
+  }
+
+  void LockedFile::write(const char* data, const size_t size)
+  {
+    if (!is_locked_)
+    {
+      throw std::runtime_error("Trying to write to closed file");
+    }
+    fwrite(data, 1, size, stream_);
+  }
+
+  size_t LockedFile::readAt(char* data, const size_t size, const int64_t offset)
+  {
+    if (!is_locked_)
+    {
+      throw std::runtime_error("Trying to read from closed file");
+    }
+    fflush(stream_);
+#ifdef _WIN32
+    const auto pos = _ftelli64(stream_);
+    _fseeki64(stream_, offset, SEEK_SET);
+    const size_t n = fread(data, 1, size, stream_);
+    _fseeki64(stream_, pos, SEEK_SET);
+#else
+    const auto pos = ftello(stream_);
+    fseeko(stream_, offset, SEEK_SET);
+    const size_t n = fread(data, 1, size, stream_);
+    fseeko(stream_, pos, SEEK_SET);
+#endif
+    return n;
+  }
+
+  int64_t LockedFile::position() const
+  {
+    if (!is_locked_)
+    {
+      throw std::runtime_error("Trying to write to closed file");
+    }
+#ifdef _WIN32
+    return _ftelli64(stream_);
+#else
+    return ftello(stream_);
+#endif
+  }
+
+  void LockedFile::rewind()
+  {
+    if (!is_locked_)
+    {
+      throw std::runtime_error("Trying to write to closed file");
+    }
+    fseek(stream_, 0, SEEK_SET);
   }
 
   /// Truncates the file to the last write position and closes the stream
+  /// Only regular files are truncated: a device or pipe (e.g. '-o /dev/null') has no size to cut.
 
   LockedFile::~LockedFile()
   {
     if (is_locked_)
     {
-      if (_chsize_s(_fileno(stream_), _ftelli64(stream_))) // truncate file to end of last write
+#ifdef _WIN32
+      const bool is_disk_file = GetFileType((HANDLE)_get_osfhandle(_fileno(stream_))) == FILE_TYPE_DISK;
+      if (is_disk_file && _chsize_s(_fileno(stream_), _ftelli64(stream_))) // truncate file to end of last write
       {
         DWORD error = ::GetLastError();
         std::string message = std::system_category().message(error);
         std::cerr << message << '\n';
       }
+      // release the lock right away (closing the handle would do so only eventually), but only once all data is written
+      fflush(stream_);
+      OVERLAPPED overlapped{};
+      UnlockFileEx((HANDLE)_get_osfhandle(_fileno(stream_)), 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+      fflush(stream_);
+      struct stat status;
+      const bool is_regular = fstat(fileno(stream_), &status) == 0 && S_ISREG(status.st_mode);
+      if (is_regular && ftruncate(fileno(stream_), ftello(stream_))) // truncate file to end of last write
+      {
+        std::cerr << std::system_category().message(errno) << '\n';
+      }
+#endif
       fclose(stream_);
     }
   }
-  FileLog::FileLog(const std::string& filename, const OpenMode mode, const char sep)
+  uint64_t commandHash(const std::string_view cmd)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : cmd)
+    {
+      hash ^= uint8_t(c);
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  std::string toHex(const uint64_t hash)
+  {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+    return buffer;
+  }
+
+  LogFormat parseLogFormat(const std::string& format)
+  {
+    if (format == "tsv") return LogFormat::TSV;
+    if (format == "binary") return LogFormat::BINARY;
+    if (format == "jsonl") return LogFormat::JSONL;
+    if (format == "csv") return LogFormat::CSV;
+    if (format == "tsv-raw") return LogFormat::TSV_RAW;
+    throw std::runtime_error("Unknown log format '" + format + "'. Use 'tsv', 'binary', 'jsonl', 'csv' or 'tsv-raw'.");
+  }
+
+  FileLog::FileLog(const std::string& filename, const OpenMode mode, const char sep, const LogFormat format, const bool intern_commands)
     : filename_(filename),
       mode_(mode),
-      sep_(sep)
+      sep_(sep),
+      format_(format),
+      intern_commands_(intern_commands)
   {
+    if (intern_commands_ && format_ != LogFormat::TSV)
+    {
+      throw std::runtime_error("Command interning is only available for TSV logs.");
+    }
   }
-  void FileLog::log(const std::string& cmd, const PTime& time, const ClientProcessMemoryCounter& pmc)
+
+  void FileLog::appendInterned_(const std::string& cmd, const std::string& header, const std::string& line)
   {
+    appendInternedRow(filename_, mode_, cmd, header, line);
+  }
+
+  void addExactColumns(ExactColumns& exact, const PTime& ptime)
+  {
+    exact["creation_time"].push_back(ptime.raw.t_create_ns);
+    exact["exit_time"].push_back(ptime.raw.t_exit_ns);
+    exact["wall_time"].push_back(ptime.raw.t_wall_ns);
+    exact["user_time"].push_back(ptime.raw.t_user_ns);
+    exact["kernel_time"].push_back(ptime.raw.t_kernel_ns);
+  }
+
+  void FileLog::append(const std::string& header, const std::string& lines, const ExactColumns& exact)
+  {
+    if (format_ == LogFormat::BINARY)
+    {
+      const auto names = splitCells(std::string_view(header).substr(0, header.find('\n')), sep_);
+      std::vector<std::vector<std::string>> rows;
+      for (size_t start = 0; start < lines.size();)
+      {
+        size_t end = lines.find('\n', start);
+        if (end == std::string::npos) end = lines.size();
+        rows.push_back(splitCells(std::string_view(lines).substr(start, end - start), sep_));
+        start = end + 1;
+      }
+      appendBinaryLog(filename_, mode_, names, rows, exact);
+      return;
+    }
+
     // its a bit inefficient to do this here, but we want write access to the file 
     // to be as short as possible
     LockedFile lockf(filename_, mode_);
 
-    // try to lock the file
-    while (!lockf.tryLock())
+    // wait for the lock (without polling)
+    if (!lockf.lock())
     {
-      std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    };
+      throw std::runtime_error("Could not lock file '" + filename_ + "'.");
+    }
 
-    std::stringstream content;
     if (lockf.isFileEmpty())
     { // at start of file .. write header
-      printLineToStream(content, '\t', [](auto type, const char sep) { return type.printHeader(sep); }, Command(), time, pmc);
+      lockf.write(header.c_str());
     }
-    printLineToStream(content, '\t', [](auto type, const char sep) { return type.print(sep); }, Command{ cmd }, time, pmc);
-    lockf.write(content.str().c_str());
+    lockf.write(lines.c_str());
   }
 } // namespace
\ No newline at end of file
@@ -24,10 +24,15 @@
 
 #include <string>
 #include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <vector>
 
 
 #include "Time.h"
-#include <Memory.h>
+#include "Memory.h"
 
 
 namespace WinTime
@@ -38,6 +43,35 @@ namespace WinTime
     APPEND
   };
   
+  /// Append the cells of @p printable (preceded by @p sep) to @p out; see printLineToStream()
+  template<typename Lambda, typename Printable>
+  void appendCellsToStream(std::ostream& out, const char sep, Lambda func, const Printable& printable)
+  {
+    out << sep << func(printable, sep);
+  }
+
+  /// Exact values (in ns) of timestamp or duration columns by column name, one per row, which a binary log stores instead of the printed cells
+  using ExactColumns = std::map<std::string, std::vector<int64_t>>;
+
+  /// Add the exact values of the columns of @p printable to @p exact; most types have none
+  template<typename Printable>
+  void addExactColumns(ExactColumns&, const Printable&)
+  {
+  }
+
+  /// the unrounded times of @p ptime (see PTime::raw)
+  void addExactColumns(ExactColumns& exact, const PTime& ptime);
+
+  /// An empty optional printable contributes no cells at all (not even empty ones)
+  template<typename Lambda, typename Printable>
+  void appendCellsToStream(std::ostream& out, const char sep, Lambda func, const std::optional<Printable>& printable)
+  {
+    if (printable)
+    {
+      out << sep << func(*printable, sep);
+    }
+  }
+
   /**
   * @brief Print a list of printable objects to a stream as a single line
   * 
@@ -58,7 +92,7 @@ namespace WinTime
   void printLineToStream(std::ostream& out, const char sep, Lambda func, Arg1&& first, Args&&... args)
   {
     out << func(first, sep);
-    ((out << sep << func(args, sep)), ...);
+    (appendCellsToStream(out, sep, func, args), ...);
     out << '\n';
   }
 
@@ -77,6 +111,27 @@ namespace WinTime
     }
   };
 
+  /// stable 64 bit hash of a command line (FNV-1a; does not change between runs or platforms)
+  uint64_t commandHash(const std::string_view cmd);
+
+  /// @p hash as 16 hex digits
+  std::string toHex(const uint64_t hash);
+
+  /// printable wrapper for a command line, which is logged as its hash (see CommandIndex.h)
+  struct CommandHash
+  {
+    std::string cmd;
+    std::string print(const char /*separator*/) const
+    {
+      return toHex(commandHash(cmd));
+    }
+
+    static std::string printHeader(const char /*separator*/)
+    {
+      return "cmd_hash";
+    }
+  };
+
 
   /// A locked file with exclusive system-wide write access to a file
   /// Note: Opening a C++ std::ofstream on that file does not work anymore
@@ -85,40 +140,109 @@ namespace WinTime
     FILE* stream_ = nullptr;
     std::string filename_;
     OpenMode openmode_{};
+    bool binary_{ false };
     bool is_locked_{ false };
   public:
 
-    /// Pass filename and mode; No operation on the file is attempted at this point. Use tryLock() to open and lock the file.
-    LockedFile(const std::string& filename, const OpenMode mode = OpenMode::OVERWRITE);
+    /// Pass filename and mode; No operation on the file is attempted at this point. Use lock() or tryLock() to open and lock the file.
+    /// If @p binary is true, no newline translation takes place (Windows only).
+    LockedFile(const std::string& filename, const OpenMode mode = OpenMode::OVERWRITE, const bool binary = false);
+
+    /// Open (overwrite or append) and lock the file, waiting as long as another process holds the lock.
+    /// Waiters are queued by the OS (flock() / LockFileEx()), not polled. Returns true on success.
+    bool lock();
 
-    /// Try to open (overwrite or append) and lock the file. Returns true on success.
+    /// Try to open (overwrite or append) and lock the file, without waiting. Returns true on success.
     bool tryLock();
 
-    /// Use this function only right after a successful! tryLock(), not after write()!
+    /// Use this function only right after a successful! lock() or tryLock(), not after write()!
     /// Returns true if the file was just created/'appended to empty'/overwritten, and false if appending to non-empty file
     bool isFileEmpty() const;
 
-    /// Write some data to file. @p tryLock() must have been successful before!
+    /// Write some data to file. @p lock() or tryLock() must have been successful before!
     void write(const char* data);
 
-    /// Truncates the file to the last write position and closes the stream
+    /// Write @p size bytes of @p data to file. @p lock() or tryLock() must have been successful before!
+    void write(const char* data, const size_t size);
+
+    /// Read up to @p size bytes at @p offset into @p data, without moving the write position. Returns the number of bytes read.
+    size_t readAt(char* data, const size_t size, const int64_t offset);
+
+    /// The current write position, i.e. the offset of the next byte written
+    int64_t position() const;
+
+    /// Move the write position to the start of the file, i.e. replace the file by whatever is written from now on
+    void rewind();
+
+    /// Truncates the file to the last write position (if it is a regular file) and closes the stream (which releases the lock)
     ~LockedFile();
+
+  private:
+    /// open and lock the file; wait for the lock if @p wait is true
+    bool open_(const bool wait);
   };
   
-  struct ClientProcessMemoryCounter;
+  /// Layout of a log file
+  enum class LogFormat
+  {
+    TSV,      ///< a header line and one line per row
+    BINARY,   ///< typed columns, see BinaryLog.h
+    JSONL,    ///< one JSON object per run with plain numbers (see RecordWriter.h)
+    CSV,      ///< like JSONL, as comma separated values with a header line
+    TSV_RAW   ///< like JSONL, as tab separated values with a header line
+  };
+
+  /// true for the formats of RecordWriter, which have one row of plain numbers per run
+  inline bool isRecordFormat(const LogFormat format)
+  {
+    return format == LogFormat::JSONL || format == LogFormat::CSV || format == LogFormat::TSV_RAW;
+  }
+
+  /// parse 'tsv', 'binary', 'jsonl', 'csv' or 'tsv-raw'
+  /// @throw std::runtime_error for any other value
+  LogFormat parseLogFormat(const std::string& format);
 
   class FileLog
   {
   public:
 
-    FileLog(const std::string& filename, const OpenMode mode = OpenMode::OVERWRITE, const char sep = '\t');
+    /// @param intern_commands Log the hash of the command line instead of the command line itself (TSV only; see CommandIndex.h)
+    FileLog(const std::string& filename, const OpenMode mode = OpenMode::OVERWRITE, const char sep = '\t', const LogFormat format = LogFormat::TSV,
+            const bool intern_commands = false);
 
-    void log(const std::string& cmd, const PTime& time, const ClientProcessMemoryCounter& pmc);
+    /// Write a single row for @p cmd, followed by the cells of all @p printables (e.g. PTime and ClientProcessMemoryCounter).
+    /// A header is written first if the file is empty.
+    template<typename ... Printables>
+    void log(const std::string& cmd, const Printables&... printables)
+    {
+      std::stringstream header, row;
+      if (intern_commands_)
+      {
+        printLineToStream(header, sep_, [](const auto& type, const char sep) { return type.printHeader(sep); }, CommandHash(), printables...);
+        printLineToStream(row, sep_, [](const auto& type, const char sep) { return type.print(sep); }, CommandHash{ cmd }, printables...);
+        appendInterned_(cmd, header.str(), row.str());
+        return;
+      }
+      printLineToStream(header, sep_, [](const auto& type, const char sep) { return type.printHeader(sep); }, Command(), printables...);
+      printLineToStream(row, sep_, [](const auto& type, const char sep) { return type.print(sep); }, Command{ cmd }, printables...);
+      ExactColumns exact;
+      if (format_ == LogFormat::BINARY) (addExactColumns(exact, printables), ...);
+      append(header.str(), row.str(), exact);
+    }
+
+    /// Lock the file and write @p lines, preceded by @p header if the file is empty
+    /// In LogFormat::BINARY, the lines (each ending in a newline) are stored as one data block instead, using the values in @p exact where given.
+    void append(const std::string& header, const std::string& lines, const ExactColumns& exact = {});
 
   private:
+    /// append @p line (for @p cmd) and record @p cmd in the dictionary and index of the log
+    void appendInterned_(const std::string& cmd, const std::string& header, const std::string& line);
+
     const std::string filename_;
     const OpenMode mode_;
     const char sep_;
+    const LogFormat format_;
+    const bool intern_commands_;
   };
 
 } // namespace
\ No newline at end of file
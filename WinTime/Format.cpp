@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Format.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace WinTime
+{
+  void appendUInt(std::string& out, const uint64_t value)
+  {
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+  }
+
+  void appendInt(std::string& out, const int64_t value)
+  {
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+  }
+
+  std::string joinArguments(const std::vector<std::string>& argv)
+  {
+    std::string joined;
+    for (const auto& arg : argv)
+    {
+      if (!joined.empty()) joined.push_back(' ');
+      joined.append(arg);
+    }
+    return joined;
+  }
+
+  namespace
+  {
+    /// @p value with exactly two digits (zero padded)
+    void appendTwoDigits(std::string& out, const uint64_t value)
+    {
+      out.push_back(char('0' + value / 10 % 10));
+      out.push_back(char('0' + value % 10));
+    }
+
+    /// seconds with two decimals, truncated like GNU time does ('1.239' -> '1.23')
+    void appendSeconds(std::string& out, const int64_t nanoseconds)
+    {
+      const auto hundredths = uint64_t(std::max<int64_t>(0, nanoseconds) / 10000000);
+      appendUInt(out, hundredths / 100);
+      out.push_back('.');
+      appendTwoDigits(out, hundredths % 100);
+    }
+  }
+
+  FormatProgram::FormatProgram(const std::string& format)
+  {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    page_size_ = info.dwPageSize;
+#else
+    page_size_ = uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+    for (size_t i = 0; i < format.size(); ++i)
+    {
+      const char c = format[i];
+      if (c == '\\')
+      {
+        if (i + 1 == format.size())
+        {
+          addLiteral_("?\\");
+          break;
+        }
+        switch (format[++i])
+        {
+          case 't': addLiteral_("\t");
+          break; case 'n': addLiteral_("\n");
+          break; case '\\': addLiteral_("\\");
+          break; default:
+            addLiteral_("?\\");
+            addLiteral_(std::string_view(&format[i], 1));
+        }
+        continue;
+      }
+      if (c != '%')
+      {
+        addLiteral_(std::string_view(&format[i], 1));
+        continue;
+      }
+      if (i + 1 == format.size())
+      {
+        addLiteral_("?");
+        break;
+      }
+      const char code = format[++i];
+      Op op = Op::LITERAL;
+      switch (code)
+      {
+        case '%': addLiteral_("%");
+        break; case 'C': op = Op::COMMAND;
+        break; case 'E': op = Op::ELAPSED_CLOCK;
+        break; case 'e': op = Op::ELAPSED;
+        break; case 'U': op = Op::USER;
+        break; case 'S': op = Op::KERNEL;
+        break; case 'P': op = Op::CPU_PERCENT;
+        break; case 'M': op = Op::MAX_RSS_KB;
+        break; case 'F': op = Op::MAJOR_FAULTS;
+        break; case 'R': op = Op::MINOR_FAULTS;
+        break; case 'I': op = Op::INPUTS;
+        break; case 'O': op = Op::OUTPUTS;
+        break; case 'w': op = Op::VOLUNTARY_CS;
+        break; case 'c': op = Op::INVOLUNTARY_CS;
+        break; case 'Z': op = Op::PAGE_SIZE;
+        break; case 'x': op = Op::EXIT_STATUS;
+        break; case 'D': case 'K': case 'X': case 'p': case 't': case 'W': case 'k': case 'r': case 's': op = Op::ZERO;
+        break; default:
+          addLiteral_("?");
+          addLiteral_(std::string_view(&format[i], 1));
+      }
+      if (op != Op::LITERAL) program_.push_back(Instruction{ op });
+    }
+    addLiteral_("\n");
+  }
+
+  void FormatProgram::addLiteral_(const std::string_view text)
+  {
+    if (program_.empty() || program_.back().op != Op::LITERAL)
+    {
+      program_.push_back(Instruction{ Op::LITERAL, uint32_t(text_.size()), 0 });
+    }
+    text_ += text;
+    program_.back().length += uint32_t(text.size());
+  }
+
+  void FormatProgram::run(const FormatValues& v, std::string& out) const
+  {
+    for (const auto& instruction : program_)
+    {
+      switch (instruction.op)
+      {
+        case Op::LITERAL: out.append(text_, instruction.offset, instruction.length);
+        break; case Op::COMMAND: out.append(v.command);
+        break; case Op::ELAPSED_CLOCK:
+        {
+          const auto hundredths = uint64_t(std::max<int64_t>(0, v.times.t_wall_ns) / 10000000);
+          const uint64_t seconds = hundredths / 100;
+          if (seconds >= 3600)
+          { // hours:minutes:seconds
+            appendUInt(out, seconds / 3600);
+            out.push_back(':');
+            appendTwoDigits(out, seconds / 60 % 60);
+            out.push_back(':');
+            appendTwoDigits(out, seconds % 60);
+          }
+          else
+          { // minutes:seconds.hundredths
+            appendUInt(out, seconds / 60);
+            out.push_back(':');
+            appendTwoDigits(out, seconds % 60);
+            out.push_back('.');
+            appendTwoDigits(out, hundredths % 100);
+          }
+        }
+        break; case Op::ELAPSED: appendSeconds(out, v.times.t_wall_ns);
+        break; case Op::USER: appendSeconds(out, v.times.t_user_ns);
+        break; case Op::KERNEL: appendSeconds(out, v.times.t_kernel_ns);
+        break; case Op::CPU_PERCENT:
+          if (v.times.t_wall_ns > 0)
+          {
+            appendUInt(out, uint64_t((v.times.t_user_ns + v.times.t_kernel_ns) * 100 / v.times.t_wall_ns));
+            out.push_back('%');
+          }
+          else
+          {
+            out.append("?%");
+          }
+        break; case Op::MAX_RSS_KB: appendUInt(out, v.memory.peak_rss / 1024);
+        break; case Op::MAJOR_FAULTS: appendUInt(out, v.memory.major_faults);
+        break; case Op::MINOR_FAULTS: appendUInt(out, v.memory.minor_faults);
+        break; case Op::INPUTS: appendUInt(out, v.memory.io_read_bytes / 512);
+        break; case Op::OUTPUTS: appendUInt(out, v.memory.io_write_bytes / 512);
+        break; case Op::VOLUNTARY_CS: appendUInt(out, v.memory.voluntary_cs);
+        break; case Op::INVOLUNTARY_CS: appendUInt(out, v.memory.involuntary_cs);
+        break; case Op::PAGE_SIZE: appendUInt(out, page_size_);
+        break; case Op::EXIT_STATUS: appendInt(out, v.exit_code);
+        break; case Op::ZERO: out.push_back('0');
+      }
+    }
+  }
+
+  FormattedOutput::FormattedOutput(const std::string& format, const std::optional<std::string>& file, const OpenMode mode, const bool quiet)
+    : program_(format),
+      file_(file),
+      mode_(mode),
+      quiet_(quiet)
+  {
+  }
+
+  void FormattedOutput::write(const FormatValues& values)
+  {
+    buffer_.clear();
+    if (!quiet_)
+    { // like GNU time
+      if (values.term_signal != 0)
+      {
+        buffer_.append("Command terminated by signal ");
+        appendInt(buffer_, values.term_signal);
+        buffer_.push_back('\n');
+      }
+      else if (values.exit_code != 0)
+      {
+        buffer_.append("Command exited with non-zero status ");
+        appendInt(buffer_, values.exit_code);
+        buffer_.push_back('\n');
+      }
+    }
+    program_.run(values, buffer_);
+    if (file_)
+    {
+      FileLog(*file_, mode_).append("", buffer_);
+      mode_ = OpenMode::APPEND;
+    }
+    else
+    {
+      std::fwrite(buffer_.data(), 1, buffer_.size(), stderr);
+    }
+  }
+
+} // namespace
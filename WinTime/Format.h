@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FileLog.h"
+#include "Memory.h"
+#include "Time.h"
+
+namespace WinTime
+{
+  /// append @p value in decimal to @p out (no temporary strings)
+  void appendUInt(std::string& out, const uint64_t value);
+
+  /// append @p value in decimal to @p out (no temporary strings)
+  void appendInt(std::string& out, const int64_t value);
+
+  /// the command line as GNU time prints it (%C): @p argv joined by single spaces, without any quoting
+  std::string joinArguments(const std::vector<std::string>& argv);
+
+  /// Everything a format can refer to, as plain numbers
+  struct FormatValues
+  {
+    std::string_view command;    ///< see joinArguments()
+    RawTimes times;
+    RawMemoryCounters memory;
+    int exit_code{ 0 };
+    int term_signal{ 0 };        ///< signal which killed the command (0: it exited)
+  };
+
+  /// Receives the values of each run of a command (see FormattedOutput and RecordWriter)
+  class RunWriter
+  {
+  public:
+    virtual ~RunWriter() = default;
+
+    virtual void write(const FormatValues& values) = 0;
+  };
+
+  /**
+    @brief A /usr/bin/time format string (see 'man time'), compiled once into a list of operations
+
+    Supports all sequences of GNU time: %C %D %E %F %I %K %M %O %P %R %S %U %W %X %Z %c %e %k %p %r %s %t %w %x and %%,
+    as well as the escapes \t, \n and \\. Like GNU time, unknown sequences are printed as '?' followed by the sequence.
+    Counters which neither Linux nor Windows maintain (the averages %D %K %X %p %t, swaps %W, signals %k, socket messages %r %s) are 0.
+    %I and %O are the bytes read from and written to storage, in units of 512 bytes.
+
+    Running the program only appends to the output string, using std::to_chars() for numbers (no streams, no temporary strings),
+    so once the output string has grown to the size of a result, formatting does not allocate anymore.
+  */
+  class FormatProgram
+  {
+  public:
+    /// the format of -p/--portability (POSIX)
+    static constexpr const char* PORTABLE = "real %e\nuser %U\nsys %S";
+
+    /// the default format of GNU time
+    static constexpr const char* GNU_DEFAULT = "%Uuser %Ssystem %Eelapsed %PCPU (%Xavgtext+%Davgdata %Mmaxresident)k\n%Iinputs+%Ooutputs (%Fmajor+%Rminor)pagefaults %Wswaps";
+
+    explicit FormatProgram(const std::string& format);
+
+    /// append the result for @p values to @p out, followed by a newline
+    void run(const FormatValues& values, std::string& out) const;
+
+  private:
+    enum class Op : uint8_t
+    {
+      LITERAL,            ///< text_[offset, offset + length)
+      COMMAND,            ///< %C
+      ELAPSED_CLOCK,      ///< %E [hours:]minutes:seconds
+      ELAPSED,            ///< %e
+      USER,               ///< %U
+      KERNEL,             ///< %S
+      CPU_PERCENT,        ///< %P
+      MAX_RSS_KB,         ///< %M
+      MAJOR_FAULTS,       ///< %F
+      MINOR_FAULTS,       ///< %R
+      INPUTS,             ///< %I
+      OUTPUTS,            ///< %O
+      VOLUNTARY_CS,       ///< %w
+      INVOLUNTARY_CS,     ///< %c
+      PAGE_SIZE,          ///< %Z
+      EXIT_STATUS,        ///< %x
+      ZERO                ///< counters which are not available
+    };
+
+    struct Instruction
+    {
+      Op op;
+      uint32_t offset{ 0 };
+      uint32_t length{ 0 };
+    };
+
+    /// append @p text as a literal, merging it with a preceding literal
+    void addLiteral_(const std::string_view text);
+
+    std::string text_;                     ///< all literal text
+    std::vector<Instruction> program_;
+    uint64_t page_size_;
+  };
+
+  /// Writes the result of a FormatProgram for each run to STDERR or to a file (like /usr/bin/time with -f and -o)
+  class FormattedOutput : public RunWriter
+  {
+  public:
+    /// @param file Write to this file instead of STDERR; the first write uses @p mode, all others append
+    /// @param quiet Do not report non-zero exit codes and signals
+    FormattedOutput(const std::string& format, const std::optional<std::string>& file, const OpenMode mode, const bool quiet);
+
+    void write(const FormatValues& values) override;
+
+  private:
+    FormatProgram program_;
+    std::optional<std::string> file_;
+    OpenMode mode_;
+    bool quiet_;
+    std::string buffer_;  ///< reused for all runs
+  };
+
+} // namespace
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "Heap.h"
+
+#include "Memory.h"
+
+#include <iostream>
+#include <sstream>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// the upper limit of a size class, e.g. '16' or '16M'; the last class is 'inf'
+    std::string sizeClassLabel(const size_t size_class)
+    {
+      if (size_class + 1 == HEAP_SIZE_CLASSES) return "inf";
+      const uint64_t limit = uint64_t(16) << size_class;
+      if (limit >= (1 << 20)) return std::to_string(limit >> 20) + "M";
+      if (limit >= (1 << 10)) return std::to_string(limit >> 10) + "K";
+      return std::to_string(limit);
+    }
+
+    /// the non-empty size classes, e.g. '16:120,32:3,4K:1'
+    std::string printSizeClasses(const HeapCounters& counters)
+    {
+      std::string result;
+      for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i)
+      {
+        if (counters.size_classes[i] == 0) continue;
+        if (!result.empty()) result += ',';
+        result += sizeClassLabel(i) + ':' + std::to_string(counters.size_classes[i]);
+      }
+      return result;
+    }
+  }
+
+  void HeapSummary::add(const HeapCounters& counters)
+  {
+    ++processes;
+    total.allocations += counters.allocations;
+    total.reallocations += counters.reallocations;
+    total.frees += counters.frees;
+    total.bytes_allocated += counters.bytes_allocated;
+    total.peak_live = std::max(total.peak_live, counters.peak_live);
+    total.live_at_exit += counters.live_at_exit;
+    for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) total.size_classes[i] += counters.size_classes[i];
+  }
+
+  void HeapSummary::print() const
+  {
+    if (processes == 0)
+    {
+      std::cerr << "Heap: no process reported its allocations (statically linked, or exited via _exit()?)\n";
+      return;
+    }
+    std::cerr << "Heap (" << processes << (processes == 1 ? " process" : " processes") << "):\n";
+    std::cerr << "      Allocations: " << total.allocations << " (+" << total.reallocations << " reallocations, " << total.frees << " frees)\n";
+    std::cerr << "  Bytes allocated: " << toHumanReadable(total.bytes_allocated) << '\n';
+    std::cerr << "   Peak live heap: " << toHumanReadable(total.peak_live) << '\n';
+    std::cerr << "     Live at exit: " << toHumanReadable(total.live_at_exit) << '\n';
+    std::cerr << "     Size classes: " << printSizeClasses(total) << " (allocations up to N bytes)\n";
+    for (const auto& profile : profiles)
+    {
+      std::cerr << "     Heap profile: " << profile << '\n';
+    }
+  }
+
+  std::string HeapSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << processes << separator
+      << total.allocations << separator
+      << total.reallocations << separator
+      << total.frees << separator
+      << total.bytes_allocated << separator
+      << total.peak_live << separator
+      << total.live_at_exit << separator
+      << printSizeClasses(total);
+    return where.str();
+  }
+
+  std::string HeapSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "heap_processes" << separator
+      << "heap_allocations" << separator
+      << "heap_reallocations" << separator
+      << "heap_frees" << separator
+      << "heap_bytes_allocated" << separator
+      << "heap_peak_live" << separator
+      << "heap_live_at_exit" << separator
+      << "heap_size_classes";
+    return where.str();
+  }
+
+} // namespace
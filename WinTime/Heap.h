@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WinTime
+{
+  /// Name of the environment variable which tells the heap hook where to write heap profiles (a path prefix; see --heap-profile)
+  static const char* const s_env_heapprofile = "processInfo_heapprofile";
+
+  /// Name of the environment variable which tells the heap hook how many bytes to allocate between samples, on average
+  static const char* const s_env_heapsamplerate = "processInfo_heapsamplerate";
+
+  /// default of s_env_heapsamplerate (like tcmalloc)
+  constexpr uint64_t HEAP_SAMPLE_RATE_DEFAULT = 512 << 10;
+
+  /// RingRecord::kind of the heap hook's events (if WinTime samples the target, see s_env_ringname): the live heap of the process changed.
+  /// value[0] is the published live heap in bytes, value[1] the peak so far
+  constexpr uint32_t HEAP_RING_LIVE = 1;
+
+  /// number of size classes of the allocation histogram: up to 16 bytes, up to 32 bytes, ..., up to 16 MiB, and larger
+  constexpr size_t HEAP_SIZE_CLASSES = 22;
+
+  /// the size class of an allocation of @p size bytes (see HEAP_SIZE_CLASSES)
+  inline size_t heapSizeClass(const uint64_t size)
+  {
+    if (size <= 16) return 0;
+    return std::min(HEAP_SIZE_CLASSES - 1, size_t(std::bit_width(size - 1)) - 4);
+  }
+
+  /**
+    @brief The allocation counters of one process, as sent by the heap hook (see HeapHook) when the process exits
+
+    This is the payload of ReportType::HEAP_COUNTERS, i.e. the layout must match between WinTime and the hook.
+    Live bytes count the usable size of each block (malloc_usable_size()), which is what the block really occupies.
+  */
+  struct HeapCounters
+  {
+    uint64_t allocations{ 0 };       ///< malloc, calloc, the aligned allocations (and new, which uses malloc)
+    uint64_t reallocations{ 0 };     ///< realloc of a non-null pointer to a non-zero size
+    uint64_t frees{ 0 };             ///< free (or realloc to size 0) of a non-null pointer
+    uint64_t bytes_allocated{ 0 };   ///< requested bytes of all allocations and reallocations
+    uint64_t peak_live{ 0 };         ///< highest sum of live blocks (precise within 16 KiB per thread)
+    uint64_t live_at_exit{ 0 };      ///< blocks not freed at exit (a growing value over runs hints at a leak)
+    uint64_t size_classes[HEAP_SIZE_CLASSES]{};   ///< allocations and reallocations per size class (of the requested size)
+  };
+
+  /// The heap counters of all processes of a target
+  struct HeapSummary
+  {
+    size_t processes{ 0 };   ///< processes which sent their counters
+    HeapCounters total;      ///< summed over all processes, except peak_live, which is the highest of a single process
+    std::vector<std::string> profiles;   ///< heap profiles written by the processes (only with --heap-profile)
+
+    /// add the counters of one more process
+    void add(const HeapCounters& counters);
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+} // namespace
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "Io.h"
+
+#include "Memory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// rows of each table printed to the console
+    constexpr size_t TOP_ROWS = 10;
+
+    /// the upper limit of a latency bucket, e.g. '4us' or '2ms' (powers of two of microseconds); the last bucket is 'inf'
+    std::string latencyLabel(const size_t bucket)
+    {
+      if (bucket + 1 == IO_LATENCY_BUCKETS) return "inf";
+      const uint64_t limit = uint64_t(1) << bucket;
+      if (limit >= 1024) return std::to_string(limit >> 10) + "ms";
+      return std::to_string(limit) + "us";
+    }
+
+    /// the non-empty buckets of @p operation, e.g. '1us:120,2us:3,1ms:1' (or '-' if there were no calls)
+    std::string printLatency(const IoCounters& counters, const IoOperation operation)
+    {
+      std::string result;
+      for (size_t i = 0; i < IO_LATENCY_BUCKETS; ++i)
+      {
+        const uint64_t calls = counters.latency[size_t(operation)][i];
+        if (calls == 0) continue;
+        if (!result.empty()) result += ',';
+        result += latencyLabel(i) + ':' + std::to_string(calls);
+      }
+      return result.empty() ? "-" : result;
+    }
+
+    /// @p part of @p whole in percent, e.g. '98%' (or '-' if whole is 0)
+    std::string percentOf(const uint64_t part, const uint64_t whole)
+    {
+      if (whole == 0) return "-";
+      return std::to_string(int(double(part) * 100.0 / double(whole) + 0.5)) + '%';
+    }
+
+    void printFiles(std::vector<IoFileStat> files, const char* title, bool (*order)(const IoFileStat&, const IoFileStat&))
+    {
+      std::sort(files.begin(), files.end(), order);
+      std::cerr << title << '\n';
+      char buffer[200];
+      std::snprintf(buffer, sizeof(buffer), "%10s %8s %8s %8s %11s %8s %11s %6s  %s\n", "time [s]", "opens", "failed", "reads", "read", "writes", "written", "mmaps", "path");
+      std::cerr << buffer;
+      for (size_t i = 0; i < std::min(files.size(), TOP_ROWS); ++i)
+      {
+        const IoFileStat& file = files[i];
+        std::snprintf(buffer, sizeof(buffer), "%10.6f %8llu %8llu %8llu %11s %8llu %11s %6llu  ", double(file.time_ns) * 1e-9, (unsigned long long)file.opens,
+                      (unsigned long long)file.failed_opens, (unsigned long long)file.reads, toHumanReadable(file.read_bytes).c_str(), (unsigned long long)file.writes,
+                      toHumanReadable(file.write_bytes).c_str(), (unsigned long long)file.mmaps);
+        std::cerr << buffer << file.path << '\n';
+      }
+    }
+
+    bool byTime(const IoFileStat& a, const IoFileStat& b)
+    {
+      return a.time_ns > b.time_ns;
+    }
+
+    bool byBytes(const IoFileStat& a, const IoFileStat& b)
+    {
+      return a.read_bytes + a.write_bytes > b.read_bytes + b.write_bytes;
+    }
+  }
+
+  void IoSummary::add(const IoCounters& counters)
+  {
+    ++processes;
+    for (size_t op = 0; op < IO_OPERATIONS; ++op)
+    {
+      total.calls[op] += counters.calls[op];
+      total.bytes[op] += counters.bytes[op];
+      total.time_ns[op] += counters.time_ns[op];
+      for (size_t i = 0; i < IO_LATENCY_BUCKETS; ++i) total.latency[op][i] += counters.latency[op][i];
+    }
+    total.failed_opens += counters.failed_opens;
+    total.mmaps += counters.mmaps;
+    total.mmap_bytes += counters.mmap_bytes;
+    total.proc_rchar += counters.proc_rchar;
+    total.proc_wchar += counters.proc_wchar;
+    total.proc_syscr += counters.proc_syscr;
+    total.proc_syscw += counters.proc_syscw;
+    total.proc_read_bytes += counters.proc_read_bytes;
+    total.proc_write_bytes += counters.proc_write_bytes;
+  }
+
+  void IoSummary::add(const IoFileStat* stats, const size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      IoFileStat stat = stats[i];
+      stat.path[sizeof(stat.path) - 1] = '\0';
+      auto same = std::find_if(files.begin(), files.end(), [&stat](const IoFileStat& f) { return std::strcmp(f.path, stat.path) == 0; });
+      if (same == files.end())
+      {
+        files.push_back(stat);
+        continue;
+      }
+      same->opens += stat.opens;
+      same->failed_opens += stat.failed_opens;
+      same->reads += stat.reads;
+      same->read_bytes += stat.read_bytes;
+      same->writes += stat.writes;
+      same->write_bytes += stat.write_bytes;
+      same->time_ns += stat.time_ns;
+      same->mmaps += stat.mmaps;
+      same->mmap_bytes += stat.mmap_bytes;
+    }
+  }
+
+  void IoSummary::print() const
+  {
+    if (processes == 0)
+    {
+      std::cerr << "I/O: no process reported its I/O (statically linked, or exited via _exit()?)\n";
+      return;
+    }
+    const auto open = size_t(IoOperation::OPEN), read = size_t(IoOperation::READ), write = size_t(IoOperation::WRITE);
+    std::cerr << "I/O (" << processes << (processes == 1 ? " process" : " processes") << "; time summed over all threads):\n";
+    std::cerr << "   open: " << total.calls[open] << " calls (" << total.failed_opens << " failed) in " << double(total.time_ns[open]) * 1e-9 << " s; latency " << printLatency(total, IoOperation::OPEN) << '\n';
+    std::cerr << "   read: " << total.calls[read] << " calls, " << toHumanReadable(total.bytes[read]) << " in " << double(total.time_ns[read]) * 1e-9 << " s; latency " << printLatency(total, IoOperation::READ) << '\n';
+    std::cerr << "  write: " << total.calls[write] << " calls, " << toHumanReadable(total.bytes[write]) << " in " << double(total.time_ns[write]) * 1e-9 << " s; latency " << printLatency(total, IoOperation::WRITE) << '\n';
+    std::cerr << "   mmap: " << total.mmaps << " file mappings of " << toHumanReadable(total.mmap_bytes) << '\n';
+    std::cerr << "  /proc/<pid>/io: " << total.proc_syscr << " reads of " << toHumanReadable(total.proc_rchar) << ", " << total.proc_syscw << " writes of " << toHumanReadable(total.proc_wchar)
+      << " (seen by the hook: " << percentOf(total.bytes[read], total.proc_rchar) << " and " << percentOf(total.bytes[write], total.proc_wchar) << " of the bytes); storage: "
+      << toHumanReadable(total.proc_read_bytes) << " read, " << toHumanReadable(total.proc_write_bytes) << " written\n";
+    if (files.empty()) return;
+    printFiles(files, "Top files by time:", byTime);
+    printFiles(files, "Top files by bytes:", byBytes);
+  }
+
+  std::string IoSummary::print(const char separator) const
+  {
+    const auto open = size_t(IoOperation::OPEN), read = size_t(IoOperation::READ), write = size_t(IoOperation::WRITE);
+    const auto top = std::min_element(files.begin(), files.end(), byTime);
+    std::stringstream where;
+    where << processes << separator
+      << total.calls[open] << separator
+      << total.failed_opens << separator
+      << total.calls[read] << separator
+      << total.bytes[read] << separator
+      << double(total.time_ns[read]) * 1e-9 << separator
+      << total.calls[write] << separator
+      << total.bytes[write] << separator
+      << double(total.time_ns[write]) * 1e-9 << separator
+      << total.proc_rchar << separator
+      << total.proc_wchar << separator
+      << (top == files.end() ? "" : top->path);
+    return where.str();
+  }
+
+  std::string IoSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "io_processes" << separator
+      << "io_opens" << separator
+      << "io_failed_opens" << separator
+      << "io_reads" << separator
+      << "io_read_bytes" << separator
+      << "io_read_time" << separator
+      << "io_writes" << separator
+      << "io_write_bytes" << separator
+      << "io_write_time" << separator
+      << "io_proc_rchar" << separator
+      << "io_proc_wchar" << separator
+      << "io_top_file";
+    return where.str();
+  }
+
+} // namespace
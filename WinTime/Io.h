@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WinTime
+{
+  /// Name of the environment variable which switches on the I/O profiler of the heap hook (see --io)
+  static const char* const s_env_io = "processInfo_io";
+
+  /// the kinds of I/O calls which are timed
+  enum class IoOperation : uint32_t
+  {
+    OPEN = 0,    ///< open(), openat(), creat(), fopen()
+    READ = 1,    ///< read(), pread(), readv()
+    WRITE = 2,   ///< write(), pwrite(), writev()
+  };
+
+  constexpr size_t IO_OPERATIONS = 3;
+
+  /// 'open', 'read' or 'write'
+  inline const char* toString(const IoOperation operation)
+  {
+    switch (operation)
+    {
+      case IoOperation::OPEN: return "open";
+      case IoOperation::READ: return "read";
+      case IoOperation::WRITE: return "write";
+    }
+    return "?";
+  }
+
+  /// number of buckets of the latency histograms: below 1 us, below 2 us, below 4 us, ..., below 2^20 us (about 1 s), and longer
+  constexpr size_t IO_LATENCY_BUCKETS = 22;
+
+  /// the bucket of a call which took @p ns nanoseconds (see IO_LATENCY_BUCKETS)
+  inline size_t ioLatencyBucket(const uint64_t ns)
+  {
+    return std::min(IO_LATENCY_BUCKETS - 1, size_t(std::bit_width(ns / 1000)));
+  }
+
+  /**
+    @brief The I/O of one process, as sent by the heap hook (see HeapHook) when the process exits
+
+    This is the payload of ReportType::IO_COUNTERS, i.e. the layout must match between WinTime and the hook.
+    The 'proc_' counters are read from /proc/self/io at exit, as a cross-check: they count all read and write system calls,
+    including those the hook cannot see (e.g. within stdio, or in statically linked code).
+  */
+  struct IoCounters
+  {
+    uint64_t calls[IO_OPERATIONS]{};     ///< calls per IoOperation (including failed ones)
+    uint64_t bytes[IO_OPERATIONS]{};     ///< bytes transferred per IoOperation (0 for OPEN)
+    uint64_t time_ns[IO_OPERATIONS]{};   ///< time spent in the calls per IoOperation
+    uint64_t latency[IO_OPERATIONS][IO_LATENCY_BUCKETS]{};   ///< calls per IoOperation and latency bucket
+    uint64_t failed_opens{ 0 };
+    uint64_t mmaps{ 0 };                 ///< file mappings
+    uint64_t mmap_bytes{ 0 };            ///< length of the file mappings (not necessarily read)
+    uint64_t proc_rchar{ 0 };            ///< bytes read by any read system call
+    uint64_t proc_wchar{ 0 };            ///< bytes written by any write system call
+    uint64_t proc_syscr{ 0 };            ///< read system calls
+    uint64_t proc_syscw{ 0 };            ///< write system calls
+    uint64_t proc_read_bytes{ 0 };       ///< bytes fetched from storage
+    uint64_t proc_write_bytes{ 0 };      ///< bytes sent to storage
+  };
+
+  /// The I/O at one file of a process; an array of these is the payload of ReportType::IO_FILES (the top files by time and by bytes)
+  struct IoFileStat
+  {
+    uint64_t opens{ 0 };
+    uint64_t failed_opens{ 0 };   ///< opens of this path which failed (e.g. searching include directories)
+    uint64_t reads{ 0 };
+    uint64_t read_bytes{ 0 };
+    uint64_t writes{ 0 };
+    uint64_t write_bytes{ 0 };
+    uint64_t time_ns{ 0 };        ///< in open, read and write calls
+    uint64_t mmaps{ 0 };
+    uint64_t mmap_bytes{ 0 };
+    char path[256]{};             ///< as resolved via /proc/self/fd (e.g. 'pipe:[1234]' for a pipe); for failed opens, as given. Long paths keep their end.
+  };
+
+  /// maximum number of IoFileStat a process sends for each order (by time, by bytes)
+  constexpr size_t IO_FILES_MAX = 64;
+
+  /// The I/O of all processes of a target
+  struct IoSummary
+  {
+    size_t processes{ 0 };           ///< processes which sent their counters
+    IoCounters total;                ///< summed over all processes
+    std::vector<IoFileStat> files;   ///< merged by path over all processes
+
+    /// add the counters of one more process
+    void add(const IoCounters& counters);
+
+    /// add the files of a process
+    void add(const IoFileStat* stats, size_t count);
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+} // namespace
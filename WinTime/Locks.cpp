@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "Locks.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+namespace WinTime
+{
+  namespace
+  {
+    /// rows printed to the console
+    constexpr size_t TOP_ROWS = 15;
+
+    /// rows of condition waits printed to the console
+    constexpr size_t TOP_CONDITION_ROWS = 5;
+
+    /// '_ZN3foo3barEv+0x1a' -> 'foo::bar()+0x1a' (the hook has no demangler)
+    std::string demangle(const char* site)
+    {
+      std::string name(site);
+#ifdef __GNUG__
+      const size_t plus = name.rfind('+');
+      if (name.rfind("_Z", 0) != 0 || plus == std::string::npos) return name;
+      int status = 0;
+      char* readable = abi::__cxa_demangle(name.substr(0, plus).c_str(), nullptr, nullptr, &status);
+      if (status == 0 && readable)
+      {
+        name = readable + name.substr(plus);
+      }
+      std::free(readable);
+#endif
+      return name;
+    }
+
+    /// total wait of the condition waits in seconds
+    double getConditionWait(const std::vector<LockStat>& stats)
+    {
+      uint64_t ns = 0;
+      for (const auto& stat : stats)
+      {
+        if (stat.kind == LockKind::CONDITION) ns += stat.wait_ns;
+      }
+      return double(ns) * 1e-9;
+    }
+
+    /// contention before condition waits (which are mostly idle threads), each by wait time (longest first)
+    bool isMoreRelevant(const LockStat& a, const LockStat& b)
+    {
+      const bool a_condition = a.kind == LockKind::CONDITION, b_condition = b.kind == LockKind::CONDITION;
+      return a_condition != b_condition ? b_condition : a.wait_ns > b.wait_ns;
+    }
+
+    /// print up to @p rows of [@p first, @p last) as a table
+    void printRows(std::vector<LockStat>::const_iterator first, std::vector<LockStat>::const_iterator last, const size_t rows)
+    {
+      char buffer[200];
+      std::snprintf(buffer, sizeof(buffer), "%12s %10s %10s  %-5s  %-32s  %s\n", "wait [s]", "count", "max [ms]", "kind", "lock", "call site");
+      std::cerr << buffer;
+      const size_t count = size_t(last - first);
+      for (size_t i = 0; i < std::min(count, rows); ++i, ++first)
+      {
+        const LockStat& stat = *first;
+        std::snprintf(buffer, sizeof(buffer), "%12.6f %10llu %10.3f  %-5s  %-32s  ", double(stat.wait_ns) * 1e-9, (unsigned long long)stat.count,
+                      double(stat.max_wait_ns) * 1e-6, toString(stat.kind), stat.lock);
+        std::cerr << buffer << demangle(stat.site) << '\n';
+      }
+      if (count > rows) std::cerr << "  (" << count - rows << " more)\n";
+    }
+
+    /// the contended lock with the longest wait, e.g. 'worker+0x2a@g_queue_mutex' (empty if there is none)
+    std::string getTopSite(const std::vector<LockStat>& stats)
+    {
+      for (const auto& stat : stats)
+      {
+        if (stat.kind != LockKind::CONDITION) return demangle(stat.site) + '@' + demangle(stat.lock);
+      }
+      return "";
+    }
+  }
+
+  void LockSummary::add(const LockStat* new_stats, const size_t count)
+  {
+    ++processes;
+    for (size_t i = 0; i < count; ++i)
+    {
+      LockStat stat = new_stats[i];
+      // the hook terminates the strings; do not rely on it
+      stat.lock[sizeof(stat.lock) - 1] = '\0';
+      stat.site[sizeof(stat.site) - 1] = '\0';
+      auto same = std::find_if(stats.begin(), stats.end(), [&stat](const LockStat& s) {
+        return s.kind == stat.kind && std::strcmp(s.lock, stat.lock) == 0 && std::strcmp(s.site, stat.site) == 0;
+      });
+      if (same == stats.end())
+      {
+        stats.push_back(stat);
+        continue;
+      }
+      same->count += stat.count;
+      same->wait_ns += stat.wait_ns;
+      same->max_wait_ns = std::max(same->max_wait_ns, stat.max_wait_ns);
+    }
+    std::stable_sort(stats.begin(), stats.end(), isMoreRelevant);
+  }
+
+  uint64_t LockSummary::getContended() const
+  {
+    uint64_t count = 0;
+    for (const auto& stat : stats)
+    {
+      if (stat.kind != LockKind::CONDITION) count += stat.count;
+    }
+    return count;
+  }
+
+  double LockSummary::getContendedWait() const
+  {
+    uint64_t ns = 0;
+    for (const auto& stat : stats)
+    {
+      if (stat.kind != LockKind::CONDITION) ns += stat.wait_ns;
+    }
+    return double(ns) * 1e-9;
+  }
+
+  void LockSummary::print() const
+  {
+    if (processes == 0)
+    {
+      std::cerr << "Locks: no process reported its lock waits (statically linked, or exited via _exit()?)\n";
+      return;
+    }
+    std::cerr << "Locks (" << processes << (processes == 1 ? " process" : " processes") << "): " << getContended() << " contended acquisitions, waited "
+      << getContendedWait() << " s (plus " << getConditionWait(stats) << " s in condition waits; summed over all threads)\n";
+    // stats are sorted with the condition waits last
+    const auto conditions = std::find_if(stats.begin(), stats.end(), [](const LockStat& stat) { return stat.kind == LockKind::CONDITION; });
+    if (conditions != stats.begin()) printRows(stats.begin(), conditions, TOP_ROWS);
+    if (conditions == stats.end()) return;
+    std::cerr << "Condition waits (threads waiting for a signal, e.g. idle workers; not contention):\n";
+    printRows(conditions, stats.end(), TOP_CONDITION_ROWS);
+  }
+
+  std::string LockSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << processes << separator
+      << getContended() << separator
+      << getContendedWait() << separator
+      << getConditionWait(stats) << separator
+      << getTopSite(stats);
+    return where.str();
+  }
+
+  std::string LockSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "lock_processes" << separator
+      << "lock_contended" << separator
+      << "lock_wait_time" << separator
+      << "lock_cond_wait_time" << separator
+      << "lock_top_site";
+    return where.str();
+  }
+
+} // namespace
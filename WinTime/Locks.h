@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WinTime
+{
+  /// Name of the environment variable which switches on the lock profiler of the heap hook (see --locks)
+  static const char* const s_env_locks = "processInfo_locks";
+
+  /// what waited
+  enum class LockKind : uint32_t
+  {
+    MUTEX = 0,      ///< pthread_mutex_lock() of a locked mutex
+    READ = 1,       ///< pthread_rwlock_rdlock() of a write-locked rwlock
+    WRITE = 2,      ///< pthread_rwlock_wrlock() of a locked rwlock
+    CONDITION = 3,  ///< pthread_cond_wait()/pthread_cond_timedwait(), i.e. waiting for a signal (and the mutex): not contention as such
+  };
+
+  /// 'mutex', 'read', 'write' or 'cond'
+  inline const char* toString(const LockKind kind)
+  {
+    switch (kind)
+    {
+      case LockKind::MUTEX: return "mutex";
+      case LockKind::READ: return "read";
+      case LockKind::WRITE: return "write";
+      case LockKind::CONDITION: return "cond";
+    }
+    return "?";
+  }
+
+  /**
+    @brief The waits at one lock from one call site of a process, as sent by the heap hook (see HeapHook) when the process exits
+
+    An array of these is the payload of ReportType::LOCK_CONTENTION (the top sites by wait time), i.e. the layout must match between WinTime and the hook.
+    Addresses are resolved by the hook, since they are meaningless outside of the process.
+  */
+  struct LockStat
+  {
+    LockKind kind{ LockKind::MUTEX };
+    uint32_t reserved{ 0 };
+    uint64_t count{ 0 };        ///< contended acquisitions (or condition waits)
+    uint64_t wait_ns{ 0 };      ///< total time spent waiting
+    uint64_t max_wait_ns{ 0 };  ///< longest single wait
+    char lock[64]{};            ///< the lock: a symbol or 'module+offset' for static locks, else its address
+    char site[128]{};           ///< the caller: 'symbol+offset' or 'module+offset'
+  };
+
+  /// maximum number of LockStat a process sends (the ones with the longest total wait; contention before condition waits)
+  constexpr size_t LOCK_STATS_MAX = 64;
+
+  /// The lock waits of all processes of a target
+  struct LockSummary
+  {
+    size_t processes{ 0 };           ///< processes which sent their waits
+    std::vector<LockStat> stats;     ///< merged by kind, lock and site over all processes; contention first, then the condition waits, each by wait time (longest first)
+
+    /// add the waits of one more process
+    void add(const LockStat* stats, size_t count);
+
+    /// total contended acquisitions (without condition waits)
+    uint64_t getContended() const;
+
+    /// total wait time of contended acquisitions in seconds (without condition waits)
+    double getContendedWait() const;
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+} // namespace
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Manifest.h"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// A minimal JSON reader for one manifest line: objects, arrays and strings; other values are skipped.
+    class JsonLine
+    {
+    public:
+      explicit JsonLine(const std::string& text)
+        : text_(text)
+      {
+      }
+
+      BatchCommand parse()
+      {
+        BatchCommand command;
+        expect_('{');
+        if (peek_() == '}')
+        {
+          ++pos_;
+          return command;
+        }
+        while (true)
+        {
+          const std::string key = string_();
+          expect_(':');
+          if (key == "argv")
+          {
+            command.argv = stringArray_();
+          }
+          else if (key == "cmd")
+          {
+            command.argv = splitCommandLine(string_());
+          }
+          else if (key == "cwd")
+          {
+            command.cwd = string_();
+          }
+          else if (key == "env")
+          {
+            for (const auto& [name, value] : stringObject_())
+            {
+              command.env.push_back(name + "=" + value);
+            }
+          }
+          else
+          {
+            skipValue_();
+          }
+          if (peek_() == ',')
+          {
+            ++pos_;
+            continue;
+          }
+          expect_('}');
+          break;
+        }
+        if (peek_() != '\0') fail_("trailing characters");
+        return command;
+      }
+
+    private:
+      [[noreturn]] void fail_(const std::string& what) const
+      {
+        throw std::runtime_error("invalid JSON (" + what + " at column " + std::to_string(pos_ + 1) + ")");
+      }
+
+      /// next non-whitespace character ('\0' at the end)
+      char peek_()
+      {
+        while (pos_ < text_.size() && std::isspace((unsigned char)text_[pos_])) ++pos_;
+        return pos_ < text_.size() ? text_[pos_] : '\0';
+      }
+
+      void expect_(char c)
+      {
+        if (peek_() != c) fail_(std::string("expected '") + c + "'");
+        ++pos_;
+      }
+
+      std::string string_()
+      {
+        expect_('"');
+        std::string result;
+        while (pos_ < text_.size() && text_[pos_] != '"')
+        {
+          char c = text_[pos_++];
+          if (c == '\\')
+          {
+            if (pos_ >= text_.size()) break;
+            c = text_[pos_++];
+            switch (c)
+            {
+              case 'n': c = '\n';
+                break; case 't': c = '\t';
+                break; case 'r': c = '\r';
+                break; case 'b': c = '\b';
+                break; case 'f': c = '\f';
+                break; case 'u':
+              {
+                if (pos_ + 4 > text_.size()) fail_("truncated \\u escape");
+                const unsigned code = std::stoul(text_.substr(pos_, 4), nullptr, 16);
+                pos_ += 4;
+                // encode as UTF-8 (surrogate pairs are not combined)
+                if (code < 0x80) result += char(code);
+                else if (code < 0x800) { result += char(0xC0 | (code >> 6)); result += char(0x80 | (code & 0x3F)); }
+                else { result += char(0xE0 | (code >> 12)); result += char(0x80 | ((code >> 6) & 0x3F)); result += char(0x80 | (code & 0x3F)); }
+                continue;
+              }
+              default: // '"', '\\', '/'
+                break;
+            }
+          }
+          result += c;
+        }
+        expect_('"');
+        return result;
+      }
+
+      std::vector<std::string> stringArray_()
+      {
+        std::vector<std::string> result;
+        expect_('[');
+        if (peek_() == ']')
+        {
+          ++pos_;
+          return result;
+        }
+        do
+        {
+          result.push_back(string_());
+        } while (peek_() == ',' && ++pos_);
+        expect_(']');
+        return result;
+      }
+
+      std::map<std::string, std::string> stringObject_()
+      {
+        std::map<std::string, std::string> result;
+        expect_('{');
+        if (peek_() == '}')
+        {
+          ++pos_;
+          return result;
+        }
+        do
+        {
+          auto key = string_();
+          expect_(':');
+          result[key] = string_();
+        } while (peek_() == ',' && ++pos_);
+        expect_('}');
+        return result;
+      }
+
+      void skipValue_()
+      {
+        switch (peek_())
+        {
+          case '"':
+            string_();
+            break; case '[': case '{':
+          {
+            const char open = text_[pos_], close = open == '[' ? ']' : '}';
+            ++pos_;
+            if (peek_() == close)
+            {
+              ++pos_;
+              return;
+            }
+            do
+            {
+              if (open == '{')
+              {
+                string_();
+                expect_(':');
+              }
+              skipValue_();
+            } while (peek_() == ',' && ++pos_);
+            expect_(close);
+          }
+            break; default: // number, true, false, null
+            while (pos_ < text_.size() && (std::isalnum((unsigned char)text_[pos_]) || text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.')) ++pos_;
+        }
+      }
+
+      std::string text_;
+      size_t pos_{ 0 };
+    };
+  }
+
+  std::vector<std::string> splitCommandLine(const std::string& line)
+  {
+    std::vector<std::string> result;
+    std::string current;
+    bool in_word = false;
+    char quote = '\0';
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+      const char c = line[i];
+      if (quote == '\'')
+      {
+        if (c == '\'') quote = '\0';
+        else current += c;
+      }
+      else if (c == '\\' && i + 1 < line.size() && (quote == '\0' || line[i + 1] == '"' || line[i + 1] == '\\'))
+      {
+        current += line[++i];
+        in_word = true;
+      }
+      else if (quote == '"')
+      {
+        if (c == '"') quote = '\0';
+        else current += c;
+      }
+      else if (c == '\'' || c == '"')
+      {
+        quote = c;
+        in_word = true;
+      }
+      else if (std::isspace((unsigned char)c))
+      {
+        if (in_word) result.push_back(current);
+        current.clear();
+        in_word = false;
+      }
+      else
+      {
+        current += c;
+        in_word = true;
+      }
+    }
+    if (quote != '\0') throw std::runtime_error("unbalanced quotes");
+    if (in_word) result.push_back(current);
+    return result;
+  }
+
+  std::vector<BatchCommand> readManifest(const std::string& filename)
+  {
+    std::ifstream in{ std::filesystem::path(filename) };
+    if (!in)
+    {
+      throw std::runtime_error("Cannot read manifest '" + filename + "'.");
+    }
+    std::vector<BatchCommand> commands;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line))
+    {
+      ++line_number;
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      const auto first = line.find_first_not_of(" \t");
+      if (first == std::string::npos || line[first] == '#') continue;
+      try
+      {
+        BatchCommand command = line[first] == '{' ? JsonLine(line.substr(first)).parse() : BatchCommand{ splitCommandLine(line), {}, {}, 0 };
+        if (command.argv.empty()) throw std::runtime_error("no command");
+        command.line = line_number;
+        commands.push_back(std::move(command));
+      }
+      catch (const std::exception& e)
+      {
+        throw std::runtime_error("Manifest '" + filename + "', line " + std::to_string(line_number) + ": " + e.what());
+      }
+    }
+    return commands;
+  }
+
+} // namespace
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace WinTime
+{
+  /// A command of a batch manifest
+  struct BatchCommand
+  {
+    std::vector<std::string> argv;  ///< including argv[0]
+    std::string cwd;                ///< working directory (empty: inherit)
+    std::vector<std::string> env;   ///< 'NAME=VALUE' entries added to the inherited environment
+    size_t line{ 0 };               ///< line in the manifest (for error messages)
+  };
+
+  /// Split a command line into arguments, like a POSIX shell would without expansions:
+  /// whitespace separates arguments, single and double quotes group them, and a backslash escapes the next character.
+  /// @throw std::runtime_error on unbalanced quotes
+  std::vector<std::string> splitCommandLine(const std::string& line);
+
+  /**
+    @brief Read a batch manifest: one command per line
+
+    Empty lines and lines starting with '#' are ignored. A line starting with '{' is a JSON object
+    with the keys "argv" (array of strings) or "cmd" (a command line as below), and optionally "cwd" (string) and "env" (object of strings), e.g.
+      {"argv": ["g++", "-c", "a.cpp"], "cwd": "/src/proj", "env": {"LANG": "C"}}
+    Any other line is a command line, split by splitCommandLine().
+
+    @throw std::runtime_error if the file cannot be read or a line is malformed
+  */
+  std::vector<BatchCommand> readManifest(const std::string& filename);
+
+} // namespace
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include "Process.h" // for widen()
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+namespace WinTime
+{
+  MappedFile::MappedFile(const std::string& filename)
+  {
+#ifdef _WIN32
+    file_ = CreateFileW(widen(filename).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+      throw std::runtime_error("Could not open '" + filename + "'.");
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = size_t(size.QuadPart);
+    if (size_ == 0) return;
+    mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL || (data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0))) == nullptr)
+    {
+      throw std::runtime_error("Could not map '" + filename + "'.");
+    }
+#else
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      throw std::runtime_error("Could not open '" + filename + "'.");
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_ = size_t(st.st_size);
+    if (size_ > 0)
+    {
+      void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED)
+      {
+        close(fd);
+        throw std::runtime_error("Could not map '" + filename + "'.");
+      }
+      madvise(map, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(map);
+    }
+    close(fd); // the mapping stays valid
+#endif
+  }
+
+  MappedFile::~MappedFile()
+  {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ && file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+    if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+
+  const char* MappedFile::data() const
+  {
+    return data_;
+  }
+
+  size_t MappedFile::size() const
+  {
+    return size_;
+  }
+
+} // namespace
@@ -25,16 +25,19 @@
 #include <array>
 #include <iomanip>
 #include <iostream>
-#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
-#define _CRT_SECURE_NO_WARNINGS 1
-#include <windows.h>
 #include <sstream>
+#include <stdexcept>
+
+#include "Platform.h"
 
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
  // To ensure correct resolution of symbols, add Psapi.lib to TARGETLIBS
  // and compile with -DPSAPI_VERSION=1
 #define PSAPI_VERSION 1
 #include <psapi.h>    // for PROCESS_MEMORY_COUNTERS
 #pragma comment (lib, "Psapi.lib")
+#endif
 
 namespace WinTime
 {
@@ -60,10 +63,24 @@ namespace WinTime
     return std::string("Congrats. That's a lot of bytes: ") + std::to_string(bytes);
   }
 
+  /// The counters of a process as plain numbers (for formats which need them unformatted); counters a platform does not offer are 0
+  struct RawMemoryCounters
+  {
+    uint64_t peak_rss{ 0 };          ///< bytes
+    uint64_t page_faults{ 0 };
+    uint64_t minor_faults{ 0 };      ///< on Windows: all page faults
+    uint64_t major_faults{ 0 };
+    uint64_t voluntary_cs{ 0 };      ///< voluntary context switches
+    uint64_t involuntary_cs{ 0 };    ///< involuntary context switches
+    uint64_t io_read_bytes{ 0 };
+    uint64_t io_write_bytes{ 0 };
+  };
+
+#ifdef _WIN32
   /// A serializable wrapper around a 'PROCESS_MEMORY_COUNTERS' struct
   struct ClientProcessMemoryCounter
   {
-    explicit ClientProcessMemoryCounter(HANDLE hProcess)
+    explicit ClientProcessMemoryCounter(ProcessHandle hProcess)
       : data_{}
     {
       bool res = GetProcessMemoryInfo(hProcess, &data_, sizeof(data_));
@@ -117,8 +134,127 @@ namespace WinTime
         << "PeakPagefileUsage";
       return where.str();
     }
+    /// peak working set (resident set size) in bytes
+    uint64_t getPeakWorkingSetSize() const
+    {
+      return data_.PeakWorkingSetSize;
+    }
+
+    uint64_t getPageFaultCount() const
+    {
+      return data_.PageFaultCount;
+    }
+
+    RawMemoryCounters getRaw() const
+    {
+      RawMemoryCounters raw;
+      raw.peak_rss = data_.PeakWorkingSetSize;
+      raw.page_faults = data_.PageFaultCount;
+      raw.minor_faults = data_.PageFaultCount;
+      return raw;
+    }
+
   private:
     PROCESS_MEMORY_COUNTERS data_;
   };
+#else
+  /// The POSIX counterpart of 'PROCESS_MEMORY_COUNTERS', filled from the rusage of the reaped child and /proc/<pid>
+  /// Names follow their Windows equivalents where there is one, so logs of both platforms can be compared.
+  struct ProcessMemoryCounters
+  {
+    uint64_t PageFaultCount;             ///< minor + major faults (Windows does not distinguish)
+    uint64_t PeakWorkingSetSize;         ///< peak resident set size in bytes (ru_maxrss)
+    uint64_t MinorPageFaults;            ///< faults served without I/O
+    uint64_t MajorPageFaults;            ///< faults which required I/O
+    uint64_t VoluntaryContextSwitches;   ///< e.g. waiting for I/O or a lock
+    uint64_t InvoluntaryContextSwitches; ///< preempted by the scheduler
+    uint64_t IOReadBytes;                ///< bytes fetched from storage
+    uint64_t IOWriteBytes;               ///< bytes sent to storage
+  };
+
+  /// A serializable wrapper around a 'ProcessMemoryCounters' struct
+  struct ClientProcessMemoryCounter
+  {
+    explicit ClientProcessMemoryCounter(ProcessHandle hProcess)
+      : data_{}
+    {
+      if (hProcess == nullptr || !hProcess->reaped)
+      {
+        throw std::runtime_error("Could not get memory info!");
+      }
+      const auto& ru = hProcess->usage;
+      data_.MinorPageFaults = ru.ru_minflt;
+      data_.MajorPageFaults = ru.ru_majflt;
+      data_.PageFaultCount = data_.MinorPageFaults + data_.MajorPageFaults;
+      data_.PeakWorkingSetSize = uint64_t(ru.ru_maxrss) * 1024; // ru_maxrss is in KiB on Linux
+      data_.VoluntaryContextSwitches = ru.ru_nvcsw;
+      data_.InvoluntaryContextSwitches = ru.ru_nivcsw;
+      data_.IOReadBytes = hProcess->io_read_bytes;
+      data_.IOWriteBytes = hProcess->io_write_bytes;
+    }
+
+    void print() const
+    { // only report data which does not depend on the time of measurement. Only report maximia (peaks) and totals.
+      std::cerr << "PageFaultCount: " << (data_.PageFaultCount) << '\n';
+      std::cerr << "PeakWorkingSetSize: " << toHumanReadable(data_.PeakWorkingSetSize) << '\n';
+      std::cerr << "MinorPageFaults: " << (data_.MinorPageFaults) << '\n';
+      std::cerr << "MajorPageFaults: " << (data_.MajorPageFaults) << '\n';
+      std::cerr << "VoluntaryContextSwitches: " << (data_.VoluntaryContextSwitches) << '\n';
+      std::cerr << "InvoluntaryContextSwitches: " << (data_.InvoluntaryContextSwitches) << '\n';
+      std::cerr << "IOReadBytes: " << toHumanReadable(data_.IOReadBytes) << '\n';
+      std::cerr << "IOWriteBytes: " << toHumanReadable(data_.IOWriteBytes) << '\n';
+    }
+
+    std::string print(const char separator) const
+    {
+      std::stringstream where;
+      where << data_.PageFaultCount << separator
+        <<                (data_.PeakWorkingSetSize) << separator
+        << toHumanReadable(data_.PeakWorkingSetSize) << separator
+        << data_.MinorPageFaults << separator
+        << data_.MajorPageFaults << separator
+        << data_.VoluntaryContextSwitches << separator
+        << data_.InvoluntaryContextSwitches << separator
+        << data_.IOReadBytes << separator
+        << data_.IOWriteBytes;
+      return where.str();
+    }
+
+    static std::string printHeader(const char separator)
+    { // the first three columns are identical to the Windows version
+      std::stringstream where;
+      where << "PageFaultCount" << separator
+        << "PeakWorkingSetSize (bytes)" << separator
+        << "PeakWorkingSetSize" << separator
+        << "MinorPageFaults" << separator
+        << "MajorPageFaults" << separator
+        << "VoluntaryContextSwitches" << separator
+        << "InvoluntaryContextSwitches" << separator
+        << "IOReadBytes" << separator
+        << "IOWriteBytes";
+      return where.str();
+    }
+    /// peak working set (resident set size) in bytes
+    uint64_t getPeakWorkingSetSize() const
+    {
+      return data_.PeakWorkingSetSize;
+    }
+
+    uint64_t getPageFaultCount() const
+    {
+      return data_.PageFaultCount;
+    }
+
+    RawMemoryCounters getRaw() const
+    {
+      return RawMemoryCounters{ data_.PeakWorkingSetSize, data_.PageFaultCount, data_.MinorPageFaults, data_.MajorPageFaults,
+                                data_.VoluntaryContextSwitches, data_.InvoluntaryContextSwitches, data_.IOReadBytes, data_.IOWriteBytes };
+    }
+
+  private:
+    ProcessMemoryCounters data_;
+  };
+
+#endif
 
 } // namespace
\ No newline at end of file
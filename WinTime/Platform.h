@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#define UNICODE 1
+ // Windows Header Files:
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+#endif
+
+namespace WinTime
+{
+#ifdef _WIN32
+
+  /// handle to a (possibly already finished) child process, which can be queried for timings and memory
+  using ProcessHandle = HANDLE;
+
+  /// exit code of a child process
+  using ExitCode = DWORD;
+
+#else
+
+  /**
+    @brief Everything the kernel tells us about a child process when it terminates
+
+    On POSIX, the PID of a child becomes invalid once the child is reaped, i.e. there is no
+    equivalent of a Windows process HANDLE which can be queried after the process exited.
+    Thus, all counters are collected at once when the child is reaped (see Process::waitForFinish()).
+  */
+  struct ProcessRecord
+  {
+    pid_t pid{ -1 };
+    int wait_status{ 0 };       ///< as returned by wait4()
+    bool reaped{ false };       ///< true once wait_status and usage are valid
+    struct rusage usage {};     ///< resources used by the child itself (not its descendants)
+    timespec t_create{};        ///< CLOCK_REALTIME when the child was spawned
+    timespec t_exit{};          ///< CLOCK_REALTIME when the child was found to be terminated
+    timespec t_create_mono{};   ///< CLOCK_MONOTONIC when the child was spawned (for the wall time)
+    timespec t_exit_mono{};     ///< CLOCK_MONOTONIC when the child was found to be terminated
+    uint64_t io_read_bytes{ 0 };  ///< 'read_bytes' of /proc/<pid>/io, i.e. bytes fetched from storage
+    uint64_t io_write_bytes{ 0 }; ///< 'write_bytes' of /proc/<pid>/io, i.e. bytes sent to storage
+  };
+
+  /// handle to a (possibly already finished) child process, which can be queried for timings and memory
+  using ProcessHandle = const ProcessRecord*;
+
+  /// exit code of a child process (128 + signal number, if it was killed by a signal)
+  using ExitCode = int;
+
+#endif
+
+} // namespace
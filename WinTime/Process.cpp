@@ -21,17 +21,32 @@
  */
 
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 #define UNICODE 1
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
  // Windows Header Files:
 #include <windows.h>
 
-#include <codecvt>
-#include <filesystem>
-
 #pragma comment (lib, "Shlwapi.lib")
 #include <Shlwapi.h>   // for PathRemoveFileSpec
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <codecvt>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
 
 #include "Process.h"
 #include <iostream>
@@ -61,6 +76,7 @@ namespace WinTime
     }
   }
 
+#ifdef _WIN32
   std::string narrow(const std::wstring& wide_str)
   {
     std::string buffer(wide_str.size() * 2 + 2, '\0');
@@ -94,6 +110,25 @@ namespace WinTime
     return narrow(selfdir);
   }
 
+#else
+  std::string narrow(const std::wstring& wide_str)
+  {
+    // std::filesystem converts between wchar_t and the native (UTF-8) encoding on POSIX
+    return std::filesystem::path(wide_str).string();
+  }
+
+  std::wstring widen(const std::string& uft8_str)
+  {
+    return std::filesystem::path(uft8_str).wstring();
+  }
+
+  std::string Process::getPathToCurrentProcess()
+  {
+    return std::filesystem::read_symlink("/proc/self/exe").parent_path().string();
+  }
+
+#endif
+
   std::string Process::concatArguments(const std::string& exe, int more_args_argc, const char** more_args_argv)
   {
     std::vector<std::string> tmp;
@@ -102,23 +137,24 @@ namespace WinTime
     return concatArguments(exe, tmp);
   }
 
-  std::string Process::concatArguments(const std::string& exe, std::vector<std::string> command_args)
+  std::string Process::concatArguments(const std::string& exe, const std::vector<std::string>& command_args)
   {
-    //std::string_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-    command_args.insert(command_args.begin(), exe); // prepend the exe
+    // built in place (no copies of the arguments), since this is on the path of every run
+    size_t size = exe.size() + 1;
+    for (const auto& arg : command_args) size += arg.size() + 1;
     std::string result;
-    for (auto arg : command_args)
-    {
-      // Does arg have quotes? E.g. '-DQT_TESTCASE_BUILDDIR="C:/dev/openms_build_ninja"'
-      if (arg.find('"') != std::string::npos)
-      { // escape them, otherwise the commandline parser will wrongly interpret those quotes
-        substitute(arg, "\"", "\\\"");
+    result.reserve(size + size / 8);
+    auto append = [&result](const std::string& arg) {
+      const bool quote = arg.find(' ') != std::string::npos; // only quote if required
+      if (quote) result += '"';
+      for (const char c : arg)
+      { // Does arg have quotes? E.g. '-DQT_TESTCASE_BUILDDIR="C:/dev/openms_build_ninja"'
+        // escape them, otherwise the commandline parser will wrongly interpret those quotes
+        if (c == '"') result += '\\';
+        result += c;
       }
-
-      if (arg.find(' ') != std::string::npos)
-      { // only quote if required
-        result += '"';
-        result += arg;
+      if (quote)
+      {
         // careful when adding a quote at the end, since 'c:\somepath\' will become 'c:\somepath\"', i.e. the closing quote is escaped and the argument is not closed
         if (countBackslashesAtEnd(arg) % 2 == 1)
         { // add extra backslash
@@ -126,15 +162,14 @@ namespace WinTime
         }
         result += '"';
       }
-      else
-      {
-        result += arg;
-      }
       result += ' ';
-    }
+    };
+    append(exe);
+    for (const auto& arg : command_args) append(arg);
     return result;
   }
 
+#ifdef _WIN32
   std::string Process::searchPATH(const std::string& target_exe, bool verbose)
   {
     auto wt = widen(target_exe);
@@ -174,9 +209,9 @@ namespace WinTime
                                  dwCreationFlags, NULL, NULL, &startupInfo, process_information_);
   }
 
-  bool Process::wasCreated() const
+  Process::Process(const std::string& target_exe, const std::vector<std::string>& argv)
+    : Process(target_exe, concatArguments(argv.front(), std::vector<std::string>(argv.begin() + 1, argv.end())))
   {
-    return was_created_;
   }
 
   PROCESS_INFORMATION& Process::getPI()
@@ -184,6 +219,21 @@ namespace WinTime
     return *process_information_;
   }
 
+  ProcessHandle Process::getHandle() const
+  {
+    return process_information_->hProcess;
+  }
+
+  std::optional<ExitCode> Process::getExitCode() const
+  {
+    DWORD exit_code{ 1 };
+    if (!GetExitCodeProcess(process_information_->hProcess, &exit_code))
+    {
+      return std::nullopt;
+    }
+    return exit_code;
+  }
+
   void Process::waitForFinish()
   {
     // wait for the child process to finish
@@ -196,4 +246,325 @@ namespace WinTime
     delete process_information_;
   }
 
+#else
+
+  std::string Process::searchPATH(const std::string& target_exe, bool verbose)
+  {
+    if (std::filesystem::exists(target_exe))
+    {
+      return target_exe;
+    }
+    // like execvp(): names containing a slash are never looked up in $PATH
+    const char* env_path = getenv("PATH");
+    if (target_exe.find('/') == std::string::npos && env_path != nullptr)
+    {
+      std::string paths(env_path);
+      size_t start = 0;
+      while (start <= paths.size())
+      {
+        size_t end = paths.find(':', start);
+        if (end == std::string::npos) end = paths.size();
+        std::string dir = paths.substr(start, end - start);
+        if (dir.empty()) dir = "."; // an empty entry denotes the current directory
+        std::string candidate = dir + '/' + target_exe;
+        if (access(candidate.c_str(), X_OK) == 0 && std::filesystem::is_regular_file(candidate))
+        {
+          if (verbose)
+          {
+            std::cout << "Found '" << target_exe << "' in PATH as '" << candidate << "'.\n";
+          }
+          return candidate;
+        }
+        start = end + 1;
+      }
+    }
+    throw std::runtime_error("Could not find executable '" + target_exe + "' ($PATH was also checked).");
+  }
+
+  namespace
+  {
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 29)
+#define WINTIME_SPAWN_CHDIR 1
+#endif
+#endif
+
+    /// true if posix_spawn() can do all that @p options asks for
+    bool canUseSpawn(const SpawnOptions& options)
+    {
+      if (!options.fast_spawn || !options.observers.empty() || options.cgroup_procs_fd != -1 || !options.cpus.empty()) return false;
+#ifndef WINTIME_SPAWN_CHDIR
+      if (!options.working_dir.empty()) return false;
+#endif
+      for (int fd = 0; fd < 3; ++fd)
+      { // dup2() onto itself would not clear FD_CLOEXEC
+        if (options.stdio[fd] == fd) return false;
+      }
+      if (options.file_limit)
+      { // posix_spawn() has no attribute for resource limits, so the child inherits ours (and changing ours meanwhile would affect all our threads)
+        struct rlimit own_file_limit;
+        if (getrlimit(RLIMIT_NOFILE, &own_file_limit) != 0 || own_file_limit.rlim_cur != options.file_limit->rlim_cur
+            || own_file_limit.rlim_max != options.file_limit->rlim_max) return false;
+      }
+      return true;
+    }
+  }
+
+  void readProcIO(ProcessRecord& record)
+  {
+    std::ifstream io("/proc/" + std::to_string(record.pid) + "/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value)
+    {
+      if (key == "read_bytes:") record.io_read_bytes = value;
+      else if (key == "write_bytes:") record.io_write_bytes = value;
+    }
+  }
+
+  Process::Process(const std::string& target_exe, const std::vector<std::string>& argv, const SpawnOptions& options)
+    : waiter_(nullptr),
+      was_created_(false)
+  {
+    for (SpawnObserver* observer : options.observers)
+    {
+      if (observer->waitsForChild()) waiter_ = observer;
+    }
+    std::vector<char*> c_argv;
+    for (const auto& arg : argv)
+    {
+      c_argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    c_argv.push_back(nullptr);
+
+    // everything the child needs is prepared here, since only async-signal-safe functions may be called after fork()
+    // our environment is passed as it is, unless entries are added or replaced
+    char** envp = environ;
+    std::vector<char*> c_env;
+    if (!options.inherit_env || !options.env.empty())
+    {
+      for (char** e = environ; options.inherit_env && *e != nullptr; ++e)
+      {
+        const std::string_view entry(*e);
+        const auto name = entry.substr(0, entry.find('=') + 1);
+        const bool replaced = std::any_of(options.env.begin(), options.env.end(), [&name](const std::string& o) { return o.compare(0, name.size(), name) == 0; });
+        if (!replaced) c_env.push_back(*e);
+      }
+      for (const auto& entry : options.env)
+      {
+        c_env.push_back(const_cast<char*>(entry.c_str()));
+      }
+      c_env.push_back(nullptr);
+      envp = c_env.data();
+    }
+
+    if (canUseSpawn(options))
+    {
+      posix_spawn_file_actions_t actions;
+      posix_spawn_file_actions_init(&actions);
+      for (int fd = 0; fd < 3; ++fd)
+      {
+        if (options.stdio[fd] != -1) posix_spawn_file_actions_adddup2(&actions, options.stdio[fd], fd);
+      }
+#ifdef WINTIME_SPAWN_CHDIR
+      if (!options.working_dir.empty()) posix_spawn_file_actions_addchdir_np(&actions, options.working_dir.c_str());
+#endif
+      clock_gettime(CLOCK_REALTIME, &record_.t_create);
+      clock_gettime(CLOCK_MONOTONIC, &record_.t_create_mono);
+      pid_t pid;
+      // glibc reports a failing exec() (and reaps the child then)
+      const int err = posix_spawn(&pid, target_exe.c_str(), &actions, nullptr, c_argv.data(), envp);
+      posix_spawn_file_actions_destroy(&actions);
+      if (err != 0)
+      {
+        errno = err;
+        return;
+      }
+      record_.pid = pid;
+      was_created_ = true;
+      return;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : options.cpus)
+    {
+      CPU_SET(cpu, &cpu_set);
+    }
+
+    // the child reports a failing exec() through this pipe; a successful exec() closes it (O_CLOEXEC)
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) != 0)
+    {
+      return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &record_.t_create);
+    clock_gettime(CLOCK_MONOTONIC, &record_.t_create_mono);
+    const pid_t pid = fork();
+    if (pid == -1)
+    {
+      const int err = errno;
+      close(err_pipe[0]);
+      close(err_pipe[1]);
+      errno = err;
+      return;
+    }
+    if (pid == 0)
+    { // child
+      close(err_pipe[0]);
+      if (options.cgroup_procs_fd != -1 && write(options.cgroup_procs_fd, "0", 1) != 1)
+      { // '0' denotes the writing process; outside of the cgroup, the target would not be accounted for
+        const int err = errno;
+        [[maybe_unused]] auto written = write(err_pipe[1], &err, sizeof(err));
+        _exit(127);
+      }
+      if (!options.cpus.empty())
+      {
+        sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+      }
+      if (options.file_limit)
+      {
+        setrlimit(RLIMIT_NOFILE, &*options.file_limit);
+      }
+      for (int fd = 0; fd < 3; ++fd)
+      {
+        if (options.stdio[fd] == -1) continue;
+        if (options.stdio[fd] == fd) fcntl(fd, F_SETFD, 0); // already in place; just keep it open across exec()
+        else dup2(options.stdio[fd], fd);
+      }
+      if (!options.working_dir.empty() && chdir(options.working_dir.c_str()) != 0)
+      {
+        const int err = errno;
+        [[maybe_unused]] auto written = write(err_pipe[1], &err, sizeof(err));
+        _exit(127);
+      }
+      for (const SpawnObserver* observer : options.observers) observer->prepareChild();
+      execve(target_exe.c_str(), c_argv.data(), envp);
+      const int err = errno;
+      [[maybe_unused]] auto written = write(err_pipe[1], &err, sizeof(err));
+      _exit(127);
+    }
+
+    // parent
+    close(err_pipe[1]);
+    // the error the child reported (0 if none); blocks until it called exec() or exited
+    auto readChildError = [&err_pipe]()
+    {
+      int child_errno = 0;
+      ssize_t read_bytes;
+      do
+      {
+        read_bytes = read(err_pipe[0], &child_errno, sizeof(child_errno));
+      } while (read_bytes == -1 && errno == EINTR);
+      close(err_pipe[0]);
+      return read_bytes > 0 ? child_errno : 0;
+    };
+    for (SpawnObserver* observer : options.observers)
+    {
+      if (observer->attach(pid)) continue;
+      // the observer reaped the child; if attaching failed since the child gave up early (e.g. it could not join the cgroup), its reason is the more useful one
+      const int err = errno;
+      const int child_errno = readChildError();
+      errno = child_errno != 0 ? child_errno : err;
+      return;
+    }
+    const int child_errno = readChildError();
+
+    record_.pid = pid;
+    if (child_errno != 0)
+    { // the child failed to set up or exec(); do not leave a zombie behind
+      if (waiter_)
+      { // it is traced and would stop before exiting
+        kill(pid, SIGKILL);
+        int status;
+        while (waitpid(pid, &status, __WALL) != -1 && !WIFEXITED(status) && !WIFSIGNALED(status))
+        {
+        }
+      }
+      else
+      {
+        waitpid(pid, nullptr, 0);
+      }
+      errno = child_errno;
+      return;
+    }
+    was_created_ = true;
+  }
+
+  ProcessHandle Process::getHandle() const
+  {
+    return &record_;
+  }
+
+  std::optional<ExitCode> Process::getExitCode() const
+  {
+    if (!record_.reaped)
+    {
+      return std::nullopt;
+    }
+    if (WIFEXITED(record_.wait_status))
+    {
+      return WEXITSTATUS(record_.wait_status);
+    }
+    if (WIFSIGNALED(record_.wait_status))
+    { // same convention as the shell
+      return 128 + WTERMSIG(record_.wait_status);
+    }
+    return std::nullopt;
+  }
+
+  void Process::waitForFinish()
+  {
+    if (!was_created_ || record_.reaped)
+    {
+      return;
+    }
+    if (waiter_)
+    {
+      waiter_->waitForExit(record_);
+      return;
+    }
+    // wait for the child to terminate, but do not reap it yet: /proc/<pid> of a zombie is still readable
+    siginfo_t info{};
+    while (waitid(P_PID, record_.pid, &info, WEXITED | WNOWAIT) == -1 && errno == EINTR)
+    {
+    }
+    collectTerminated();
+  }
+
+  pid_t Process::getPID() const
+  {
+    return record_.pid;
+  }
+
+  void Process::collectTerminated()
+  {
+    if (!was_created_ || record_.reaped)
+    {
+      return;
+    }
+    clock_gettime(CLOCK_REALTIME, &record_.t_exit);
+    clock_gettime(CLOCK_MONOTONIC, &record_.t_exit_mono);
+    readProcIO(record_);
+
+    // now reap it and get its resource usage
+    while (wait4(record_.pid, &record_.wait_status, 0, &record_.usage) == -1)
+    {
+      if (errno != EINTR) return;
+    }
+    record_.reaped = true;
+  }
+
+  Process::~Process()
+  {
+  }
+
+#endif
+
+  bool Process::wasCreated() const
+  {
+    return was_created_;
+  }
+
 } // namespace
@@ -22,13 +22,63 @@
 
 #pragma once 
 
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "Platform.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
 namespace WinTime
 {
-  
-  
+#ifndef _WIN32
+  /**
+    @brief Follows a spawned process from before its exec() on (POSIX only), e.g. ProcessTree (tracing) or CpuProfiler (sampling)
+
+    Process calls prepareChild() in the forked child right before exec(), and attach() in the parent right after fork().
+    An observer which has to wait for the process itself (e.g. since it traces it) takes over Process::waitForFinish().
+  */
+  class SpawnObserver
+  {
+  public:
+    virtual ~SpawnObserver() = default;
+
+    /// In the forked child before exec(); may wait until the parent called attach(). Only async-signal-safe functions may be used.
+    virtual void prepareChild() const = 0;
+
+    /// In the parent right after fork(). Returns false (with errno set) if @p child cannot be followed; Process kills and reaps the child then.
+    virtual bool attach(pid_t child) = 0;
+
+    /// true if the process can only be waited for by waitForExit(), e.g. since it is traced
+    virtual bool waitsForChild() const
+    {
+      return false;
+    }
+
+    /// only if waitsForChild(): wait until the process terminated and reap it into @p record
+    virtual void waitForExit(ProcessRecord& /*record*/)
+    {
+    }
+  };
+
+  /// optional extras when spawning a process (POSIX only)
+  struct SpawnOptions
+  {
+    std::vector<SpawnObserver*> observers; ///< follow the process (see SpawnObserver); attached in this order
+    int cgroup_procs_fd{ -1 };     ///< open 'cgroup.procs' file of a cgroup which the process joins before exec()
+    std::string working_dir;       ///< change to this directory before exec() (empty: inherit)
+    std::vector<std::string> env;  ///< 'NAME=VALUE' entries which are added to (or replace those of) the inherited environment
+    bool inherit_env{ true };      ///< false: the environment of the process consists of @p env only
+    std::vector<int> cpus;         ///< restrict the process to these CPUs (empty: inherit)
+    int stdio[3]{ -1, -1, -1 };    ///< descriptors which become STDIN, STDOUT and STDERR of the process (-1: inherit)
+    bool fast_spawn{ false };      ///< use posix_spawn() instead of fork() where possible (see Process)
+    std::optional<rlimit> file_limit; ///< RLIMIT_NOFILE of the process (empty: inherit ours)
+  };
+#endif
+
   int countBackslashesAtEnd(const std::string& arg);
 
   void substitute(std::string& str, const std::string& search,
@@ -43,28 +93,68 @@ namespace WinTime
 
     static std::string concatArguments(const std::string& exe, int more_args_argc, const char** more_args_argv);
 
-    static std::string concatArguments(const std::string& exe, std::vector<std::string> command_args);
+    static std::string concatArguments(const std::string& exe, const std::vector<std::string>& command_args);
 
     /// search for an executable on the %PATH% environment variable.
     static std::string searchPATH(const std::string& exe, bool verbose = false);
 
+#ifdef _WIN32
     /// Starts a process, with extra arguments (if not empty)
     /// The @p target_exe must be an absolute or relative path. The %PATH% environment variable is not used! (use @p searchPATH if you need that)
     Process(const std::string& target_exe, const std::string& p_command_args, DWORD dwCreationFlags = 0);
+#endif
+
+#ifdef _WIN32
+    /// Starts a process with the argument vector @p argv, where argv[0] is the name of the command as given by the user.
+    /// The @p target_exe must be an absolute or relative path. The %PATH% environment variable is not used! (use @p searchPATH if you need that)
+    Process(const std::string& target_exe, const std::vector<std::string>& argv);
+#else
+    /// Starts a process with the argument vector @p argv, where argv[0] is the name of the command as given by the user.
+    /// The @p target_exe must be an absolute or relative path. The %PATH% environment variable is not used! (use @p searchPATH if you need that)
+    /// Each of @p options.observers follows the process from before its exec() on; one which waits for the process itself replaces waitForFinish().
+    /// With @p options.fast_spawn, the process is started by posix_spawn() (a vfork()-style clone which does not copy our page tables)
+    /// unless something has to run in the child before exec() (tracing, profiling, joining a cgroup, CPU affinity, a file limit other than ours), which needs fork().
+    /// This saves a few hundred microseconds, but Linux accounts our resident memory to the child until it calls exec(),
+    /// so its peak RSS (ru_maxrss) is at least ours. @p argv is passed as it is, and so is our environment, if @p options does not change it.
+    Process(const std::string& target_exe, const std::vector<std::string>& argv, const SpawnOptions& options = {});
+#endif
 
     /// Was the process succesfully created in the C'tor?
     bool wasCreated() const;
 
+#ifdef _WIN32
     /// get process information of the internal process
     PROCESS_INFORMATION& getPI();
+#endif
+
+    /// get a handle which can be passed to getProcessTime() and ClientProcessMemoryCounter
+    /// On POSIX, this is only valid after waitForFinish()
+    ProcessHandle getHandle() const;
+
+    /// exit code of the process; empty if the process did not finish (yet) or the code cannot be queried
+    std::optional<ExitCode> getExitCode() const;
     
     /// wait for the child process to finish
     void waitForFinish();
 
+#ifndef _WIN32
+    /// PID of the child (-1 if it was not created)
+    pid_t getPID() const;
+
+    /// Record the exit time and I/O counters of the child, then reap it. The child must have terminated already
+    /// (e.g. its pidfd became readable), so this does not block. Not for traced processes (see ProcessTree).
+    void collectTerminated();
+#endif
+
     ~Process();
 
   private:
+#ifdef _WIN32
     PROCESS_INFORMATION* process_information_;
+#else
+    ProcessRecord record_;
+    SpawnObserver* waiter_;   ///< the observer which waits for the process (nullptr: waitForFinish() does)
+#endif
     bool was_created_;
   };
 
@@ -72,5 +162,10 @@ namespace WinTime
 
   std::wstring widen(const std::string& uft8_str);
 
+#ifndef _WIN32
+  /// read the 'read_bytes' and 'write_bytes' fields of /proc/<pid>/io into @p record (if available)
+  void readProcIO(ProcessRecord& record);
+#endif
+
 
 } // namespace
\ No newline at end of file
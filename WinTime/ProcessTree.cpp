@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "ProcessTree.h"
+
+#include "Memory.h"
+#include "Process.h"
+#include "Time.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace WinTime
+{
+
+  void TreeSummary::print() const
+  {
+    std::cerr << "TreeProcesses: " << processes << '\n';
+    std::cerr << "TreeUserTime: " << toTimeDiffString(t_user) << '\n';
+    std::cerr << "TreeKernelTime: " << toTimeDiffString(t_kernel) << '\n';
+    std::cerr << "TreePeakWorkingSetSize (largest process): " << toHumanReadable(peak_rss_max) << '\n';
+    std::cerr << "TreePeakWorkingSetSize (concurrent): " << toHumanReadable(peak_rss_concurrent) << '\n';
+  }
+
+  std::string TreeSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << processes << separator
+      << t_user << separator
+      << t_kernel << separator
+      << peak_rss_max << separator
+      << peak_rss_concurrent;
+    return where.str();
+  }
+
+  std::string TreeSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "tree_processes" << separator
+      << "tree_user_time" << separator
+      << "tree_kernel_time" << separator
+      << "TreePeakWorkingSetSize max (bytes)" << separator
+      << "TreePeakWorkingSetSize concurrent (bytes)";
+    return where.str();
+  }
+
+  void printTree(const std::vector<TreeNode>& nodes)
+  {
+    // the columns of the reports (see attachReports()) only if any process sent them
+    const bool heap = std::any_of(nodes.begin(), nodes.end(), [](const TreeNode& n) { return n.heap_allocations.has_value(); });
+    const bool locks = std::any_of(nodes.begin(), nodes.end(), [](const TreeNode& n) { return n.t_lock_wait.has_value(); });
+    const bool io = std::any_of(nodes.begin(), nodes.end(), [](const TreeNode& n) { return n.t_io.has_value(); });
+    char buffer[200];
+    std::snprintf(buffer, sizeof(buffer), "%8s %8s %9s %9s %9s %9s %11s", "PID", "PPID", "start", "wall", "user", "kernel", "PeakRSS");
+    std::cerr << buffer;
+    if (heap)
+    {
+      std::snprintf(buffer, sizeof(buffer), " %12s %11s", "allocations", "PeakHeap");
+      std::cerr << buffer;
+    }
+    if (locks)
+    {
+      std::snprintf(buffer, sizeof(buffer), " %9s", "lockwait");
+      std::cerr << buffer;
+    }
+    if (io)
+    {
+      std::snprintf(buffer, sizeof(buffer), " %9s", "io");
+      std::cerr << buffer;
+    }
+    std::cerr << "  command\n";
+    for (const auto& n : nodes)
+    {
+      std::snprintf(buffer, sizeof(buffer), "%8i %8i %9.3f %9.3f %9.3f %9.3f %11s", n.pid, n.ppid, n.t_start, n.t_wall, n.t_user, n.t_kernel, toHumanReadable(n.peak_rss).c_str());
+      std::cerr << buffer;
+      if (heap)
+      {
+        if (n.heap_allocations) std::snprintf(buffer, sizeof(buffer), " %12llu %11s", (unsigned long long)*n.heap_allocations, toHumanReadable(n.heap_peak_live.value_or(0)).c_str());
+        else std::snprintf(buffer, sizeof(buffer), " %12s %11s", "-", "-");
+        std::cerr << buffer;
+      }
+      if (locks)
+      {
+        if (n.t_lock_wait) std::snprintf(buffer, sizeof(buffer), " %9.3f", *n.t_lock_wait);
+        else std::snprintf(buffer, sizeof(buffer), " %9s", "-");
+        std::cerr << buffer;
+      }
+      if (io)
+      {
+        if (n.t_io) std::snprintf(buffer, sizeof(buffer), " %9.3f", *n.t_io);
+        else std::snprintf(buffer, sizeof(buffer), " %9s", "-");
+        std::cerr << buffer;
+      }
+      std::cerr << "  " << n.cmdline << (n.exited ? "" : "  [still running]") << '\n';
+    }
+  }
+
+  std::string printTree(const std::vector<TreeNode>& nodes, const std::string& run_id, const char separator)
+  {
+    // reports which a process did not send are empty cells
+    const auto cell = [&](std::stringstream& where, const auto& value) {
+      if (value) where << *value;
+      where << separator;
+    };
+    std::stringstream where;
+    for (const auto& n : nodes)
+    {
+      where << run_id << separator
+        << n.pid << separator
+        << n.ppid << separator
+        << n.t_start << separator
+        << n.t_wall << separator
+        << n.t_user << separator
+        << n.t_kernel << separator
+        << n.peak_rss << separator
+        << n.exited << separator;
+      cell(where, n.heap_allocations);
+      cell(where, n.heap_peak_live);
+      cell(where, n.t_lock_wait);
+      cell(where, n.t_io);
+      where << n.cmdline << '\n';
+    }
+    return where.str();
+  }
+
+  std::string printTreeHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "creation_time" << separator
+      << "pid" << separator
+      << "ppid" << separator
+      << "start_time" << separator
+      << "wall_time" << separator
+      << "user_time" << separator
+      << "kernel_time" << separator
+      << "PeakWorkingSetSize (bytes)" << separator
+      << "exited" << separator
+      << "heap_allocations" << separator
+      << "heap_peak_live (bytes)" << separator
+      << "lock_wait_time" << separator
+      << "io_time" << separator
+      << "cmd" << '\n';
+    return where.str();
+  }
+
+#ifndef _WIN32
+
+  namespace
+  {
+    /// value of a 'Key:   value' line of /proc/<pid>/status, or -1
+    int64_t readStatusField(pid_t pid, const std::string& key)
+    {
+      std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+      std::string line;
+      while (std::getline(status, line))
+      {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':')
+        {
+          return std::stoll(line.substr(key.size() + 1));
+        }
+      }
+      return -1;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+  ProcessTree::ProcessTree(std::chrono::microseconds sample_interval)
+    : sample_interval_(sample_interval),
+      page_size_(sysconf(_SC_PAGESIZE))
+  {
+  }
+
+  ProcessTree::~ProcessTree()
+  {
+    for (auto& [pid, node] : nodes_)
+    {
+      if (node.fd_statm != -1) close(node.fd_statm);
+    }
+    for (const int fd : retired_statm_) close(fd);
+  }
+
+  void ProcessTree::prepareChild() const
+  {
+    ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+    raise(SIGSTOP); // wait for the parent to set the trace options
+  }
+
+  bool ProcessTree::attach(pid_t root)
+  {
+    root_ = root;
+    t_root_start_ = std::chrono::steady_clock::now();
+    // orphaned descendants get reparented to us (instead of init), so we can reap them
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    int status;
+    while (waitpid(root, &status, __WALL | WUNTRACED) == -1)
+    {
+      if (errno != EINTR) return false;
+    }
+    if (!WIFSTOPPED(status))
+    {
+      errno = ECHILD;
+      return false;
+    }
+    const long options = PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_TRACEEXIT;
+    if (ptrace(PTRACE_SETOPTIONS, root, nullptr, options) == -1)
+    { // PTRACE_TRACEME failed in the child (e.g. forbidden by seccomp)
+      const int err = errno;
+      kill(root, SIGKILL);
+      waitpid(root, &status, __WALL);
+      errno = err;
+      return false;
+    }
+
+    Node node;
+    node.data.pid = root;
+    node.data.ppid = getpid();
+    node.t_start = t_root_start_;
+    node.fd_statm = open(("/proc/" + std::to_string(root) + "/statm").c_str(), O_RDONLY | O_CLOEXEC);
+    nodes_[root] = node;
+    order_.push_back(root);
+    started_[root] = true;
+
+    ptrace(PTRACE_CONT, root, nullptr, 0);
+    return true;
+  }
+
+  bool ProcessTree::waitsForChild() const
+  {
+    return true;
+  }
+
+  void ProcessTree::waitForExit(ProcessRecord& root_record)
+  {
+    run(root_record);
+  }
+
+  void ProcessTree::run(ProcessRecord& root_record)
+  {
+    std::thread sampler(&ProcessTree::sampleConcurrentRSS_, this);
+
+    bool root_done = false;
+    while (!root_done)
+    {
+      int status;
+      struct rusage usage {};
+      const pid_t pid = wait4(-1, &status, __WALL, &usage);
+      if (pid == -1)
+      {
+        if (errno == EINTR) continue;
+        break; // ECHILD: nothing left to wait for
+      }
+
+      if (WIFEXITED(status) || WIFSIGNALED(status))
+      {
+        started_.erase(pid);
+        if (pid == root_)
+        {
+          clock_gettime(CLOCK_REALTIME, &root_record.t_exit);
+          clock_gettime(CLOCK_MONOTONIC, &root_record.t_exit_mono);
+          root_record.wait_status = status;
+          root_record.usage = usage;
+          root_record.reaped = true;
+          root_done = true;
+        }
+        continue;
+      }
+      if (!WIFSTOPPED(status))
+      {
+        continue;
+      }
+
+      const int sig = WSTOPSIG(status);
+      const int event = status >> 16;
+      int inject_signal = 0;
+      if (sig == SIGTRAP && event != 0)
+      {
+        switch (event)
+        {
+        break; case PTRACE_EVENT_FORK: case PTRACE_EVENT_VFORK: case PTRACE_EVENT_CLONE:
+        {
+          unsigned long child = 0;
+          ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &child);
+          onNewTask_(pid, pid_t(child));
+        }
+        break; case PTRACE_EVENT_EXEC:
+        {
+          std::lock_guard lock(mutex_);
+          auto it = nodes_.find(pid);
+          if (it != nodes_.end()) it->second.data.cmdline = readCmdline_(pid);
+        }
+        break; case PTRACE_EVENT_EXIT:
+          onExit_(pid, pid == root_ ? &root_record : nullptr);
+        }
+      }
+      else if (sig == SIGSTOP && !started_[pid])
+      { // initial stop of an auto-attached task (may arrive before the event of its parent)
+        started_[pid] = true;
+      }
+      else
+      { // a real signal: deliver it
+        inject_signal = sig;
+      }
+      ptrace(PTRACE_CONT, pid, nullptr, inject_signal);
+    }
+
+    {
+      std::lock_guard lock(mutex_);
+      stop_sampling_ = true;
+    }
+    cv_.notify_one();
+    sampler.join();
+
+    {
+      // descendants which outlive the root: report what we have so far
+      std::lock_guard lock(mutex_);
+      for (auto& [pid, node] : nodes_)
+      {
+        if (node.data.exited) continue;
+        readCounters_(node);
+        node.data.t_wall = secondsSince(node.t_start);
+      }
+    }
+    detachRemaining_();
+  }
+
+  void ProcessTree::detachRemaining_()
+  {
+    // a tracee can only be detached while it is stopped: stop each task with a thread-directed SIGSTOP, which PTRACE_DETACH then suppresses
+    // (tasks whose initial stop is still pending have a SIGSTOP already)
+    for (const auto& [tid, started] : started_)
+    {
+      if (started) syscall(SYS_tkill, tid, SIGSTOP);
+    }
+    std::set<pid_t> detached;
+    while (!started_.empty())
+    {
+      int status;
+      const pid_t pid = waitpid(-1, &status, __WALL);
+      if (pid == -1)
+      {
+        if (errno == EINTR) continue;
+        break; // ECHILD: nothing left
+      }
+      if (WIFEXITED(status) || WIFSIGNALED(status))
+      {
+        started_.erase(pid);
+        continue;
+      }
+      if (!WIFSTOPPED(status))
+      {
+        continue;
+      }
+
+      const int sig = WSTOPSIG(status);
+      const int event = status >> 16;
+      if (sig == SIGSTOP && event == 0)
+      { // our stop (or the initial stop of a task created meanwhile)
+        ptrace(PTRACE_DETACH, pid, nullptr, 0);
+        started_.erase(pid);
+        detached.insert(pid);
+        continue;
+      }
+      if (sig == SIGTRAP && (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK || event == PTRACE_EVENT_CLONE))
+      { // the new task is auto-attached; wait for its initial stop (unless it was reported first)
+        unsigned long child = 0;
+        ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &child);
+        if (!detached.count(pid_t(child))) started_.try_emplace(pid_t(child), false);
+      }
+      ptrace(PTRACE_CONT, pid, nullptr, event == 0 ? sig : 0);
+    }
+  }
+
+  void ProcessTree::onNewTask_(pid_t parent, pid_t child)
+  {
+    started_.try_emplace(child, false);
+    if (readStatusField(child, "Tgid") != child)
+    { // a thread
+      return;
+    }
+    Node node;
+    node.data.pid = child;
+    node.data.ppid = int(readStatusField(child, "PPid"));
+    node.t_start = std::chrono::steady_clock::now();
+    node.data.t_start = std::chrono::duration<double>(node.t_start - t_root_start_).count();
+    node.fd_statm = open(("/proc/" + std::to_string(child) + "/statm").c_str(), O_RDONLY | O_CLOEXEC);
+
+    std::lock_guard lock(mutex_);
+    // until it calls exec(), a forked process runs the code (and has the cmdline) of its parent
+    const pid_t parent_tgid = pid_t(readStatusField(parent, "Tgid"));
+    auto it_parent = nodes_.find(parent_tgid);
+    if (it_parent != nodes_.end()) node.data.cmdline = it_parent->second.data.cmdline;
+    nodes_[child] = node;
+    order_.push_back(child);
+  }
+
+  void ProcessTree::onExit_(pid_t pid, ProcessRecord* root_record)
+  {
+    std::lock_guard lock(mutex_);
+    auto it = nodes_.find(pid);
+    if (it == nodes_.end())
+    { // a thread
+      return;
+    }
+    Node& node = it->second;
+    node.data.t_wall = secondsSince(node.t_start);
+    readCounters_(node);
+    if (node.data.cmdline.empty()) node.data.cmdline = readCmdline_(pid);
+    node.data.exited = true;
+    if (node.fd_statm != -1)
+    { // the sampler may be reading it right now (see sampleConcurrentRSS_())
+      retired_statm_.push_back(node.fd_statm);
+      node.fd_statm = -1;
+    }
+    if (root_record)
+    {
+      readProcIO(*root_record);
+    }
+  }
+
+  void ProcessTree::readCounters_(Node& node)
+  {
+    const pid_t pid = node.data.pid;
+    // /proc/<pid>/stat: 'pid (comm) state ... utime(14) stime(15) ...'; comm may contain spaces
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string content;
+    std::getline(stat, content);
+    const auto pos = content.rfind(')');
+    if (pos != std::string::npos)
+    {
+      std::istringstream fields(content.substr(pos + 2));
+      std::string skip;
+      for (int i = 3; i < 14; ++i) fields >> skip;
+      uint64_t utime = 0, stime = 0;
+      fields >> utime >> stime;
+      const double ticks = double(sysconf(_SC_CLK_TCK));
+      node.data.t_user = utime / ticks;
+      node.data.t_kernel = stime / ticks;
+    }
+    const auto hwm_kib = readStatusField(pid, "VmHWM");
+    if (hwm_kib >= 0) node.data.peak_rss = uint64_t(hwm_kib) * 1024;
+  }
+
+  std::string ProcessTree::readCmdline_(pid_t pid)
+  {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/cmdline", std::ios::binary);
+    std::string cmdline((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    while (!cmdline.empty() && cmdline.back() == '\0') cmdline.pop_back();
+    for (auto& c : cmdline)
+    {
+      if (c == '\0') c = ' ';
+    }
+    return cmdline;
+  }
+
+  void ProcessTree::sampleConcurrentRSS_()
+  {
+    char buffer[256];
+    std::vector<int> fds;
+    std::unique_lock lock(mutex_);
+    while (!stop_sampling_)
+    {
+      for (const int fd : retired_statm_) close(fd);
+      retired_statm_.clear();
+      fds.clear();
+      for (const auto& [pid, node] : nodes_)
+      {
+        if (node.fd_statm != -1) fds.push_back(node.fd_statm);
+      }
+      lock.unlock();
+
+      // /proc/<pid>/statm: 'size resident shared text lib data dt' (in pages)
+      uint64_t rss = 0;
+      for (const int fd : fds)
+      {
+        const ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (n <= 0) continue;
+        buffer[n] = '\0';
+        unsigned long long size = 0, resident = 0;
+        if (std::sscanf(buffer, "%llu %llu", &size, &resident) == 2)
+        {
+          rss += resident * page_size_;
+        }
+      }
+      lock.lock();
+      if (rss > peak_rss_concurrent_) peak_rss_concurrent_ = rss;
+      cv_.wait_for(lock, sample_interval_, [this] { return stop_sampling_; });
+    }
+  }
+
+  std::vector<TreeNode> ProcessTree::getNodes() const
+  {
+    std::lock_guard lock(mutex_);
+    std::vector<TreeNode> result;
+    for (const auto pid : order_)
+    {
+      result.push_back(nodes_.at(pid).data);
+    }
+    return result;
+  }
+
+  TreeSummary ProcessTree::getSummary() const
+  {
+    std::lock_guard lock(mutex_);
+    TreeSummary summary;
+    summary.processes = nodes_.size();
+    for (const auto& [pid, node] : nodes_)
+    {
+      summary.t_user += node.data.t_user;
+      summary.t_kernel += node.data.t_kernel;
+      if (node.data.peak_rss > summary.peak_rss_max) summary.peak_rss_max = node.data.peak_rss;
+    }
+    // sampling may miss short peaks; a single process is a lower bound
+    summary.peak_rss_concurrent = std::max(peak_rss_concurrent_, summary.peak_rss_max);
+    return summary;
+  }
+
+#endif
+
+} // namespace
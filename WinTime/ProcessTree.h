@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+#include "Process.h"
+
+namespace WinTime
+{
+  /// One process of a process tree (the root or any of its descendants)
+  struct TreeNode
+  {
+    int pid{ 0 };
+    int ppid{ 0 };
+    std::string cmdline;     ///< arguments separated by spaces (after the last exec())
+    double t_start{ 0 };     ///< seconds since the root was spawned
+    double t_wall{ 0 };
+    double t_user{ 0 };
+    double t_kernel{ 0 };
+    uint64_t peak_rss{ 0 };  ///< peak resident set size in bytes
+    bool exited{ false };    ///< false if it was still running when the root finished (data is partial then)
+    // what the process reported itself (see attachReports() in ReportServer.h); empty if it sent nothing
+    std::optional<uint64_t> heap_allocations;  ///< with --heap
+    std::optional<uint64_t> heap_peak_live;    ///< with --heap: highest live heap in bytes
+    std::optional<double> t_lock_wait;         ///< with --locks: seconds waited for contended locks (condition waits excluded)
+    std::optional<double> t_io;                ///< with --io: seconds spent in open/read/write calls
+  };
+
+  /// Aggregate over all processes of a tree
+  struct TreeSummary
+  {
+    size_t processes{ 0 };
+    double t_user{ 0 };                 ///< sum over all processes
+    double t_kernel{ 0 };               ///< sum over all processes
+    uint64_t peak_rss_max{ 0 };         ///< highest peak RSS of a single process
+    uint64_t peak_rss_concurrent{ 0 };  ///< highest sum of RSS of all processes alive at the same time (sampled)
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+  /// Print the per-process breakdown as a table to std::cerr
+  void printTree(const std::vector<TreeNode>& nodes);
+
+  /// Write the per-process breakdown as rows of a table, each starting with @p run_id (e.g. the creation time of the root)
+  std::string printTree(const std::vector<TreeNode>& nodes, const std::string& run_id, const char separator);
+
+  /// Header matching printTree(nodes, run_id, separator)
+  std::string printTreeHeader(const char separator);
+
+#ifndef _WIN32
+  /**
+    @brief Follows a child process and all its descendants using ptrace() and records per-process usage
+
+    The child calls prepareChild() right before its exec(), which stops it until the parent calls attach().
+    From then on, every fork/vfork/clone is followed automatically. Each process is stopped briefly right
+    before it exits (PTRACE_EVENT_EXIT), while its /proc entry is still complete, to read its final counters.
+    The tool is also made a child subreaper, so orphaned descendants are reparented to (and reaped by) us.
+
+    Concurrent memory is sampled on a background thread by summing the RSS of all live processes.
+
+    Note: targets which use ptrace() themselves (debuggers, LeakSanitizer) cannot run in this mode.
+  */
+  class ProcessTree : public SpawnObserver
+  {
+  public:
+    /// @param sample_interval How often the RSS of all live processes is summed up
+    explicit ProcessTree(std::chrono::microseconds sample_interval = std::chrono::milliseconds(10));
+
+    ~ProcessTree();
+
+    /// To be called in the forked child before exec(). Only async-signal-safe functions are used.
+    void prepareChild() const override;
+
+    /// To be called in the parent right after fork(). Waits for the initial stop of the child, sets up tracing and resumes it.
+    /// Returns false (with errno set) if the child cannot be traced; the child is reaped then (and killed, if need be).
+    bool attach(pid_t root) override;
+
+    /// the traced root can only be waited for by run()
+    bool waitsForChild() const override;
+
+    /// calls run()
+    void waitForExit(ProcessRecord& root_record) override;
+
+    /// Trace until the root terminated; the root is reaped into @p root_record
+    /// Descendants which outlive the root are reported with the data gathered so far and detached, so they run on untraced.
+    void run(ProcessRecord& root_record);
+
+    /// all processes, ordered by start time (the root comes first)
+    std::vector<TreeNode> getNodes() const;
+
+    TreeSummary getSummary() const;
+
+  private:
+    /// a traced process (thread group); threads are tracked only as far as needed to resume them
+    struct Node
+    {
+      TreeNode data;
+      int fd_statm{ -1 };  ///< /proc/<pid>/statm for sampling the RSS
+      std::chrono::steady_clock::time_point t_start;
+    };
+
+    /// a new task (process or thread) was created by @p parent
+    void onNewTask_(pid_t parent, pid_t child);
+
+    /// read cmdline and final counters of @p pid while it is stopped at PTRACE_EVENT_EXIT
+    void onExit_(pid_t pid, ProcessRecord* root_record);
+
+    /// read CPU times and peak RSS of @p node from /proc
+    static void readCounters_(Node& node);
+
+    /// read /proc/<pid>/cmdline
+    static std::string readCmdline_(pid_t pid);
+
+    /// stop and detach all tasks which are still traced
+    void detachRemaining_();
+
+    /// sum up the RSS of all live processes periodically (runs on a background thread during run());
+    /// the reads of /proc do not hold mutex_, since they may be slow (e.g. while a process maps memory) and would stall the tracer
+    void sampleConcurrentRSS_();
+
+    pid_t root_{ -1 };
+    std::chrono::steady_clock::time_point t_root_start_;
+    std::chrono::microseconds sample_interval_;
+    std::map<pid_t, Node> nodes_;        ///< by PID (== TGID)
+    std::map<pid_t, bool> started_;      ///< all traced tasks (incl. threads); value: true once their initial stop was handled
+    std::vector<pid_t> order_;           ///< PIDs in order of creation
+    std::vector<int> retired_statm_;     ///< fd_statm of exited processes, closed by the sampler between its reads (so no fd it reads is reused meanwhile)
+    mutable std::mutex mutex_;           ///< guards nodes_ and retired_statm_ (the sampler copies the fd_statm, but reads them without it)
+    bool stop_sampling_{ false };
+    std::condition_variable cv_;
+    uint64_t peak_rss_concurrent_{ 0 };
+    long page_size_;
+  };
+#endif
+
+} // namespace
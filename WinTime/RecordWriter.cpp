@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "RecordWriter.h"
+
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// the columns of a record, in order
+    constexpr std::array<const char*, 18> COLUMNS{
+      "cmd", "exit_code", "signal",
+      "start_ns", "start", "end_ns", "end",
+      "wall_ns", "user_ns", "kernel_ns",
+      "peak_rss_bytes", "page_faults", "minor_faults", "major_faults",
+      "voluntary_cs", "involuntary_cs", "io_read_bytes", "io_write_bytes" };
+
+    void appendJSONString(std::string& out, const std::string_view text)
+    {
+      out.push_back('"');
+      for (const char c : text)
+      {
+        switch (c)
+        {
+          case '"': out.append("\\\"");
+          break; case '\\': out.append("\\\\");
+          break; case '\n': out.append("\\n");
+          break; case '\r': out.append("\\r");
+          break; case '\t': out.append("\\t");
+          break; default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            { // other control characters
+              const char* hex = "0123456789abcdef";
+              out.append("\\u00");
+              out.push_back(hex[c >> 4]);
+              out.push_back(hex[c & 0xf]);
+            }
+            else
+            {
+              out.push_back(c);
+            }
+        }
+      }
+      out.push_back('"');
+    }
+
+    void appendCSVString(std::string& out, const std::string_view text)
+    {
+      if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+      {
+        out.append(text);
+        return;
+      }
+      out.push_back('"');
+      for (const char c : text)
+      {
+        if (c == '"') out.push_back('"');
+        out.push_back(c);
+      }
+      out.push_back('"');
+    }
+
+    void appendTSVString(std::string& out, const std::string_view text)
+    {
+      for (const char c : text)
+      {
+        switch (c)
+        {
+          case '\t': out.append("\\t");
+          break; case '\n': out.append("\\n");
+          break; case '\r': out.append("\\r");
+          break; case '\\': out.append("\\\\");
+          break; default: out.push_back(c);
+        }
+      }
+    }
+  }
+
+  RecordWriter::RecordWriter(const LogFormat format, const std::optional<std::string>& file, const OpenMode mode)
+    : format_(format),
+      file_(file),
+      mode_(mode)
+  {
+    if (!isRecordFormat(format_))
+    {
+      throw std::runtime_error("RecordWriter: only 'jsonl', 'csv' and 'tsv-raw' are supported.");
+    }
+  }
+
+  std::string RecordWriter::header() const
+  {
+    if (format_ == LogFormat::JSONL) return {};
+    const char sep = format_ == LogFormat::CSV ? ',' : '\t';
+    std::string result;
+    for (const auto name : COLUMNS)
+    {
+      if (!result.empty()) result.push_back(sep);
+      result.append(name);
+    }
+    result.push_back('\n');
+    return result;
+  }
+
+  void RecordWriter::write(const FormatValues& values)
+  {
+    buffer_.clear();
+    render(values, buffer_);
+
+    if (file_)
+    {
+      FileLog(*file_, mode_).append(header(), buffer_);
+      mode_ = OpenMode::APPEND;
+      return;
+    }
+    if (!header_written_)
+    {
+      const auto h = header();
+      std::fwrite(h.data(), 1, h.size(), stdout);
+      header_written_ = true;
+    }
+    std::fwrite(buffer_.data(), 1, buffer_.size(), stdout);
+    std::fflush(stdout); // a reader at the other end of a pipe gets each row right away
+  }
+
+  void RecordWriter::render(const FormatValues& v, std::string& out) const
+  {
+    const bool json = format_ == LogFormat::JSONL;
+    const char sep = format_ == LogFormat::CSV ? ',' : '\t';
+    size_t column = 0;
+    // start the next cell: separator or the key of a JSON member
+    auto next = [&]() {
+      if (json)
+      {
+        out.push_back(column == 0 ? '{' : ',');
+        out.push_back('"');
+        out.append(COLUMNS[column]);
+        out.append("\":");
+      }
+      else if (column > 0)
+      {
+        out.push_back(sep);
+      }
+      ++column;
+    };
+    auto text = [&](const std::string_view value) {
+      next();
+      switch (format_)
+      {
+        case LogFormat::JSONL: appendJSONString(out, value);
+        break; case LogFormat::CSV: appendCSVString(out, value);
+        break; default: appendTSVString(out, value);
+      }
+    };
+    auto number = [&](const int64_t value) {
+      next();
+      appendInt(out, value);
+    };
+    auto count = [&](const uint64_t value) {
+      next();
+      appendUInt(out, value);
+    };
+
+    text(v.command);
+    number(v.exit_code);
+    number(v.term_signal);
+    number(v.times.t_create_ns);
+    text(toISO8601(v.times.t_create_ns));
+    number(v.times.t_exit_ns);
+    text(toISO8601(v.times.t_exit_ns));
+    number(v.times.t_wall_ns);
+    number(v.times.t_user_ns);
+    number(v.times.t_kernel_ns);
+    count(v.memory.peak_rss);
+    count(v.memory.page_faults);
+    count(v.memory.minor_faults);
+    count(v.memory.major_faults);
+    count(v.memory.voluntary_cs);
+    count(v.memory.involuntary_cs);
+    count(v.memory.io_read_bytes);
+    count(v.memory.io_write_bytes);
+    if (json) out.push_back('}');
+    out.push_back('\n');
+  }
+
+} // namespace
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "FileLog.h"
+#include "Format.h"
+
+namespace WinTime
+{
+  /**
+    @brief Writes one machine-readable row per run: JSON Lines, CSV or raw TSV (see LogFormat)
+
+    Unlike the TSV log, all values are plain numbers which need no parsing of units: memory and I/O in bytes,
+    durations in nanoseconds (on Windows, multiples of 100ns), start and end both as nanoseconds since the Unix epoch and as ISO-8601 (UTC),
+    plus the exit code and terminating signal. The columns are the same for single runs, repeated runs (one row per measured run) and batches.
+
+    Rows are streamed: each one is rendered into a reused buffer and written (and flushed) right away, either appended to a file
+    (under its lock, with a header line for CSV and raw TSV if the file is empty) or to STDOUT, so a batch can be piped into another program.
+    Command lines are escaped as needed: JSON string escapes, CSV quoting (RFC 4180), and \t, \n, \r and \\ in raw TSV.
+  */
+  class RecordWriter : public RunWriter
+  {
+  public:
+    /// @param file Append to this file instead of writing to STDOUT; the first write uses @p mode, all others append
+    /// @throw std::runtime_error if @p format is not a record format (see isRecordFormat())
+    RecordWriter(const LogFormat format, const std::optional<std::string>& file, const OpenMode mode);
+
+    void write(const FormatValues& values) override;
+
+    /// append the row for @p values (including the newline) to @p out, e.g. to write several rows at once
+    void render(const FormatValues& values, std::string& out) const;
+
+    /// the header line (including the newline) for CSV and raw TSV; empty for JSON Lines
+    std::string header() const;
+
+  private:
+    LogFormat format_;
+    std::optional<std::string> file_;
+    OpenMode mode_;
+    bool header_written_{ false };  ///< for STDOUT
+    std::string buffer_;            ///< reused for all rows
+  };
+
+} // namespace
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "ReportProtocol.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// write all of @p iov (which is modified) to @p fd, retrying after EINTR and partial writes
+    bool sendAll(const int fd, iovec* iov, int count)
+    {
+      while (count > 0)
+      {
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = size_t(count);
+        const ssize_t written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+          if (errno == EINTR) continue;
+          return false;
+        }
+        size_t rest = size_t(written);
+        while (count > 0 && rest >= iov->iov_len)
+        {
+          rest -= iov->iov_len;
+          ++iov;
+          --count;
+        }
+        if (count > 0)
+        {
+          iov->iov_base = static_cast<char*>(iov->iov_base) + rest;
+          iov->iov_len -= rest;
+        }
+      }
+      return true;
+    }
+  }
+
+  ReportClient::ReportClient()
+  {
+    const char* path = getenv(s_env_reportsocket);
+    if (!path || std::strlen(path) >= sizeof(address_.sun_path)) return;
+    address_.sun_family = AF_UNIX;
+    std::strcpy(address_.sun_path, path);
+    connect_();
+  }
+
+  ReportClient::~ReportClient()
+  {
+    if (fd_ != -1) close(fd_);
+  }
+
+  bool ReportClient::isValid() const
+  {
+    return fd_ != -1;
+  }
+
+  bool ReportClient::connect_()
+  {
+    if (fd_ != -1) close(fd_);
+    pid_ = getpid();
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ == -1) return false;
+    int result;
+    do result = connect(fd_, reinterpret_cast<const sockaddr*>(&address_), sizeof(address_));
+    while (result == -1 && errno == EINTR);
+    if (result != 0)
+    {
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+
+    // HELLO: parent PID and command line (truncated to what fits into the buffer)
+    char hello[4096];
+    const uint32_t ppid = uint32_t(getppid());
+    std::memcpy(hello, &ppid, sizeof(ppid));
+    size_t size = sizeof(ppid);
+    const int fd_cmdline = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+    if (fd_cmdline != -1)
+    {
+      const ssize_t bytes = read(fd_cmdline, hello + size, sizeof(hello) - size);
+      if (bytes > 0) size += size_t(bytes);
+      close(fd_cmdline);
+    }
+    return send(ReportType::HELLO, hello, size);
+  }
+
+  bool ReportClient::send(ReportType type, const void* data, size_t size)
+  {
+    if (fd_ == -1) return false;
+    // a forked child must not write into the connection of its parent
+    if (getpid() != pid_ && !connect_()) return false;
+    ReportHeader header{ REPORT_MAGIC, uint32_t(size), uint32_t(pid_), uint32_t(type) };
+    iovec iov[2]{ { &header, sizeof(header) }, { const_cast<void*>(data), size } };
+    if (!sendAll(fd_, iov, size ? 2 : 1))
+    {
+      close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    return true;
+  }
+
+} // namespace
+
+#endif
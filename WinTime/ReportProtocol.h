@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/un.h>
+
+namespace WinTime
+{
+  /// Name of the environment variable which tells the target the path of the report socket (like s_env_pipename in NamedPipeLib/Defs.h)
+  static const char* const s_env_reportsocket = "processInfo_reportsocket";
+
+  /// What a message of a target process (see ReportClient) contains
+  enum class ReportType : uint32_t
+  {
+    HELLO = 1,    ///< sent on connect: the parent PID (uint32) followed by the command line (arguments separated by NUL)
+    TEXT = 2,     ///< free text, e.g. for tests
+    HEAP_COUNTERS = 16,   ///< HeapCounters of the process, sent at exit by the heap hook (see Heap.h)
+    HEAP_PROFILE = 17,    ///< the path of a heap profile written by the heap hook (see --heap-profile)
+    LOCK_CONTENTION = 18, ///< LockStat of the locks with the longest waits, sent at exit by the heap hook (see Locks.h)
+    IO_COUNTERS = 19,     ///< IoCounters of the process, sent at exit by the heap hook (see Io.h)
+    IO_FILES = 20,        ///< IoFileStat of the files with the most I/O time and bytes, sent at exit by the heap hook (see Io.h)
+  };
+
+  /**
+    @brief Header of each message from a target process to ReportServer (in native byte order; both ends run on the same host)
+
+    The header is followed by @p size bytes of payload, whose layout depends on @p type.
+  */
+  struct ReportHeader
+  {
+    uint32_t magic;   ///< 'WTR1'
+    uint32_t size;    ///< bytes of payload after the header
+    uint32_t pid;     ///< the sender
+    uint32_t type;    ///< see ReportType
+  };
+
+  constexpr uint32_t REPORT_MAGIC = 0x31525457; // 'WTR1'
+
+  /// limit for the payload of a single message, so a broken client cannot make the server allocate without bounds
+  constexpr uint32_t REPORT_MAX_SIZE = 64 << 20;
+
+  /**
+    @brief The target's side of ReportServer: sends framed messages over the Unix domain socket named in s_env_reportsocket
+
+    Connects on construction and introduces the process with a HELLO message. A process forked by the target
+    which inherited the client opens a connection of its own on its first send(), so messages of different processes never interleave.
+    send() blocks until the message is written completely (the server never stops reading), but neither allocates nor raises SIGPIPE.
+  */
+  class ReportClient
+  {
+  public:
+    /// connect to the socket named in the environment (if any; see isValid())
+    ReportClient();
+
+    ReportClient(const ReportClient&) = delete;
+    void operator=(const ReportClient&) = delete;
+
+    /// closes the connection
+    ~ReportClient();
+
+    /// false if the environment variable is not set or the server cannot be reached
+    bool isValid() const;
+
+    /// send a message of @p type with @p size bytes of @p data; returns false if the connection is lost
+    bool send(ReportType type, const void* data, size_t size);
+
+  private:
+    /// (re-)connect and send HELLO; returns false on failure
+    bool connect_();
+
+    sockaddr_un address_{};
+    int fd_{ -1 };
+    pid_t pid_{ -1 };   ///< the process which opened fd_
+  };
+
+} // namespace
+
+#endif
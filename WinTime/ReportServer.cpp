@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef _WIN32
+
+#include "ReportServer.h"
+
+#include "Heap.h"
+#include "Io.h"
+#include "Locks.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace WinTime
+{
+  ReportServer::ReportServer()
+  {
+    const char* tmp = getenv("TMPDIR");
+    std::string dir_template = std::string(tmp && *tmp ? tmp : "/tmp") + "/wintime-XXXXXX";
+    if (!mkdtemp(&dir_template[0]))
+    {
+      throw std::runtime_error("ReportServer: could not create a directory for the socket: " + std::string(std::strerror(errno)));
+    }
+    dir_ = dir_template;
+    path_ = dir_ + "/report.sock";
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (path_.size() >= sizeof(address.sun_path) || listen_fd_ == -1)
+    {
+      rmdir(dir_.c_str());
+      throw std::runtime_error("ReportServer: could not create a socket at '" + path_ + "'.");
+    }
+    std::strcpy(address.sun_path, path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd_, SOMAXCONN) != 0)
+    {
+      const std::string reason = std::strerror(errno);
+      close(listen_fd_);
+      unlink(path_.c_str());
+      rmdir(dir_.c_str());
+      throw std::runtime_error("ReportServer: could not listen on '" + path_ + "': " + reason);
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    for (const int fd : { listen_fd_, stop_fd_ })
+    {
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    // ... and use an ENV, so all processes of the target know where to report to
+    setenv(s_env_reportsocket, path_.c_str(), 1);
+    thread_ = std::thread(&ReportServer::run_, this);
+  }
+
+  ReportServer::~ReportServer()
+  {
+    finish();
+    unsetenv(s_env_reportsocket);
+    close(stop_fd_);
+    close(epoll_fd_);
+    close(listen_fd_);
+    unlink(path_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  const std::string& ReportServer::getPath() const
+  {
+    return path_;
+  }
+
+  std::vector<ProcessReport> ReportServer::finish(std::chrono::milliseconds grace)
+  {
+    if (finished_) return {};
+    grace_ = grace;
+    const uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof(one)) != sizeof(one))
+    {
+      throw std::runtime_error("ReportServer: could not stop the event loop.");
+    }
+    thread_.join();
+    finished_ = true;
+    return std::move(reports_);
+  }
+
+  const ReportServerStats& ReportServer::getStats() const
+  {
+    return stats_;
+  }
+
+  void ReportServer::run_()
+  {
+    bool stopping = false;
+    auto deadline = std::chrono::steady_clock::now();
+    epoll_event events[64];
+    for (;;)
+    {
+      int timeout = -1;
+      if (stopping)
+      {
+        accept_(); // connections of processes which exited may still wait in the listen queue
+        if (connections_.empty()) break;
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) break;
+        timeout = int(remaining.count()) + 1;
+      }
+      const int count = epoll_wait(epoll_fd_, events, 64, timeout);
+      if (count == -1 && errno != EINTR) break;
+      for (int i = 0; i < count; ++i)
+      {
+        const int fd = events[i].data.fd;
+        if (fd == listen_fd_)
+        {
+          accept_();
+        }
+        else if (fd == stop_fd_)
+        {
+          uint64_t value;
+          [[maybe_unused]] const auto ignored = read(stop_fd_, &value, sizeof(value));
+          stopping = true;
+          deadline = std::chrono::steady_clock::now() + grace_;
+        }
+        else
+        {
+          auto it = connections_.find(fd);
+          if (it == connections_.end()) continue;
+          if (!read_(fd, it->second))
+          {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections_.erase(it);
+          }
+        }
+      }
+    }
+
+    // clients which are still connected after the grace period: take what they sent so far
+    for (auto& [fd, connection] : connections_)
+    {
+      read_(fd, connection);
+      close(fd);
+    }
+    connections_.clear();
+  }
+
+  void ReportServer::accept_()
+  {
+    for (;;)
+    {
+      const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd == -1)
+      {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        return; // EAGAIN: the queue is empty
+      }
+      ucred peer{};
+      socklen_t length = sizeof(peer);
+      if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || peer.uid != getuid())
+      {
+        close(fd);
+        continue;
+      }
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLRDHUP;
+      event.data.fd = fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+      connections_[fd].pid = uint32_t(peer.pid);
+      ++stats_.connections;
+      stats_.max_concurrent = std::max(stats_.max_concurrent, connections_.size());
+    }
+  }
+
+  bool ReportServer::read_(int fd, Connection& connection)
+  {
+    char chunk[65536];
+    bool open = true;
+    for (;;)
+    {
+      const ssize_t bytes = recv(fd, chunk, sizeof(chunk), 0);
+      if (bytes > 0)
+      {
+        connection.buffer.append(chunk, size_t(bytes));
+        continue;
+      }
+      if (bytes == -1 && errno == EINTR) continue;
+      open = bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+      break;
+    }
+
+    // file all complete messages
+    size_t pos = 0;
+    const std::string& buffer = connection.buffer;
+    while (buffer.size() - pos >= sizeof(ReportHeader))
+    {
+      ReportHeader header;
+      std::memcpy(&header, buffer.data() + pos, sizeof(header));
+      if (header.magic != REPORT_MAGIC || header.size > REPORT_MAX_SIZE)
+      {
+        ++stats_.rejected;
+        return false;
+      }
+      if (buffer.size() - pos - sizeof(header) < header.size) break;
+      onMessage_(connection.pid, header, buffer.data() + pos + sizeof(header));
+      pos += sizeof(header) + header.size;
+    }
+    connection.buffer.erase(0, pos);
+    return open;
+  }
+
+  void ReportServer::onMessage_(uint32_t pid, const ReportHeader& header, const char* payload)
+  {
+    ++stats_.messages;
+    stats_.bytes += sizeof(header) + header.size;
+    auto [it, inserted] = index_.emplace(pid, reports_.size());
+    if (inserted)
+    {
+      reports_.emplace_back().pid = pid;
+    }
+    ProcessReport& report = reports_[it->second];
+    if (ReportType(header.type) == ReportType::HELLO)
+    {
+      if (header.size < sizeof(uint32_t)) return;
+      std::memcpy(&report.ppid, payload, sizeof(uint32_t));
+      report.cmdline.assign(payload + sizeof(uint32_t), header.size - sizeof(uint32_t));
+      while (!report.cmdline.empty() && report.cmdline.back() == '\0') report.cmdline.pop_back();
+      std::replace(report.cmdline.begin(), report.cmdline.end(), '\0', ' ');
+      return;
+    }
+    report.messages.push_back(ReportMessage{ ReportType(header.type), std::string(payload, header.size) });
+  }
+
+  std::vector<size_t> matchTreeNodes(const std::vector<ProcessReport>& reports, const std::vector<TreeNode>& nodes)
+  {
+    std::map<int, size_t> by_pid;
+    for (size_t i = 0; i < nodes.size(); ++i) by_pid.emplace(nodes[i].pid, i);
+    std::vector<size_t> result;
+    result.reserve(reports.size());
+    for (const auto& report : reports)
+    {
+      auto it = by_pid.find(int(report.pid));
+      result.push_back(it == by_pid.end() ? SIZE_MAX : it->second);
+    }
+    return result;
+  }
+
+  void attachReports(const std::vector<ProcessReport>& reports, std::vector<TreeNode>& nodes)
+  {
+    const auto matches = matchTreeNodes(reports, nodes);
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+      if (matches[i] == SIZE_MAX) continue;
+      TreeNode& node = nodes[matches[i]];
+      for (const auto& message : reports[i].messages)
+      {
+        if (message.type == ReportType::HEAP_COUNTERS && message.payload.size() == sizeof(HeapCounters))
+        {
+          HeapCounters counters;
+          std::memcpy(&counters, message.payload.data(), sizeof(counters));
+          node.heap_allocations = node.heap_allocations.value_or(0) + counters.allocations;
+          node.heap_peak_live = std::max(node.heap_peak_live.value_or(0), counters.peak_live);
+        }
+        if (message.type == ReportType::LOCK_CONTENTION && message.payload.size() % sizeof(LockStat) == 0)
+        {
+          double t_wait = 0;
+          for (size_t pos = 0; pos < message.payload.size(); pos += sizeof(LockStat))
+          {
+            LockStat stat;
+            std::memcpy(&stat, message.payload.data() + pos, sizeof(stat));
+            if (stat.kind != LockKind::CONDITION) t_wait += stat.wait_ns / 1e9;
+          }
+          node.t_lock_wait = node.t_lock_wait.value_or(0) + t_wait;
+        }
+        if (message.type == ReportType::IO_COUNTERS && message.payload.size() == sizeof(IoCounters))
+        {
+          IoCounters counters;
+          std::memcpy(&counters, message.payload.data(), sizeof(counters));
+          double t_io = 0;
+          for (const uint64_t ns : counters.time_ns) t_io += ns / 1e9;
+          node.t_io = node.t_io.value_or(0) + t_io;
+        }
+      }
+    }
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ProcessTree.h"
+#include "ReportProtocol.h"
+
+namespace WinTime
+{
+  /// A message of a target process (everything but HELLO)
+  struct ReportMessage
+  {
+    ReportType type;
+    std::string payload;
+  };
+
+  /// Everything a single process of the target reported (over all its connections, e.g. before and after exec())
+  struct ProcessReport
+  {
+    uint32_t pid{ 0 };
+    uint32_t ppid{ 0 };
+    std::string cmdline;                   ///< arguments separated by spaces (of the latest HELLO)
+    std::vector<ReportMessage> messages;   ///< in the order they were sent
+  };
+
+  /// Counters of a ReportServer
+  struct ReportServerStats
+  {
+    size_t connections{ 0 };
+    size_t max_concurrent{ 0 };   ///< most connections open at the same time
+    size_t messages{ 0 };         ///< including HELLO
+    uint64_t bytes{ 0 };          ///< including headers
+    size_t rejected{ 0 };         ///< connections closed because of a malformed message
+  };
+
+  /**
+    @brief Receives the reports of any number of target processes at once (the multi-client counterpart of NamedPipeServer)
+
+    Listens on a Unix domain socket in a private temporary directory, whose path is published in the environment variable
+    s_env_reportsocket, which all processes of the target inherit. One event loop (epoll, on a background thread) accepts
+    the connections and reads the framed messages (see ReportHeader) of all of them, so hundreds of processes can connect
+    at once; a client is only ever delayed by the kernel's socket buffers, never turned away (the listen backlog is SOMAXCONN
+    and connect() waits when it is full). Messages are grouped by the PID of the connecting process (SO_PEERCRED),
+    not by the PID in their header, which a client could get wrong (e.g. after fork()) or fake.
+
+    finish() keeps accepting and reading until the listen queue is empty and every client hung up, which happens
+    when a process exits, so no report of a process which exited before finish() is lost.
+  */
+  class ReportServer
+  {
+  public:
+    /// create the socket, set the environment variable and start the event loop
+    /// @throw std::runtime_error if the socket cannot be created
+    ReportServer();
+
+    ReportServer(const ReportServer&) = delete;
+    void operator=(const ReportServer&) = delete;
+
+    /// calls finish() (if not done yet) and removes the socket
+    ~ReportServer();
+
+    /// path of the socket, as published in the environment
+    const std::string& getPath() const;
+
+    /// read everything until all clients hung up, but wait at most @p grace for clients which are still connected (e.g. orphaned daemons);
+    /// returns the reports of all processes, in the order they first connected
+    std::vector<ProcessReport> finish(std::chrono::milliseconds grace = std::chrono::milliseconds(200));
+
+    /// only valid after finish()
+    const ReportServerStats& getStats() const;
+
+  private:
+    struct Connection
+    {
+      uint32_t pid{ 0 };    ///< of the process which connected (SO_PEERCRED)
+      std::string buffer;   ///< received bytes which do not form a complete message yet
+    };
+
+    /// the event loop (runs on thread_)
+    void run_();
+
+    /// accept all pending connections
+    void accept_();
+
+    /// read from @p fd; returns false once the client hung up (or sent garbage)
+    bool read_(int fd, Connection& connection);
+
+    /// file a complete message of process @p pid
+    void onMessage_(uint32_t pid, const ReportHeader& header, const char* payload);
+
+    std::string dir_;
+    std::string path_;
+    int listen_fd_{ -1 };
+    int epoll_fd_{ -1 };
+    int stop_fd_{ -1 };   ///< eventfd, signalled by finish()
+    std::chrono::milliseconds grace_{ 0 };
+    std::thread thread_;
+    bool finished_{ false };
+    std::map<int, Connection> connections_;   ///< by fd
+    std::map<uint32_t, size_t> index_;        ///< PID -> position in reports_
+    std::vector<ProcessReport> reports_;
+    ReportServerStats stats_;
+  };
+
+  /// the index of the node in @p nodes (see ProcessTree) which each of @p reports came from (matched by PID; SIZE_MAX if the process was not traced)
+  std::vector<size_t> matchTreeNodes(const std::vector<ProcessReport>& reports, const std::vector<TreeNode>& nodes);
+
+  /// add what each of @p reports sent (heap counters, lock waits, I/O time) to its node in @p nodes (see matchTreeNodes())
+  void attachReports(const std::vector<ProcessReport>& reports, std::vector<TreeNode>& nodes);
+
+} // namespace
+
+#endif
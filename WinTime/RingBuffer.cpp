@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "RingBuffer.h"
+
+#include "Platform.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// a thread which found no free ring drops this many records before it tries again (rings are freed only when their thread exits)
+    constexpr uint32_t CLAIM_RETRY = 256;
+
+    /// the ring of the calling thread (in the client)
+    struct ThreadRing
+    {
+      const Detail::RingSegment* segment{ nullptr }; ///< the segment 'control' belongs to (nullptr: not used yet)
+      Detail::RingControl* control{ nullptr };       ///< nullptr if no ring was free
+      RingRecord* records{ nullptr };
+      uint64_t head{ 0 };                            ///< local copy of control->head
+      uint64_t cached_tail{ 0 };                     ///< last tail seen; re-read only when the ring looks full
+      uint32_t retry{ 0 };                           ///< records to drop before the next attempt to claim a ring
+    };
+
+#ifdef _WIN32
+    thread_local ThreadRing s_thread_ring;
+#else
+    /// the heap hook pushes from within malloc(), so the TLS must not be allocated lazily
+    thread_local ThreadRing s_thread_ring __attribute__((tls_model("initial-exec")));
+
+    /// the child of fork() must not write to the ring of the parent's thread
+    void resetThreadRing()
+    {
+      s_thread_ring = ThreadRing{};
+    }
+#endif
+
+    /// take the first free ring of @p segment for the calling thread; returns false if there is none
+    bool claimRing(Detail::RingSegment* segment, ThreadRing& t)
+    {
+      for (uint32_t i = 0; i < segment->rings; ++i)
+      {
+        auto* control = Detail::getControl(segment, i);
+        uint32_t expected = Detail::RING_FREE;
+        if (control->state.load(std::memory_order_relaxed) != Detail::RING_FREE
+            || !control->state.compare_exchange_strong(expected, Detail::RING_CLAIMING, std::memory_order_acquire))
+        {
+          continue;
+        }
+#ifdef _WIN32
+        control->pid = GetCurrentProcessId();
+        control->tid = GetCurrentThreadId();
+#else
+        control->pid = uint32_t(getpid());
+        control->tid = uint32_t(syscall(SYS_gettid));
+#endif
+        control->state.store(Detail::RING_CLAIMED, std::memory_order_release);
+        t.control = control;
+        t.records = Detail::getRecords(segment, i);
+        t.head = control->head.load(std::memory_order_relaxed);
+        t.cached_tail = control->tail.load(std::memory_order_acquire);
+        return true;
+      }
+      return false;
+    }
+  }
+
+  RingBufferClient::RingBufferClient()
+  {
+    const char* name = getenv(s_env_ringname);
+    if (!name) return;
+
+    void* memory = nullptr;
+#ifdef _WIN32
+    HANDLE hMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (hMapping == NULL) return;
+    memory = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    CloseHandle(hMapping); // the view keeps the mapping alive
+    if (memory == NULL) return;
+    MEMORY_BASIC_INFORMATION info{};
+    VirtualQuery(memory, &info, sizeof(info));
+    size_ = info.RegionSize;
+#else
+    const int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+    if (fd == -1) return;
+    struct stat st {};
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Detail::RingSegment))
+    {
+      size_ = size_t(st.st_size);
+      memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (memory == MAP_FAILED) memory = nullptr;
+    }
+    close(fd);
+    if (!memory) return;
+#endif
+    auto* segment = static_cast<Detail::RingSegment*>(memory);
+    if (segment->magic != Detail::RING_MAGIC || segment->version != Detail::RING_VERSION || Detail::getSegmentSize(segment->rings, segment->capacity) > size_)
+    {
+#ifdef _WIN32
+      UnmapViewOfFile(memory);
+#else
+      munmap(memory, size_);
+#endif
+      return;
+    }
+    segment_ = segment;
+#ifndef _WIN32
+    pthread_atfork(nullptr, nullptr, resetThreadRing);
+#endif
+  }
+
+  RingBufferClient::~RingBufferClient()
+  {
+    if (!segment_) return;
+#ifdef _WIN32
+    UnmapViewOfFile(segment_);
+#else
+    munmap(segment_, size_);
+#endif
+  }
+
+  bool RingBufferClient::isValid() const
+  {
+    return segment_ != nullptr;
+  }
+
+  bool RingBufferClient::push(uint32_t kind, uint32_t aux, uint64_t value0, uint64_t value1)
+  {
+    if (!segment_) return false;
+    ThreadRing& t = s_thread_ring;
+    if (t.segment != segment_)
+    { // first record of this thread
+      t = ThreadRing{};
+      t.segment = segment_;
+    }
+    if (!t.control && (t.retry > 0 || !claimRing(segment_, t)))
+    {
+      t.retry = t.retry > 0 ? t.retry - 1 : CLAIM_RETRY - 1;
+      segment_->dropped_unclaimed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    const uint64_t capacity = segment_->capacity;
+    if (t.head - t.cached_tail >= capacity)
+    {
+      t.cached_tail = t.control->tail.load(std::memory_order_acquire);
+      if (t.head - t.cached_tail >= capacity)
+      { // only this thread writes 'dropped'
+        t.control->dropped.store(t.control->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    t.records[t.head & (capacity - 1)] = RingRecord{ now(), kind, aux, { value0, value1 } };
+    t.control->head.store(++t.head, std::memory_order_release);
+    return true;
+  }
+
+  uint64_t RingBufferClient::now()
+  {
+#ifdef _WIN32
+    static const uint64_t frequency = [] { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return uint64_t(f.QuadPart); }();
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    const uint64_t ticks = uint64_t(counter.QuadPart);
+    return ticks / frequency * 1000000000 + ticks % frequency * 1000000000 / frequency;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+#endif
+  }
+
+} // namespace
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace WinTime
+{
+  /// Name of the environment variable which tells the target the name of the shared memory (like s_env_pipename in NamedPipeLib/Defs.h)
+  static const char* const s_env_ringname = "processInfo_ringname";
+
+  /// One event, reported by the target; the meaning of kind, aux and the values is defined by the producer
+  struct RingRecord
+  {
+    uint64_t t_ns;       ///< monotonic clock of the producer in ns (see RingBufferClient::now())
+    uint32_t kind;
+    uint32_t aux;
+    uint64_t value[2];
+  };
+  static_assert(sizeof(RingRecord) == 32, "RingRecord is part of the shared memory layout");
+
+  /// The thread (and its process) which writes to a ring
+  struct RingOwner
+  {
+    uint32_t pid;
+    uint32_t tid;
+  };
+
+  namespace Detail
+  {
+    constexpr uint32_t RING_MAGIC = 0x42525457; // 'WTRB'
+    constexpr uint32_t RING_VERSION = 2;
+
+    /// Life cycle of a ring (RingControl::state)
+    enum RingState : uint32_t
+    {
+      RING_FREE = 0,       ///< not owned by any thread
+      RING_CLAIMED = 1,    ///< owned by the thread in pid/tid
+      RING_CLAIMING = 2,   ///< a thread is filling in pid/tid
+    };
+
+    /// Control block of one single-producer/single-consumer ring; head and tail are on their own cache lines
+    struct RingControl
+    {
+      alignas(64) std::atomic<uint64_t> head;    ///< next record to write (only written by the producer)
+      uint32_t pid;
+      uint32_t tid;
+      std::atomic<uint64_t> dropped;              ///< records the producer could not write because the ring was full
+      std::atomic<uint32_t> state;                ///< see RingState; FREE -> CLAIMING -> CLAIMED by a producer, CLAIMED -> FREE by the consumer
+      alignas(64) std::atomic<uint64_t> tail;    ///< next record to read (only written by the consumer)
+    };
+
+    /// Start of the shared memory, followed by the RingControl blocks and then the records of all rings
+    struct RingSegment
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t rings;                             ///< number of rings
+      uint32_t capacity;                          ///< records per ring (a power of 2)
+      std::atomic<uint64_t> dropped_unclaimed;    ///< records of threads which found no free ring
+    };
+
+    constexpr size_t alignTo64(size_t bytes)
+    {
+      return (bytes + 63) / 64 * 64;
+    }
+
+    /// bytes of shared memory needed for @p rings rings of @p capacity records each
+    constexpr size_t getSegmentSize(size_t rings, size_t capacity)
+    {
+      return alignTo64(sizeof(RingSegment)) + rings * sizeof(RingControl) + rings * capacity * sizeof(RingRecord);
+    }
+
+    inline RingControl* getControl(RingSegment* segment, size_t ring)
+    {
+      auto* base = reinterpret_cast<char*>(segment) + alignTo64(sizeof(RingSegment));
+      return reinterpret_cast<RingControl*>(base) + ring;
+    }
+
+    inline RingRecord* getRecords(RingSegment* segment, size_t ring)
+    {
+      auto* base = reinterpret_cast<char*>(getControl(segment, segment->rings));
+      return reinterpret_cast<RingRecord*>(base) + ring * segment->capacity;
+    }
+  }
+
+  /**
+    @brief The target's side of RingBufferServer (see RingBufferServer.h): appends records to the ring of the calling thread
+
+    The server creates shared memory with one lock-free single-producer/single-consumer ring of fixed-size records per target thread
+    and publishes its name in the environment variable s_env_ringname, which is inherited by the target (like the name of the pipe of NamedPipeServer).
+    Each thread of the target (and of its child processes) which reports an event claims a free ring on first use, so there is exactly one
+    producer per ring and no locking at all. If a ring is full, records are dropped (and counted), i.e. the target never waits for the server.
+    Rings of threads which exited are handed back by the server, so later threads can claim them.
+
+    push() is wait-free and neither allocates, throws nor makes system calls (except when the calling thread claims a ring),
+    so it can be called from within malloc() or a signal handler (this header and RingBuffer.cpp are used by the heap hook).
+    There should be only one client per process.
+  */
+  class RingBufferClient
+  {
+  public:
+    /// map the shared memory named in the environment variable s_env_ringname (if any; see isValid())
+    RingBufferClient();
+
+    RingBufferClient(const RingBufferClient&) = delete;
+    void operator=(const RingBufferClient&) = delete;
+
+    /// unmap the shared memory
+    ~RingBufferClient();
+
+    /// false if the environment variable is not set or the shared memory cannot be mapped (push() does nothing then)
+    bool isValid() const;
+
+    /// append a record (stamped with now()) to the ring of the calling thread; returns false if it was dropped
+    bool push(uint32_t kind, uint32_t aux, uint64_t value0, uint64_t value1);
+
+    /// monotonic clock in ns (CLOCK_MONOTONIC, or QueryPerformanceCounter() on Windows)
+    static uint64_t now();
+
+  private:
+    Detail::RingSegment* segment_{ nullptr };
+    size_t size_{ 0 };
+  };
+
+} // namespace
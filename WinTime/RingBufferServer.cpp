@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#include "RingBufferServer.h"
+
+#include "Platform.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// false if the thread @p owner exited (or its process is gone)
+    bool isAlive(const RingOwner& owner)
+    {
+#ifdef _WIN32
+      HANDLE hThread = OpenThread(SYNCHRONIZE, FALSE, owner.tid);
+      if (hThread == NULL) return GetLastError() != ERROR_INVALID_PARAMETER;
+      const bool alive = WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT;
+      CloseHandle(hThread);
+      return alive;
+#else
+      return syscall(SYS_tgkill, pid_t(owner.pid), pid_t(owner.tid), 0) == 0 || errno != ESRCH;
+#endif
+    }
+  }
+
+  RingBufferServer::RingBufferServer(size_t rings, size_t capacity)
+  {
+    static std::atomic<unsigned> s_instances{ 0 };
+    rings = std::max(size_t(1), rings);
+    size_t capacity_pow2 = 1;
+    while (capacity_pow2 < capacity) capacity_pow2 *= 2;
+    size_ = Detail::getSegmentSize(rings, capacity_pow2);
+    const unsigned instance = s_instances++;
+
+#ifdef _WIN32
+    name_ = "Local\\WinTimeRing" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(instance);
+    hMapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, DWORD(uint64_t(size_) >> 32), DWORD(size_ & 0xFFFFFFFF), name_.c_str());
+    if (hMapping_ == NULL)
+    {
+      throw std::runtime_error("Could not create shared memory '" + name_ + "'.");
+    }
+    void* memory = MapViewOfFile(hMapping_, FILE_MAP_ALL_ACCESS, 0, 0, size_);
+    if (memory == NULL)
+    {
+      CloseHandle(hMapping_);
+      throw std::runtime_error("Could not map shared memory '" + name_ + "'.");
+    }
+#else
+    name_ = "/wintime-ring-" + std::to_string(getpid()) + "-" + std::to_string(instance);
+    const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+      throw std::runtime_error("Could not create shared memory '" + name_ + "': " + std::strerror(errno));
+    }
+    void* memory = MAP_FAILED;
+    if (ftruncate(fd, off_t(size_)) == 0)
+    {
+      memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int error = errno;
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+      shm_unlink(name_.c_str());
+      throw std::runtime_error("Could not map shared memory '" + name_ + "': " + std::strerror(error));
+    }
+#endif
+    // the memory is zeroed; construct the atomics in place
+    segment_ = new (memory) Detail::RingSegment{ Detail::RING_MAGIC, Detail::RING_VERSION, uint32_t(rings), uint32_t(capacity_pow2), {0} };
+    for (size_t i = 0; i < rings; ++i)
+    {
+      new (Detail::getControl(segment_, i)) Detail::RingControl{ {0}, 0, 0, {0}, {Detail::RING_FREE}, {0} };
+    }
+
+    // ... and use an ENV, so the child process knows the name of the shared memory
+#ifdef _WIN32
+    SetEnvironmentVariableA(s_env_ringname, name_.c_str());
+#else
+    setenv(s_env_ringname, name_.c_str(), 1);
+#endif
+  }
+
+  RingBufferServer::~RingBufferServer()
+  {
+#ifdef _WIN32
+    SetEnvironmentVariableA(s_env_ringname, NULL);
+    UnmapViewOfFile(segment_);
+    CloseHandle(hMapping_);
+#else
+    unsetenv(s_env_ringname);
+    munmap(segment_, size_);
+    shm_unlink(name_.c_str());
+#endif
+  }
+
+  const std::string& RingBufferServer::getName() const
+  {
+    return name_;
+  }
+
+  size_t RingBufferServer::drain(const std::function<void(const RingOwner&, const RingRecord&)>& callback)
+  {
+    // checking an owner is a system call, so it is done only once free rings run short
+    const bool recycle = getClaimedRings() * 4 >= size_t(segment_->rings) * 3;
+    size_t count = 0;
+    for (size_t i = 0; i < segment_->rings; ++i)
+    {
+      auto* control = Detail::getControl(segment_, i);
+      if (control->state.load(std::memory_order_acquire) != Detail::RING_CLAIMED) continue;
+      const size_t n = drainRing_(i, callback);
+      count += n;
+      if (recycle && n == 0 && !isAlive(RingOwner{ control->pid, control->tid }))
+      { // the thread may have pushed after the first look
+        count += drainRing_(i, callback);
+        releaseRing_(i);
+      }
+    }
+    return count;
+  }
+
+  size_t RingBufferServer::drainRing_(size_t index, const std::function<void(const RingOwner&, const RingRecord&)>& callback)
+  {
+    auto* control = Detail::getControl(segment_, index);
+    const uint64_t head = control->head.load(std::memory_order_acquire);
+    uint64_t tail = control->tail.load(std::memory_order_relaxed);
+    if (tail == head) return 0;
+    const uint64_t mask = segment_->capacity - 1;
+    const RingOwner owner{ control->pid, control->tid };
+    const RingRecord* records = Detail::getRecords(segment_, index);
+    size_t count = 0;
+    for (; tail != head; ++tail, ++count)
+    {
+      callback(owner, records[tail & mask]);
+    }
+    control->tail.store(tail, std::memory_order_release);
+    return count;
+  }
+
+  void RingBufferServer::releaseRing_(size_t index)
+  {
+    auto* control = Detail::getControl(segment_, index);
+    dropped_recycled_ += control->dropped.load(std::memory_order_relaxed);
+    control->dropped.store(0, std::memory_order_relaxed);
+    control->head.store(0, std::memory_order_relaxed);
+    control->tail.store(0, std::memory_order_relaxed);
+    control->pid = 0;
+    control->tid = 0;
+    // the next owner sees the reset ring (it claims with acquire)
+    control->state.store(Detail::RING_FREE, std::memory_order_release);
+    ++recycled_;
+  }
+
+  size_t RingBufferServer::getClaimedRings() const
+  {
+    size_t claimed = 0;
+    for (size_t i = 0; i < segment_->rings; ++i)
+    {
+      claimed += Detail::getControl(segment_, i)->state.load(std::memory_order_relaxed) != Detail::RING_FREE;
+    }
+    return claimed;
+  }
+
+  size_t RingBufferServer::getRecycledRings() const
+  {
+    return recycled_;
+  }
+
+  uint64_t RingBufferServer::getDropped() const
+  {
+    uint64_t dropped = segment_->dropped_unclaimed.load(std::memory_order_relaxed) + dropped_recycled_;
+    for (size_t i = 0; i < segment_->rings; ++i)
+    {
+      dropped += Detail::getControl(segment_, i)->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+  }
+
+} // namespace
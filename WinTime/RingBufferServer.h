@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "RingBuffer.h"
+
+namespace WinTime
+{
+  /**
+    @brief Shared memory with one lock-free single-producer/single-consumer ring of fixed-size records per target thread
+
+    The server creates the shared memory and publishes its name in the environment variable s_env_ringname,
+    which is inherited by the target (like the name of the pipe of NamedPipeServer). Each thread of the target
+    (and of its child processes) which reports an event claims a free ring on first use (see RingBufferClient),
+    so there is exactly one producer per ring and no locking at all. If a ring is full, records are dropped (and counted),
+    i.e. the target never waits for the server. The server drains all rings, e.g. periodically while the target runs.
+
+    Once three quarters of the rings are claimed, drain() checks the owners of idle rings and frees the rings of threads which exited,
+    so a target which starts more threads over time than there are rings keeps reporting.
+  */
+  class RingBufferServer
+  {
+  public:
+    /// create the shared memory for @p rings threads with @p capacity records each (rounded up to a power of 2) and set the environment variable
+    /// @throw std::runtime_error if the shared memory cannot be created
+    explicit RingBufferServer(size_t rings = 64, size_t capacity = size_t(1) << 14);
+
+    RingBufferServer(const RingBufferServer&) = delete;
+    void operator=(const RingBufferServer&) = delete;
+
+    /// unmap and remove the shared memory
+    ~RingBufferServer();
+
+    /// name of the shared memory, as published in the environment
+    const std::string& getName() const;
+
+    /// pass all records written since the last call to @p callback (ring by ring, in the order they were written); returns their number.
+    /// If free rings run short, the rings of threads which exited are drained a last time and freed.
+    size_t drain(const std::function<void(const RingOwner&, const RingRecord&)>& callback);
+
+    /// number of rings currently owned by producer threads (at most the number of rings)
+    size_t getClaimedRings() const;
+
+    /// number of rings which were freed after their thread exited
+    size_t getRecycledRings() const;
+
+    /// records which were lost since the rings were full (or the producer found no free ring)
+    uint64_t getDropped() const;
+
+  private:
+    /// pass the new records of ring @p index to @p callback; returns their number
+    size_t drainRing_(size_t index, const std::function<void(const RingOwner&, const RingRecord&)>& callback);
+
+    /// free ring @p index, whose thread exited and which was drained
+    void releaseRing_(size_t index);
+
+    std::string name_;
+    Detail::RingSegment* segment_{ nullptr };
+    size_t size_{ 0 };
+    size_t recycled_{ 0 };
+    uint64_t dropped_recycled_{ 0 };   ///< records dropped by the threads of freed rings
+#ifdef _WIN32
+    void* hMapping_{ nullptr };
+#endif
+  };
+
+} // namespace
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Sampler.h"
+
+#include "Heap.h"
+#include "Memory.h"
+#include "RingBufferServer.h"
+#include "Time.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace WinTime
+{
+
+  std::chrono::microseconds parseInterval(const std::string& interval)
+  {
+    char* end = nullptr;
+    const double value = std::strtod(interval.c_str(), &end);
+    const std::string unit(end);
+    double factor_us;
+    if (unit.empty() || unit == "ms") factor_us = 1e3;
+    else if (unit == "s") factor_us = 1e6;
+    else if (unit == "us") factor_us = 1;
+    else throw std::runtime_error("Invalid unit in interval '" + interval + "'. Use 'us', 'ms' or 's'.");
+
+    const auto result = std::chrono::microseconds(int64_t(value * factor_us));
+    if (end == interval.c_str() || result.count() <= 0)
+    {
+      throw std::runtime_error("Invalid interval '" + interval + "'. Must be a positive duration, e.g. '10ms'.");
+    }
+    return result;
+  }
+
+  std::string printTimeline(const Timeline& timeline, const std::string& run_id, const char separator)
+  {
+    std::stringstream where;
+    for (const auto& s : timeline)
+    {
+      where << run_id << separator
+        << s.t << separator
+        << s.rss << separator
+        << s.t_cpu << separator
+        << s.minor_faults << separator
+        << s.major_faults << separator
+        << s.io_read_bytes << separator
+        << s.io_write_bytes << separator;
+      if (s.heap_live) where << *s.heap_live;
+      where << '\n';
+    }
+    return where.str();
+  }
+
+  std::string printTimelineHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "creation_time" << separator
+      << "time" << separator
+      << "rss (bytes)" << separator
+      << "cpu_time" << separator
+      << "minor_faults" << separator
+      << "major_faults" << separator
+      << "io_read (bytes)" << separator
+      << "io_write (bytes)" << separator
+      << "heap_live (bytes)" << '\n';
+    return where.str();
+  }
+
+  void SamplingSummary::print() const
+  {
+    std::cerr << "Samples: " << samples << " (every " << interval * 1e3 << " ms)\n";
+    std::cerr << "SampledPeakWorkingSetSize: " << toHumanReadable(peak_rss) << " (at " << t_peak << " seconds)\n";
+    std::cerr << "SamplingCost: " << cost_mean * 1e6 << " us per sample (max: " << cost_max * 1e6 << " us), "
+      << t_cpu_sampler * 1e3 << " ms CPU in total\n";
+  }
+
+  std::string SamplingSummary::print(const char separator) const
+  {
+    std::stringstream where;
+    where << samples << separator
+      << interval << separator
+      << peak_rss << separator
+      << t_peak << separator
+      << cost_mean << separator
+      << t_cpu_sampler;
+    return where.str();
+  }
+
+  std::string SamplingSummary::printHeader(const char separator)
+  {
+    std::stringstream where;
+    where << "samples" << separator
+      << "sample_interval" << separator
+      << "SampledPeakWorkingSetSize (bytes)" << separator
+      << "sampled_peak_time" << separator
+      << "sampling_cost_per_sample" << separator
+      << "sampler_cpu_time";
+    return where.str();
+  }
+
+#ifndef _WIN32
+  namespace
+  {
+    /// parse an unsigned integer at @p pos and advance @p pos behind it (no allocation, no locale)
+    uint64_t parseUInt(const char*& pos, const char* end)
+    {
+      while (pos < end && (*pos < '0' || *pos > '9')) ++pos;
+      uint64_t value = 0;
+      while (pos < end && *pos >= '0' && *pos <= '9')
+      {
+        value = value * 10 + (*pos - '0');
+        ++pos;
+      }
+      return value;
+    }
+
+    /// skip @p n space-separated fields
+    void skipFields(const char*& pos, const char* end, int n)
+    {
+      for (int i = 0; i < n && pos < end; ++i)
+      {
+        while (pos < end && *pos == ' ') ++pos;
+        while (pos < end && *pos != ' ') ++pos;
+      }
+    }
+
+    /// read the whole file behind the (open) @p fd from offset 0; returns the number of bytes read or -1
+    ssize_t reread(int fd, char* buffer, size_t size)
+    {
+      return pread(fd, buffer, size, 0);
+    }
+  }
+#endif
+
+  Sampler::Sampler(ProcessHandle hProcess, std::chrono::microseconds interval, RingBufferServer* rings)
+    : interval_(interval), rings_(rings)
+  {
+#ifdef _WIN32
+    hProcess_ = hProcess;
+    pid_ = GetProcessId(hProcess);
+#else
+    pid_ = uint32_t(hProcess->pid);
+    const std::string proc_dir = "/proc/" + std::to_string(hProcess->pid) + "/";
+    fd_stat_ = open((proc_dir + "stat").c_str(), O_RDONLY | O_CLOEXEC);
+    fd_schedstat_ = open((proc_dir + "schedstat").c_str(), O_RDONLY | O_CLOEXEC);
+    fd_io_ = open((proc_dir + "io").c_str(), O_RDONLY | O_CLOEXEC);
+    page_size_ = sysconf(_SC_PAGESIZE);
+    ticks_per_second_ = sysconf(_SC_CLK_TCK);
+#endif
+    timeline_.reserve(1024);
+  }
+
+  Sampler::~Sampler()
+  {
+    stop();
+#ifndef _WIN32
+    for (int fd : { fd_stat_, fd_schedstat_, fd_io_ })
+    {
+      if (fd != -1) close(fd);
+    }
+#endif
+  }
+
+  void Sampler::start()
+  {
+    t_start_ = std::chrono::steady_clock::now();
+    thread_ = std::thread(&Sampler::run_, this);
+  }
+
+  void Sampler::stop()
+  {
+    {
+      std::lock_guard lock(mutex_);
+      stop_requested_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable())
+    {
+      thread_.join();
+    }
+  }
+
+  const Timeline& Sampler::getTimeline() const
+  {
+    return timeline_;
+  }
+
+  SamplingSummary Sampler::getSummary() const
+  {
+    SamplingSummary summary;
+    summary.samples = timeline_.size();
+    summary.interval = std::chrono::duration<double>(interval_).count();
+    for (const auto& s : timeline_)
+    {
+      if (s.rss > summary.peak_rss)
+      {
+        summary.peak_rss = s.rss;
+        summary.t_peak = s.t;
+      }
+    }
+    summary.cost_mean = timeline_.empty() ? 0 : cost_total_ / timeline_.size();
+    summary.cost_max = cost_max_;
+    summary.t_cpu_sampler = t_cpu_sampler_;
+    return summary;
+  }
+
+  void Sampler::run_()
+  {
+    using clock = std::chrono::steady_clock;
+    auto next_tick = t_start_;
+    std::unique_lock lock(mutex_);
+    while (!stop_requested_)
+    {
+      Sample sample;
+      const auto t_before = clock::now();
+      if (!takeSample_(sample))
+      {
+        break;
+      }
+      if (rings_)
+      {
+        drainRings_();
+        sample.heap_live = heap_live_;
+      }
+      const auto t_after = clock::now();
+      sample.t = std::chrono::duration<double>(t_before - t_start_).count();
+      timeline_.push_back(sample);
+
+      const double cost = std::chrono::duration<double>(t_after - t_before).count();
+      cost_total_ += cost;
+      if (cost > cost_max_) cost_max_ = cost;
+
+      // next tick at an absolute time, skipping ticks we missed
+      do
+      {
+        next_tick += interval_;
+      } while (next_tick <= t_after);
+      if (cv_.wait_until(lock, next_tick, [this] { return stop_requested_; }))
+      {
+        break;
+      }
+    }
+
+    // own CPU time, to judge how much sampling disturbed the target
+#ifdef _WIN32
+    FILETIME t_create, t_exit, t_kernel, t_user;
+    if (GetThreadTimes(GetCurrentThread(), &t_create, &t_exit, &t_kernel, &t_user))
+    {
+      t_cpu_sampler_ = toSeconds(t_kernel) + toSeconds(t_user);
+    }
+#else
+    timespec t_cpu{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t_cpu) == 0)
+    {
+      t_cpu_sampler_ = t_cpu.tv_sec + t_cpu.tv_nsec / 1e9;
+    }
+#endif
+  }
+
+  void Sampler::drainRings_()
+  {
+    rings_->drain([this](const RingOwner& owner, const RingRecord& record) {
+      // each thread has a ring of its own, so the latest event is found by its time
+      if (owner.pid != pid_ || record.kind != HEAP_RING_LIVE || record.t_ns < t_heap_live_) return;
+      heap_live_ = record.value[0];
+      t_heap_live_ = record.t_ns;
+    });
+  }
+
+#ifdef _WIN32
+  bool Sampler::takeSample_(Sample& sample)
+  {
+    DWORD exit_code;
+    if (!GetExitCodeProcess(hProcess_, &exit_code) || exit_code != STILL_ACTIVE)
+    {
+      return false;
+    }
+    sample = Sample{};
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(hProcess_, &pmc, sizeof(pmc)))
+    {
+      return false;
+    }
+    sample.rss = pmc.WorkingSetSize;
+    sample.minor_faults = pmc.PageFaultCount;
+
+    FILETIME t_create, t_exit, t_kernel, t_user;
+    if (GetProcessTimes(hProcess_, &t_create, &t_exit, &t_kernel, &t_user))
+    {
+      sample.t_cpu = toSeconds(t_kernel) + toSeconds(t_user);
+    }
+
+    IO_COUNTERS io;
+    if (GetProcessIoCounters(hProcess_, &io))
+    {
+      sample.io_read_bytes = io.ReadTransferCount;
+      sample.io_write_bytes = io.WriteTransferCount;
+    }
+    return true;
+  }
+#else
+  bool Sampler::takeSample_(Sample& sample)
+  {
+    if (fd_stat_ == -1)
+    {
+      return false;
+    }
+    sample = Sample{};
+
+    // /proc/<pid>/stat: 'pid (comm) state ppid ... minflt cminflt majflt cmajflt utime stime ... rss ...'
+    const ssize_t n_stat = reread(fd_stat_, buffer_, sizeof(buffer_));
+    if (n_stat <= 0)
+    { // ESRCH: the process was reaped
+      return false;
+    }
+    const char* end = buffer_ + n_stat;
+    const char* pos = end;
+    while (pos > buffer_ && *(pos - 1) != ')') --pos; // 'comm' may contain spaces and parentheses
+    if (pos == buffer_ || pos + 2 >= end || pos[1] == 'Z' || pos[1] == 'X')
+    { // a zombie has released its memory
+      return false;
+    }
+    skipFields(pos, end, 7); // state .. flags
+    sample.minor_faults = parseUInt(pos, end);
+    skipFields(pos, end, 1); // cminflt
+    sample.major_faults = parseUInt(pos, end);
+    skipFields(pos, end, 1); // cmajflt
+    const uint64_t utime = parseUInt(pos, end);
+    const uint64_t stime = parseUInt(pos, end);
+    skipFields(pos, end, 8); // cutime .. vsize
+    sample.rss = parseUInt(pos, end) * page_size_;
+    sample.t_cpu = double(utime + stime) / ticks_per_second_;
+
+    // /proc/<pid>/schedstat: 'time_on_cpu_ns wait_ns timeslices'
+    if (fd_schedstat_ != -1)
+    {
+      const ssize_t n = reread(fd_schedstat_, buffer_, sizeof(buffer_));
+      if (n > 0)
+      {
+        const char* p = buffer_;
+        sample.t_cpu = parseUInt(p, buffer_ + n) / 1e9;
+      }
+    }
+
+    // /proc/<pid>/io: 'rchar: N\nwchar: N\nsyscr: N\nsyscw: N\nread_bytes: N\nwrite_bytes: N\n...'
+    if (fd_io_ != -1)
+    {
+      const ssize_t n = reread(fd_io_, buffer_, sizeof(buffer_));
+      if (n > 0)
+      {
+        const char* p = buffer_;
+        const char* io_end = buffer_ + n;
+        for (int i = 0; i < 4; ++i) parseUInt(p, io_end); // rchar .. syscw
+        sample.io_read_bytes = parseUInt(p, io_end);
+        sample.io_write_bytes = parseUInt(p, io_end);
+      }
+    }
+    return true;
+  }
+#endif
+
+} // namespace
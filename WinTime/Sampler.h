@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Platform.h"
+
+namespace WinTime
+{
+  /// Parse a duration like '10ms', '500us', '2s' or '0.5s'. A plain number is taken as milliseconds.
+  /// @throw std::runtime_error if @p interval is not a positive duration
+  std::chrono::microseconds parseInterval(const std::string& interval);
+
+  /// A snapshot of the resource usage of a running process
+  struct Sample
+  {
+    double t;                 ///< seconds since sampling started
+    uint64_t rss;             ///< resident set size (working set) in bytes
+    double t_cpu;             ///< user + kernel time in seconds
+    uint64_t minor_faults;    ///< on Windows: all page faults
+    uint64_t major_faults;    ///< on Windows: always 0
+    uint64_t io_read_bytes;
+    uint64_t io_write_bytes;
+    std::optional<uint64_t> heap_live;   ///< live heap of the process, as last published by the heap hook (only with --heap)
+  };
+
+  using Timeline = std::vector<Sample>;
+
+  /// Write @p timeline as rows of a table, each starting with @p run_id (e.g. the creation time of the process)
+  std::string printTimeline(const Timeline& timeline, const std::string& run_id, const char separator);
+
+  /// Header matching printTimeline()
+  std::string printTimelineHeader(const char separator);
+
+  /// Summary of a timeline, including the cost of sampling
+  struct SamplingSummary
+  {
+    size_t samples{ 0 };
+    double interval{ 0 };        ///< requested interval in seconds
+    uint64_t peak_rss{ 0 };      ///< highest RSS seen in any sample
+    double t_peak{ 0 };          ///< time of the first sample which saw peak_rss
+    double cost_mean{ 0 };       ///< average wall time needed to take one sample (seconds)
+    double cost_max{ 0 };        ///< longest wall time needed to take one sample (seconds)
+    double t_cpu_sampler{ 0 };   ///< total CPU time of the sampling thread (seconds)
+
+    void print() const;
+
+    std::string print(const char separator) const;
+
+    static std::string printHeader(const char separator);
+  };
+
+  class RingBufferServer;
+
+  /**
+    @brief Samples the resource usage of a running process in regular intervals on a background thread
+
+    Ticks are scheduled at absolute times (no drift); if taking a sample takes longer than the interval, ticks are skipped.
+    On Linux, the /proc/<pid> files are opened once and re-read into a fixed buffer for each sample.
+    Sampling ends when stop() is called or the process is gone (or a zombie).
+    If the target reports events through a RingBufferServer (e.g. the heap hook with --heap), the rings are drained with each sample.
+  */
+  class Sampler
+  {
+  public:
+    /// Prepare sampling of @p hProcess (which must be running); call start() to begin.
+    /// The events of the target in @p rings (optional; must outlive the sampler) are added to the samples.
+    Sampler(ProcessHandle hProcess, std::chrono::microseconds interval, RingBufferServer* rings = nullptr);
+
+    Sampler(const Sampler&) = delete;
+    void operator=(const Sampler&) = delete;
+
+    /// calls stop()
+    ~Sampler();
+
+    /// start the sampling thread; the first sample is taken immediately
+    void start();
+
+    /// stop the sampling thread and wait for it to finish
+    void stop();
+
+    /// all samples taken so far; only valid after stop()
+    const Timeline& getTimeline() const;
+
+    /// only valid after stop()
+    SamplingSummary getSummary() const;
+
+  private:
+    /// read the current counters; returns false if the process is gone
+    bool takeSample_(Sample& sample);
+
+    /// the sampling loop (runs on thread_)
+    void run_();
+
+    /// take the events from rings_ into the state of the target
+    void drainRings_();
+
+    std::chrono::microseconds interval_;
+#ifdef _WIN32
+    HANDLE hProcess_;
+#else
+    int fd_stat_{ -1 };      ///< /proc/<pid>/stat
+    int fd_schedstat_{ -1 }; ///< /proc/<pid>/schedstat (ns resolution CPU time; optional)
+    int fd_io_{ -1 };        ///< /proc/<pid>/io (optional)
+    char buffer_[1024];      ///< reused for reading all /proc files
+    long page_size_;
+    long ticks_per_second_;
+#endif
+    RingBufferServer* rings_;
+    uint32_t pid_;                          ///< of the sampled process (events of other processes are ignored)
+    std::optional<uint64_t> heap_live_;     ///< latest HEAP_RING_LIVE event of the sampled process
+    uint64_t t_heap_live_{ 0 };             ///< its RingRecord::t_ns
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_requested_{ false };
+    std::chrono::steady_clock::time_point t_start_;
+    Timeline timeline_;
+    double cost_total_{ 0 };
+    double cost_max_{ 0 };
+    double t_cpu_sampler_{ 0 };
+  };
+
+} // namespace
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include "SelfProfile.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace WinTime
+{
+  SelfProfile& SelfProfile::get()
+  {
+    static SelfProfile profile;
+    return profile;
+  }
+
+  SelfProfile::SelfProfile()
+    : t_start_(Clock::now()),
+      t_previous_(t_start_)
+  {
+    stages_.reserve(16);
+  }
+
+  void SelfProfile::mark(const char* stage)
+  {
+    const auto t = Clock::now();
+    auto it = stages_.begin();
+    while (it != stages_.end() && it->name != stage && std::strcmp(it->name, stage) != 0) ++it;
+    if (it == stages_.end()) it = stages_.insert(it, Stage{ stage, t_previous_, 0, Clock::duration::zero() });
+    ++it->passes;
+    it->duration += t - t_previous_;
+    t_previous_ = t;
+  }
+
+  void SelfProfile::print() const
+  {
+    auto to_ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::fprintf(stderr, "Self profile (ms since start of main()):\n");
+    std::fprintf(stderr, "  %-16s %10s %7s %12s\n", "stage", "start", "passes", "duration");
+    for (const auto& s : stages_)
+    {
+      std::fprintf(stderr, "  %-16s %10.3f %7zu %12.3f\n", s.name, to_ms(s.t_first - t_start_), s.passes, to_ms(s.duration));
+    }
+    std::fprintf(stderr, "  %-16s %10s %7s %12.3f\n", "total", "", "", to_ms(t_previous_ - t_start_));
+  }
+
+} // namespace
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+namespace WinTime
+{
+  /**
+    @brief Timestamps of the stages WinTime itself goes through (see --self-profile)
+
+    Each call of mark() ends a stage, which started with the previous mark (or when the profile was created).
+    Marks are cheap (no allocation once a stage was seen), so they are always recorded and only printed on request.
+    Stages which are passed several times (e.g. when repeating the target) are summed up right away, so the profile
+    does not grow with the number of runs.
+  */
+  class SelfProfile
+  {
+  public:
+    /// the profile of this process; its clock starts with the first call (i.e. at the start of main())
+    static SelfProfile& get();
+
+    /// record that @p stage ended now; @p stage must be a string literal
+    void mark(const char* stage);
+
+    /// print each stage with its start (of the first pass), number of passes and total duration to std::cerr
+    void print() const;
+
+  private:
+    SelfProfile();
+
+    using Clock = std::chrono::steady_clock;
+
+    /// totals of a stage
+    struct Stage
+    {
+      const char* name;
+      Clock::time_point t_first; ///< start of the first pass
+      size_t passes;
+      Clock::duration duration;  ///< sum over all passes
+    };
+
+    Clock::time_point t_start_;
+    Clock::time_point t_previous_; ///< the last mark
+    std::vector<Stage> stages_;    ///< in order of first appearance
+  };
+
+} // namespace
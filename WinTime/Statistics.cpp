@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+namespace WinTime
+{
+  namespace
+  {
+    /// median of sorted @p values
+    double sortedMedian(const std::vector<double>& values)
+    {
+      const size_t n = values.size();
+      return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    }
+  }
+
+  Statistics Statistics::compute(std::vector<double> values)
+  {
+    Statistics s;
+    s.n = values.size();
+    if (values.empty()) return s;
+
+    std::sort(values.begin(), values.end());
+    s.min = values.front();
+    s.max = values.back();
+    s.median = sortedMedian(values);
+    s.mean = std::accumulate(values.begin(), values.end(), 0.0) / s.n;
+    if (s.n > 1)
+    {
+      double sq_sum = 0;
+      for (double v : values) sq_sum += (v - s.mean) * (v - s.mean);
+      s.stddev = std::sqrt(sq_sum / (s.n - 1));
+    }
+    std::vector<double> deviations;
+    deviations.reserve(s.n);
+    for (double v : values) deviations.push_back(std::abs(v - s.median));
+    std::sort(deviations.begin(), deviations.end());
+    s.mad = sortedMedian(deviations);
+    s.outliers = std::count_if(values.begin(), values.end(), [&s](double v) { return s.isOutlier(v); });
+    return s;
+  }
+
+  bool Statistics::isOutlier(double x) const
+  {
+    if (mad == 0) return false; // more than half of the values are identical
+    return 0.6745 * std::abs(x - median) / mad > 3.5;
+  }
+
+  double median(std::vector<double> values)
+  {
+    std::sort(values.begin(), values.end());
+    return sortedMedian(values);
+  }
+
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    const double rank = std::clamp(p, 0.0, 100.0) / 100 * double(sorted.size() - 1);
+    const auto lower = size_t(rank);
+    if (lower + 1 >= sorted.size()) return sorted.back();
+    return sorted[lower] + (rank - double(lower)) * (sorted[lower + 1] - sorted[lower]);
+  }
+
+  std::optional<std::pair<double, double>> medianConfidenceInterval(std::vector<double> values)
+  {
+    // ranks (1-based) of the order statistics bounding the interval: n/2 -+ 1.96 * sqrt(n) / 2 (normal approximation to the binomial)
+    const double n = double(values.size());
+    const double half_width = 1.96 * std::sqrt(n) / 2;
+    const auto lower = size_t(std::floor(n / 2 - half_width));
+    const auto upper = size_t(std::ceil(1 + n / 2 + half_width));
+    if (n / 2 - half_width < 1 || upper > values.size()) return std::nullopt;
+
+    std::sort(values.begin(), values.end());
+    return std::make_pair(values[lower - 1], values[upper - 1]);
+  }
+
+  ConfidenceInterval bootstrapRatioOfMedians(const std::vector<double>& numerator, const std::vector<double>& denominator,
+                                             double level, size_t resamples, unsigned seed)
+  {
+    ConfidenceInterval ci;
+    ci.estimate = median(numerator) / median(denominator);
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> pick_num(0, numerator.size() - 1);
+    std::uniform_int_distribution<size_t> pick_den(0, denominator.size() - 1);
+    std::vector<double> num(numerator.size()), den(denominator.size());
+    std::vector<double> ratios;
+    ratios.reserve(resamples);
+    for (size_t r = 0; r < resamples; ++r)
+    {
+      for (auto& v : num) v = numerator[pick_num(rng)];
+      for (auto& v : den) v = denominator[pick_den(rng)];
+      std::sort(num.begin(), num.end());
+      std::sort(den.begin(), den.end());
+      ratios.push_back(sortedMedian(num) / sortedMedian(den));
+    }
+    std::sort(ratios.begin(), ratios.end());
+    const double alpha = (1 - level) / 2;
+    ci.lower = ratios[size_t(alpha * (resamples - 1))];
+    ci.upper = ratios[size_t((1 - alpha) * (resamples - 1))];
+    return ci;
+  }
+
+  double mannWhitneyGreater(const std::vector<double>& x, const std::vector<double>& y)
+  {
+    // rank all values jointly (ties get their average rank)
+    std::vector<std::pair<double, bool>> all; // value, is from x
+    for (double v : x) all.emplace_back(v, true);
+    for (double v : y) all.emplace_back(v, false);
+    std::sort(all.begin(), all.end());
+
+    const double n1 = double(x.size()), n2 = double(y.size()), n = n1 + n2;
+    double rank_sum_x = 0, tie_term = 0;
+    for (size_t i = 0; i < all.size();)
+    {
+      size_t j = i;
+      while (j < all.size() && all[j].first == all[i].first) ++j;
+      const double rank = (i + 1 + j) / 2.0; // average of ranks i+1 ... j
+      for (size_t k = i; k < j; ++k)
+      {
+        if (all[k].second) rank_sum_x += rank;
+      }
+      const double t = double(j - i);
+      tie_term += t * t * t - t;
+      i = j;
+    }
+    const double u = rank_sum_x - n1 * (n1 + 1) / 2;
+    const double mean = n1 * n2 / 2;
+    const double variance = n1 * n2 / 12 * ((n + 1) - tie_term / (n * (n - 1)));
+    if (variance <= 0) return 1; // all values are identical
+    const double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+  }
+
+} // namespace
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace WinTime
+{
+  /// Robust and classic descriptive statistics of a sample
+  struct Statistics
+  {
+    size_t n{ 0 };
+    double mean{ 0 };
+    double median{ 0 };
+    double stddev{ 0 };     ///< sample standard deviation (n-1)
+    double min{ 0 };
+    double max{ 0 };
+    double mad{ 0 };        ///< median absolute deviation from the median (unscaled)
+    size_t outliers{ 0 };   ///< number of values for which isOutlier() is true
+
+    /// compute all statistics of @p values (which may be empty)
+    static Statistics compute(std::vector<double> values);
+
+    /// true if the modified z-score (0.6745 * |x - median| / MAD) of @p x exceeds 3.5 (Iglewicz and Hoaglin)
+    bool isOutlier(double x) const;
+  };
+
+  /// median of @p values (which must not be empty)
+  double median(std::vector<double> values);
+
+  /// @p p-th percentile (0-100) of @p sorted (ascending, not empty), interpolating linearly between the closest ranks
+  double percentile(const std::vector<double>& sorted, double p);
+
+  /// Distribution-free 95% confidence interval of the median, based on order statistics.
+  /// Returns nothing if there are too few values (less than 8).
+  std::optional<std::pair<double, double>> medianConfidenceInterval(std::vector<double> values);
+
+  /// An estimate with its confidence interval
+  struct ConfidenceInterval
+  {
+    double estimate{ 0 };
+    double lower{ 0 };
+    double upper{ 0 };
+  };
+
+  /**
+    @brief Ratio of the medians of @p numerator and @p denominator with a percentile bootstrap confidence interval
+
+    Both samples are resampled independently (with replacement) @p resamples times. The generator is seeded with
+    @p seed, so results are reproducible. Both samples must not be empty.
+  */
+  ConfidenceInterval bootstrapRatioOfMedians(const std::vector<double>& numerator, const std::vector<double>& denominator,
+                                             double level = 0.95, size_t resamples = 10000, unsigned seed = 42);
+
+  /// One-sided Mann-Whitney U test: p-value for the hypothesis that values of @p x tend to be larger than values of @p y
+  /// Uses the normal approximation (with tie and continuity correction); both samples must not be empty.
+  double mannWhitneyGreater(const std::vector<double>& x, const std::vector<double>& y);
+
+} // namespace
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _WIN32
+
+#include "Supervisor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <iterator>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // same on all architectures
+#endif
+
+namespace WinTime
+{
+  namespace
+  {
+    int pidfdOpen(pid_t pid)
+    {
+      return int(syscall(SYS_pidfd_open, pid, 0));
+    }
+
+    /// returns the limit before, if it was raised
+    std::optional<rlimit> raiseFileLimit()
+    {
+      struct rlimit limit;
+      if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+      {
+        const rlimit original = limit;
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) == 0) return original;
+      }
+      return std::nullopt;
+    }
+  }
+
+  Supervisor::Supervisor()
+  {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ == -1)
+    {
+      throw std::runtime_error("Could not create an epoll instance.");
+    }
+    original_file_limit_ = raiseFileLimit();
+  }
+
+  Supervisor::~Supervisor()
+  {
+    for (size_t i = 0; i < processes_.size(); ++i)
+    {
+      if (pidfds_[i] == -1) continue;
+      kill(processes_[i]->getPID(), SIGKILL);
+      waitpid(processes_[i]->getPID(), nullptr, 0);
+      close(pidfds_[i]);
+    }
+    close(epoll_fd_);
+    if (original_file_limit_) setrlimit(RLIMIT_NOFILE, &*original_file_limit_);
+  }
+
+  std::optional<size_t> Supervisor::spawn(const std::string& target_exe, const std::vector<std::string>& argv, const SpawnOptions& options)
+  {
+    if (std::any_of(options.observers.begin(), options.observers.end(), [](const SpawnObserver* o) { return o->waitsForChild(); }))
+    { // we wait via pidfd
+      errno = EINVAL;
+      return std::nullopt;
+    }
+    SpawnOptions child_options = options;
+    if (!child_options.file_limit) child_options.file_limit = original_file_limit_;
+    auto process = std::make_unique<Process>(target_exe, argv, child_options);
+    if (!process->wasCreated()) return std::nullopt;
+
+    const size_t index = released_.empty() ? processes_.size() : released_.back();
+    const int pidfd = pidfdOpen(process->getPID());
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    if (pidfd == -1 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pidfd, &event) == -1)
+    { // cannot watch it; do not leave it running unsupervised
+      const int err = errno;
+      if (pidfd != -1) close(pidfd);
+      kill(process->getPID(), SIGKILL);
+      process->waitForFinish();
+      errno = err;
+      return std::nullopt;
+    }
+    if (index == processes_.size())
+    {
+      processes_.push_back(std::move(process));
+      pidfds_.push_back(pidfd);
+    }
+    else
+    {
+      released_.pop_back();
+      processes_[index] = std::move(process);
+      pidfds_[index] = pidfd;
+    }
+    ++running_;
+    return index;
+  }
+
+  size_t Supervisor::running() const
+  {
+    return running_;
+  }
+
+  std::vector<size_t> Supervisor::waitAny(std::optional<std::chrono::milliseconds> timeout)
+  {
+    std::vector<size_t> collected;
+    if (running_ == 0) return collected;
+
+    epoll_event events[256];
+    const int timeout_ms = timeout ? int(timeout->count()) : -1;
+    int count;
+    do
+    {
+      count = epoll_wait(epoll_fd_, events, int(std::size(events)), timeout_ms);
+    } while (count == -1 && errno == EINTR);
+
+    for (int i = 0; i < count; ++i)
+    {
+      const size_t index = size_t(events[i].data.u64);
+      processes_[index]->collectTerminated();
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, pidfds_[index], nullptr);
+      close(pidfds_[index]);
+      pidfds_[index] = -1;
+      --running_;
+      collected.push_back(index);
+    }
+    return collected;
+  }
+
+  const Process& Supervisor::getProcess(size_t index) const
+  {
+    return *processes_.at(index);
+  }
+
+  void Supervisor::release(size_t index)
+  {
+    if (pidfds_.at(index) != -1 || !processes_[index])
+    {
+      throw std::runtime_error("Supervisor: only collected children can be released.");
+    }
+    processes_[index].reset();
+    released_.push_back(index);
+  }
+
+  int Supervisor::getEventFD() const
+  {
+    return epoll_fd_;
+  }
+
+} // namespace
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2023-2023 Chris Bielow <chris[dot]bielow[at]fu-berlin[dot].de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Process.h"
+
+namespace WinTime
+{
+  /**
+    @brief Supervises many child processes from a single thread
+
+    Each child gets a pidfd (Linux 5.3+), which becomes readable when the child terminates. All pidfds are
+    watched by one epoll instance, so waitAny() wakes up as soon as any child exits. It then collects
+    the exit time, I/O counters and rusage of that child right away (see Process::collectTerminated()),
+    i.e. the measured wall time is not inflated by polling delays, and no thread per child is needed.
+
+    The soft limit on open files is raised to the hard limit, since each running child needs a file descriptor.
+    The children get the original limit (programs using select() may rely on it), and it is restored in the destructor.
+  */
+  class Supervisor
+  {
+  public:
+    /// @throw std::runtime_error if epoll is not available
+    Supervisor();
+
+    Supervisor(const Supervisor&) = delete;
+    void operator=(const Supervisor&) = delete;
+
+    /// children which were not collected yet are killed and reaped, so no zombies are left behind
+    ~Supervisor();
+
+    /// Start a child (see Process; observers which wait for the child themselves, like ProcessTree, are not supported). Unless @p options sets a file_limit,
+    /// the child gets the limit on open files WinTime had before it was raised.
+    /// Returns its index, or nothing (with errno set) if it could not be started or watched.
+    std::optional<size_t> spawn(const std::string& target_exe, const std::vector<std::string>& argv, const SpawnOptions& options = {});
+
+    /// number of children which were started but not collected yet
+    size_t running() const;
+
+    /// Wait until at least one child terminated (or @p timeout expired; zero: do not block) and collect all terminated children.
+    /// Returns their indices.
+    std::vector<size_t> waitAny(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+    /// the child with index @p index (collected or not)
+    const Process& getProcess(size_t index) const;
+
+    /// Forget the collected child @p index; its index may be reused by a later spawn() (for long running supervisors)
+    void release(size_t index);
+
+    /// A descriptor which becomes readable when a child terminated, e.g. to watch it from another epoll instance
+    /// and then call waitAny() with a zero timeout.
+    int getEventFD() const;
+
+  private:
+    int epoll_fd_{ -1 };
+    std::vector<std::unique_ptr<Process>> processes_;
+    std::vector<int> pidfds_;  ///< by index; -1 once collected
+    std::vector<size_t> released_;  ///< indices which can be reused
+    size_t running_{ 0 };
+    std::optional<rlimit> original_file_limit_;  ///< RLIMIT_NOFILE before it was raised (empty: unchanged)
+  };
+
+} // namespace
+
+#endif
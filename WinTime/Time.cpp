@@ -22,6 +22,7 @@
 
 #include "Time.h"
 
+#include <cmath>
 #include <iostream>
 
 namespace WinTime
@@ -59,11 +60,12 @@ namespace WinTime
   }
 
 
+#ifdef _WIN32
   std::string toDateString(const SYSTEMTIME& time)
   {
     char buffer[100];
     int written_bytes = std::snprintf(buffer, sizeof(buffer), "%i/%.2i/%.2i %.2i:%.2i:%.2i.%.3i", time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond, time.wMilliseconds);
-    assert(written_bytes < sizeof(buffer) - 1);
+    assert(written_bytes < int(sizeof(buffer)) - 1);
     return std::string(buffer);
   }
 
@@ -87,6 +89,62 @@ namespace WinTime
     return (diff) / (1e7); // QuardPart is in 100-nanosecond intervals,i.e. 1e9 / 1e2 of a second
   }
 
+#else
+  std::string toDateString(const timespec& time)
+  {
+    tm local{};
+    localtime_r(&time.tv_sec, &local);
+    char buffer[100];
+    int written_bytes = std::snprintf(buffer, sizeof(buffer), "%i/%.2i/%.2i %.2i:%.2i:%.2i.%.3i", local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec, int(time.tv_nsec / 1000000));
+    assert(written_bytes < int(sizeof(buffer)) - 1);
+    return std::string(buffer);
+  }
+
+  double toSeconds(const timeval& t)
+  {
+    return t.tv_sec + t.tv_usec / 1e6;
+  }
+
+  double toSeconds(const timespec& from, const timespec& to)
+  {
+    return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) / 1e9;
+  }
+
+  int64_t toNanoseconds(const timeval& t)
+  {
+    return int64_t(t.tv_sec) * 1000000000 + int64_t(t.tv_usec) * 1000;
+  }
+
+  int64_t toNanoseconds(const timespec& t)
+  {
+    return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+  }
+
+#endif
+
+  std::string toISO8601(const int64_t epoch_ns)
+  {
+    // floor division, so times before 1970 get a positive fraction
+    int64_t seconds = epoch_ns / 1000000000;
+    int64_t fraction = epoch_ns % 1000000000;
+    if (fraction < 0)
+    {
+      fraction += 1000000000;
+      --seconds;
+    }
+    const time_t t = time_t(seconds);
+    tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &t);
+#else
+    gmtime_r(&t, &utc);
+#endif
+    char buffer[100];
+    int written_bytes = std::snprintf(buffer, sizeof(buffer), "%.4i-%.2i-%.2iT%.2i:%.2i:%.2i.%.9lliZ", utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, (long long)fraction);
+    assert(written_bytes < int(sizeof(buffer)) - 1);
+    return std::string(buffer);
+  }
+
   /// convert seconds to higher units (minute, hour, days)
   std::string toTimeDiffString(const double seconds)
   {
@@ -100,12 +158,13 @@ namespace WinTime
     t_sec -= t_min * 60;
     int t_msec = (int)((seconds - trunc(seconds)) * 1000);
     char buffer[100];
-    int written_bytes = std::snprintf(buffer, sizeof(buffer), " %Ii days, %.2Ii:%.2Ii:%.2Ii.%.3i (%.2f seconds)", t_days, t_hour, t_min, t_sec, t_msec, seconds);
-    assert(written_bytes < sizeof(buffer) - 1);
+    int written_bytes = std::snprintf(buffer, sizeof(buffer), " %lli days, %.2lli:%.2lli:%.2lli.%.3i (%.2f seconds)", (long long)t_days, (long long)t_hour, (long long)t_min, (long long)t_sec, t_msec, seconds);
+    assert(written_bytes < int(sizeof(buffer)) - 1);
     return std::string(buffer);
   }
 
-  PTime getProcessTime(HANDLE hProcess)
+#ifdef _WIN32
+  PTime getProcessTime(ProcessHandle hProcess)
   {
     FILETIME 
       lpCreationTime{},
@@ -131,11 +190,39 @@ namespace WinTime
     SYSTEMTIME t_create, t_exit;
     FileTimeToSystemTime(&lpCreationTimeLocal, &t_create);
     FileTimeToSystemTime(&lpExitTimeLocal, &t_exit);
-    return PTime{ toDateString(t_create),
-      toDateString(t_exit),
-      toSeconds(lpUserTime),
-      toSeconds(lpKernelTime),
-      toSeconds(lpCreationTime, lpExitTime) };
+    const int64_t epoch_offset = 116444736000000000; // 1601-01-01 to 1970-01-01 in units of 100ns
+    const RawTimes raw{ .t_create_ns = (int64_t(toInt64(lpCreationTime)) - epoch_offset) * 100,
+      .t_exit_ns = (int64_t(toInt64(lpExitTime)) - epoch_offset) * 100,
+      .t_kernel_ns = int64_t(toInt64(lpKernelTime)) * 100,
+      .t_user_ns = int64_t(toInt64(lpUserTime)) * 100,
+      .t_wall_ns = int64_t(toInt64(lpExitTime) - toInt64(lpCreationTime)) * 100 };
+    return PTime{ .t_create = toDateString(t_create),
+      .t_exit = toDateString(t_exit),
+      .t_kernel = toSeconds(lpKernelTime),
+      .t_user = toSeconds(lpUserTime),
+      .t_wall = toSeconds(lpCreationTime, lpExitTime),
+      .raw = raw };
+  }
+#else
+  PTime getProcessTime(ProcessHandle hProcess)
+  {
+    if (hProcess == nullptr || !hProcess->reaped)
+    {
+      std::cerr << "Could not query Process timings\n";
+      return PTime{};
+    }
+    const RawTimes raw{ .t_create_ns = toNanoseconds(hProcess->t_create),
+      .t_exit_ns = toNanoseconds(hProcess->t_exit),
+      .t_kernel_ns = toNanoseconds(hProcess->usage.ru_stime),
+      .t_user_ns = toNanoseconds(hProcess->usage.ru_utime),
+      .t_wall_ns = toNanoseconds(hProcess->t_exit_mono) - toNanoseconds(hProcess->t_create_mono) };
+    return PTime{ .t_create = toDateString(hProcess->t_create),
+      .t_exit = toDateString(hProcess->t_exit),
+      .t_kernel = toSeconds(hProcess->usage.ru_stime),
+      .t_user = toSeconds(hProcess->usage.ru_utime),
+      .t_wall = toSeconds(hProcess->t_create_mono, hProcess->t_exit_mono),
+      .raw = raw };
   }
+#endif
 
 } // namespace
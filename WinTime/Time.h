@@ -26,24 +26,46 @@
 #include <optional>
 
 #include <sstream>
-#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
-#define UNICODE 1
- // Windows Header Files:
-#include <windows.h>
+
+#include "Platform.h"
 
 
 namespace WinTime
 {
+#ifdef _WIN32
   std::string toDateString(const SYSTEMTIME& time);
 
   uint64_t toInt64(FILETIME t);
 
   double toSeconds(FILETIME t);
   double toSeconds(FILETIME from, FILETIME to);
+#else
+  /// format as local time, e.g. '2023/02/13 10:19:04.200'
+  std::string toDateString(const timespec& time);
+
+  double toSeconds(const timeval& t);
+  double toSeconds(const timespec& from, const timespec& to);
+
+  int64_t toNanoseconds(const timeval& t);
+  int64_t toNanoseconds(const timespec& t);
+#endif
 
   /// convert seconds to higher units (minute, hour, days)
   std::string toTimeDiffString(const double seconds);
 
+  /// Process times as exact integers, for machine-readable output
+  struct RawTimes
+  {
+    int64_t t_create_ns{ 0 };   ///< nanoseconds since the Unix epoch (UTC)
+    int64_t t_exit_ns{ 0 };     ///< nanoseconds since the Unix epoch (UTC)
+    int64_t t_kernel_ns{ 0 };
+    int64_t t_user_ns{ 0 };
+    int64_t t_wall_ns{ 0 };
+  };
+
+  /// format nanoseconds since the Unix epoch as ISO-8601 in UTC, e.g. '2023-02-13T09:19:04.200123456Z'
+  std::string toISO8601(const int64_t epoch_ns);
+
   /// Process time data aggregator
   struct PTime
   {
@@ -52,6 +74,7 @@ namespace WinTime
     double t_kernel;
     double t_user;
     double t_wall;
+    RawTimes raw;   ///< the same times, unrounded (in ns on all platforms; on Windows with a resolution of 100ns)
 
     void print() const;
 
@@ -62,6 +85,6 @@ namespace WinTime
   };
 
 
-  PTime getProcessTime(HANDLE hProcess);
+  PTime getProcessTime(ProcessHandle hProcess);
 
 } // namespace WinTime
@@ -20,25 +20,54 @@
  * IN THE SOFTWARE.
  */
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
 #define UNICODE 1
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING 1
 // Windows Header Files:
 #include <windows.h>
+#include <strsafe.h>
+#else
+#include <cerrno>
+#include <cstring>
+#endif
 
+#include <algorithm>
 #include <iostream>
 
 #include <locale>
 #include <codecvt>
 #include <filesystem>
+#include <map>
+#include <memory>
 #include <string>
-#include <strsafe.h>
+#include <thread>
 
 #include "Arch.h"
+#include "Baseline.h"
+#include "Batch.h"
+#include "Benchmark.h"
+#include "Calibration.h"
+#include "CGroup.h"
+#include "Compare.h"
+#include "CpuProfile.h"
+#include "Daemon.h"
 #include "config.h"
 #include "FileLog.h"
+#include "Format.h"
+#include "Heap.h"
+#include "Io.h"
+#include "Locks.h"
+#include "RecordWriter.h"
+#include "ReportServer.h"
+#include "RingBufferServer.h"
+#include "Manifest.h"
 #include "Memory.h"
 #include "Process.h"
+#include "ProcessTree.h"
+#include "Sampler.h"
+#include "SelfProfile.h"
+#include "Supervisor.h"
 #include "Time.h"
 
 #include "args.hxx"  // arg parser
@@ -90,11 +119,60 @@ namespace WinTime
   {
     PTime ptime{};
     ClientProcessMemoryCounter pmc;
-    DWORD exit_code{1};
+    ExitCode exit_code{1};
+    std::optional<SamplingSummary> sampling; ///< only with a sample interval
+    Timeline timeline;                        ///< only with a sample interval
+    std::optional<TreeSummary> tree;          ///< only when tracking the process tree
+    std::vector<TreeNode> tree_nodes;         ///< only when tracking the process tree
+    std::optional<CGroupSummary> cgroup;      ///< only when running in a cgroup
+    std::optional<HeapSummary> heap;          ///< only when counting allocations
+    std::optional<LockSummary> locks;         ///< only when profiling locks
+    std::optional<IoSummary> io;              ///< only when profiling I/O
+    std::optional<CpuProfileSummary> cpu_profile; ///< only when sampling call stacks
+    int term_signal{ 0 };                     ///< the signal which killed the target (POSIX only; 0 if it exited)
+  };
+
+  /// how to measure the target
+  struct RunOptions
+  {
+    std::optional<std::chrono::microseconds> sample_interval; ///< sample the resource usage while the target runs
+    bool track_tree{ false };                                 ///< account for all descendants of the target (POSIX only)
+    bool use_cgroup{ false };                                 ///< run the target in a transient cgroup (Linux only; falls back to per-process accounting)
+    std::string working_dir;                                  ///< working directory of the target (POSIX only; empty: inherit)
+    std::vector<std::string> env;                             ///< 'NAME=VALUE' entries added to the environment of the target (POSIX only)
+    std::vector<int> cpus;                                    ///< CPUs the target may run on (POSIX only; empty: inherit)
+    bool fast_spawn{ false };                                 ///< start the target with posix_spawn() (POSIX only; see Process)
+    bool count_heap{ false };                                 ///< preload the heap hook into the target (Linux only; see HeapHook)
+    std::string heap_profile;                                 ///< with count_heap: path prefix of the heap profiles (empty: no profiling)
+    uint64_t heap_sample_rate{ HEAP_SAMPLE_RATE_DEFAULT };     ///< with heap_profile: mean bytes between samples
+    bool profile_locks{ false };                              ///< preload the heap hook and time the waits for contended locks (Linux only)
+    bool profile_io{ false };                                 ///< preload the heap hook and time file I/O by path (Linux only)
+    std::string cpu_profile;                                  ///< sample call stacks and write the folded stacks to this file (Linux only; empty: no profiling)
+    unsigned cpu_sample_rate{ CPU_SAMPLE_RATE_DEFAULT };      ///< with cpu_profile: samples per second of CPU time
   };
 
+#ifndef _WIN32
+  /// the 'LD_PRELOAD=...' entry which adds the heap hook (next to this executable) to the libraries the target preloads already
+  /// @throw std::runtime_error if the hook is missing
+  std::string getHeapHookPreload()
+  {
+    const auto hook = std::filesystem::path(Process::getPathToCurrentProcess()) / WINTIME_HEAP_LIB;
+    if (!std::filesystem::exists(hook))
+    {
+      throw std::runtime_error("Cannot find the heap hook '" + hook.string() + "', which --heap needs.");
+    }
+    const char* preload = getenv("LD_PRELOAD");
+    return "LD_PRELOAD=" + hook.string() + (preload && *preload ? std::string(":") + preload : std::string());
+  }
+#endif
+
   void PrintError(std::string lpszFunction)
   {
+#ifndef _WIN32
+    // Display the system error message for the last errno
+    const int err = errno;
+    std::cerr << lpszFunction << " failed with error :" << std::to_string(err) << ' ' << std::strerror(err) << '\n';
+#else
     // Retrieve the system error message for the last-error code
 
     LPVOID lpMsgBuf;
@@ -114,36 +192,424 @@ namespace WinTime
 
     std::cerr << lpszFunction << " failed with error :" << std::to_string(dw) << ' ' << std::string((char*)lpMsgBuf);
     LocalFree(lpMsgBuf);
+#endif
   }
 
-  std::optional<TargetInfo> runExternalProcess(const std::string& target_path, std::string& p_command_args)
+  /// run @p target_path with the argument vector @p command_args (which includes argv[0]) and measure it
+  std::optional<TargetInfo> runExternalProcess(const std::string& target_path, const StringList& command_args, const RunOptions& options = {})
   {
     std::optional<TargetInfo> result;
-    Process process(target_path, p_command_args);
+    // with --heap and --sample-interval, the heap hook streams the live heap of the target into the timeline
+    std::optional<RingBufferServer> rings;
+#ifdef _WIN32
+    Process process(target_path, command_args);
+#else
+    std::optional<ProcessTree> tree;
+    if (options.track_tree)
+    {
+      tree.emplace(options.sample_interval.value_or(std::chrono::milliseconds(10)));
+    }
+    std::optional<CGroupRun> cgroup;
+    if (options.use_cgroup)
+    {
+      cgroup.emplace();
+      if (!cgroup->isValid())
+      {
+        std::cerr << "Cannot use a cgroup (" << cgroup->getError() << "). Falling back to per-process accounting.\n";
+        cgroup.reset();
+      }
+    }
+    std::optional<CpuProfiler> profiler;
+    if (!options.cpu_profile.empty())
+    {
+      profiler.emplace(options.cpu_sample_rate);
+      if (!profiler->isValid())
+      {
+        std::cerr << "Cannot profile the CPU (" << profiler->getError() << "). Running without.\n";
+        profiler.reset();
+      }
+    }
+    SpawnOptions spawn_options;
+    // the profiler lets the child continue, then the tree waits for its stop (see prepareChild())
+    if (profiler) spawn_options.observers.push_back(&*profiler);
+    if (tree) spawn_options.observers.push_back(&*tree);
+    spawn_options.cgroup_procs_fd = cgroup ? cgroup->getProcsFD() : -1;
+    spawn_options.working_dir = options.working_dir;
+    spawn_options.env = options.env;
+    spawn_options.cpus = options.cpus;
+    spawn_options.fast_spawn = options.fast_spawn;
+    // all processes of the target report to the server, which publishes its socket in our environment
+    std::optional<ReportServer> reports;
+    if (options.count_heap || options.profile_locks || options.profile_io)
+    {
+      spawn_options.env.push_back(getHeapHookPreload());
+      if (options.profile_locks)
+      {
+        spawn_options.env.push_back(std::string(s_env_locks) + "=1");
+      }
+      if (options.profile_io)
+      {
+        spawn_options.env.push_back(std::string(s_env_io) + "=1");
+      }
+      if (!options.heap_profile.empty())
+      {
+        spawn_options.env.push_back(std::string(s_env_heapprofile) + '=' + options.heap_profile);
+        spawn_options.env.push_back(std::string(s_env_heapsamplerate) + '=' + std::to_string(options.heap_sample_rate));
+      }
+      reports.emplace();
+      if (options.count_heap && options.sample_interval)
+      {
+        try
+        {
+          rings.emplace();
+        }
+        catch (const std::runtime_error& e)
+        {
+          std::cerr << e.what() << " The timeline will not show the live heap.\n";
+        }
+      }
+    }
+    Process process(target_path, command_args, spawn_options);
+#endif
+    SelfProfile::get().mark("spawn");
     if (!process.wasCreated())
     {
       PrintError("CreateProcess");
       return result;
     }
 
+    std::optional<Sampler> sampler;
+    if (options.sample_interval)
+    {
+      sampler.emplace(process.getHandle(), *options.sample_interval, rings ? &*rings : nullptr);
+      sampler->start();
+    }
+
     // wait for the child process to finish
     process.waitForFinish();
+    SelfProfile::get().mark("wait");
 
-    DWORD exit_code{ 1 };
-    if (!GetExitCodeProcess(process.getPI().hProcess, &exit_code))
+    auto exit_code = process.getExitCode();
+    if (!exit_code)
     {
       PrintError("Could not get return code of target process");
     }
 
-    ClientProcessMemoryCounter pmc(process.getPI().hProcess);
-    auto timings = getProcessTime(process.getPI().hProcess);
+    ClientProcessMemoryCounter pmc(process.getHandle());
+    auto timings = getProcessTime(process.getHandle());
+    SelfProfile::get().mark("counter query");
+
+    TargetInfo info{ .ptime = timings,
+                     .pmc = pmc,
+                     .exit_code = exit_code.value_or(1),
+                     .sampling = {},
+                     .timeline = {},
+                     .tree = {},
+                     .tree_nodes = {},
+                     .cgroup = {},
+                     .heap = {},
+                     .locks = {},
+                     .io = {},
+                     .cpu_profile = {},
+                     .term_signal = 0 };
+#ifndef _WIN32
+    if (WIFSIGNALED(process.getHandle()->wait_status))
+    {
+      info.term_signal = WTERMSIG(process.getHandle()->wait_status);
+    }
+#endif
+    if (sampler)
+    {
+      sampler->stop();
+      info.sampling = sampler->getSummary();
+      info.timeline = sampler->getTimeline();
+    }
+    if (rings && rings->getDropped() > 0)
+    {
+      std::cerr << "Warning: " << rings->getDropped() << " live heap events of the target were dropped; the timeline may miss some changes.\n";
+    }
+#ifndef _WIN32
+    if (tree)
+    {
+      info.tree = tree->getSummary();
+      info.tree_nodes = tree->getNodes();
+    }
+    if (cgroup)
+    {
+      info.cgroup = cgroup->getSummary();
+    }
+    if (profiler)
+    {
+      profiler->stop();
+      profiler->writeFolded(options.cpu_profile);
+      info.cpu_profile = profiler->getSummary();
+    }
+    if (reports)
+    {
+      if (options.count_heap) info.heap.emplace();
+      if (options.profile_locks) info.locks.emplace();
+      if (options.profile_io) info.io.emplace();
+      const auto process_reports = reports->finish();
+      if (tree)
+      { // per process, next to its times
+        attachReports(process_reports, info.tree_nodes);
+      }
+      for (const auto& report : process_reports)
+      {
+        for (const auto& message : report.messages)
+        {
+          if (message.type == ReportType::LOCK_CONTENTION && info.locks && message.payload.size() % sizeof(LockStat) == 0)
+          {
+            std::vector<LockStat> stats(message.payload.size() / sizeof(LockStat));
+            std::memcpy(stats.data(), message.payload.data(), message.payload.size());
+            info.locks->add(stats.data(), stats.size());
+          }
+          if (message.type == ReportType::IO_COUNTERS && info.io && message.payload.size() == sizeof(IoCounters))
+          {
+            IoCounters counters;
+            std::memcpy(&counters, message.payload.data(), sizeof(counters));
+            info.io->add(counters);
+          }
+          if (message.type == ReportType::IO_FILES && info.io && message.payload.size() % sizeof(IoFileStat) == 0)
+          {
+            std::vector<IoFileStat> stats(message.payload.size() / sizeof(IoFileStat));
+            std::memcpy(stats.data(), message.payload.data(), message.payload.size());
+            info.io->add(stats.data(), stats.size());
+          }
+          if (!info.heap) continue;
+          if (message.type == ReportType::HEAP_PROFILE)
+          {
+            info.heap->profiles.push_back(message.payload);
+          }
+          if (message.type != ReportType::HEAP_COUNTERS || message.payload.size() != sizeof(HeapCounters)) continue;
+          HeapCounters counters;
+          std::memcpy(&counters, message.payload.data(), sizeof(counters));
+          info.heap->add(counters);
+        }
+      }
+    }
+#endif
+    return info;
+  }
+
+  /// the values of a run for -f/--format and the record formats; @p command as made by joinArguments()
+  FormatValues toFormatValues(const std::string& command, const PTime& ptime, const ClientProcessMemoryCounter& pmc, const ExitCode exit_code, const int term_signal)
+  {
+    return FormatValues{ command, ptime.raw, pmc.getRaw(), int(exit_code), term_signal };
+  }
+
+  /// run the target once (see runExternalProcess()) for a benchmark; a failed run or a non-zero exit code (stored in @p failed_exit_code) yields nothing
+  /// If @p run_writer is given, the run is reported there (see -f/--format and RecordWriter).
+  std::optional<RunMeasurement> measureOnce(const std::string& target_path, const StringList& command_args, const RunOptions& options, ExitCode& failed_exit_code,
+                                            RunWriter* run_writer = nullptr)
+  {
+    auto result = runExternalProcess(target_path, command_args, options);
+    if (!result) return std::nullopt;
+    if (run_writer)
+    {
+      run_writer->write(toFormatValues(joinArguments(command_args), result->ptime, result->pmc, result->exit_code, result->term_signal));
+    }
+    if (result->exit_code != 0)
+    {
+      failed_exit_code = result->exit_code;
+      return std::nullopt;
+    }
+    return RunMeasurement{ result->ptime.t_create, result->ptime.t_wall, result->ptime.t_user, result->ptime.t_kernel, result->pmc.getPeakWorkingSetSize(), result->pmc.getPageFaultCount() };
+  }
+
+  /// run @p commands (each including argv[0]) interleaved and compare all others against the first; returns the exit code of WinTime
+  int runComparison(const std::vector<StringList>& commands, const RunOptions& run_options, const InterleaveOptions& interleave_options,
+                    const std::optional<std::string>& output_file, const OpenMode open_mode, const LogFormat log_format, const bool intern_commands, bool verbose)
+  {
+    StringList targets, command_lines;
+    for (const auto& command : commands)
+    {
+      targets.push_back(Process::searchPATH(command.front(), verbose));
+      command_lines.push_back(Process::concatArguments(command.front(), StringList(command.begin() + 1, command.end())));
+      const auto arch_result = checkMatchingArch(targets.back());
+      if (arch_result != ArchMatched::SAME)
+      {
+        std::cerr << getArchMatchedExplanation(arch_result, targets.back()) << '\n'
+                  << "All commands of a comparison must match the architecture of WinTime.\n";
+        return 1;
+      }
+    }
+
+    ExitCode failed_exit_code{ 1 };
+    size_t failed_index{ 0 };
+    auto runs = runInterleaved(commands.size(), interleave_options, [&](size_t index) {
+      failed_index = index;
+      return measureOnce(targets[index], commands[index], run_options, failed_exit_code);
+    });
+    if (!runs)
+    {
+      std::cerr << "'" << command_lines[failed_index] << "' failed (exit code " << failed_exit_code << "). Aborting.\n";
+      return failed_exit_code;
+    }
 
-    return TargetInfo{ timings, pmc, exit_code };
+    for (size_t i = 1; i < commands.size(); ++i)
+    {
+      const auto comparison = Comparison::compute(command_lines[0], (*runs)[0], (*runs)[i]);
+      if (!output_file || verbose)
+      {
+        comparison.print(command_lines[i]);
+      }
+      if (output_file)
+      {
+        FileLog(*output_file, i == 1 ? open_mode : OpenMode::APPEND, '\t', log_format, intern_commands).log(command_lines[i], comparison);
+      }
+    }
+    return 0;
+  }
+
+  /// measure a no-op target repeatedly and store the result for this host in @p calibration_file (see --calibrate)
+  int runCalibration(const BenchmarkOptions& benchmark_options, const RunOptions& run_options, const std::string& calibration_file)
+  {
+#ifdef _WIN32
+    // a tiny console program which is always there: WinTime itself, which returns right away with --noop-target
+    const std::string target = (std::filesystem::path(Process::getPathToCurrentProcess()) / WINTIME_EXE).string();
+    const StringList target_argv{ target, "--noop-target" };
+#else
+    const std::string target = Process::searchPATH("true");
+    const StringList target_argv{ "true" };
+#endif
+    ExitCode failed_exit_code{ 1 };
+    Benchmark benchmark(benchmark_options);
+    if (!benchmark.run([&]() { return measureOnce(target, target_argv, run_options, failed_exit_code); }))
+    {
+      std::cerr << "The no-op target '" << target << "' failed (exit code " << failed_exit_code << "). Aborting.\n";
+      return 1;
+    }
+    const auto calibration = Calibration::fromRuns(getHostName(), benchmark.getRuns());
+    calibration.print();
+    CalibrationStore store(calibration_file);
+    store.set(calibration);
+    store.save();
+    std::cerr << "Stored in '" << calibration_file << "'.\n";
+    return 0;
   }
+
+#ifndef _WIN32
+  /// run all commands of @p manifest_file on @p slots slots and log each of them; returns the exit code of WinTime
+  /// All children are supervised from this thread (see Supervisor), i.e. there is no thread per slot.
+  int runBatchManifest(const std::string& manifest_file, size_t slots, bool pin, const RunOptions& run_options,
+                       const std::optional<std::string>& output_file, const OpenMode open_mode, const LogFormat log_format, const bool intern_commands,
+                       RunWriter* run_writer)
+  {
+    const auto commands = readManifest(manifest_file);
+    const auto slot_cpus = pin ? assignCPUs(slots) : std::vector<std::vector<int>>(slots);
+    if (output_file && open_mode == OpenMode::OVERWRITE)
+    { // all rows are appended; the first one writes the header
+      std::filesystem::remove(*output_file);
+    }
+
+    struct RunningJob
+    {
+      size_t job;
+      size_t slot;
+      std::unique_ptr<CGroupRun> cgroup;
+    };
+    Supervisor supervisor;
+    JobQueue queue(commands.size());
+    std::map<size_t, RunningJob> running; // by index of the Supervisor
+    size_t failures{ 0 };
+
+    // start the next job of @p slot; jobs which cannot be started count as failed
+    auto startJob = [&](size_t slot) {
+      while (auto job = queue.next())
+      {
+        const auto& command = commands[*job];
+        try
+        {
+          std::string exe = command.argv.front();
+          if (!command.cwd.empty() && exe.find('/') != std::string::npos && std::filesystem::path(exe).is_relative())
+          { // relative to the working directory of the command
+            exe = (std::filesystem::path(command.cwd) / exe).string();
+          }
+          std::unique_ptr<CGroupRun> cgroup;
+          if (run_options.use_cgroup)
+          {
+            cgroup = std::make_unique<CGroupRun>();
+            if (!cgroup->isValid())
+            {
+              std::cerr << "Manifest line " << command.line << ": cannot use a cgroup (" << cgroup->getError() << "). Falling back to per-process accounting.\n";
+              cgroup.reset();
+            }
+          }
+          SpawnOptions spawn_options;
+          spawn_options.cgroup_procs_fd = cgroup ? cgroup->getProcsFD() : -1;
+          spawn_options.working_dir = command.cwd;
+          spawn_options.env = command.env;
+          spawn_options.cpus = slot_cpus[slot];
+          spawn_options.fast_spawn = run_options.fast_spawn;
+          if (auto index = supervisor.spawn(Process::searchPATH(exe), command.argv, spawn_options))
+          {
+            running.emplace(*index, RunningJob{ *job, slot, std::move(cgroup) });
+            return;
+          }
+          PrintError("Manifest line " + std::to_string(command.line) + ": starting '" + exe + "'");
+        }
+        catch (const std::exception& e)
+        {
+          std::cerr << "Manifest line " << command.line << ": " << e.what() << '\n';
+        }
+        ++failures;
+      }
+    };
+
+    for (size_t slot = 0; slot < slots; ++slot)
+    {
+      startJob(slot);
+    }
+    while (supervisor.running() > 0)
+    {
+      for (size_t index : supervisor.waitAny())
+      {
+        auto node = running.extract(index);
+        const RunningJob& run = node.mapped();
+        const auto& command = commands[run.job];
+        const Process& process = supervisor.getProcess(index);
+
+        const std::string command_line = Process::concatArguments(command.argv.front(), StringList(command.argv.begin() + 1, command.argv.end()));
+        const BatchRunInfo run_info{ command.line, run.slot, toCPUList(slot_cpus[run.slot]), process.getExitCode().value_or(1) };
+        if (run_info.exit_code != 0) ++failures;
+        const auto ptime = getProcessTime(process.getHandle());
+        const ClientProcessMemoryCounter pmc(process.getHandle());
+        const auto cgroup = run.cgroup ? std::optional<CGroupSummary>(run.cgroup->getSummary()) : std::nullopt;
+        if (run_writer)
+        {
+          const int status = process.getHandle()->wait_status;
+          run_writer->write(toFormatValues(joinArguments(command.argv), ptime, pmc, run_info.exit_code, WIFSIGNALED(status) ? WTERMSIG(status) : 0));
+        }
+        else if (output_file)
+        {
+          FileLog(*output_file, OpenMode::APPEND, '\t', log_format, intern_commands).log(command_line, ptime, pmc, run_info, cgroup);
+        }
+        else
+        {
+          std::cerr << "[slot " << run.slot << "] exit " << run_info.exit_code << ", " << ptime.t_wall << " s, "
+                    << toHumanReadable(pmc.getPeakWorkingSetSize()) << ": " << command_line << '\n';
+        }
+        startJob(run.slot);
+      }
+    }
+
+    if (failures > 0)
+    {
+      std::cerr << failures << " of " << commands.size() << " commands failed.\n";
+      return 1;
+    }
+    return 0;
+  }
+#endif
+
+  /// the platform independent main(); @p argv is UTF-8 encoded
+  int wintimeMain(int argc, const char** argv);
 } // namespace
 
 using namespace WinTime;
 
+#ifdef _WIN32
 int wmain(int argc, wchar_t** argv_wide)
 {
   std::vector<const char*> argv(argc);
@@ -153,6 +619,21 @@ int wmain(int argc, wchar_t** argv_wide)
     argv_data[i] = narrow(argv_wide[i]);
     argv[i] = argv_data[i].c_str();
   }
+  return wintimeMain(argc, &argv.front());
+}
+#else
+int main(int argc, char** argv)
+{
+  return wintimeMain(argc, const_cast<const char**>(argv));
+}
+#endif
+
+int WinTime::wintimeMain(int argc, const char** argv)
+{
+  SelfProfile::get(); // start the clock
+  // the no-op target of --calibrate on Windows
+  if (argc == 2 && std::string_view(argv[1]) == "--noop-target") return 0;
+
   args::ArgumentParser p_parser("WinTime - measure time and memory usage of a process.", "");
   p_parser.helpParams.width = 134;
   //args::ValueFlag<int> integer(parser, "integer", "The integer flag", { 'i' });
@@ -160,34 +641,84 @@ int wmain(int argc, wchar_t** argv_wide)
   //args::Positional<std::string> foo(parser, "foo", "The foo position");
   args::Flag p_append(p_parser, "append_file", "with -o FILE, append instead of overwriting", { 'a', "append" });
   args::ValueFlag<std::string> p_output_file(p_parser, "output", "write to FILE instead of STDERR", { 'o', "output" });
+  args::ValueFlag<std::string> p_format(p_parser, "format", "print the usage of COMMAND in FORMAT, like /usr/bin/time (e.g. '%e %M'; see README) instead of WinTime's report", { 'f', "format" });
+  args::Flag p_portability(p_parser, "portability", "print 'real %e\\nuser %U\\nsys %S' (POSIX), like /usr/bin/time -p", { 'p', "portability" });
+  args::Flag p_quiet(p_parser, "quiet", "with -f or -p, do not report non-zero exit codes and signals of COMMAND", { 'q', "quiet" });
+  args::Flag p_intern_commands(p_parser, "intern", "with -o FILE, log a hash of the command line; each command is stored once in FILE.cmds.tsv and its rows are indexed in FILE.idx", { "intern-commands" });
+  args::ValueFlag<std::string> p_output_format(p_parser, "format", "with -o FILE, write 'tsv' (default) or 'binary' (typed columns; see wintime-logconv); 'jsonl', 'csv' or 'tsv-raw' write one row of plain numbers per run (to STDOUT without -o)", { "output-format" });
   args::Flag p_verbose(p_parser, "verbose", "print COMMAND and ARGS", { 'v', "verbose" });
+  args::ValueFlag<std::string> p_sample_interval(p_parser, "interval", "sample memory, CPU time, page faults and I/O of COMMAND every INTERVAL (e.g. 10ms) while it runs", { "sample-interval" });
+  args::Flag p_tree(p_parser, "tree", "account for all descendants of COMMAND and report each of them (Linux only)", { "tree" });
+  args::Flag p_cgroup(p_parser, "cgroup", "run COMMAND in a transient cgroup (v2) and report memory.peak, cpu.stat, io.stat and pressure stall times of all its processes (Linux only)", { "cgroup" });
+  args::ValueFlag<std::string> p_calibration(p_parser, "file", "with --calibrate or --overhead, the calibration store (default: per user, e.g. '~/.config/wintime/calibration.tsv')", { "calibration" });
+  args::Flag p_overhead(p_parser, "overhead", "report the calibrated wrapper overhead of this host (see --calibrate) and the wall time minus it, next to the raw times", { "overhead" });
+  args::Flag p_self_profile(p_parser, "self-profile", "print how long the stages of WinTime itself took (parse, PATH search, spawn, wait, ...) to STDERR", { "self-profile" });
+  args::Flag p_heap(p_parser, "heap", "count the heap allocations of COMMAND and its children: number, bytes, peak live heap and size classes (Linux only; preloads " WINTIME_HEAP_LIB ")", { "heap" });
+  args::ValueFlag<std::string> p_heap_profile(p_parser, "prefix", "like --heap, and sample allocations with their call stacks (every 512 KiB on average); each process writes pprof heap profiles at its peak and at exit to PREFIX.<pid>.peak.heap and PREFIX.<pid>.exit.heap (Linux only)", { "heap-profile" });
+  args::ValueFlag<uint64_t> p_heap_sample_rate(p_parser, "bytes", "with --heap-profile, sample every BYTES allocated bytes on average (default: 524288; smaller is more precise, but slower)", { "heap-sample-rate" });
+  args::Flag p_locks(p_parser, "locks", "time the waits of COMMAND and its children for contended pthread mutexes and rwlocks (and condition waits) by lock and call site (Linux only; preloads " WINTIME_HEAP_LIB ")", { "locks" });
+  args::ValueFlag<std::string> p_cpu_profile(p_parser, "file", "sample the call stacks of COMMAND and its children every 1 ms of CPU time (perf_event_open() task-clock; no root or hardware counters needed) and write folded stacks for flame graphs to FILE, plus a table of the top functions (Linux only)", { "cpu-profile" });
+  args::ValueFlag<unsigned> p_cpu_sample_rate(p_parser, "Hz", "with --cpu-profile, take Hz samples per second of CPU time of each thread (default: 999)", { "cpu-sample-rate" });
+  args::Flag p_io(p_parser, "io", "time the file I/O of COMMAND and its children (open, read, write, mmap) by path, with latency histograms and the top files by time and bytes (Linux only; preloads " WINTIME_HEAP_LIB ")", { "io" });
+  args::Flag p_fast_spawn(p_parser, "fast-spawn", "start COMMAND with posix_spawn() instead of fork(): lower latency, but the peak RSS of COMMAND includes the memory of WinTime (Linux only; ignored with --tree, --cgroup and --pin, and with --batch if the soft file limit is below the hard one)", { "fast-spawn" });
+  args::ValueFlag<size_t> p_runs(p_parser, "N", "run COMMAND N times and report statistics (with --target-ci or --time-budget: at least N times)", { 'r', "runs" });
+  args::ValueFlag<size_t> p_warmup(p_parser, "N", "run COMMAND N times before measuring", { "warmup" });
+  args::ValueFlag<double> p_target_ci(p_parser, "PCT", "repeat COMMAND until the 95% confidence interval of the median wall time is within +-PCT percent", { "target-ci" });
+  args::ValueFlag<std::string> p_time_budget(p_parser, "duration", "repeat COMMAND until DURATION (e.g. 60s) is used up", { "time-budget" });
+  args::ValueFlag<size_t> p_max_runs(p_parser, "N", "with --target-ci or --time-budget, stop after N runs (default: 1000)", { "max-runs" });
+  args::Flag p_compare(p_parser, "compare", "compare COMMANDs separated by ':::' (e.g. 'a.exe ::: b.exe -O3') against the first one; runs them interleaved (default: 10 rounds, see -r)", { "compare" });
+  args::Flag p_shuffle(p_parser, "shuffle", "with --compare, run the commands in random order in each round (instead of ABAB...)", { "shuffle" });
+  args::ValueFlag<std::string> p_save_baseline(p_parser, "baseline", "store the runs of COMMAND in FILE (replacing earlier runs of the same command line)", { "save-baseline" });
+  args::ValueFlag<std::string> p_check_baseline(p_parser, "baseline", "check the runs of COMMAND against those stored in FILE and return 99 on a regression", { "check-baseline" });
+  args::ValueFlag<std::string> p_regression_test(p_parser, "test", "with --check-baseline: 'mann-whitney' (default; increase above threshold and significant) or 'threshold'", { "regression-test" });
+  args::ValueFlag<std::string> p_thresholds(p_parser, "list", "with --check-baseline: allowed increase of the median in percent (default: 'wall=5,user=5,peak_ws=10,page_faults=20')", { "thresholds" });
+  args::ValueFlag<double> p_alpha(p_parser, "alpha", "with --check-baseline: significance level of the test (default: 0.05)", { "alpha" });
+  args::ValueFlag<size_t> p_jobs(p_parser, "N", "with --batch, run N commands at a time (default: number of CPUs)", { 'j', "jobs" });
+  args::Flag p_pin(p_parser, "pin", "with --batch, pin each slot to its own subset of CPUs", { "pin" });
+  args::ValueFlag<std::string> p_raw_runs(p_parser, "raw", "when repeating COMMAND, write each run as a row to FILE", { "raw-runs" });
+  args::ValueFlag<std::string> p_timeline_file(p_parser, "timeline", "with --sample-interval, write the timeline to FILE (default: '<output>.timeline.tsv' with -o)", { "timeline" });
   args::HelpFlag p_help(p_parser, "help", "display this help and exit", { 'h', "help" });
   args::Group group(p_parser, "", args::Group::Validators::AtLeastOne);
   args::Flag p_version(group, "version", "output version information and exit", { 'V', "version" });
-  args::Positional<std::string> p_command(group, "COMMAND", "the executable to run");
+  args::ValueFlag<std::string> p_batch(group, "manifest", "run all commands of the MANIFEST file (one per line, or JSON objects with argv/cmd, cwd and env) concurrently and log each of them (Linux only)", { "batch" });
+  args::Flag p_calibrate(group, "calibrate", "measure a no-op target (-r times, default: 100) and store its times for this host (see --overhead)", { "calibrate" });
+  args::ValueFlag<std::string> p_daemon(group, "socket", "measure the commands of wintime-client, which connects to the Unix domain SOCKET, until SIGINT/SIGTERM (Linux only)", { "daemon" });
+  // parsing stops at COMMAND (KickOut): all arguments after it are its own, even if they look like options (e.g. 'sh -c ...')
+  args::Positional<std::string> p_command(group, "COMMAND", "the executable to run", args::Options::KickOut);
   args::PositionalList<std::string> p_command_args(p_parser, "ARG", "arguments to COMMAND");
   try
   {
-    p_parser.ParseCLI(argc, &argv.front());
+    p_parser.Prog(argv[0]);
+    const StringList cli_args(argv + 1, argv + argc);
+    const auto command_args = p_parser.ParseArgs(cli_args);
+    p_command_args.Get().assign(command_args, cli_args.end());
   }
-  catch (args::Help)
+  catch (const args::Help&)
   {
     std::cout << p_parser;
     return 0;
   }
-  catch (args::ParseError e)
+  catch (const args::ParseError& e)
   {
     std::cerr << e.what() << std::endl;
     std::cerr << p_parser;
     return 1;
   }
-  catch (args::ValidationError e)
+  catch (const args::ValidationError& e)
   {
     std::cerr << e.what() << std::endl;
     std::cerr << p_parser;
     return 1;
   }
 
+  SelfProfile::get().mark("parse");
+  // print the self profile however this function is left (but not via exit())
+  struct SelfProfilePrinter
+  {
+    bool enabled;
+    ~SelfProfilePrinter() { if (enabled) SelfProfile::get().print(); }
+  } self_profile_printer{ p_self_profile.Get() };
+
   if (p_version)
   { // TODO Use CMake to configure a header
     std::cerr << "Version: " << CMAKE_PROJECT_VERSION << '\n';
@@ -196,14 +727,257 @@ int wmain(int argc, wchar_t** argv_wide)
 
   try
   {
+    RunOptions run_options;
+    run_options.fast_spawn = p_fast_spawn;
+    if (p_sample_interval)
+    {
+      run_options.sample_interval = parseInterval(p_sample_interval.Get());
+    }
+    if (p_tree)
+    {
+#ifdef _WIN32
+      std::cerr << "--tree is not supported on Windows yet.\n";
+      return 1;
+#else
+      run_options.track_tree = true;
+#endif
+    }
+    if (p_cgroup)
+    {
+#ifdef _WIN32
+      std::cerr << "--cgroup is not supported on Windows. Falling back to per-process accounting.\n";
+#else
+      run_options.use_cgroup = true;
+#endif
+    }
+    if (p_heap || p_heap_profile)
+    {
+#ifdef _WIN32
+      std::cerr << "--heap and --heap-profile are not supported on Windows yet.\n";
+      return 1;
+#else
+      run_options.count_heap = true;
+#endif
+    }
+    if (p_locks)
+    {
+#ifdef _WIN32
+      std::cerr << "--locks is not supported on Windows yet.\n";
+      return 1;
+#else
+      run_options.profile_locks = true;
+#endif
+    }
+    if (p_io)
+    {
+#ifdef _WIN32
+      std::cerr << "--io is not supported on Windows yet.\n";
+      return 1;
+#else
+      run_options.profile_io = true;
+#endif
+    }
+    if (p_cpu_profile)
+    {
+#ifdef _WIN32
+      std::cerr << "--cpu-profile is not supported on Windows yet.\n";
+      return 1;
+#else
+      run_options.cpu_profile = p_cpu_profile.Get();
+#endif
+    }
+    if (p_cpu_sample_rate)
+    {
+      if (!p_cpu_profile || p_cpu_sample_rate.Get() == 0)
+      {
+        std::cerr << "--cpu-sample-rate needs --cpu-profile and a positive number of samples per second.\n";
+        return 1;
+      }
+      run_options.cpu_sample_rate = p_cpu_sample_rate.Get();
+    }
+    if (p_heap_profile)
+    {
+      // the target may change its working directory
+      run_options.heap_profile = std::filesystem::absolute(p_heap_profile.Get()).string();
+    }
+    if (p_heap_sample_rate)
+    {
+      if (!p_heap_profile || p_heap_sample_rate.Get() == 0)
+      {
+        std::cerr << "--heap-sample-rate needs --heap-profile and a positive number of bytes.\n";
+        return 1;
+      }
+      run_options.heap_sample_rate = p_heap_sample_rate.Get();
+    }
+
+    BenchmarkOptions benchmark_options;
+    if (p_runs) benchmark_options.runs = std::max(size_t(1), p_runs.Get());
+    if (p_warmup) benchmark_options.warmup = p_warmup.Get();
+    if (p_target_ci) benchmark_options.target_ci = p_target_ci.Get();
+    if (p_time_budget) benchmark_options.time_budget = parseInterval(p_time_budget.Get());
+    if (p_max_runs) benchmark_options.max_runs = p_max_runs.Get();
+    RegressionOptions regression_options;
+    if (p_regression_test) regression_options.test = RegressionOptions::parseTest(p_regression_test.Get());
+    if (p_thresholds) regression_options.parseThresholds(p_thresholds.Get());
+    if (p_alpha) regression_options.alpha = p_alpha.Get();
+    const bool use_baseline = p_save_baseline || p_check_baseline;
+    const LogFormat log_format = p_output_format ? parseLogFormat(p_output_format.Get()) : LogFormat::TSV;
+    const bool intern_commands = p_intern_commands;
+    if (intern_commands && log_format != LogFormat::TSV)
+    {
+      std::cerr << "--intern-commands is only available for TSV logs.\n";
+      return 1;
+    }
+    // -f/-p (like /usr/bin/time) and the record formats replace the report (and the log with -o) by one line per run
+    std::unique_ptr<RunWriter> run_writer;
+    const auto output_file = p_output_file ? std::optional<std::string>(p_output_file.Get()) : std::nullopt;
+    if (isRecordFormat(log_format))
+    {
+      if (p_compare)
+      {
+        std::cerr << "--output-format=jsonl|csv|tsv-raw cannot be combined with --compare.\n";
+        return 1;
+      }
+      run_writer = std::make_unique<RecordWriter>(log_format, output_file, p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE);
+    }
+    if (p_format || p_portability)
+    {
+      if (p_format && p_portability)
+      {
+        std::cerr << "-f/--format and -p/--portability cannot be combined.\n";
+        return 1;
+      }
+      if (p_compare || p_output_format || intern_commands)
+      {
+        std::cerr << "-f/--format and -p/--portability cannot be combined with --compare, --output-format or --intern-commands.\n";
+        return 1;
+      }
+      run_writer = std::make_unique<FormattedOutput>(p_format ? p_format.Get() : std::string(FormatProgram::PORTABLE), output_file,
+                                                     p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE, p_quiet);
+    }
+
+    const std::string calibration_file = p_calibration ? p_calibration.Get() : (p_calibrate || p_overhead ? getDefaultCalibrationFile() : std::string());
+    if (p_calibrate)
+    {
+      if (p_command || p_batch || p_daemon || p_compare || use_baseline || run_options.track_tree || run_options.sample_interval
+          || run_options.use_cgroup || run_options.count_heap || run_options.profile_locks || run_options.profile_io
+          || !run_options.cpu_profile.empty() || run_writer || p_overhead)
+      {
+        std::cerr << "--calibrate can only be combined with -r, --warmup, --calibration and --fast-spawn.\n";
+        return 1;
+      }
+      if (!p_runs) benchmark_options.runs = 100;
+      if (!p_warmup) benchmark_options.warmup = 5;
+      return runCalibration(benchmark_options, run_options, calibration_file);
+    }
+    // the wall time of a no-op target on this host, which is part of every measured wall time
+    std::optional<double> overhead;
+    if (p_overhead)
+    {
+      if (p_batch || p_daemon || p_compare || run_writer)
+      {
+        std::cerr << "--overhead cannot be combined with --batch, --daemon, --compare, -f, -p or --output-format=jsonl|csv|tsv-raw.\n";
+        return 1;
+      }
+      const auto calibration = CalibrationStore(calibration_file).get(getHostName());
+      if (!calibration)
+      {
+        std::cerr << "No calibration for host '" << getHostName() << "' in '" << calibration_file << "'. Run with --calibrate first.\n";
+        return 1;
+      }
+      overhead = calibration->wall_median;
+    }
+
+    if (p_daemon)
+    {
+#ifdef _WIN32
+      std::cerr << "--daemon is not supported on Windows.\n";
+      return 1;
+#else
+      if (p_batch || p_command || benchmark_options.isRepeated() || p_compare || use_baseline || run_options.track_tree || run_options.sample_interval
+          || run_options.use_cgroup || run_options.count_heap || run_options.profile_locks || run_options.profile_io
+          || !run_options.cpu_profile.empty() || p_format || p_portability || intern_commands)
+      {
+        std::cerr << "--daemon can only be combined with -o, -a, --output-format and --fast-spawn.\n";
+        return 1;
+      }
+      DaemonOptions daemon_options;
+      daemon_options.log_file = output_file;
+      daemon_options.open_mode = p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE;
+      daemon_options.log_format = log_format;
+      daemon_options.fast_spawn = run_options.fast_spawn;
+      Daemon(p_daemon.Get(), daemon_options).run();
+      return 0;
+#endif
+    }
+
+    if (p_batch)
+    {
+#ifdef _WIN32
+      std::cerr << "--batch is not supported on Windows yet.\n";
+      return 1;
+#else
+      if (benchmark_options.isRepeated() || p_compare || use_baseline || run_options.track_tree || run_options.sample_interval || run_options.count_heap
+          || run_options.profile_locks || run_options.profile_io || !run_options.cpu_profile.empty())
+      {
+        std::cerr << "--batch cannot be combined with repeated runs, --compare, baselines, --tree, --sample-interval, --heap, --locks, --io or --cpu-profile.\n";
+        return 1;
+      }
+      const size_t slots = p_jobs ? std::max(size_t(1), p_jobs.Get()) : std::max(1u, std::thread::hardware_concurrency());
+      return runBatchManifest(p_batch.Get(), slots, p_pin, run_options, output_file,
+                              p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE, log_format, intern_commands, run_writer.get());
+#endif
+    }
+
+    if ((benchmark_options.isRepeated() || p_compare || use_baseline) && (run_options.sample_interval || run_options.track_tree || run_options.use_cgroup || run_options.count_heap
+                                                                        || run_options.profile_locks || run_options.profile_io || !run_options.cpu_profile.empty()))
+    {
+      std::cerr << "--sample-interval, --tree, --cgroup, --heap, --locks, --io and --cpu-profile cannot be combined with repeated runs.\n";
+      return 1;
+    }
+
+    const OpenMode open_mode = p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE;
+
+    if (p_compare)
+    {
+      if (benchmark_options.isAdaptive())
+      {
+        std::cerr << "--target-ci and --time-budget cannot be combined with --compare.\n";
+        return 1;
+      }
+      // split 'COMMAND ARGS...' at each ':::'
+      std::vector<StringList> commands(1, StringList{ args::get(p_command) });
+      for (const auto& arg : args::get(p_command_args))
+      {
+        if (arg == ":::") commands.emplace_back();
+        else commands.back().push_back(arg);
+      }
+      if (commands.size() < 2 || std::any_of(commands.begin(), commands.end(), [](const auto& c) { return c.empty(); }))
+      {
+        std::cerr << "--compare needs at least two commands, separated by ':::'.\n";
+        return 1;
+      }
+      InterleaveOptions interleave_options;
+      if (p_runs) interleave_options.rounds = benchmark_options.runs;
+      interleave_options.warmup = benchmark_options.warmup;
+      interleave_options.shuffle = p_shuffle.Get();
+      if (interleave_options.rounds < COMPARE_MIN_RUNS)
+      {
+        std::cerr << "Warning: with fewer than " << COMPARE_MIN_RUNS << " rounds, the comparison gives no verdict (inconclusive).\n";
+      }
+      return runComparison(commands, run_options, interleave_options,
+                           p_output_file ? std::optional<std::string>(p_output_file.Get()) : std::nullopt, open_mode, log_format, intern_commands, p_verbose);
+    }
+
     std::string command = Process::searchPATH(args::get(p_command), p_verbose);
+    SelfProfile::get().mark("PATH search");
 
     const auto self_dir = Process::getPathToCurrentProcess();
 
-    const auto arch_result = checkMatchingArch(&command[0]);
+    const auto arch_result = checkMatchingArch(command);
     if (p_verbose || arch_result != ArchMatched::SAME)
     {
-      std::cout << getArchMatchedExplanation(arch_result, &command[0]) << '\n';
+      std::cout << getArchMatchedExplanation(arch_result, command) << '\n';
     }
     if (arch_result == ArchMatched::TARGET_UNKNOWN)
     {
@@ -214,49 +988,181 @@ int wmain(int argc, wchar_t** argv_wide)
     if (arch_result == ArchMatched::MIXED)
     {
       std::cerr << "Trying to find '" << WINTIME_EXE_OTHERARCH << "' automatically...\n";
-      std::string wintime_other = self_dir + "\\" + std::string(WINTIME_EXE_OTHERARCH);
+      std::string wintime_other = (std::filesystem::path(self_dir) / WINTIME_EXE_OTHERARCH).string();
       if (!std::filesystem::exists(wintime_other))
       {
         std::cerr << "Cannot find '" << wintime_other << "'; Please make sure it is present or invoke it manually!\n";
         exit(1);
       }
     
-      // it exists... now invoke it and quit this process
-      Process process(wintime_other, Process::concatArguments(wintime_other, argc - 1, (&argv[0]) + 1), NORMAL_PRIORITY_CLASS);
+      // it exists... now invoke it (with our own arguments) and quit this process
+      StringList other_argv(argv, argv + argc);
+      other_argv[0] = wintime_other;
+      Process process(wintime_other, other_argv);
       if (!process.wasCreated())
       {
         exit(1);
       }
       process.waitForFinish();
-      exit(0);
+      exit(process.getExitCode().value_or(1));
     }
+    SelfProfile::get().mark("arch check");
 
-    std::string wcommand_args = Process::concatArguments(args::get(p_command), StringList(args::get(p_command_args)));
+    StringList command_argv = args::get(p_command_args);
+    command_argv.insert(command_argv.begin(), args::get(p_command));
+    std::string wcommand_args = Process::concatArguments(args::get(p_command), args::get(p_command_args));
   
     if (p_verbose)
     {
+#ifdef _WIN32
       std::wcerr << "CMD {ARGS}:\n  " << widen(wcommand_args) << '\n';
+#else
+      std::cerr << "CMD {ARGS}:\n  " << wcommand_args << '\n';
+#endif
     }
 
-    
-    auto external_process_result = runExternalProcess(command.c_str(), wcommand_args);
+    if (benchmark_options.isRepeated() || use_baseline)
+    {
+      ExitCode failed_exit_code{ 1 };
+      Benchmark benchmark(benchmark_options);
+      size_t calls = 0; // the first calls are warmup runs, which are not reported by run_writer
+      const bool success = benchmark.run([&]() {
+        RunWriter* report_run = run_writer && calls++ >= benchmark_options.warmup ? run_writer.get() : nullptr;
+        return measureOnce(command, command_argv, run_options, failed_exit_code, report_run);
+      });
+      if (!success)
+      {
+        std::cerr << "Run " << benchmark.getRuns().size() + 1 << " of the target failed (exit code " << failed_exit_code << "). Aborting.\n";
+        return failed_exit_code;
+      }
+
+      const auto summary = benchmark.getSummary();
+      const auto overhead_estimate = overhead ? std::optional(OverheadEstimate{ *overhead, summary.wall.median }) : std::nullopt;
+      if ((!p_output_file && !run_writer) || p_verbose)
+      {
+        summary.print();
+        if (overhead_estimate) overhead_estimate->print();
+      }
+      if (benchmark_options.target_ci && !summary.target_reached)
+      {
+        std::cerr << "Warning: the target CI of +-" << *benchmark_options.target_ci << "% was not reached within " << summary.runs << " runs.\n";
+      }
+      if (p_output_file && !run_writer)
+      {
+        FileLog(p_output_file.Get(), open_mode, '\t', log_format, intern_commands).log(wcommand_args, summary, overhead_estimate);
+      }
+      if (p_raw_runs)
+      {
+        FileLog(p_raw_runs.Get(), open_mode).append(printRunsHeader('\t'), printRuns(benchmark.getRuns(), summary.t_create, '\t'));
+      }
+
+      int exit_code = 0;
+      if (p_check_baseline)
+      {
+        const auto baseline = BaselineStore(p_check_baseline.Get()).get(wcommand_args);
+        if (!baseline)
+        {
+          std::cerr << "No baseline for '" << wcommand_args << "' in '" << p_check_baseline.Get() << "'.\n";
+          return 1;
+        }
+        const auto report = checkRegression(*baseline, benchmark.getRuns(), regression_options);
+        if (report.hasRegression())
+        {
+          std::cerr << "Regression against baseline '" << p_check_baseline.Get() << "' (" << baseline->size() << " vs. " << summary.runs << " runs):\n";
+          report.print();
+          exit_code = EXIT_CODE_REGRESSION;
+        }
+        else if (p_verbose)
+        {
+          report.print();
+        }
+      }
+      if (p_save_baseline)
+      {
+        BaselineStore store(p_save_baseline.Get());
+        store.set(wcommand_args, benchmark.getRuns());
+        store.save();
+      }
+      return exit_code;
+    }
+
+    auto external_process_result = runExternalProcess(command, command_argv, run_options);
     if (!external_process_result)
     {
       std::cerr << "Running external process failed. Aborting.\n";
       return 1;
     }
 
+    if (run_writer)
+    {
+      const auto& r = *external_process_result;
+      run_writer->write(toFormatValues(joinArguments(command_argv), r.ptime, r.pmc, r.exit_code, r.term_signal));
+    }
+
+    const auto overhead_estimate = overhead ? std::optional(OverheadEstimate{ *overhead, external_process_result->ptime.t_wall }) : std::nullopt;
     // only print to commandline if verbose or not writing to file
-    if (!p_output_file || p_verbose)
+    if ((!p_output_file && !run_writer) || p_verbose)
     {
       external_process_result->pmc.print();
       external_process_result->ptime.print();
+      if (overhead_estimate)
+      {
+        overhead_estimate->print();
+      }
+      if (external_process_result->sampling)
+      {
+        external_process_result->sampling->print();
+      }
+      if (external_process_result->tree)
+      {
+        external_process_result->tree->print();
+        printTree(external_process_result->tree_nodes);
+      }
+      if (external_process_result->cgroup)
+      {
+        external_process_result->cgroup->print();
+      }
+      if (external_process_result->heap)
+      {
+        external_process_result->heap->print();
+      }
+      if (external_process_result->locks)
+      {
+        external_process_result->locks->print();
+      }
+      if (external_process_result->io)
+      {
+        external_process_result->io->print();
+      }
+      if (external_process_result->cpu_profile)
+      {
+        external_process_result->cpu_profile->print();
+      }
+    }
+    SelfProfile::get().mark("report");
+
+    if (p_output_file && !run_writer)
+    {
+      FileLog fl(p_output_file.Get(), open_mode, '\t', log_format, intern_commands);
+      fl.log(wcommand_args, external_process_result->ptime, overhead_estimate, external_process_result->pmc,
+             external_process_result->sampling, external_process_result->tree, external_process_result->cgroup, external_process_result->heap,
+             external_process_result->locks, external_process_result->io, external_process_result->cpu_profile);
+    }
+    SelfProfile::get().mark("log write");
+
+    // the timeline goes next to the log; its rows refer to the log row by creation time
+    if (external_process_result->sampling && (p_timeline_file || p_output_file))
+    {
+      const std::string timeline_file = p_timeline_file ? p_timeline_file.Get() : p_output_file.Get() + ".timeline.tsv";
+      FileLog(timeline_file, open_mode).append(printTimelineHeader('\t'),
+        printTimeline(external_process_result->timeline, external_process_result->ptime.t_create, '\t'));
     }
 
-    if (p_output_file)
+    // same for the per-process breakdown of the tree
+    if (external_process_result->tree && p_output_file)
     {
-      FileLog fl(p_output_file.Get(), p_append.Get() ? OpenMode::APPEND : OpenMode::OVERWRITE);
-      fl.log(wcommand_args, external_process_result->ptime, external_process_result->pmc);
+      FileLog(p_output_file.Get() + ".tree.tsv", open_mode).append(printTreeHeader('\t'),
+        printTree(external_process_result->tree_nodes, external_process_result->ptime.t_create, '\t'));
     }
 
     // return the same exit code as target process